@@ -19,6 +19,9 @@ extern "C"
     static const unsigned int AES_VSC_ERROR_CLOCK_SYNC_ERROR = 0x0A;
     static const unsigned int AES_VSC_ERROR_RECEIVER_NOT_READY_YET = 0x0B;
     static const unsigned int AES_VSC_ERROR_NO_DATA = 0x0C;
+    static const unsigned int AES_VSC_ERROR_INVALID_PTP_CONFIG = 0x0D;
+    static const unsigned int AES_VSC_ERROR_INVALID_BUFFER_SIZE = 0x0E;
+    static const unsigned int AES_VSC_ERROR_SENDER_BUFFER_OVERFLOW = 0x0F;
 
 #ifdef __cplusplus
 } /* extern \"C\" */
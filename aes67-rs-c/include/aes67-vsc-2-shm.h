@@ -0,0 +1,56 @@
+#ifndef __RUST_AES67_RS_SHM__
+#define __RUST_AES67_RS_SHM__
+
+/*
+ * Layout of the shared memory segments that hold receiver buffers.
+ * See aes67-rs/src/buffer/shm.rs for a description of the protocol.
+ * Sender buffers are not exported, their payload is laid out by send phase
+ * and can't be indexed by media time.
+ *
+ * The eventfd of a segment can't be opened through /proc. Duplicate it
+ * from the VSC process with pidfd_open(pid, 0) and
+ * pidfd_getfd(pidfd, eventfd, 0), using the pid and eventfd number from
+ * the buffer descriptor. This needs ptrace access to the VSC process.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define AES_VSC_SHM_MAGIC 0x37364541u
+#define AES_VSC_SHM_VERSION 1u
+#define AES_VSC_SHM_HEADER_LEN 4096u
+
+    enum aes67_vsc_shm_sample_format
+    {
+        AES_VSC_SHM_F32_PLANAR = 0,
+        AES_VSC_SHM_L16 = 1,
+        AES_VSC_SHM_L24 = 2,
+    };
+
+    typedef struct aes67_vsc_shm_header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t sample_format;
+        uint32_t channels;
+        uint32_t sample_rate;
+        /* atomic, number of readers waiting on the eventfd */
+        uint32_t waiters;
+        uint64_t capacity_frames;
+        /* 0 if the segment has no validity map */
+        uint64_t validity_offset;
+        uint64_t data_offset;
+        uint64_t data_len;
+        /* atomic, load with acquire semantics before reading data */
+        uint64_t write_cursor;
+    } aes67_vsc_shm_header_t;
+
+#ifdef __cplusplus
+} /* extern \"C\" */
+#endif
+
+#endif /* __RUST_AES67_RS_SHM__ */
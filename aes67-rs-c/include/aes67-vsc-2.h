@@ -16,10 +16,18 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
+
 /** \brief
  *  Configuration for an AES67 receiver
  */
 typedef struct Aes67VscReceiverConfig {
+    /** \brief
+     *  Unique receiver ID
+     */
+    uint32_t id;
+
     /** \brief
      *  Name of the receiver. Technically this does not have to be unique but stats are reported by receiver name,
      *  so giving the same name to multiple receivers at the same time will make those hard to interpret.
@@ -37,13 +45,9 @@ typedef struct Aes67VscReceiverConfig {
     float link_offset;
 } Aes67VscReceiverConfig_t;
 
-
-#include <stddef.h>
-#include <stdint.h>
-
 /** \brief
- *  Create a new AES67 receiver
- *  * `config` - the configuration for the sender
+ *  Create a new AES67 receiver. Returns the ID of the new receiver or a negative error code.
+ *  * `config` - the configuration for the receiver
  */
 int32_t
 aes67_vsc_create_receiver (
@@ -58,10 +62,10 @@ aes67_vsc_create_receiver (
  */
 uint8_t
 aes67_vsc_destroy_receiver (
-    uint32_t receiver_id);
+    uint64_t receiver_id);
 
 /** \brief
- *  `&'lt mut [T]` but with a guaranteed `#[repr(C)]` layout.
+ *  `&'lt [T]` but with a guaranteed `#[repr(C)]` layout.
  *
  *  # C layout (for some given type T)
  *
@@ -79,30 +83,149 @@ aes67_vsc_destroy_receiver (
  *  allowed to be `NULL` (with the contents of `len` then being undefined)
  *  use the `Option< slice_ptr<_> >` type.
  */
-typedef struct slice_mut_float {
+typedef struct slice_ref_float_ptr {
     /** \brief
      *  Pointer to the first element (if any).
      */
-    float * ptr;
+    float * const * ptr;
 
     /** \brief
      *  Element count
      */
     size_t len;
-} slice_mut_float_t;
+} slice_ref_float_ptr_t;
 
 /** \brief
- *  Fetch data from the specified receiver
+ *  Fetch data from the specified receiver. Samples are copied directly from the receiver's buffer into the
+ *  provided channel buffers. This function never blocks: if the requested frames have not been received (yet)
+ *  or have already been overwritten, it returns immediately and leaves the buffers untouched.
  *
  *  * `receiver_id` - the receiver id as returned by the `aes67_vsc_create_receiver` function
- *  * `playout_time` - the media clock timestamp of the first frame to fetch
- *  * `buffer_ptr` - pointer to a float[] to which the fetched audio samples will be written
+ *  * `playout_time` - the media clock time at which the first frame is played out. The receiver's link offset
+ *  is subtracted internally to find the corresponding RTP ingress time.
+ *  * `buffers` - one float buffer per channel, each at least `frames` long. NULL entries skip the channel.
+ *  * `frames` - the number of frames to fetch for each channel
+ *  * `valid_frames` - if not NULL, receives the number of frames that were written to each buffer
  */
 uint8_t
 aes67_vsc_receive (
-    uint32_t receiver_id,
+    uint64_t receiver_id,
     uint64_t playout_time,
-    slice_mut_float_t buffer_ptr);
+    slice_ref_float_ptr_t buffers,
+    size_t frames,
+    size_t * valid_frames);
+
+
+/** \brief
+ *  Configuration for an AES67 sender
+ */
+typedef struct Aes67VscSenderConfig {
+    /** \brief
+     *  Unique sender ID
+     */
+    uint32_t id;
+
+    /** \brief
+     *  Name of the sender, used as session name.
+     */
+    char const * name;
+
+    /** \brief
+     *  Multicast address and port the stream is sent to, e.g. "239.69.1.2:5004"
+     */
+    char const * target;
+
+    /** \brief
+     *  Number of channels
+     */
+    uint32_t channels;
+
+    /** \brief
+     *  Bit depth of the transmitted samples, either 16 or 24
+     */
+    uint8_t bit_depth;
+
+    /** \brief
+     *  Sample rate in Hz
+     */
+    uint32_t sample_rate;
+
+    /** \brief
+     *  Packet time in milliseconds
+     */
+    float packet_time;
+
+    /** \brief
+     *  RTP payload type
+     */
+    uint8_t payload_type;
+} Aes67VscSenderConfig_t;
+
+/** \brief
+ *  Create a new AES67 sender. Returns the ID of the new sender or a negative error code.
+ *  * `config` - the configuration for the sender
+ */
+int32_t
+aes67_vsc_create_sender (
+    Aes67VscSenderConfig_t const * config);
+
+/** \brief
+ *  `&'lt [T]` but with a guaranteed `#[repr(C)]` layout.
+ *
+ *  # C layout (for some given type T)
+ *
+ *  ```c
+ *  typedef struct {
+ *  // Cannot be NULL
+ *  T * ptr;
+ *  size_t len;
+ *  } slice_T;
+ *  ```
+ *
+ *  # Nullable pointer?
+ *
+ *  If you want to support the above typedef, but where the `ptr` field is
+ *  allowed to be `NULL` (with the contents of `len` then being undefined)
+ *  use the `Option< slice_ptr<_> >` type.
+ */
+typedef struct slice_ref_float_const_ptr {
+    /** \brief
+     *  Pointer to the first element (if any).
+     */
+    float const * const * ptr;
+
+    /** \brief
+     *  Element count
+     */
+    size_t len;
+} slice_ref_float_const_ptr_t;
+
+/** \brief
+ *  Send a block of audio data with the specified sender. The samples are converted straight from the
+ *  provided channel buffers into the sender's packet buffer and handed over to the sender thread. This function
+ *  never blocks or allocates, if the sender thread cannot keep up, it returns an error code immediately.
+ *
+ *  * `sender_id` - the sender id as returned by the `aes67_vsc_create_sender` function
+ *  * `ingress_time` - the media clock timestamp of the first frame in the block
+ *  * `buffers` - one float buffer per channel, each at least `frames` long. NULL entries are sent as silence.
+ *  * `frames` - the number of frames in each buffer
+ */
+uint8_t
+aes67_vsc_send (
+    uint64_t sender_id,
+    uint64_t ingress_time,
+    slice_ref_float_const_ptr_t buffers,
+    size_t frames);
+
+/** \brief
+ *  Destroy an existing AES67 sender. This stops the sender and de-allocates any memory it has allocated
+ *  during its creation.
+ *
+ *  * `sender_id` - the ID of the sender to be destroyed
+ */
+uint8_t
+aes67_vsc_destroy_sender (
+    uint64_t sender_id);
 
 
 #ifdef __cplusplus
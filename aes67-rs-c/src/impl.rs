@@ -15,153 +15,373 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+use crate::{
+    AES_VSC_ERROR_INVALID_BUFFER_SIZE, AES_VSC_ERROR_INVALID_CHANNEL, AES_VSC_ERROR_NO_DATA,
+    AES_VSC_ERROR_RECEIVER_BUFFER_UNDERRUN, AES_VSC_ERROR_RECEIVER_NOT_FOUND,
+    AES_VSC_ERROR_SENDER_BUFFER_OVERFLOW, AES_VSC_ERROR_SENDER_NOT_FOUND,
+    AES_VSC_ERROR_UNSUPPORTED_BIT_DEPTH, AES_VSC_ERROR_UNSUPPORTED_SAMPLE_RATE,
+    AES_VSC_ERROR_VSC_NOT_CREATED, AES_VSC_OK, Aes67VscReceiverConfig, Aes67VscSenderConfig,
+};
 use ::safer_ffi::prelude::*;
 use aes67_rs::{
+    buffer::receiver::ReadResult,
+    config::{Config, PtpMode, adjust_labels_for_channel_count},
     error::{
-        ConfigError, ConfigResult, GetErrorCode, ReceiverApiResult, ReceiverInternalResult,
-        VscApiResult,
+        ClockError, ConfigError, ConfigResult, ReceiverInternalResult, SenderInternalError,
+        SenderInternalResult, ToBoxedResult, VscApiResult, VscInternalError,
+    },
+    formats::{AudioFormat, FrameFormat, MutableDuration, SampleFormat, SessionId},
+    nic::find_nic_with_name,
+    receiver::{
+        api::ReceiverApi,
+        config::{IoBackend, ReceiveMode, ReceiverConfig, SessionInfo},
     },
-    formats::SessionId,
-    receiver::{api::ReceiverApi, config::ReceiverConfig},
+    sender::{api::SenderApi, config::SenderConfig},
+    time::{ClockMode, ClockNic, get_primary_clock},
+    utils::AtomicF32,
     vsc::VirtualSoundCardApi,
 };
-use aes67_rs_sdp::SdpWrapper;
 use dashmap::DashMap;
-use futures_lite::future::block_on;
 use lazy_static::lazy_static;
 use sdp::SessionDescription;
-use std::{io::Cursor, sync::Arc};
+use std::{env, io::Cursor, slice, sync::Arc, time::Duration};
+use tokio::{
+    runtime::{self, Runtime},
+    sync::oneshot,
+};
+use tosub::SubsystemHandle;
+use tracing::{error, info};
+
+const DEFAULT_VSC_NAME: &str = "aes67-virtual-sound-card";
+
+struct Vsc {
+    runtime: Runtime,
+    api: VirtualSoundCardApi,
+}
+
+struct Receiver {
+    api: ReceiverApi,
+    config: ReceiverConfig,
+}
 
-use crate::{AES_VSC_ERROR_RECEIVER_NOT_FOUND, AES_VSC_OK, Aes67VscReceiverConfig};
+struct Sender {
+    api: SenderApi,
+    channels: usize,
+    /// sent in place of channels the caller did not provide a buffer for
+    silence: Vec<f32>,
+}
 
 lazy_static! {
-    static ref VIRTUAL_SOUND_CARD: Arc<VirtualSoundCardApi> =
-        init_vsc().expect("failed to initialized AES67 virtual sound card");
-    static ref RECEIVERS: DashMap<SessionId, ReceiverApi> = DashMap::new();
-}
-
-fn init_vsc() -> VscApiResult<Arc<VirtualSoundCardApi>> {
-    // let config = try_init().boxed()?;
-    // let (wb, _, _) = block_on(worterbuch_client::connect_with_default_config())
-    //     .map_err(VscInternalError::from)
-    //     .boxed()?;
-    // let _audio_nic = find_nic_with_name(config.audio.nic)?;
-    // let vsc_name = env::var("AES67_VSC_NAME").unwrap_or("aes67-virtual-sound-card".to_owned());
-    // info!("Creating new VSC with name '{vsc_name}' …");
-    // let _subsys = tosub::build_root(vsc_name.clone())
-    //     .with_timeout(Duration::from_secs(5))
-    //     .start(|s| async move {
-    //         s.shutdown_requested().await;
-    //         Ok::<(), VscInternalError>(())
-    //     });
-
-    // let clock_mode = config.ptp.map(|ptp| match ptp {
-    //     PtpMode::System => ClockMode::System,
-    //     PtpMode::Phc { nic } => ClockMode::Phc {
-    //         nic: ClockNic::NonRedundant(nic),
-    //         subsys: &subsys,
-    //     },
-    //     PtpMode::Internal { nic } => ClockMode::Internal {
-    //         nic: ClockNic::NonRedundant(nic),
-    //         wb: wb.clone(),
-    //     },
-    // });
-
-    // let _clock = get_primary_clock(vsc_name.clone(), clock_mode, config.audio.sample_rate);
-    // let vsc = block_on(VirtualSoundCardApi::new(
-    //     vsc_name.clone(),
-    //     &subsys,
-    //     wb,
-    //     clock,
-    //     audio_nic,
-    // ))?;
-    // TODO store subsys somewhere to keep it alive
-    // info!("VSC '{}' created.", vsc_name);
-    // Ok(Arc::new(vsc))
-    todo!()
-}
-
-// fn try_init() -> VscInternalResult<Config> {
-//     // let config = Config::load()?;
-//     //
-//     let config = Config::default();
-//     // let runtime = runtime::Builder::new_current_thread()
-//     //     .enable_all()
-//     //     .build()?;
-//     let init_future = async {
-//         // telemetry::init(&config).await?;
-//         Ok::<(), VscInternalError>(())
-//     };
-//     // runtime.block_on(init_future)?;
-//     block_on(init_future)?;
-//     info!("AES67 VSC SubsystemHandle initialized successfully.");
-//     Ok(config)
-// }
+    static ref VIRTUAL_SOUND_CARD: Option<Vsc> = match init_vsc() {
+        Ok(it) => Some(it),
+        Err(e) => {
+            error!("Failed to initialize AES67 virtual sound card: {e}");
+            None
+        }
+    };
+    static ref RECEIVERS: DashMap<SessionId, Receiver> = DashMap::new();
+    static ref SENDERS: DashMap<SessionId, Sender> = DashMap::new();
+}
+
+/// Starts the VSC on its own runtime. Configuration is loaded from worterbuch, using the value of the
+/// `AES67_VSC_NAME` environment variable as application ID.
+fn init_vsc() -> VscApiResult<Vsc> {
+    let runtime = runtime::Builder::new_multi_thread()
+        .enable_all()
+        .thread_name("aes67-vsc")
+        .build()
+        .map_err(VscInternalError::from)
+        .boxed()?;
+
+    let vsc_name = env::var("AES67_VSC_NAME").unwrap_or_else(|_| DEFAULT_VSC_NAME.to_owned());
+    info!("Creating new VSC with name '{vsc_name}' …");
+
+    let (tx, rx) = oneshot::channel();
+    let name = vsc_name.clone();
+    runtime.spawn(async move {
+        tosub::build_root(name.clone())
+            .with_timeout(Duration::from_secs(5))
+            .start(|s| async move {
+                let vsc = start_vsc(&s, name).await;
+                let started = vsc.is_ok();
+                tx.send(vsc).ok();
+                if started {
+                    // keep the root subsystem alive for as long as the process runs
+                    s.shutdown_requested().await;
+                }
+                Ok::<(), VscInternalError>(())
+            })
+            .await
+    });
+
+    let api = runtime.block_on(rx)??;
+    info!("VSC '{}' created.", vsc_name);
+
+    Ok(Vsc { runtime, api })
+}
+
+async fn start_vsc(subsys: &SubsystemHandle, name: String) -> VscApiResult<VirtualSoundCardApi> {
+    let (wb, _, _) = worterbuch_client::connect_with_default_config().await?;
+    let config = Config::load(&name, &wb).await?;
+
+    let clock_mode = config.ptp.map(|ptp| match ptp {
+        PtpMode::System => ClockMode::System,
+        PtpMode::Phc { nic } => ClockMode::Phc {
+            nic: ClockNic::NonRedundant(nic),
+            subsys,
+            wb: wb.clone(),
+        },
+        PtpMode::Internal { nic } => ClockMode::Internal {
+            nic: ClockNic::NonRedundant(nic),
+            wb: wb.clone(),
+        },
+    });
+    let clock = get_primary_clock(name.clone(), clock_mode, config.audio.sample_rate)
+        .map_err(ClockError::other)?;
+    let audio_nic = find_nic_with_name(&config.audio.nic)?;
+
+    VirtualSoundCardApi::new(name, subsys, wb, clock, audio_nic).await
+}
 
 impl<'a> TryFrom<&Aes67VscReceiverConfig<'a>> for ReceiverConfig {
     type Error = ConfigError;
     fn try_from(value: &Aes67VscReceiverConfig<'a>) -> ConfigResult<Self> {
-        let id = value.id;
-        let _label = value
+        let id = value.id as SessionId;
+        let label = value
             .name
             .map(|it| it.to_string())
             .unwrap_or_else(|| id.to_string());
-        let _session = SdpWrapper(
-            SessionDescription::unmarshal(&mut Cursor::new(value.sdp.to_str()))
-                .map_err(|e| ConfigError::InvalidSdp(e.to_string()))?,
-        );
-        let _link_offset = value.link_offset;
-        let _delay_calculation_interval: Option<()> = None;
-
-        todo!()
-        // Ok(ReceiverConfig {
-        //     id,
-        //     label,
-        //     session,
-        //     link_offset,
-        //     delay_calculation_interval,
-        // })
+        let session = SessionDescription::unmarshal(&mut Cursor::new(value.sdp.to_str()))
+            .map_err(|e| ConfigError::InvalidSdp(e.to_string()))?;
+        let session_info = SessionInfo::try_from(&session)?;
+
+        Ok(ReceiverConfig {
+            id,
+            label,
+            audio_format: AudioFormat {
+                sample_rate: session_info.sample_rate,
+                frame_format: FrameFormat {
+                    channels: session_info.channels,
+                    sample_format: session_info.sample_format,
+                },
+            },
+            source: (session_info.destination_ip, session_info.destination_port).into(),
+            origin_ip: session_info.sender_ip(),
+            rtp_offset: session_info.rtp_offset,
+            channel_labels: session_info.channel_labels,
+            link_offset: MutableDuration(Arc::new(AtomicF32::new(value.link_offset))),
+            delay_calculation_interval: None,
+            payload_type: Some(session_info.payload_type),
+            kernel_filter: true,
+            receive_mode: ReceiveMode::default(),
+            io_backend: IoBackend::default(),
+            recording: None,
+            routing: None,
+            capture: None,
+        })
     }
 }
 
-pub fn try_create_receiver(config: &Aes67VscReceiverConfig) -> ReceiverInternalResult<i32> {
-    let config = match ReceiverConfig::try_from(config) {
-        Ok(it) => it,
-        Err(err) => return Ok(-(err.error_code() as i32)),
+pub fn try_create_receiver(config: &Aes67VscReceiverConfig) -> VscApiResult<i32> {
+    let Some(vsc) = VIRTUAL_SOUND_CARD.as_ref() else {
+        return Ok(-(AES_VSC_ERROR_VSC_NOT_CREATED as i32));
     };
-    let (receiver_api, _, _) = match block_on(VIRTUAL_SOUND_CARD.create_receiver(config)) {
-        Ok(it) => it,
-        Err(err) => return Ok(-(err.error_code() as i32)),
-    };
-    RECEIVERS.insert(0, receiver_api);
-    Ok(0)
+    let config = ReceiverConfig::try_from(config)?;
+    let id = config.id;
+    let (api, _, _) = vsc
+        .runtime
+        .block_on(vsc.api.create_receiver(config.clone()))?;
+    RECEIVERS.insert(id, Receiver { api, config });
+    Ok(id as i32)
 }
 
+/// Hot path of the receive API. This must not block or allocate: the lookup takes an uncontended shard lock
+/// and the samples are copied straight from the receiver buffer into the caller's channel buffers.
 pub fn try_receive<'a>(
     receiver_id: SessionId,
-    _playout_time: u64,
-    _buffer_ptr: c_slice::Mut<'a, f32>,
-) -> ReceiverApiResult<u8> {
-    let Some(_receiver) = RECEIVERS.get(&receiver_id) else {
+    playout_time: u64,
+    buffers: c_slice::Ref<'a, *mut f32>,
+    frames: usize,
+    valid_frames: Option<&'a mut usize>,
+) -> ReceiverInternalResult<u8> {
+    let mut written = 0;
+    let res = receive(receiver_id, playout_time, &buffers, frames, &mut written);
+    if let Some(valid_frames) = valid_frames {
+        *valid_frames = written;
+    }
+    res
+}
+
+fn receive(
+    receiver_id: SessionId,
+    playout_time: u64,
+    buffers: &[*mut f32],
+    frames: usize,
+    written: &mut usize,
+) -> ReceiverInternalResult<u8> {
+    let Some(mut receiver) = RECEIVERS.get_mut(&receiver_id) else {
         return Ok(AES_VSC_ERROR_RECEIVER_NOT_FOUND);
     };
 
-    // match receiver.receive_all(playout_time, buffer_ptr.as_ptr() as usize, buffer_ptr.len())? {
-    //     DataState::Ready => Ok(AES_VSC_OK),
-    //     DataState::NotReady => Ok(AES_VSC_ERROR_NO_DATA),
-    //     DataState::ReceiverNotReady => Ok(AES_VSC_ERROR_RECEIVER_NOT_READY_YET),
-    //     DataState::InvalidChannelNumber => Ok(AES_VSC_ERROR_INVALID_CHANNEL),
-    //     DataState::Missed => Ok(AES_VSC_ERROR_RECEIVER_BUFFER_UNDERRUN),
-    //     DataState::SyncError => Ok(AES_VSC_ERROR_CLOCK_SYNC_ERROR),
-    // }
+    if buffers.len() > receiver.config.io_channels() {
+        return Ok(AES_VSC_ERROR_INVALID_CHANNEL);
+    }
+
+    let Some(ingress_time) = playout_time.checked_sub(receiver.config.frames_in_link_offset())
+    else {
+        return Ok(AES_VSC_ERROR_NO_DATA);
+    };
 
-    // TODO adapt to new receiver API
+    let channel_buffers = buffers.iter().map(|ptr| {
+        if ptr.is_null() {
+            None
+        } else {
+            // SAFETY: the caller guarantees that every non-null pointer points to at least `frames` floats
+            Some(unsafe { slice::from_raw_parts_mut(*ptr, frames) })
+        }
+    });
 
-    Ok(AES_VSC_OK)
+    match receiver
+        .api
+        .receive(channel_buffers, ingress_time, frames)?
+    {
+        ReadResult::Ok(len) => {
+            *written = len;
+            Ok(AES_VSC_OK)
+        }
+        ReadResult::NotReady(_) => Ok(AES_VSC_ERROR_NO_DATA),
+        ReadResult::TooLate => Ok(AES_VSC_ERROR_RECEIVER_BUFFER_UNDERRUN),
+    }
 }
 
 pub fn try_destroy_receiver(id: SessionId) -> VscApiResult<u8> {
-    block_on(VIRTUAL_SOUND_CARD.destroy_receiver(id))?;
+    let Some(vsc) = VIRTUAL_SOUND_CARD.as_ref() else {
+        return Ok(AES_VSC_ERROR_VSC_NOT_CREATED);
+    };
+    if RECEIVERS.remove(&id).is_none() {
+        return Ok(AES_VSC_ERROR_RECEIVER_NOT_FOUND);
+    }
+    vsc.runtime.block_on(vsc.api.destroy_receiver(id))?;
+    Ok(AES_VSC_OK)
+}
+
+impl<'a> TryFrom<&Aes67VscSenderConfig<'a>> for SenderConfig {
+    type Error = ConfigError;
+    fn try_from(value: &Aes67VscSenderConfig<'a>) -> ConfigResult<Self> {
+        let id = value.id as SessionId;
+        let label = value
+            .name
+            .map(|it| it.to_string())
+            .unwrap_or_else(|| id.to_string());
+        let target = value.target.to_str().parse()?;
+        let sample_format = match value.bit_depth {
+            16 => SampleFormat::L16,
+            24 => SampleFormat::L24,
+            other => return Err(ConfigError::UnsupportedSampleFormat(format!("L{other}"))),
+        };
+        let channels = value.channels as usize;
+        let mut channel_labels = Vec::with_capacity(channels);
+        adjust_labels_for_channel_count(channels, &mut channel_labels);
+
+        Ok(SenderConfig {
+            id,
+            label,
+            audio_format: AudioFormat {
+                sample_rate: value.sample_rate,
+                frame_format: FrameFormat {
+                    channels,
+                    sample_format,
+                },
+            },
+            target,
+            packet_time: MutableDuration(Arc::new(AtomicF32::new(value.packet_time))),
+            payload_type: value.payload_type,
+            channel_labels,
+            playback: None,
+            relay: None,
+            routing: None,
+            capture: None,
+        })
+    }
+}
+
+pub fn try_create_sender(config: &Aes67VscSenderConfig) -> VscApiResult<i32> {
+    let Some(vsc) = VIRTUAL_SOUND_CARD.as_ref() else {
+        return Ok(-(AES_VSC_ERROR_VSC_NOT_CREATED as i32));
+    };
+    if config.bit_depth != 16 && config.bit_depth != 24 {
+        return Ok(-(AES_VSC_ERROR_UNSUPPORTED_BIT_DEPTH as i32));
+    }
+    if config.sample_rate == 0 {
+        return Ok(-(AES_VSC_ERROR_UNSUPPORTED_SAMPLE_RATE as i32));
+    }
+    let config = SenderConfig::try_from(config)?;
+    let id = config.id;
+    let channels = config.io_channels();
+    let (api, _, _) = vsc.runtime.block_on(vsc.api.create_sender(config))?;
+    let silence = vec![0.0; api.max_frames()];
+    SENDERS.insert(
+        id,
+        Sender {
+            api,
+            channels,
+            silence,
+        },
+    );
+    Ok(id as i32)
+}
+
+/// Hot path of the send API. Like [try_receive] this must not block or allocate: samples are converted
+/// straight from the caller's buffers into the sender's packet buffer, packets are handed over to the sender
+/// thread with a non-blocking channel send.
+pub fn try_send<'a>(
+    sender_id: SessionId,
+    ingress_time: u64,
+    buffers: c_slice::Ref<'a, *const f32>,
+    frames: usize,
+) -> SenderInternalResult<u8> {
+    let Some(mut sender) = SENDERS.get_mut(&sender_id) else {
+        return Ok(AES_VSC_ERROR_SENDER_NOT_FOUND);
+    };
+    let sender = &mut *sender;
+
+    if buffers.len() != sender.channels {
+        return Ok(AES_VSC_ERROR_INVALID_CHANNEL);
+    }
+    if frames == 0 || frames > sender.silence.len() {
+        return Ok(AES_VSC_ERROR_INVALID_BUFFER_SIZE);
+    }
+
+    if let Err(SenderInternalError::BlockTooLarge { .. }) =
+        sender.api.start_write(ingress_time, frames, 0)
+    {
+        return Ok(AES_VSC_ERROR_INVALID_BUFFER_SIZE);
+    }
+    for (ch, ptr) in buffers.iter().enumerate() {
+        let channel_buffer = if ptr.is_null() {
+            &sender.silence[..frames]
+        } else {
+            // SAFETY: the caller guarantees that every non-null pointer points to at least `frames` floats
+            unsafe { slice::from_raw_parts(*ptr, frames) }
+        };
+        sender.api.write_channel(ch, channel_buffer);
+    }
+
+    match sender.api.end_write() {
+        Ok(()) => Ok(AES_VSC_OK),
+        Err(SenderInternalError::TrySendError(_)) => Ok(AES_VSC_ERROR_SENDER_BUFFER_OVERFLOW),
+        Err(e) => Err(e),
+    }
+}
+
+pub fn try_destroy_sender(id: SessionId) -> VscApiResult<u8> {
+    let Some(vsc) = VIRTUAL_SOUND_CARD.as_ref() else {
+        return Ok(AES_VSC_ERROR_VSC_NOT_CREATED);
+    };
+    if SENDERS.remove(&id).is_none() {
+        return Ok(AES_VSC_ERROR_SENDER_NOT_FOUND);
+    }
+    vsc.runtime.block_on(vsc.api.destroy_sender(id))?;
     Ok(AES_VSC_OK)
 }
 
@@ -19,7 +19,10 @@
 
 mod r#impl;
 
-use crate::r#impl::{try_create_receiver, try_destroy_receiver, try_receive};
+use crate::r#impl::{
+    try_create_receiver, try_create_sender, try_destroy_receiver, try_destroy_sender, try_receive,
+    try_send,
+};
 use ::safer_ffi::prelude::*;
 use aes67_rs::{error::GetErrorCode, formats::SessionId};
 
@@ -40,6 +43,8 @@ pub const AES_VSC_ERROR_CLOCK_SYNC_ERROR: u8 = 0x0A;
 pub const AES_VSC_ERROR_RECEIVER_NOT_READY_YET: u8 = 0x0B;
 pub const AES_VSC_ERROR_NO_DATA: u8 = 0x0C;
 pub const AES_VSC_ERROR_INVALID_PTP_CONFIG: u8 = 0x0D;
+pub const AES_VSC_ERROR_INVALID_BUFFER_SIZE: u8 = 0x0E;
+pub const AES_VSC_ERROR_SENDER_BUFFER_OVERFLOW: u8 = 0x0F;
 
 /// Configuration for an AES67 receiver
 #[derive_ReprC]
@@ -57,8 +62,8 @@ pub struct Aes67VscReceiverConfig<'a> {
     link_offset: f32,
 }
 
-/// Create a new AES67 receiver
-/// * `config` - the configuration for the sender
+/// Create a new AES67 receiver. Returns the ID of the new receiver or a negative error code.
+/// * `config` - the configuration for the receiver
 #[ffi_export]
 fn aes67_vsc_create_receiver<'a>(config: &'a Aes67VscReceiverConfig<'a>) -> i32 {
     // eprintln!("config: {:?}", config);
@@ -68,18 +73,25 @@ fn aes67_vsc_create_receiver<'a>(config: &'a Aes67VscReceiverConfig<'a>) -> i32
     }
 }
 
-/// Fetch data from the specified receiver
+/// Fetch data from the specified receiver. Samples are copied directly from the receiver's buffer into the
+/// provided channel buffers. This function never blocks: if the requested frames have not been received (yet)
+/// or have already been overwritten, it returns immediately and leaves the buffers untouched.
 ///
 /// * `receiver_id` - the receiver id as returned by the `aes67_vsc_create_receiver` function
-/// * `playout_time` - the media clock timestamp of the first frame to fetch
-/// * `buffer_ptr` - pointer to a float[] to which the fetched audio samples will be written
+/// * `playout_time` - the media clock time at which the first frame is played out. The receiver's link offset
+///   is subtracted internally to find the corresponding RTP ingress time.
+/// * `buffers` - one float buffer per channel, each at least `frames` long. NULL entries skip the channel.
+/// * `frames` - the number of frames to fetch for each channel
+/// * `valid_frames` - if not NULL, receives the number of frames that were written to each buffer
 #[ffi_export]
 fn aes67_vsc_receive<'a>(
     receiver_id: SessionId,
     playout_time: u64,
-    buffer_ptr: c_slice::Mut<'a, f32>,
+    buffers: c_slice::Ref<'a, *mut f32>,
+    frames: usize,
+    valid_frames: Option<&'a mut usize>,
 ) -> u8 {
-    match try_receive(receiver_id, playout_time, buffer_ptr) {
+    match try_receive(receiver_id, playout_time, buffers, frames, valid_frames) {
         Ok(it) => it,
         Err(err) => err.error_code(),
     }
@@ -97,3 +109,69 @@ fn aes67_vsc_destroy_receiver(receiver_id: SessionId) -> u8 {
         Err(err) => err.error_code(),
     }
 }
+
+/// Configuration for an AES67 sender
+#[derive_ReprC]
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct Aes67VscSenderConfig<'a> {
+    /// Unique sender ID
+    id: u32,
+    /// Name of the sender, used as session name.
+    name: Option<char_p::Ref<'a>>,
+    /// Multicast address and port the stream is sent to, e.g. "239.69.1.2:5004"
+    target: char_p::Ref<'a>,
+    /// Number of channels
+    channels: u32,
+    /// Bit depth of the transmitted samples, either 16 or 24
+    bit_depth: u8,
+    /// Sample rate in Hz
+    sample_rate: u32,
+    /// Packet time in milliseconds
+    packet_time: f32,
+    /// RTP payload type
+    payload_type: u8,
+}
+
+/// Create a new AES67 sender. Returns the ID of the new sender or a negative error code.
+/// * `config` - the configuration for the sender
+#[ffi_export]
+fn aes67_vsc_create_sender<'a>(config: &'a Aes67VscSenderConfig<'a>) -> i32 {
+    match try_create_sender(config) {
+        Ok(it) => it,
+        Err(err) => -(err.error_code() as i32),
+    }
+}
+
+/// Send a block of audio data with the specified sender. The samples are converted straight from the
+/// provided channel buffers into the sender's packet buffer and handed over to the sender thread. This function
+/// never blocks or allocates, if the sender thread cannot keep up, it returns an error code immediately.
+///
+/// * `sender_id` - the sender id as returned by the `aes67_vsc_create_sender` function
+/// * `ingress_time` - the media clock timestamp of the first frame in the block
+/// * `buffers` - one float buffer per channel, each at least `frames` long. NULL entries are sent as silence.
+/// * `frames` - the number of frames in each buffer
+#[ffi_export]
+fn aes67_vsc_send<'a>(
+    sender_id: SessionId,
+    ingress_time: u64,
+    buffers: c_slice::Ref<'a, *const f32>,
+    frames: usize,
+) -> u8 {
+    match try_send(sender_id, ingress_time, buffers, frames) {
+        Ok(it) => it,
+        Err(err) => err.error_code(),
+    }
+}
+
+/// Destroy an existing AES67 sender. This stops the sender and de-allocates any memory it has allocated
+/// during its creation.
+///
+/// * `sender_id` - the ID of the sender to be destroyed
+#[ffi_export]
+fn aes67_vsc_destroy_sender(sender_id: SessionId) -> u8 {
+    match try_destroy_sender(sender_id) {
+        Ok(it) => it,
+        Err(err) => err.error_code(),
+    }
+}
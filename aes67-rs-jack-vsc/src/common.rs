@@ -16,184 +16,84 @@
  */
 
 use aes67_rs::{
-    error::ClockResult,
-    formats::Frames,
-    time::{Clock, MediaClock},
-    utils::AverageCalculationBuffer,
+    monitoring::timing::{
+        CYCLE_TIMING_REPORT_INTERVAL, CycleSample, CycleTimingStats, CycleTimings,
+    },
+    time::{MICROS_PER_SEC, servo::AudioCycle},
 };
 use jack::{Client, ProcessScope};
-#[cfg(debug_assertions)]
-use tracing::{debug, info, warn};
-
-const MAX_DRIFT_EXCEEDED_COUNT: u16 = 10;
-
-pub struct JackClock {
-    ptp_clock: Clock,
-    jack_clock_offset: Option<i64>,
-    drift_buffer: AverageCalculationBuffer<i64>,
-    drift_exceeded_counter: u16,
-}
-
-pub enum ClockOffset {
-    Stable { offset: i64, compensation: i64 },
-    Unstable,
-}
+use std::{
+    sync::Arc,
+    time::{Duration, Instant},
+};
+use tokio::{select, time::interval};
+use tosub::SubsystemHandle;
 
-pub enum ClockState {
-    Stable {
-        current_time: Frames,
-        compensation: i64,
-    },
-    Unstable,
-}
+/// Exposes the JACK frame counter of a process cycle to the [aes67_rs::time::servo::MediaClockServo].
+pub struct JackCycle<'a>(pub &'a ProcessScope);
 
-impl JackClock {
-    pub fn new(ptp_clock: Clock) -> Self {
-        JackClock {
-            ptp_clock,
-            jack_clock_offset: None,
-            drift_buffer: AverageCalculationBuffer::new([0i64; 100].into()),
-            drift_exceeded_counter: 0,
-        }
+impl AudioCycle for JackCycle<'_> {
+    fn last_frame_time(&self) -> u32 {
+        self.0.last_frame_time()
     }
 
-    pub fn update_clock(
-        &mut self,
-        client: &Client,
-        ps: &ProcessScope,
-        max_drift: Frames,
-        continuously_compensate_drift: bool,
-    ) -> ClockResult<ClockState> {
-        let drift_buf_len =
-            (client.sample_rate() as usize / 48_000) * (10_000 / ps.n_frames() as usize);
-        if self.drift_buffer.len() != drift_buf_len {
-            #[cfg(debug_assertions)]
-            info!("Updating drift buffer length to {drift_buf_len}");
-            self.drift_buffer = AverageCalculationBuffer::new(vec![0i64; drift_buf_len].into());
-        }
-
-        let state = match self.jack_clock_offset {
-            Some(offset) => {
-                self.compensate_drift(offset, ps, max_drift, continuously_compensate_drift)?
-            }
-            None => self.init_clock(ps)?,
-        };
-
-        Ok(match state {
-            ClockOffset::Stable {
-                offset,
-                compensation,
-            } => {
-                ClockState::Stable {
-                    // TODO this might wrap, wrap needs to be detected and handled!
-                    current_time: (ps.last_frame_time() as i64 + offset) as Frames,
-                    compensation,
-                }
-            }
-            ClockOffset::Unstable => ClockState::Unstable,
-        })
+    fn frames_since_cycle_start(&self) -> u32 {
+        self.0.frames_since_cycle_start()
     }
 
-    fn init_clock(&mut self, ps: &ProcessScope) -> ClockResult<ClockOffset> {
-        let t1 = ps.frames_since_cycle_start();
-        let ptp_time = self.ptp_clock.current_time()?.media_time as i64;
-        let t3 = ps.frames_since_cycle_start();
-        let jack_time = (ps.last_frame_time() + (t1 + t3) / 2) as i64;
-
-        let diff = ptp_time - jack_time;
-
-        self.jack_clock_offset = Some(diff);
-
-        Ok(ClockOffset::Unstable)
+    fn n_frames(&self) -> u32 {
+        self.0.n_frames()
     }
+}
 
-    fn compensate_drift(
-        &mut self,
-        offset: i64,
-        ps: &ProcessScope,
-        max_drift: Frames,
-        continuously_compensate_drift: bool,
-    ) -> ClockResult<ClockOffset> {
-        let t1 = ps.frames_since_cycle_start();
-        let ptp_time = self.ptp_clock.current_time()?.media_time as i64;
-        let t3 = ps.frames_since_cycle_start();
-        let jack_time = (ps.last_frame_time() + (t1 + t3) / 2) as i64;
-
-        let jack_ptpt_time = jack_time + offset;
-
-        let diff = ptp_time - jack_time;
-        let drift = ptp_time - jack_ptpt_time;
-
-        let drift_abs = drift.unsigned_abs();
-
-        // hard reset when drift exceeds JACK buffer size
-        // this will cause an audible glitch
-        if drift_abs > ps.n_frames() as u64 {
-            #[cfg(debug_assertions)]
-            warn!("JACK clock is off by {drift} frames, resetting JACK clock.");
-            self.jack_clock_offset = Some(diff);
-            self.drift_exceeded_counter = 0;
-            return Ok(ClockOffset::Unstable);
+/// Records the timing of a finished process callback. `start` is the time the callback was entered, slack is
+/// measured against the start of the next JACK cycle.
+pub fn record_cycle(
+    timings: &CycleTimings,
+    client: &Client,
+    ps: &ProcessScope,
+    start: Instant,
+    clock: Duration,
+    io: Duration,
+) {
+    let wall = start.elapsed();
+    let (period_micros, slack_micros) = match ps.cycle_times() {
+        Ok(times) => (
+            times.period_usecs as u64,
+            times.next_usecs as i64 - client.time() as i64,
+        ),
+        Err(_) => {
+            let period = ps.n_frames() as u64 * MICROS_PER_SEC / client.sample_rate() as u64;
+            (period, period as i64 - wall.as_micros() as i64)
         }
+    };
+    timings.record(
+        period_micros,
+        CycleSample {
+            wall_micros: wall.as_micros() as u64,
+            io_micros: io.as_micros() as u64,
+            clock_micros: clock.as_micros() as u64,
+            slack_micros,
+        },
+    );
+}
 
-        if drift_abs > max_drift {
-            self.drift_exceeded_counter += 1;
-
-            #[cfg(debug_assertions)]
-            warn!(
-                "Max JACK clock drift exceeded: {}/{} ({}/{}).",
-                drift_abs, max_drift, self.drift_exceeded_counter, MAX_DRIFT_EXCEEDED_COUNT
-            );
-
-            // soft reset when drift exceeds client's requested max drift
-            // this may cause an audible glitch, depending on how the receiver
-            // handles the resulting timestamp inconsitency
-            if self.drift_exceeded_counter >= MAX_DRIFT_EXCEEDED_COUNT {
-                #[cfg(debug_assertions)]
-                warn!("JACK clock is off by {drift} frames, resetting JACK clock.");
-                self.jack_clock_offset = Some(diff);
-                self.drift_exceeded_counter = 0;
-                return Ok(ClockOffset::Stable {
-                    offset: diff,
-                    compensation: 0,
-                });
+/// Spawns a subsystem that periodically reports the cycle timings of a JACK client to monitoring.
+pub fn start_cycle_timing_reporter(
+    subsys: &SubsystemHandle,
+    transceiver_id: String,
+    timings: Arc<CycleTimings>,
+    report: impl Fn(CycleTimingStats) + Send + 'static,
+) -> SubsystemHandle {
+    subsys.spawn(format!("cycle_timing/{transceiver_id}"), async move |s| {
+        let mut interval = interval(CYCLE_TIMING_REPORT_INTERVAL);
+        interval.tick().await;
+        loop {
+            select! {
+                _ = interval.tick() => report(timings.take()),
+                _ = s.shutdown_requested() => break,
             }
         }
-
-        let slew = if let Some(drift) = self.drift_buffer.update(drift) {
-            let slew = if continuously_compensate_drift {
-                drift.signum()
-            } else {
-                0
-            };
-
-            #[cfg(debug_assertions)]
-            if drift != 0 {
-                if drift > 0 {
-                    debug!(
-                        "JACK clock is {} frames BEHIND; slewing jack clock by {}",
-                        drift, slew
-                    );
-                } else {
-                    debug!(
-                        "JACK clock is {} frames AHEAD; slewing jack clock by {}",
-                        -drift, slew
-                    );
-                }
-            }
-
-            slew
-        } else {
-            0
-        };
-
-        let updated_offset = offset + slew;
-
-        self.jack_clock_offset = Some(updated_offset);
-
-        Ok(ClockOffset::Stable {
-            offset: updated_offset,
-            compensation: slew,
-        })
-    }
+        Ok::<(), miette::Error>(())
+    })
 }
@@ -17,6 +17,7 @@
 
 use crate::{receive::start_playout, send::start_recording};
 use aes67_rs::{
+    config::MediaClockServoConfig,
     formats::SessionId,
     monitoring::Monitoring,
     receiver::{api::ReceiverApi, config::ReceiverConfig},
@@ -38,15 +39,21 @@ pub struct JackIoHandlerActor {
     tx_clients: HashMap<SessionId, SubsystemHandle>,
     rx_clients: HashMap<SessionId, SubsystemHandle>,
     rx: mpsc::Receiver<JackIoHandlerMessage>,
+    clock_servo: MediaClockServoConfig,
 }
 
 impl JackIoHandlerActor {
-    pub(crate) fn new(subsys: SubsystemHandle, rx: mpsc::Receiver<JackIoHandlerMessage>) -> Self {
+    pub(crate) fn new(
+        subsys: SubsystemHandle,
+        rx: mpsc::Receiver<JackIoHandlerMessage>,
+        clock_servo: MediaClockServoConfig,
+    ) -> Self {
         Self {
             subsys,
             tx_clients: HashMap::new(),
             rx_clients: HashMap::new(),
             rx,
+            clock_servo,
         }
     }
 
@@ -124,7 +131,16 @@ impl JackIoHandlerActor {
         monitoring: Monitoring,
     ) -> IoHandlerResult<()> {
         let id = config.id;
-        let recording = start_recording(app_id, subsys, sender, config, clock, monitoring).await?;
+        let recording = start_recording(
+            app_id,
+            subsys,
+            sender,
+            config,
+            clock,
+            self.clock_servo.clone(),
+            monitoring,
+        )
+        .await?;
         self.tx_clients.insert(id, recording);
         Ok(())
     }
@@ -156,7 +172,16 @@ impl JackIoHandlerActor {
         monitoring: Monitoring,
     ) -> IoHandlerResult<()> {
         let id = config.id;
-        let playout = start_playout(app_id, subsys, receiver, config, clock, monitoring).await?;
+        let playout = start_playout(
+            app_id,
+            subsys,
+            receiver,
+            config,
+            clock,
+            self.clock_servo.clone(),
+            monitoring,
+        )
+        .await?;
         self.rx_clients.insert(id, playout);
         Ok(())
     }
@@ -222,11 +247,11 @@ pub struct JackIoHandler {
 }
 
 impl JackIoHandler {
-    pub fn new(subsys: &SubsystemHandle) -> Self {
+    pub fn new(subsys: &SubsystemHandle, clock_servo: MediaClockServoConfig) -> Self {
         let (tx, rx) = mpsc::channel(1);
 
         subsys.spawn("jack_io_handler", |s| async {
-            JackIoHandlerActor::new(s, rx).run().await;
+            JackIoHandlerActor::new(s, rx, clock_servo).run().await;
             Ok::<(), miette::Error>(())
         });
 
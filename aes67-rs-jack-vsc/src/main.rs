@@ -63,7 +63,7 @@ async fn run(
     args: Args,
     config: AppConfig,
 ) -> miette::Result<()> {
-    let io_handler = JackIoHandler::new(&subsys);
+    let io_handler = JackIoHandler::new(&subsys, config.media_clock_servo.clone());
 
     init_management_agent(
         &subsys,
@@ -16,21 +16,26 @@
  */
 
 use crate::{
-    common::{ClockState, JackClock},
+    common::{JackCycle, record_cycle, start_cycle_timing_reporter},
     session_manager::{SessionManagerNotificationHandler, start_session_manager},
 };
 use aes67_rs::{
     buffer::receiver::ReadResult,
+    config::MediaClockServoConfig,
     formats::{Frames, frames_to_duration},
-    monitoring::Monitoring,
+    monitoring::{Monitoring, RxStats, timing::CycleTimings},
     receiver::{api::ReceiverApi, config::ReceiverConfig},
-    time::Clock,
+    resampling::{AdaptiveResampler, RESAMPLER_LATENCY_FRAMES},
+    time::{
+        Clock,
+        servo::{ClockState, MediaClockServo},
+    },
 };
 use jack::{
     AudioOut, Client, ClientOptions, Control, Port, ProcessScope, contrib::ClosureProcessHandler,
 };
 use miette::IntoDiagnostic;
-use std::{thread, time::Instant};
+use std::{sync::Arc, thread, time::Instant};
 use tokio::sync::mpsc;
 use tosub::SubsystemHandle;
 #[cfg(debug_assertions)]
@@ -38,12 +43,15 @@ use tracing::{error, info};
 
 struct State {
     ports: Vec<Port<AudioOut>>,
+    resamplers: Vec<AdaptiveResampler>,
+    scratch: Vec<Vec<f32>>,
     receiver: ReceiverApi,
-    clock: JackClock,
+    clock: MediaClockServo,
     config: ReceiverConfig,
     muted: bool,
     monitoring: Monitoring,
     subsys: SubsystemHandle,
+    timings: Arc<CycleTimings>,
 }
 
 impl State {}
@@ -54,6 +62,7 @@ pub async fn start_playout(
     receiver: ReceiverApi,
     config: ReceiverConfig,
     clock: Clock,
+    clock_servo: MediaClockServoConfig,
     monitoring: Monitoring,
 ) -> miette::Result<SubsystemHandle> {
     // TODO evaluate client status
@@ -68,7 +77,7 @@ pub async fn start_playout(
 
     let mut ports = vec![];
 
-    for l in config.channel_labels.clone().iter() {
+    for l in config.io_channel_labels() {
         let label = l.to_owned();
         ports.push(
             client
@@ -79,18 +88,24 @@ pub async fn start_playout(
 
     let (tx, notifications) = mpsc::channel(1024);
     let cid = config.label.clone();
+    let timings = Arc::new(CycleTimings::new());
     let notification_handler = SessionManagerNotificationHandler {
         client_id: cid.clone(),
         tx,
+        timings: timings.clone(),
     };
+    let channels = ports.len();
     let process_handler_state = State {
         ports,
+        resamplers: vec![AdaptiveResampler::new(); channels],
+        scratch: vec![vec![0.0; scratch_len(client.buffer_size())]; channels],
         receiver,
-        clock: JackClock::new(clock),
+        clock: MediaClockServo::new(clock, clock_servo, config.audio_format.sample_rate),
         config: config.clone(),
         muted: false,
-        monitoring,
+        monitoring: monitoring.clone(),
         subsys: subsys.clone(),
+        timings: timings.clone(),
     };
     let process_handler =
         ClosureProcessHandler::with_state(process_handler_state, process, buffer_change);
@@ -107,15 +122,31 @@ pub async fn start_playout(
         format!("rx/{}", config.id),
     );
 
+    start_cycle_timing_reporter(
+        &session_manager,
+        format!("rx/{}", config.id),
+        timings,
+        move |timing| monitoring.receiver_stats(RxStats::CycleTiming(timing)),
+    );
+
     Ok(session_manager)
 }
 
-fn buffer_change(_: &mut State, _client: &Client, _buffer_len: jack::Frames) -> Control {
+/// A slewed cycle reads one frame more or less than the JACK buffer holds.
+fn scratch_len(buffer_len: jack::Frames) -> usize {
+    buffer_len as usize + 1
+}
+
+fn buffer_change(state: &mut State, _client: &Client, buffer_len: jack::Frames) -> Control {
+    for buf in state.scratch.iter_mut() {
+        buf.resize(scratch_len(buffer_len), 0.0);
+    }
+
     #[cfg(debug_assertions)]
     {
         use aes67_rs::time::MILLIS_PER_SEC_F;
-        let buffer_ms = _buffer_len as f32 * MILLIS_PER_SEC_F / _client.sample_rate() as f32;
-        info!("JACK buffer size changed to {_buffer_len} frames / {buffer_ms:.1} ms");
+        let buffer_ms = buffer_len as f32 * MILLIS_PER_SEC_F / _client.sample_rate() as f32;
+        info!("JACK buffer size changed to {buffer_len} frames / {buffer_ms:.1} ms");
     }
     Control::Continue
 }
@@ -130,10 +161,18 @@ fn process(state: &mut State, client: &Client, ps: &ProcessScope) -> Control {
 
     let start = Instant::now();
 
-    let max_drift = ps.n_frames() as Frames;
+    let clock_state = state.clock.update_clock(&JackCycle(ps));
+    let clock_read = start.elapsed();
+
+    if let Some(servo) = state.clock.take_telemetry() {
+        state.report_clock_servo(servo);
+    }
 
-    let playout_time = match state.clock.update_clock(client, ps, max_drift, true) {
-        Ok(ClockState::Stable { current_time, .. }) => current_time,
+    let (playout_time, compensation) = match clock_state {
+        Ok(ClockState::Stable {
+            current_time,
+            compensation,
+        }) => (current_time, compensation),
         Ok(ClockState::Unstable) => {
             muted(state, ps);
             return Control::Continue;
@@ -145,19 +184,30 @@ fn process(state: &mut State, client: &Client, ps: &ProcessScope) -> Control {
         }
     };
 
+    // when the JACK clock is slewed, read the frames that were skipped or repeated by the slew and resample
+    // them to fit into the JACK buffer, so the playout stays continuous
     let link_offset_frames = state.config.frames_in_link_offset();
-    let ingress_time = playout_time - link_offset_frames;
+    let read_frames = (ps.n_frames() as i64 + compensation) as usize;
+    let ingress_time = ((playout_time - link_offset_frames) as i64 - compensation) as Frames
+        + RESAMPLER_LATENCY_FRAMES;
+
+    // the scratch buffers are sized in buffer_change, never allocate in the process callback
+    if state.scratch.iter().any(|b| b.len() < read_frames) {
+        muted(state, ps);
+        return Control::Continue;
+    }
 
     let pre_req = Instant::now();
 
     loop {
-        let buffers = state.ports.iter_mut().map(|p| Some(p.as_mut_slice(ps)));
+        let buffers = state
+            .scratch
+            .iter_mut()
+            .map(|b| Some(&mut b[..read_frames]));
 
-        match state
-            .receiver
-            .receive(buffers, ingress_time, ps.n_frames() as usize)
-        {
+        match state.receiver.receive(buffers, ingress_time, read_frames) {
             Ok(ReadResult::Ok(_)) => {
+                resample(state, ps, read_frames);
                 unmuted(state);
                 break;
             }
@@ -191,21 +241,29 @@ fn process(state: &mut State, client: &Client, ps: &ProcessScope) -> Control {
         }
     }
 
-    let post_req = Instant::now();
-
-    // TODO send timing to monitoring
-
-    let _total = post_req.duration_since(start).as_micros();
-    let _req = post_req.duration_since(pre_req).as_micros();
-
-    // if total > 100 {
-    //     eprintln!("latency playout req: {req} µs");
-    //     eprintln!("latency playout total: {total} µs");
-    // }
+    record_cycle(
+        &state.timings,
+        client,
+        ps,
+        start,
+        clock_read,
+        pre_req.elapsed(),
+    );
 
     Control::Continue
 }
 
+fn resample(state: &mut State, ps: &ProcessScope, read_frames: usize) {
+    for ((port, buf), resampler) in state
+        .ports
+        .iter_mut()
+        .zip(state.scratch.iter())
+        .zip(state.resamplers.iter_mut())
+    {
+        resampler.process(&buf[..read_frames], port.as_mut_slice(ps));
+    }
+}
+
 fn muted(state: &mut State, ps: &ProcessScope) {
     if !state.muted {
         state.muted = true;
@@ -216,6 +274,10 @@ fn muted(state: &mut State, ps: &ProcessScope) {
         let buf = port.as_mut_slice(ps);
         buf.fill(0.0);
     }
+
+    for resampler in state.resamplers.iter_mut() {
+        resampler.reset();
+    }
 }
 
 fn unmuted(state: &mut State) {
@@ -226,7 +288,7 @@ fn unmuted(state: &mut State) {
 }
 
 mod monitoring {
-    use aes67_rs::monitoring::RxStats;
+    use aes67_rs::monitoring::MediaClockServoStats;
 
     use super::*;
 
@@ -234,5 +296,10 @@ mod monitoring {
         pub fn report_muted(&self, muted: bool) {
             self.monitoring.receiver_stats(RxStats::Muted(muted));
         }
+
+        pub fn report_clock_servo(&self, servo: MediaClockServoStats) {
+            self.monitoring
+                .receiver_stats(RxStats::MediaClockServo(servo));
+        }
     }
 }
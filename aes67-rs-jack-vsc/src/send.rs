@@ -16,18 +16,24 @@
  */
 
 use crate::{
-    common::{ClockState, JackClock},
+    common::{JackCycle, record_cycle, start_cycle_timing_reporter},
     session_manager::{SessionManagerNotificationHandler, start_session_manager},
 };
 use aes67_rs::{
-    monitoring::Monitoring,
+    config::MediaClockServoConfig,
+    error::SenderInternalError,
+    monitoring::{Monitoring, TxStats, timing::CycleTimings},
     sender::{api::SenderApi, config::SenderConfig},
-    time::Clock,
+    time::{
+        Clock,
+        servo::{ClockState, MediaClockServo},
+    },
 };
 use jack::{
     AudioIn, Client, ClientOptions, Control, Port, ProcessScope, contrib::ClosureProcessHandler,
 };
 use miette::IntoDiagnostic;
+use std::{sync::Arc, time::Instant};
 use tokio::sync::mpsc;
 use tosub::SubsystemHandle;
 #[cfg(debug_assertions)]
@@ -36,9 +42,10 @@ use tracing::{error, info};
 struct State {
     sender: SenderApi,
     ports: Vec<Port<AudioIn>>,
-    clock: JackClock,
+    clock: MediaClockServo,
     subsys: SubsystemHandle,
-    config: SenderConfig,
+    monitoring: Monitoring,
+    timings: Arc<CycleTimings>,
 }
 
 impl Drop for State {
@@ -55,7 +62,8 @@ pub async fn start_recording(
     sender: SenderApi,
     config: SenderConfig,
     clock: Clock,
-    _monitoring: Monitoring,
+    clock_servo: MediaClockServoConfig,
+    monitoring: Monitoring,
 ) -> miette::Result<SubsystemHandle> {
     // TODO evaluate client status
     let (client, _status) =
@@ -68,7 +76,7 @@ pub async fn start_recording(
 
     let mut ports = vec![];
 
-    for l in config.channel_labels.clone().iter() {
+    for l in config.io_channel_labels() {
         let label = l.to_owned();
         ports.push(
             client
@@ -79,13 +87,19 @@ pub async fn start_recording(
 
     let (tx, notifications) = mpsc::channel(1024);
     let client_id = config.label.clone();
-    let notification_handler = SessionManagerNotificationHandler { client_id, tx };
+    let timings = Arc::new(CycleTimings::new());
+    let notification_handler = SessionManagerNotificationHandler {
+        client_id,
+        tx,
+        timings: timings.clone(),
+    };
     let process_handler_state = State {
         sender,
         ports,
-        clock: JackClock::new(clock),
+        clock: MediaClockServo::new(clock, clock_servo, config.audio_format.sample_rate),
         subsys: subsys.clone(),
-        config: config.clone(),
+        monitoring: monitoring.clone(),
+        timings: timings.clone(),
     };
     let process_handler =
         ClosureProcessHandler::with_state(process_handler_state, process, buffer_change);
@@ -101,6 +115,13 @@ pub async fn start_recording(
         format!("tx/{}", config.id),
     );
 
+    start_cycle_timing_reporter(
+        &session_manager,
+        format!("tx/{}", config.id),
+        timings,
+        move |timing| monitoring.sender_stats(TxStats::CycleTiming(timing)),
+    );
+
     Ok(session_manager)
 }
 
@@ -121,12 +142,16 @@ fn process(state: &mut State, client: &Client, ps: &ProcessScope) -> Control {
         return Control::Quit;
     }
 
-    let max_drift = state
-        .config
-        .packet_time
-        .frames(state.config.audio_format.sample_rate);
+    let start = Instant::now();
+
+    let clock_state = state.clock.update_clock(&JackCycle(ps));
+    let clock_read = start.elapsed();
 
-    let (ingress_time, compensation) = match state.clock.update_clock(client, ps, max_drift, true) {
+    if let Some(servo) = state.clock.take_telemetry() {
+        state.report_clock_servo(servo);
+    }
+
+    let (ingress_time, compensation) = match clock_state {
         Ok(ClockState::Stable {
             current_time,
             compensation,
@@ -141,9 +166,15 @@ fn process(state: &mut State, client: &Client, ps: &ProcessScope) -> Control {
         }
     };
 
-    state
-        .sender
-        .start_write(ingress_time, ps.n_frames() as usize, compensation);
+    let pre_write = Instant::now();
+
+    if let Err(SenderInternalError::BlockTooLarge { requested, max }) =
+        state
+            .sender
+            .start_write(ingress_time, ps.n_frames() as usize, compensation)
+    {
+        state.report_block_too_large(requested, max);
+    }
 
     for (ch, port) in state.ports.iter().enumerate() {
         state.sender.write_channel(ch, port.as_slice(ps));
@@ -153,5 +184,32 @@ fn process(state: &mut State, client: &Client, ps: &ProcessScope) -> Control {
         // TODO sender was not ready; send to monitoring
     }
 
+    record_cycle(
+        &state.timings,
+        client,
+        ps,
+        start,
+        clock_read,
+        pre_write.elapsed(),
+    );
+
     Control::Continue
 }
+
+mod monitoring {
+    use aes67_rs::monitoring::MediaClockServoStats;
+
+    use super::*;
+
+    impl State {
+        pub fn report_clock_servo(&self, servo: MediaClockServoStats) {
+            self.monitoring
+                .sender_stats(TxStats::MediaClockServo(servo));
+        }
+
+        pub fn report_block_too_large(&self, requested: usize, max: usize) {
+            self.monitoring
+                .sender_stats(TxStats::BlockTooLarge { requested, max });
+        }
+    }
+}
@@ -15,6 +15,7 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+use aes67_rs::monitoring::timing::CycleTimings;
 use dirs::config_local_dir;
 use jack::{AsyncClient, Client, Control, NotificationHandler, PortId, ProcessHandler};
 use miette::{Context, IntoDiagnostic, Result, miette};
@@ -22,6 +23,7 @@ use serde::{Deserialize, Serialize};
 use std::{
     collections::{BTreeSet, HashMap, hash_map::Entry},
     path::PathBuf,
+    sync::Arc,
 };
 use tokio::{fs, select, sync::mpsc};
 use tosub::SubsystemHandle;
@@ -42,6 +44,7 @@ pub enum Notification {
 pub struct SessionManagerNotificationHandler {
     pub client_id: String,
     pub tx: mpsc::Sender<Notification>,
+    pub timings: Arc<CycleTimings>,
 }
 
 impl NotificationHandler for SessionManagerNotificationHandler {
@@ -114,6 +117,7 @@ impl NotificationHandler for SessionManagerNotificationHandler {
     }
 
     fn xrun(&mut self, _: &Client) -> Control {
+        self.timings.xrun();
         self.tx
             .try_send(Notification::XRun(self.client_id.clone()))
             .ok();
@@ -287,7 +291,6 @@ impl JackNotificationHandler {
                 info!("{}: JACK graph reorder", self.client_name);
             }
             Notification::XRun(client) => {
-                // TODO report playout xrun
                 warn!("{}: JACK buffer xrun in client {client}", self.client_name);
             }
         }
@@ -0,0 +1,214 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use aes67_rs::{
+    error::ClockResult,
+    formats::{Frames, FramesPerSecond, frames_to_duration},
+    time::{Clock, MediaClock},
+};
+use std::{
+    io,
+    time::{Duration, Instant},
+};
+use timerfd::{SetTimeFlags, TimerFd, TimerState};
+use tracing::info;
+
+/// A single cycle of the null backend.
+pub struct Cycle {
+    /// media time of the first frame of the block
+    pub media_time: Frames,
+    /// how many frames after the start of the block the thread actually woke up
+    pub wakeup_latency: Frames,
+    /// number of blocks skipped because the thread fell behind the media clock
+    pub skipped: u64,
+}
+
+/// Wakes up the calling thread once per block of `block_size` frames, aligned to the PTP media clock.
+///
+/// The timer is re-armed every cycle with the remaining time until the next block boundary as measured on
+/// the media clock, so the cycle follows the PTP clock rather than the local monotonic clock.
+pub struct CycleTimer {
+    clock: Clock,
+    timer: TimerFd,
+    block_size: Frames,
+    sample_rate: FramesPerSecond,
+    next_cycle: Option<Frames>,
+}
+
+impl CycleTimer {
+    pub fn new(clock: Clock, block_size: usize, sample_rate: FramesPerSecond) -> io::Result<Self> {
+        Ok(Self {
+            clock,
+            timer: TimerFd::new()?,
+            block_size: block_size as Frames,
+            sample_rate,
+            next_cycle: None,
+        })
+    }
+
+    pub fn wait(&mut self) -> ClockResult<Cycle> {
+        let now = self.clock.current_time()?.media_time;
+        let block_size = self.block_size;
+        let cycle_start = self
+            .next_cycle
+            .unwrap_or((now / block_size + 1) * block_size);
+
+        if cycle_start > now {
+            let wait = frames_to_duration(cycle_start - now, self.sample_rate);
+            if !wait.is_zero() {
+                self.timer
+                    .set_state(TimerState::Oneshot(wait), SetTimeFlags::Default);
+                self.timer.read();
+            }
+        }
+
+        let woke = self.clock.current_time()?.media_time;
+
+        // if the thread fell behind by a whole block or more, skip ahead instead of trying to catch up
+        let (media_time, skipped) = if woke >= cycle_start + block_size {
+            let current = (woke / block_size) * block_size;
+            (current, (current - cycle_start) / block_size)
+        } else {
+            (cycle_start, 0)
+        };
+
+        self.next_cycle = Some(media_time + block_size);
+
+        Ok(Cycle {
+            media_time,
+            wakeup_latency: woke.saturating_sub(media_time),
+            skipped,
+        })
+    }
+}
+
+#[derive(Debug, Default, Clone)]
+struct Summary {
+    count: u64,
+    min: Duration,
+    max: Duration,
+    sum: Duration,
+}
+
+impl Summary {
+    fn record(&mut self, value: Duration) {
+        if self.count == 0 || value < self.min {
+            self.min = value;
+        }
+        self.max = self.max.max(value);
+        self.sum += value;
+        self.count += 1;
+    }
+
+    fn mean(&self) -> Duration {
+        if self.count == 0 {
+            Duration::ZERO
+        } else {
+            self.sum / self.count as u32
+        }
+    }
+}
+
+/// Per-cycle timing of a null backend thread. Values are accumulated over one report interval and over the
+/// whole lifetime of the stream.
+pub struct CycleStats {
+    name: String,
+    block_duration: Duration,
+    report_interval: Duration,
+    last_report: Instant,
+    interval: IntervalStats,
+    total: IntervalStats,
+}
+
+#[derive(Debug, Default, Clone)]
+struct IntervalStats {
+    wakeup_latency: Summary,
+    processing: Summary,
+    overruns: u64,
+    skipped: u64,
+    dropouts: u64,
+}
+
+impl CycleStats {
+    pub fn new(
+        name: String,
+        block_size: usize,
+        sample_rate: FramesPerSecond,
+        report_interval: Duration,
+    ) -> Self {
+        Self {
+            name,
+            block_duration: frames_to_duration(block_size as Frames, sample_rate),
+            report_interval,
+            last_report: Instant::now(),
+            interval: IntervalStats::default(),
+            total: IntervalStats::default(),
+        }
+    }
+
+    /// Records a cycle. `processing` is the time spent in the cycle after waking up, `dropout` whether the
+    /// cycle could not be served with valid audio.
+    pub fn record(
+        &mut self,
+        cycle: &Cycle,
+        sample_rate: FramesPerSecond,
+        processing: Duration,
+        dropout: bool,
+    ) {
+        let wakeup_latency = frames_to_duration(cycle.wakeup_latency, sample_rate);
+        let overrun = processing > self.block_duration;
+        for stats in [&mut self.interval, &mut self.total] {
+            stats.wakeup_latency.record(wakeup_latency);
+            stats.processing.record(processing);
+            stats.skipped += cycle.skipped;
+            if overrun {
+                stats.overruns += 1;
+            }
+            if dropout {
+                stats.dropouts += 1;
+            }
+        }
+
+        if self.last_report.elapsed() >= self.report_interval {
+            self.last_report = Instant::now();
+            log(&self.name, "last interval", &self.interval);
+            self.interval = IntervalStats::default();
+        }
+    }
+}
+
+impl Drop for CycleStats {
+    fn drop(&mut self) {
+        log(&self.name, "total", &self.total);
+    }
+}
+
+fn log(name: &str, period: &str, stats: &IntervalStats) {
+    info!(
+        "{name} ({period}): {} cycles; wake-up latency min/mean/max {:?}/{:?}/{:?}; processing min/mean/max {:?}/{:?}/{:?}; {} overruns, {} skipped, {} dropouts",
+        stats.processing.count,
+        stats.wakeup_latency.min,
+        stats.wakeup_latency.mean(),
+        stats.wakeup_latency.max,
+        stats.processing.min,
+        stats.processing.mean(),
+        stats.processing.max,
+        stats.overruns,
+        stats.skipped,
+        stats.dropouts,
+    );
+}
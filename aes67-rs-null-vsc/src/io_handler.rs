@@ -0,0 +1,357 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use crate::{playout::start_playout, recording::start_recording};
+use aes67_rs::{
+    formats::SessionId,
+    monitoring::Monitoring,
+    receiver::{api::ReceiverApi, config::ReceiverConfig},
+    sender::{api::SenderApi, config::SenderConfig},
+    time::Clock,
+};
+use aes67_rs_vsc_management_agent::{IoHandler, error::IoHandlerResult};
+use miette::{IntoDiagnostic, miette};
+use std::{collections::HashMap, env, time::Duration};
+use tokio::{
+    select,
+    sync::{mpsc, oneshot},
+};
+use tosub::SubsystemHandle;
+use tracing::{error, info, warn};
+
+pub const DEFAULT_BLOCK_SIZE: usize = 64;
+pub const DEFAULT_REPORT_INTERVAL: Duration = Duration::from_secs(10);
+
+#[derive(Debug, Clone)]
+pub struct NullVscConfig {
+    /// Frames per cycle
+    pub block_size: usize,
+    /// Interval between cycle timing summaries
+    pub report_interval: Duration,
+}
+
+impl Default for NullVscConfig {
+    fn default() -> Self {
+        Self {
+            block_size: DEFAULT_BLOCK_SIZE,
+            report_interval: DEFAULT_REPORT_INTERVAL,
+        }
+    }
+}
+
+impl NullVscConfig {
+    pub fn from_env() -> Self {
+        let default = Self::default();
+        Self {
+            block_size: env::var("AES67_NULL_VSC_BLOCK_SIZE")
+                .ok()
+                .and_then(|it| it.parse().ok())
+                .filter(|it| *it > 0)
+                .unwrap_or(default.block_size),
+            report_interval: env::var("AES67_NULL_VSC_REPORT_INTERVAL")
+                .ok()
+                .and_then(|it| it.parse().ok())
+                .map(Duration::from_secs)
+                .unwrap_or(default.report_interval),
+        }
+    }
+}
+
+pub struct NullIoHandlerActor {
+    subsys: SubsystemHandle,
+    tx_clients: HashMap<SessionId, SubsystemHandle>,
+    rx_clients: HashMap<SessionId, SubsystemHandle>,
+    rx: mpsc::Receiver<NullIoHandlerMessage>,
+    config: NullVscConfig,
+}
+
+impl NullIoHandlerActor {
+    pub(crate) fn new(
+        subsys: SubsystemHandle,
+        rx: mpsc::Receiver<NullIoHandlerMessage>,
+        config: NullVscConfig,
+    ) -> Self {
+        Self {
+            subsys,
+            tx_clients: HashMap::new(),
+            rx_clients: HashMap::new(),
+            rx,
+            config,
+        }
+    }
+
+    async fn run(mut self) {
+        info!(
+            "Null I/O handler actor started with a block size of {} frames.",
+            self.config.block_size
+        );
+        loop {
+            select! {
+                recv = self.rx.recv() => if let Some(msg) = recv {
+                    self.process_message(msg).await;
+                } else {
+                    break;
+                },
+                _ = self.subsys.shutdown_requested() => break,
+            }
+        }
+        info!("Null I/O handler actor stopped.");
+    }
+
+    async fn process_message(&mut self, msg: NullIoHandlerMessage) {
+        match msg {
+            NullIoHandlerMessage::SenderCreated(
+                subsys,
+                sender,
+                config,
+                clock,
+                monitoring,
+                resp_tx,
+            ) => {
+                let res = self
+                    .sender_created(subsys, sender, config, clock, monitoring)
+                    .await;
+                let _ = resp_tx.send(res);
+            }
+            NullIoHandlerMessage::SenderUpdated(id, resp_tx) => {
+                let res = self.sender_updated(id).await;
+                let _ = resp_tx.send(res);
+            }
+            NullIoHandlerMessage::SenderDeleted(id, resp_tx) => {
+                let res = self.sender_deleted(id).await;
+                let _ = resp_tx.send(res);
+            }
+            NullIoHandlerMessage::ReceiverCreated(
+                subsys,
+                receiver,
+                config,
+                clock,
+                monitoring,
+                resp_tx,
+            ) => {
+                let res = self
+                    .receiver_created(subsys, receiver, config, clock, monitoring)
+                    .await;
+                let _ = resp_tx.send(res);
+            }
+            NullIoHandlerMessage::ReceiverUpdated(id, resp_tx) => {
+                let res = self.receiver_updated(id).await;
+                let _ = resp_tx.send(res);
+            }
+            NullIoHandlerMessage::ReceiverDeleted(id, resp_tx) => {
+                let res = self.receiver_deleted(id).await;
+                let _ = resp_tx.send(res);
+            }
+        }
+    }
+
+    async fn sender_created(
+        &mut self,
+        subsys: SubsystemHandle,
+        sender: SenderApi,
+        config: SenderConfig,
+        clock: Clock,
+        monitoring: Monitoring,
+    ) -> IoHandlerResult<()> {
+        let id = config.id;
+        let recording = start_recording(
+            subsys,
+            sender,
+            config,
+            clock,
+            self.config.block_size,
+            self.config.report_interval,
+            monitoring,
+        )?;
+        self.tx_clients.insert(id, recording);
+        Ok(())
+    }
+
+    async fn sender_updated(&mut self, _id: SessionId) -> IoHandlerResult<()> {
+        Err(miette!("not implemented").into())
+    }
+
+    async fn sender_deleted(&mut self, id: SessionId) -> IoHandlerResult<()> {
+        let Some(recording) = self.tx_clients.remove(&id) else {
+            error!("No recording found for sender id {}", id);
+            return Ok(());
+        };
+        recording.request_local_shutdown();
+        recording.join().await;
+        Ok(())
+    }
+
+    async fn receiver_created(
+        &mut self,
+        subsys: SubsystemHandle,
+        receiver: ReceiverApi,
+        config: ReceiverConfig,
+        clock: Clock,
+        monitoring: Monitoring,
+    ) -> IoHandlerResult<()> {
+        let id = config.id;
+        let playout = start_playout(
+            subsys,
+            receiver,
+            config,
+            clock,
+            self.config.block_size,
+            self.config.report_interval,
+            monitoring,
+        )?;
+        self.rx_clients.insert(id, playout);
+        Ok(())
+    }
+
+    async fn receiver_updated(&mut self, _id: SessionId) -> IoHandlerResult<()> {
+        Err(miette!("not implemented").into())
+    }
+
+    async fn receiver_deleted(&mut self, id: SessionId) -> IoHandlerResult<()> {
+        let Some(playout) = self.rx_clients.remove(&id) else {
+            error!("No playout found for receiver id {}", id);
+            return Ok(());
+        };
+        playout.request_local_shutdown();
+        playout.join().await;
+        Ok(())
+    }
+}
+
+impl Drop for NullIoHandlerActor {
+    fn drop(&mut self) {
+        warn!("Null I/O handler dropped. Shutting down all playout and recording threads …");
+        for (_, playout) in self.rx_clients.drain() {
+            playout.request_local_shutdown();
+        }
+        for (_, recording) in self.tx_clients.drain() {
+            recording.request_local_shutdown();
+        }
+    }
+}
+
+pub(crate) enum NullIoHandlerMessage {
+    SenderCreated(
+        SubsystemHandle,
+        SenderApi,
+        SenderConfig,
+        Clock,
+        Monitoring,
+        oneshot::Sender<IoHandlerResult<()>>,
+    ),
+    SenderUpdated(SessionId, oneshot::Sender<IoHandlerResult<()>>),
+    SenderDeleted(SessionId, oneshot::Sender<IoHandlerResult<()>>),
+    ReceiverCreated(
+        SubsystemHandle,
+        ReceiverApi,
+        ReceiverConfig,
+        Clock,
+        Monitoring,
+        oneshot::Sender<IoHandlerResult<()>>,
+    ),
+    ReceiverUpdated(SessionId, oneshot::Sender<IoHandlerResult<()>>),
+    ReceiverDeleted(SessionId, oneshot::Sender<IoHandlerResult<()>>),
+}
+
+/// [IoHandler] that does not connect to any audio system. Every receiver and sender is driven by its own
+/// timer thread instead, which makes it possible to benchmark the core without JACK.
+#[derive(Clone)]
+pub struct NullIoHandler {
+    tx: mpsc::Sender<NullIoHandlerMessage>,
+}
+
+impl NullIoHandler {
+    pub fn new(subsys: &SubsystemHandle, config: NullVscConfig) -> Self {
+        let (tx, rx) = mpsc::channel(1);
+
+        subsys.spawn("null_io_handler", |s| async {
+            NullIoHandlerActor::new(s, rx, config).run().await;
+            Ok::<(), miette::Error>(())
+        });
+
+        Self { tx }
+    }
+}
+
+impl IoHandler for NullIoHandler {
+    async fn sender_created(
+        &self,
+        _app_id: String,
+        subsys: SubsystemHandle,
+        sender: SenderApi,
+        config: SenderConfig,
+        clock: Clock,
+        monitoring: Monitoring,
+    ) -> IoHandlerResult<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        let msg =
+            NullIoHandlerMessage::SenderCreated(subsys, sender, config, clock, monitoring, resp_tx);
+        self.tx.send(msg).await.into_diagnostic()?;
+        resp_rx.await.into_diagnostic()??;
+        Ok(())
+    }
+
+    async fn sender_updated(&self, id: SessionId) -> IoHandlerResult<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        let msg = NullIoHandlerMessage::SenderUpdated(id, resp_tx);
+        self.tx.send(msg).await.into_diagnostic()?;
+        resp_rx.await.into_diagnostic()??;
+        Ok(())
+    }
+
+    async fn sender_deleted(&self, id: SessionId) -> IoHandlerResult<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        let msg = NullIoHandlerMessage::SenderDeleted(id, resp_tx);
+        self.tx.send(msg).await.into_diagnostic()?;
+        resp_rx.await.into_diagnostic()??;
+        Ok(())
+    }
+
+    async fn receiver_created(
+        &self,
+        _app_id: String,
+        subsys: SubsystemHandle,
+        receiver: ReceiverApi,
+        config: ReceiverConfig,
+        clock: Clock,
+        monitoring: Monitoring,
+    ) -> IoHandlerResult<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        let msg = NullIoHandlerMessage::ReceiverCreated(
+            subsys, receiver, config, clock, monitoring, resp_tx,
+        );
+        self.tx.send(msg).await.into_diagnostic()?;
+        resp_rx.await.into_diagnostic()??;
+        Ok(())
+    }
+
+    async fn receiver_updated(&mut self, id: SessionId) -> IoHandlerResult<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        let msg = NullIoHandlerMessage::ReceiverUpdated(id, resp_tx);
+        self.tx.send(msg).await.into_diagnostic()?;
+        resp_rx.await.into_diagnostic()??;
+        Ok(())
+    }
+
+    async fn receiver_deleted(&mut self, id: SessionId) -> IoHandlerResult<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        let msg = NullIoHandlerMessage::ReceiverDeleted(id, resp_tx);
+        self.tx.send(msg).await.into_diagnostic()?;
+        resp_rx.await.into_diagnostic()??;
+        Ok(())
+    }
+}
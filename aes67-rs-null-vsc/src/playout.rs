@@ -0,0 +1,189 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use crate::cycle::{CycleStats, CycleTimer};
+use aes67_rs::{
+    buffer::receiver::ReadResult,
+    formats::{Frames, FramesPerSecond, frames_to_duration},
+    monitoring::Monitoring,
+    receiver::{api::ReceiverApi, config::ReceiverConfig},
+    time::Clock,
+    utils::set_realtime_priority,
+};
+use miette::IntoDiagnostic;
+use std::{
+    sync::{
+        Arc,
+        atomic::{AtomicBool, Ordering},
+    },
+    thread,
+    time::{Duration, Instant},
+};
+use tokio::{select, sync::oneshot};
+use tosub::SubsystemHandle;
+use tracing::{error, info};
+
+struct State {
+    receiver: ReceiverApi,
+    buffers: Vec<Vec<f32>>,
+    config: ReceiverConfig,
+    block_size: usize,
+    muted: bool,
+    monitoring: Monitoring,
+}
+
+pub fn start_playout(
+    subsys: SubsystemHandle,
+    receiver: ReceiverApi,
+    config: ReceiverConfig,
+    clock: Clock,
+    block_size: usize,
+    report_interval: Duration,
+    monitoring: Monitoring,
+) -> miette::Result<SubsystemHandle> {
+    let sample_rate = config.audio_format.sample_rate;
+    let timer = CycleTimer::new(clock, block_size, sample_rate).into_diagnostic()?;
+    let stats = CycleStats::new(
+        format!("playout '{}'", config.label),
+        block_size,
+        sample_rate,
+        report_interval,
+    );
+    let channels = config.io_channels();
+    let state = State {
+        receiver,
+        buffers: vec![vec![0.0; block_size]; channels],
+        config: config.clone(),
+        block_size,
+        muted: false,
+        monitoring,
+    };
+
+    Ok(
+        subsys.spawn(format!("null_playout/rx/{}", config.id), async move |s| {
+            let (tx, mut rx) = oneshot::channel();
+            let exit = Arc::new(AtomicBool::new(false));
+            let exit_clone = exit.clone();
+
+            thread::spawn(move || {
+                set_realtime_priority();
+                let res = run(state, timer, stats, exit_clone);
+                tx.send(res).ok();
+            });
+
+            select! {
+                _ = s.shutdown_requested() => {
+                    exit.store(true, Ordering::SeqCst);
+                    // wait for the thread so the receiver is not used after it has been deleted
+                    (&mut rx).await.into_diagnostic()?
+                }
+                res = &mut rx => {
+                    s.request_local_shutdown();
+                    res.into_diagnostic()?
+                }
+            }
+        }),
+    )
+}
+
+fn run(
+    mut state: State,
+    mut timer: CycleTimer,
+    mut stats: CycleStats,
+    exit: Arc<AtomicBool>,
+) -> miette::Result<()> {
+    info!("Null playout '{}' started.", state.config.label);
+
+    let sample_rate = state.config.audio_format.sample_rate;
+    let link_offset_frames = state.config.frames_in_link_offset();
+
+    while !exit.load(Ordering::SeqCst) {
+        let cycle = match timer.wait() {
+            Ok(it) => it,
+            Err(e) => {
+                error!("Could not get current media time: {e}");
+                return Err(miette::miette!("clock error: {e}"));
+            }
+        };
+
+        let start = Instant::now();
+        let ingress_time = cycle.media_time - link_offset_frames;
+        let dropout = !process(&mut state, ingress_time, sample_rate);
+        stats.record(&cycle, sample_rate, start.elapsed(), dropout);
+    }
+
+    info!("Null playout '{}' stopped.", state.config.label);
+
+    Ok(())
+}
+
+/// Reads one block from the receiver, same as the JACK process callback. Returns false if no valid audio
+/// could be read.
+fn process(state: &mut State, ingress_time: Frames, sample_rate: FramesPerSecond) -> bool {
+    let block_size = state.block_size;
+
+    loop {
+        let buffers = state.buffers.iter_mut().map(|b| Some(&mut b[..]));
+
+        match state.receiver.receive(buffers, ingress_time, block_size) {
+            Ok(ReadResult::Ok(_)) => {
+                unmuted(state);
+                return true;
+            }
+            Ok(ReadResult::NotReady(missing)) => {
+                // clock is likely not synced yet
+                if missing > block_size {
+                    muted(state);
+                    return false;
+                }
+
+                // yield thread and re-try
+                thread::sleep(frames_to_duration(missing as Frames / 10, sample_rate));
+            }
+            Ok(ReadResult::TooLate) | Err(_) => {
+                muted(state);
+                return false;
+            }
+        }
+    }
+}
+
+fn muted(state: &mut State) {
+    if !state.muted {
+        state.muted = true;
+        state.report_muted(true);
+    }
+}
+
+fn unmuted(state: &mut State) {
+    if state.muted {
+        state.muted = false;
+        state.report_muted(false);
+    }
+}
+
+mod monitoring {
+    use aes67_rs::monitoring::RxStats;
+
+    use super::*;
+
+    impl State {
+        pub fn report_muted(&self, muted: bool) {
+            self.monitoring.receiver_stats(RxStats::Muted(muted));
+        }
+    }
+}
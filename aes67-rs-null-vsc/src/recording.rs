@@ -0,0 +1,183 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use crate::cycle::{CycleStats, CycleTimer};
+use aes67_rs::{
+    error::SenderInternalError,
+    monitoring::Monitoring,
+    sender::{api::SenderApi, config::SenderConfig},
+    time::Clock,
+    utils::set_realtime_priority,
+};
+use miette::IntoDiagnostic;
+use std::{
+    f32::consts::TAU,
+    sync::{
+        Arc,
+        atomic::{AtomicBool, Ordering},
+    },
+    thread,
+    time::{Duration, Instant},
+};
+use tokio::{select, sync::oneshot};
+use tosub::SubsystemHandle;
+use tracing::{error, info};
+
+/// Frequency of the test tone in Hz
+const TONE_FREQUENCY: f32 = 1_000.0;
+/// Amplitude of the test tone, -20 dBFS
+const TONE_AMPLITUDE: f32 = 0.1;
+
+struct State {
+    sender: SenderApi,
+    config: SenderConfig,
+    tone: Vec<f32>,
+    phase: f32,
+    monitoring: Monitoring,
+}
+
+impl Drop for State {
+    fn drop(&mut self) {
+        self.sender.stop();
+    }
+}
+
+pub fn start_recording(
+    subsys: SubsystemHandle,
+    sender: SenderApi,
+    config: SenderConfig,
+    clock: Clock,
+    block_size: usize,
+    report_interval: Duration,
+    monitoring: Monitoring,
+) -> miette::Result<SubsystemHandle> {
+    let sample_rate = config.audio_format.sample_rate;
+    let timer = CycleTimer::new(clock, block_size, sample_rate).into_diagnostic()?;
+    let stats = CycleStats::new(
+        format!("recording '{}'", config.label),
+        block_size,
+        sample_rate,
+        report_interval,
+    );
+    let state = State {
+        sender,
+        config: config.clone(),
+        tone: vec![0.0; block_size],
+        phase: 0.0,
+        monitoring,
+    };
+
+    Ok(
+        subsys.spawn(format!("null_recording/tx/{}", config.id), async move |s| {
+            let (tx, mut rx) = oneshot::channel();
+            let exit = Arc::new(AtomicBool::new(false));
+            let exit_clone = exit.clone();
+
+            thread::spawn(move || {
+                set_realtime_priority();
+                let res = run(state, timer, stats, exit_clone);
+                tx.send(res).ok();
+            });
+
+            select! {
+                _ = s.shutdown_requested() => {
+                    exit.store(true, Ordering::SeqCst);
+                    // wait for the thread so the sender is not used after it has been deleted
+                    (&mut rx).await.into_diagnostic()?
+                }
+                res = &mut rx => {
+                    s.request_local_shutdown();
+                    res.into_diagnostic()?
+                }
+            }
+        }),
+    )
+}
+
+fn run(
+    mut state: State,
+    mut timer: CycleTimer,
+    mut stats: CycleStats,
+    exit: Arc<AtomicBool>,
+) -> miette::Result<()> {
+    info!("Null recording '{}' started.", state.config.label);
+
+    let sample_rate = state.config.audio_format.sample_rate;
+
+    while !exit.load(Ordering::SeqCst) {
+        let cycle = match timer.wait() {
+            Ok(it) => it,
+            Err(e) => {
+                error!("Could not get current media time: {e}");
+                return Err(miette::miette!("clock error: {e}"));
+            }
+        };
+
+        let start = Instant::now();
+        let dropout = !process(&mut state, cycle.media_time);
+        stats.record(&cycle, sample_rate, start.elapsed(), dropout);
+    }
+
+    info!("Null recording '{}' stopped.", state.config.label);
+
+    Ok(())
+}
+
+/// Writes one block of the test tone to every channel of the sender, same as the JACK process callback.
+/// Returns false if the sender could not take the block.
+fn process(state: &mut State, ingress_time: u64) -> bool {
+    let step = TAU * TONE_FREQUENCY / state.config.audio_format.sample_rate as f32;
+    for sample in state.tone.iter_mut() {
+        *sample = TONE_AMPLITUDE * state.phase.sin();
+        state.phase = (state.phase + step) % TAU;
+    }
+
+    if let Err(SenderInternalError::BlockTooLarge { requested, max }) =
+        state.sender.start_write(ingress_time, state.tone.len(), 0)
+    {
+        state.report_block_too_large(requested, max);
+        return false;
+    }
+
+    for ch in 0..state.config.io_channels() {
+        state.sender.write_channel(ch, &state.tone);
+    }
+
+    if state.sender.end_write().is_err() {
+        state.report_buffer_overflow();
+        return false;
+    }
+
+    true
+}
+
+mod monitoring {
+    use aes67_rs::monitoring::TxStats;
+
+    use super::*;
+
+    impl State {
+        pub fn report_buffer_overflow(&self) {
+            self.monitoring.sender_stats(TxStats::BufferOverflow);
+        }
+
+        pub fn report_block_too_large(&self, requested: usize, max: usize) {
+            self.monitoring
+                .sender_stats(TxStats::BlockTooLarge { requested, max });
+        }
+    }
+}
@@ -0,0 +1,120 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use aes67_rs::{formats::FramesPerSecond, time::servo::AudioCycle};
+use pipewire::{
+    spa::{
+        param::{
+            ParamType,
+            audio::{AudioFormat, AudioInfoRaw},
+        },
+        pod::{Object, Value, serialize::PodSerializer},
+        utils::SpaTypes,
+    },
+    stream::StreamRef,
+    sys::{pw_stream_get_time_n, pw_time},
+};
+use std::{io::Cursor, mem};
+
+/// Largest quantum PipeWire uses by default (`default.clock.max-quantum`). Scratch buffers are allocated for
+/// this size up front, so quantum changes never allocate on the RT thread.
+pub const MAX_QUANTUM: usize = 8192;
+
+/// Timing of the current PipeWire graph cycle, see [AudioCycle].
+pub struct PipeWireCycle {
+    ticks: u64,
+    cycle_start_nanos: i64,
+    sample_rate: FramesPerSecond,
+    n_frames: u32,
+}
+
+impl PipeWireCycle {
+    pub fn current(stream: &StreamRef, sample_rate: FramesPerSecond, n_frames: u32) -> Self {
+        let mut time: pw_time = unsafe { mem::zeroed() };
+        unsafe {
+            pw_stream_get_time_n(stream.as_raw_ptr(), &mut time, mem::size_of::<pw_time>());
+        }
+
+        // ticks are counted in units of the graph rate, which is forced to the stream rate, but convert
+        // anyway in case the graph runs at a different rate
+        let ticks = if time.rate.denom > 0 {
+            (time.ticks as u128 * time.rate.num as u128 * sample_rate as u128
+                / time.rate.denom as u128) as u64
+        } else {
+            time.ticks
+        };
+
+        Self {
+            ticks,
+            cycle_start_nanos: time.now,
+            sample_rate,
+            n_frames,
+        }
+    }
+}
+
+impl AudioCycle for PipeWireCycle {
+    fn last_frame_time(&self) -> u32 {
+        self.ticks as u32
+    }
+
+    fn frames_since_cycle_start(&self) -> u32 {
+        let elapsed = (monotonic_nanos() - self.cycle_start_nanos).max(0) as u128;
+        (elapsed * self.sample_rate as u128 / 1_000_000_000) as u32
+    }
+
+    fn n_frames(&self) -> u32 {
+        self.n_frames
+    }
+}
+
+fn monotonic_nanos() -> i64 {
+    let mut ts = libc::timespec {
+        tv_sec: 0,
+        tv_nsec: 0,
+    };
+    unsafe {
+        libc::clock_gettime(libc::CLOCK_MONOTONIC, &mut ts);
+    }
+    ts.tv_sec * 1_000_000_000 + ts.tv_nsec
+}
+
+/// Serialized `EnumFormat` param for a planar 32 bit float stream with the given rate and channel count.
+pub fn format_param(sample_rate: FramesPerSecond, channels: usize) -> Vec<u8> {
+    let mut audio_info = AudioInfoRaw::new();
+    audio_info.set_format(AudioFormat::F32P);
+    audio_info.set_rate(sample_rate);
+    audio_info.set_channels(channels as u32);
+
+    let obj = Object {
+        type_: SpaTypes::ObjectParamFormat.as_raw(),
+        id: ParamType::EnumFormat.as_raw(),
+        properties: audio_info.into(),
+    };
+
+    PodSerializer::serialize(Cursor::new(Vec::new()), &Value::Object(obj))
+        .expect("serializing a static pod can't fail")
+        .0
+        .into_inner()
+}
+
+/// Interprets the memory of a mapped buffer plane as float samples.
+pub fn as_samples(data: &mut [u8]) -> &mut [f32] {
+    // planes of F32P buffers are always aligned to the sample size
+    let (_, samples, _) = unsafe { data.align_to_mut::<f32>() };
+    samples
+}
@@ -0,0 +1,197 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use crate::{
+    playout::{self, PlayoutParams, create_playout_stream},
+    recording::{self, RecordingParams, create_recording_stream},
+};
+use aes67_rs::formats::SessionId;
+use miette::{IntoDiagnostic, miette};
+use pipewire::{
+    context::Context,
+    core::Core,
+    main_loop::MainLoop,
+    stream::{Stream, StreamListener},
+};
+use std::{cell::RefCell, collections::HashMap, rc::Rc, thread};
+use tokio::sync::oneshot;
+#[cfg(debug_assertions)]
+use tracing::info;
+use tracing::{error, warn};
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub(crate) enum StreamKey {
+    Playout(SessionId),
+    Recording(SessionId),
+}
+
+pub(crate) enum GraphCommand {
+    CreatePlayout(PlayoutParams, oneshot::Sender<miette::Result<()>>),
+    CreateRecording(RecordingParams, oneshot::Sender<miette::Result<()>>),
+    Destroy(StreamKey, oneshot::Sender<()>),
+    Terminate,
+}
+
+enum ActiveStream {
+    Playout(Stream, StreamListener<playout::State>),
+    Recording(Stream, StreamListener<recording::State>),
+}
+
+impl ActiveStream {
+    fn stream(&self) -> &Stream {
+        match self {
+            ActiveStream::Playout(stream, _) => stream,
+            ActiveStream::Recording(stream, _) => stream,
+        }
+    }
+}
+
+impl Drop for ActiveStream {
+    fn drop(&mut self) {
+        // make sure the process callback is not running anymore before the listener and its state are dropped
+        if let Err(e) = self.stream().disconnect() {
+            warn!("Could not disconnect PipeWire stream: {e}");
+        }
+    }
+}
+
+/// Handle to the thread that owns the PipeWire connection. All streams are created and destroyed on that
+/// thread, since PipeWire objects must not leave the thread of their main loop.
+#[derive(Clone)]
+pub(crate) struct Graph {
+    tx: pipewire::channel::Sender<GraphCommand>,
+}
+
+impl Graph {
+    pub fn start() -> miette::Result<Self> {
+        let (tx, rx) = pipewire::channel::channel::<GraphCommand>();
+        let (init_tx, init_rx) = std::sync::mpsc::channel();
+
+        thread::Builder::new()
+            .name("pipewire".to_owned())
+            .spawn(move || {
+                if let Err(e) = run(rx, &init_tx) {
+                    error!("PipeWire main loop failed: {e}");
+                    init_tx.send(Err(e)).ok();
+                }
+            })
+            .into_diagnostic()?;
+
+        init_rx.recv().into_diagnostic()??;
+
+        Ok(Self { tx })
+    }
+
+    pub async fn create_playout(&self, params: PlayoutParams) -> miette::Result<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        self.send(GraphCommand::CreatePlayout(params, resp_tx))?;
+        resp_rx.await.into_diagnostic()?
+    }
+
+    pub async fn create_recording(&self, params: RecordingParams) -> miette::Result<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        self.send(GraphCommand::CreateRecording(params, resp_tx))?;
+        resp_rx.await.into_diagnostic()?
+    }
+
+    pub async fn destroy(&self, key: StreamKey) -> miette::Result<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        self.send(GraphCommand::Destroy(key, resp_tx))?;
+        resp_rx.await.into_diagnostic()
+    }
+
+    pub fn terminate(&self) {
+        self.send(GraphCommand::Terminate).ok();
+    }
+
+    fn send(&self, cmd: GraphCommand) -> miette::Result<()> {
+        self.tx
+            .send(cmd)
+            .map_err(|_| miette!("PipeWire main loop is not running"))
+    }
+}
+
+fn run(
+    rx: pipewire::channel::Receiver<GraphCommand>,
+    init_tx: &std::sync::mpsc::Sender<miette::Result<()>>,
+) -> miette::Result<()> {
+    pipewire::init();
+
+    let mainloop = MainLoop::new(None).into_diagnostic()?;
+    let context = Context::new(&mainloop).into_diagnostic()?;
+    let core = context.connect(None).into_diagnostic()?;
+
+    #[cfg(debug_assertions)]
+    info!("Connected to PipeWire.");
+
+    let streams = Rc::new(RefCell::new(HashMap::<StreamKey, ActiveStream>::new()));
+
+    let ml = mainloop.clone();
+    let _receiver = rx.attach(mainloop.loop_(), move |cmd| {
+        process_command(cmd, &core, &streams, &ml)
+    });
+
+    init_tx.send(Ok(())).ok();
+
+    mainloop.run();
+
+    #[cfg(debug_assertions)]
+    info!("PipeWire main loop stopped.");
+
+    Ok(())
+}
+
+fn process_command(
+    cmd: GraphCommand,
+    core: &Core,
+    streams: &RefCell<HashMap<StreamKey, ActiveStream>>,
+    mainloop: &MainLoop,
+) {
+    match cmd {
+        GraphCommand::CreatePlayout(params, resp_tx) => {
+            let key = StreamKey::Playout(params.config.id);
+            let res = create_playout_stream(core, params)
+                .map(|(stream, listener)| {
+                    streams
+                        .borrow_mut()
+                        .insert(key, ActiveStream::Playout(stream, listener));
+                })
+                .map_err(|e| miette!("Could not create PipeWire playout stream: {e}"));
+            resp_tx.send(res).ok();
+        }
+        GraphCommand::CreateRecording(params, resp_tx) => {
+            let key = StreamKey::Recording(params.config.id);
+            let res = create_recording_stream(core, params)
+                .map(|(stream, listener)| {
+                    streams
+                        .borrow_mut()
+                        .insert(key, ActiveStream::Recording(stream, listener));
+                })
+                .map_err(|e| miette!("Could not create PipeWire recording stream: {e}"));
+            resp_tx.send(res).ok();
+        }
+        GraphCommand::Destroy(key, resp_tx) => {
+            let stream = streams.borrow_mut().remove(&key);
+            drop(stream);
+            resp_tx.send(()).ok();
+        }
+        GraphCommand::Terminate => {
+            streams.borrow_mut().clear();
+            mainloop.quit();
+        }
+    }
+}
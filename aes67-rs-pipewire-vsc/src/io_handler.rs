@@ -0,0 +1,352 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use crate::{
+    graph::{Graph, StreamKey},
+    playout::PlayoutParams,
+    recording::RecordingParams,
+};
+use aes67_rs::{
+    config::MediaClockServoConfig,
+    formats::SessionId,
+    monitoring::Monitoring,
+    receiver::{api::ReceiverApi, config::ReceiverConfig},
+    sender::{api::SenderApi, config::SenderConfig},
+    time::Clock,
+};
+use aes67_rs_vsc_management_agent::{IoHandler, error::IoHandlerResult};
+use miette::{IntoDiagnostic, miette};
+use std::collections::HashMap;
+use tokio::{
+    select,
+    sync::{mpsc, oneshot},
+};
+use tosub::SubsystemHandle;
+use tracing::{error, info, warn};
+
+pub struct PipeWireIoHandlerActor {
+    subsys: SubsystemHandle,
+    graph: Graph,
+    tx_clients: HashMap<SessionId, SubsystemHandle>,
+    rx_clients: HashMap<SessionId, SubsystemHandle>,
+    rx: mpsc::Receiver<PipeWireIoHandlerMessage>,
+    clock_servo: MediaClockServoConfig,
+}
+
+impl PipeWireIoHandlerActor {
+    pub(crate) fn new(
+        subsys: SubsystemHandle,
+        graph: Graph,
+        rx: mpsc::Receiver<PipeWireIoHandlerMessage>,
+        clock_servo: MediaClockServoConfig,
+    ) -> Self {
+        Self {
+            subsys,
+            graph,
+            tx_clients: HashMap::new(),
+            rx_clients: HashMap::new(),
+            rx,
+            clock_servo,
+        }
+    }
+
+    async fn run(mut self) {
+        info!("PipeWire I/O handler actor started.");
+        loop {
+            select! {
+                recv = self.rx.recv() => if let Some(msg) = recv {
+                    self.process_message(msg).await;
+                } else {
+                    break;
+                },
+                _ = self.subsys.shutdown_requested() => break,
+            }
+        }
+        info!("PipeWire I/O handler actor stopped.");
+    }
+
+    async fn process_message(&mut self, msg: PipeWireIoHandlerMessage) {
+        match msg {
+            PipeWireIoHandlerMessage::SenderCreated(
+                subsys,
+                sender,
+                config,
+                clock,
+                monitoring,
+                resp_tx,
+            ) => {
+                let res = self
+                    .sender_created(subsys, sender, config, clock, monitoring)
+                    .await;
+                let _ = resp_tx.send(res);
+            }
+            PipeWireIoHandlerMessage::SenderUpdated(id, resp_tx) => {
+                let res = self.sender_updated(id).await;
+                let _ = resp_tx.send(res);
+            }
+            PipeWireIoHandlerMessage::SenderDeleted(id, resp_tx) => {
+                let res = self.sender_deleted(id).await;
+                let _ = resp_tx.send(res);
+            }
+            PipeWireIoHandlerMessage::ReceiverCreated(
+                subsys,
+                receiver,
+                config,
+                clock,
+                monitoring,
+                resp_tx,
+            ) => {
+                let res = self
+                    .receiver_created(subsys, receiver, config, clock, monitoring)
+                    .await;
+                let _ = resp_tx.send(res);
+            }
+            PipeWireIoHandlerMessage::ReceiverUpdated(id, resp_tx) => {
+                let res = self.receiver_updated(id).await;
+                let _ = resp_tx.send(res);
+            }
+            PipeWireIoHandlerMessage::ReceiverDeleted(id, resp_tx) => {
+                let res = self.receiver_deleted(id).await;
+                let _ = resp_tx.send(res);
+            }
+        }
+    }
+
+    async fn sender_created(
+        &mut self,
+        subsys: SubsystemHandle,
+        sender: SenderApi,
+        config: SenderConfig,
+        clock: Clock,
+        monitoring: Monitoring,
+    ) -> IoHandlerResult<()> {
+        let id = config.id;
+        self.graph
+            .create_recording(RecordingParams {
+                subsys: subsys.clone(),
+                sender,
+                config,
+                clock,
+                clock_servo: self.clock_servo.clone(),
+                monitoring,
+            })
+            .await?;
+        let recording = self.watch_stream(&subsys, format!("tx/{id}"), StreamKey::Recording(id));
+        self.tx_clients.insert(id, recording);
+        Ok(())
+    }
+
+    async fn sender_updated(&mut self, _id: SessionId) -> IoHandlerResult<()> {
+        Err(miette!("not implemented").into())
+    }
+
+    async fn sender_deleted(&mut self, id: SessionId) -> IoHandlerResult<()> {
+        let Some(recording) = self.tx_clients.remove(&id) else {
+            error!("No recording found for sender id {}", id);
+            return Ok(());
+        };
+        recording.request_local_shutdown();
+        recording.join().await;
+        Ok(())
+    }
+
+    async fn receiver_created(
+        &mut self,
+        subsys: SubsystemHandle,
+        receiver: ReceiverApi,
+        config: ReceiverConfig,
+        clock: Clock,
+        monitoring: Monitoring,
+    ) -> IoHandlerResult<()> {
+        let id = config.id;
+        self.graph
+            .create_playout(PlayoutParams {
+                subsys: subsys.clone(),
+                receiver,
+                config,
+                clock,
+                clock_servo: self.clock_servo.clone(),
+                monitoring,
+            })
+            .await?;
+        let playout = self.watch_stream(&subsys, format!("rx/{id}"), StreamKey::Playout(id));
+        self.rx_clients.insert(id, playout);
+        Ok(())
+    }
+
+    async fn receiver_updated(&mut self, _id: SessionId) -> IoHandlerResult<()> {
+        Err(miette!("not implemented").into())
+    }
+
+    async fn receiver_deleted(&mut self, id: SessionId) -> IoHandlerResult<()> {
+        let Some(playout) = self.rx_clients.remove(&id) else {
+            error!("No playout found for receiver id {}", id);
+            return Ok(());
+        };
+        playout.request_local_shutdown();
+        playout.join().await;
+        Ok(())
+    }
+
+    /// Spawns a subsystem that owns the PipeWire stream with the given key and destroys the stream once it
+    /// is shut down. Joining the subsystem guarantees that the process callback has stopped.
+    fn watch_stream(
+        &self,
+        subsys: &SubsystemHandle,
+        name: String,
+        key: StreamKey,
+    ) -> SubsystemHandle {
+        let graph = self.graph.clone();
+        subsys.spawn(format!("pipewire_stream/{name}"), async move |s| {
+            s.shutdown_requested().await;
+            graph.destroy(key).await
+        })
+    }
+}
+
+impl Drop for PipeWireIoHandlerActor {
+    fn drop(&mut self) {
+        warn!("PipeWire I/O handler dropped. Shutting down all playout and recording streams …");
+        for (_, playout) in self.rx_clients.drain() {
+            playout.request_local_shutdown();
+        }
+        for (_, recording) in self.tx_clients.drain() {
+            recording.request_local_shutdown();
+        }
+    }
+}
+
+pub(crate) enum PipeWireIoHandlerMessage {
+    SenderCreated(
+        SubsystemHandle,
+        SenderApi,
+        SenderConfig,
+        Clock,
+        Monitoring,
+        oneshot::Sender<IoHandlerResult<()>>,
+    ),
+    SenderUpdated(SessionId, oneshot::Sender<IoHandlerResult<()>>),
+    SenderDeleted(SessionId, oneshot::Sender<IoHandlerResult<()>>),
+    ReceiverCreated(
+        SubsystemHandle,
+        ReceiverApi,
+        ReceiverConfig,
+        Clock,
+        Monitoring,
+        oneshot::Sender<IoHandlerResult<()>>,
+    ),
+    ReceiverUpdated(SessionId, oneshot::Sender<IoHandlerResult<()>>),
+    ReceiverDeleted(SessionId, oneshot::Sender<IoHandlerResult<()>>),
+}
+
+/// [IoHandler] that exposes receivers and senders as native PipeWire streams.
+#[derive(Clone)]
+pub struct PipeWireIoHandler {
+    tx: mpsc::Sender<PipeWireIoHandlerMessage>,
+}
+
+impl PipeWireIoHandler {
+    pub fn new(
+        subsys: &SubsystemHandle,
+        clock_servo: MediaClockServoConfig,
+    ) -> miette::Result<Self> {
+        let (tx, rx) = mpsc::channel(1);
+
+        let graph = Graph::start()?;
+
+        subsys.spawn("pipewire_io_handler", |s| async move {
+            let g = graph.clone();
+            PipeWireIoHandlerActor::new(s, graph, rx, clock_servo)
+                .run()
+                .await;
+            g.terminate();
+            Ok::<(), miette::Error>(())
+        });
+
+        Ok(Self { tx })
+    }
+}
+
+impl IoHandler for PipeWireIoHandler {
+    async fn sender_created(
+        &self,
+        _app_id: String,
+        subsys: SubsystemHandle,
+        sender: SenderApi,
+        config: SenderConfig,
+        clock: Clock,
+        monitoring: Monitoring,
+    ) -> IoHandlerResult<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        let msg = PipeWireIoHandlerMessage::SenderCreated(
+            subsys, sender, config, clock, monitoring, resp_tx,
+        );
+        self.tx.send(msg).await.into_diagnostic()?;
+        resp_rx.await.into_diagnostic()??;
+        Ok(())
+    }
+
+    async fn sender_updated(&self, id: SessionId) -> IoHandlerResult<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        let msg = PipeWireIoHandlerMessage::SenderUpdated(id, resp_tx);
+        self.tx.send(msg).await.into_diagnostic()?;
+        resp_rx.await.into_diagnostic()??;
+        Ok(())
+    }
+
+    async fn sender_deleted(&self, id: SessionId) -> IoHandlerResult<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        let msg = PipeWireIoHandlerMessage::SenderDeleted(id, resp_tx);
+        self.tx.send(msg).await.into_diagnostic()?;
+        resp_rx.await.into_diagnostic()??;
+        Ok(())
+    }
+
+    async fn receiver_created(
+        &self,
+        _app_id: String,
+        subsys: SubsystemHandle,
+        receiver: ReceiverApi,
+        config: ReceiverConfig,
+        clock: Clock,
+        monitoring: Monitoring,
+    ) -> IoHandlerResult<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        let msg = PipeWireIoHandlerMessage::ReceiverCreated(
+            subsys, receiver, config, clock, monitoring, resp_tx,
+        );
+        self.tx.send(msg).await.into_diagnostic()?;
+        resp_rx.await.into_diagnostic()??;
+        Ok(())
+    }
+
+    async fn receiver_updated(&mut self, id: SessionId) -> IoHandlerResult<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        let msg = PipeWireIoHandlerMessage::ReceiverUpdated(id, resp_tx);
+        self.tx.send(msg).await.into_diagnostic()?;
+        resp_rx.await.into_diagnostic()??;
+        Ok(())
+    }
+
+    async fn receiver_deleted(&mut self, id: SessionId) -> IoHandlerResult<()> {
+        let (resp_tx, resp_rx) = oneshot::channel();
+        let msg = PipeWireIoHandlerMessage::ReceiverDeleted(id, resp_tx);
+        self.tx.send(msg).await.into_diagnostic()?;
+        resp_rx.await.into_diagnostic()??;
+        Ok(())
+    }
+}
@@ -0,0 +1,270 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use crate::common::{MAX_QUANTUM, PipeWireCycle, as_samples, format_param};
+use aes67_rs::{
+    buffer::receiver::ReadResult,
+    config::MediaClockServoConfig,
+    formats::{Frames, frames_to_duration},
+    monitoring::Monitoring,
+    receiver::{api::ReceiverApi, config::ReceiverConfig},
+    resampling::{AdaptiveResampler, RESAMPLER_LATENCY_FRAMES},
+    time::{
+        Clock,
+        servo::{ClockState, MediaClockServo},
+    },
+};
+use pipewire::{
+    core::Core,
+    keys,
+    properties::properties,
+    spa::{buffer::Data, pod::Pod, utils::Direction},
+    stream::{Stream, StreamFlags, StreamListener, StreamRef},
+};
+use std::thread;
+use tosub::SubsystemHandle;
+#[cfg(debug_assertions)]
+use tracing::error;
+
+pub(crate) struct PlayoutParams {
+    pub subsys: SubsystemHandle,
+    pub receiver: ReceiverApi,
+    pub config: ReceiverConfig,
+    pub clock: Clock,
+    pub clock_servo: MediaClockServoConfig,
+    pub monitoring: Monitoring,
+}
+
+pub(crate) struct State {
+    resamplers: Vec<AdaptiveResampler>,
+    scratch: Vec<Vec<f32>>,
+    receiver: ReceiverApi,
+    clock: MediaClockServo,
+    config: ReceiverConfig,
+    muted: bool,
+    monitoring: Monitoring,
+    subsys: SubsystemHandle,
+}
+
+/// Creates a PipeWire output stream that plays out the audio of an AES67 receiver.
+pub(crate) fn create_playout_stream(
+    core: &Core,
+    params: PlayoutParams,
+) -> Result<(Stream, StreamListener<State>), pipewire::Error> {
+    let PlayoutParams {
+        subsys,
+        receiver,
+        config,
+        clock,
+        clock_servo,
+        monitoring,
+    } = params;
+
+    let channels = config.io_channels();
+    let sample_rate = config.audio_format.sample_rate;
+
+    let stream = Stream::new(
+        core,
+        &config.label,
+        properties! {
+            *keys::MEDIA_TYPE => "Audio",
+            *keys::MEDIA_CATEGORY => "Playback",
+            *keys::MEDIA_CLASS => "Audio/Source",
+            *keys::NODE_NAME => format!("aes67-rx-{}", config.id),
+            *keys::NODE_DESCRIPTION => config.label.clone(),
+            *keys::NODE_RATE => format!("1/{sample_rate}"),
+            *keys::NODE_ALWAYS_PROCESS => "true",
+        },
+    )?;
+
+    let state = State {
+        resamplers: vec![AdaptiveResampler::new(); channels],
+        // one extra frame for the clock compensation
+        scratch: vec![vec![0.0; MAX_QUANTUM + 1]; channels],
+        receiver,
+        clock: MediaClockServo::new(clock, clock_servo, sample_rate),
+        config: config.clone(),
+        muted: false,
+        monitoring,
+        subsys,
+    };
+
+    let listener = stream
+        .add_local_listener_with_user_data(state)
+        .process(process)
+        .register()?;
+
+    let format = format_param(sample_rate, channels);
+    let mut params = [Pod::from_bytes(&format).expect("serialized pod is valid")];
+
+    stream.connect(
+        Direction::Output,
+        None,
+        StreamFlags::AUTOCONNECT | StreamFlags::MAP_BUFFERS | StreamFlags::RT_PROCESS,
+        &mut params,
+    )?;
+
+    Ok((stream, listener))
+}
+
+fn process(stream: &StreamRef, state: &mut State) {
+    let Some(mut buffer) = stream.dequeue_buffer() else {
+        return;
+    };
+
+    // the quantum may change at any time, the number of frames requested in this cycle is all that counts
+    let requested = buffer.requested() as usize;
+    let datas = buffer.datas_mut();
+    let max_frames = datas
+        .iter()
+        .map(|d| d.as_raw().maxsize as usize / size_of::<f32>())
+        .min()
+        .unwrap_or(0);
+    let n_frames = if requested > 0 {
+        requested.min(max_frames)
+    } else {
+        max_frames
+    }
+    .min(MAX_QUANTUM);
+
+    for data in datas.iter_mut() {
+        let chunk = data.chunk_mut();
+        *chunk.offset_mut() = 0;
+        *chunk.stride_mut() = size_of::<f32>() as i32;
+        *chunk.size_mut() = (n_frames * size_of::<f32>()) as u32;
+    }
+
+    let sample_rate = state.config.audio_format.sample_rate;
+    let cycle = PipeWireCycle::current(stream, sample_rate, n_frames as u32);
+
+    // Check for shutdown early to avoid accessing resources during teardown
+    let clock_state = if state.subsys.is_shut_down() {
+        Ok(ClockState::Unstable)
+    } else {
+        state.clock.update_clock(&cycle)
+    };
+
+    if let Some(servo) = state.clock.take_telemetry() {
+        state.report_clock_servo(servo);
+    }
+
+    let (playout_time, compensation) = match clock_state {
+        Ok(ClockState::Stable {
+            current_time,
+            compensation,
+        }) => (current_time, compensation),
+        Ok(ClockState::Unstable) => {
+            muted(state, datas, n_frames);
+            return;
+        }
+        Err(_e) => {
+            #[cfg(debug_assertions)]
+            error!("Could not get current media time: {_e}");
+            muted(state, datas, n_frames);
+            return;
+        }
+    };
+
+    // when the graph clock is slewed, read the frames that were skipped or repeated by the slew and resample
+    // them to fit into the PipeWire buffer, so the playout stays continuous
+    let link_offset_frames = state.config.frames_in_link_offset();
+    let read_frames = ((n_frames as i64 + compensation) as usize).min(MAX_QUANTUM + 1);
+    let ingress_time = ((playout_time - link_offset_frames) as i64 - compensation) as Frames
+        + RESAMPLER_LATENCY_FRAMES;
+
+    loop {
+        let buffers = state
+            .scratch
+            .iter_mut()
+            .map(|b| Some(&mut b[..read_frames]));
+
+        match state.receiver.receive(buffers, ingress_time, read_frames) {
+            Ok(ReadResult::Ok(_)) => {
+                resample(state, datas, read_frames, n_frames);
+                unmuted(state);
+                break;
+            }
+            Ok(ReadResult::NotReady(missing)) => {
+                // clock is likely not synced yet
+                if missing > n_frames {
+                    muted(state, datas, n_frames);
+                    break;
+                }
+
+                // yield thread and re-try
+                thread::sleep(frames_to_duration(missing as Frames / 10, sample_rate));
+            }
+            Ok(ReadResult::TooLate) | Err(_) => {
+                muted(state, datas, n_frames);
+                break;
+            }
+        }
+    }
+}
+
+fn resample(state: &mut State, datas: &mut [Data], read_frames: usize, n_frames: usize) {
+    for ((data, buf), resampler) in datas
+        .iter_mut()
+        .zip(state.scratch.iter())
+        .zip(state.resamplers.iter_mut())
+    {
+        if let Some(output) = data.data() {
+            resampler.process(&buf[..read_frames], &mut as_samples(output)[..n_frames]);
+        }
+    }
+}
+
+fn muted(state: &mut State, datas: &mut [Data], n_frames: usize) {
+    if !state.muted {
+        state.muted = true;
+        state.report_muted(true);
+    }
+
+    for data in datas.iter_mut() {
+        if let Some(output) = data.data() {
+            as_samples(output)[..n_frames].fill(0.0);
+        }
+    }
+
+    for resampler in state.resamplers.iter_mut() {
+        resampler.reset();
+    }
+}
+
+fn unmuted(state: &mut State) {
+    if state.muted {
+        state.muted = false;
+        state.report_muted(false);
+    }
+}
+
+mod monitoring {
+    use aes67_rs::monitoring::{MediaClockServoStats, RxStats};
+
+    use super::*;
+
+    impl State {
+        pub fn report_muted(&self, muted: bool) {
+            self.monitoring.receiver_stats(RxStats::Muted(muted));
+        }
+
+        pub fn report_clock_servo(&self, servo: MediaClockServoStats) {
+            self.monitoring
+                .receiver_stats(RxStats::MediaClockServo(servo));
+        }
+    }
+}
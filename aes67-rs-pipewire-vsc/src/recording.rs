@@ -0,0 +1,211 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use crate::common::{PipeWireCycle, as_samples, format_param};
+use aes67_rs::{
+    config::MediaClockServoConfig,
+    error::SenderInternalError,
+    monitoring::Monitoring,
+    sender::{api::SenderApi, config::SenderConfig},
+    time::{
+        Clock,
+        servo::{ClockState, MediaClockServo},
+    },
+};
+use pipewire::{
+    core::Core,
+    keys,
+    properties::properties,
+    spa::{pod::Pod, utils::Direction},
+    stream::{Stream, StreamFlags, StreamListener, StreamRef},
+};
+use tosub::SubsystemHandle;
+#[cfg(debug_assertions)]
+use tracing::{error, info};
+
+pub(crate) struct RecordingParams {
+    pub subsys: SubsystemHandle,
+    pub sender: SenderApi,
+    pub config: SenderConfig,
+    pub clock: Clock,
+    pub clock_servo: MediaClockServoConfig,
+    pub monitoring: Monitoring,
+}
+
+pub(crate) struct State {
+    sender: SenderApi,
+    clock: MediaClockServo,
+    sample_rate: u32,
+    subsys: SubsystemHandle,
+    monitoring: Monitoring,
+}
+
+impl Drop for State {
+    fn drop(&mut self) {
+        #[cfg(debug_assertions)]
+        info!("PipeWire recording stopped.");
+        self.sender.stop();
+    }
+}
+
+/// Creates a PipeWire input stream that feeds the audio it captures into an AES67 sender.
+pub(crate) fn create_recording_stream(
+    core: &Core,
+    params: RecordingParams,
+) -> Result<(Stream, StreamListener<State>), pipewire::Error> {
+    let RecordingParams {
+        subsys,
+        sender,
+        config,
+        clock,
+        clock_servo,
+        monitoring,
+    } = params;
+
+    let channels = config.io_channels();
+    let sample_rate = config.audio_format.sample_rate;
+
+    let stream = Stream::new(
+        core,
+        &config.label,
+        properties! {
+            *keys::MEDIA_TYPE => "Audio",
+            *keys::MEDIA_CATEGORY => "Capture",
+            *keys::MEDIA_CLASS => "Audio/Sink",
+            *keys::NODE_NAME => format!("aes67-tx-{}", config.id),
+            *keys::NODE_DESCRIPTION => config.label.clone(),
+            *keys::NODE_RATE => format!("1/{sample_rate}"),
+            *keys::NODE_ALWAYS_PROCESS => "true",
+        },
+    )?;
+
+    let state = State {
+        sender,
+        clock: MediaClockServo::new(clock, clock_servo, sample_rate),
+        sample_rate,
+        subsys,
+        monitoring,
+    };
+
+    let listener = stream
+        .add_local_listener_with_user_data(state)
+        .process(process)
+        .register()?;
+
+    let format = format_param(sample_rate, channels);
+    let mut params = [Pod::from_bytes(&format).expect("serialized pod is valid")];
+
+    stream.connect(
+        Direction::Input,
+        None,
+        StreamFlags::AUTOCONNECT | StreamFlags::MAP_BUFFERS | StreamFlags::RT_PROCESS,
+        &mut params,
+    )?;
+
+    Ok((stream, listener))
+}
+
+fn process(stream: &StreamRef, state: &mut State) {
+    let Some(mut buffer) = stream.dequeue_buffer() else {
+        return;
+    };
+
+    // Check for shutdown early to avoid accessing resources during teardown
+    if state.subsys.is_shut_down() {
+        return;
+    }
+
+    let datas = buffer.datas_mut();
+
+    // the quantum may change at any time, the size of the captured chunk is all that counts
+    let n_frames = datas
+        .iter()
+        .map(|d| d.chunk().size() as usize / size_of::<f32>())
+        .min()
+        .unwrap_or(0)
+        .min(state.sender.max_frames());
+
+    if n_frames == 0 {
+        return;
+    }
+
+    let cycle = PipeWireCycle::current(stream, state.sample_rate, n_frames as u32);
+    let clock_state = state.clock.update_clock(&cycle);
+
+    if let Some(servo) = state.clock.take_telemetry() {
+        state.report_clock_servo(servo);
+    }
+
+    let (ingress_time, compensation) = match clock_state {
+        Ok(ClockState::Stable {
+            current_time,
+            compensation,
+        }) => (current_time, compensation),
+        Ok(ClockState::Unstable) => {
+            return;
+        }
+        Err(_e) => {
+            #[cfg(debug_assertions)]
+            error!("Could not get current media time: {_e}");
+            return;
+        }
+    };
+
+    if let Err(SenderInternalError::BlockTooLarge { requested, max }) =
+        state
+            .sender
+            .start_write(ingress_time, n_frames, compensation)
+    {
+        state.report_block_too_large(requested, max);
+        return;
+    }
+
+    for (ch, data) in datas.iter_mut().enumerate() {
+        let offset = data.chunk().offset() as usize / size_of::<f32>();
+        if let Some(input) = data.data() {
+            state
+                .sender
+                .write_channel(ch, &as_samples(input)[offset..offset + n_frames]);
+        }
+    }
+
+    if state.sender.end_write().is_err() {
+        state.report_buffer_overflow();
+    }
+}
+
+mod monitoring {
+    use aes67_rs::monitoring::{MediaClockServoStats, TxStats};
+
+    use super::*;
+
+    impl State {
+        pub fn report_clock_servo(&self, servo: MediaClockServoStats) {
+            self.monitoring
+                .sender_stats(TxStats::MediaClockServo(servo));
+        }
+
+        pub fn report_buffer_overflow(&self) {
+            self.monitoring.sender_stats(TxStats::BufferOverflow);
+        }
+
+        pub fn report_block_too_large(&self, requested: usize, max: usize) {
+            self.monitoring
+                .sender_stats(TxStats::BlockTooLarge { requested, max });
+        }
+    }
+}
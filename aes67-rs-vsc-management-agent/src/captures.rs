@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Packet captures of the running senders and receivers, served as pcapng files through the REST API.
+
+use crate::{
+    error::{ManagementAgentError, ManagementAgentResult},
+    meters::RECEIVER,
+};
+use aes67_rs::{capture::CaptureRing, formats::SessionId};
+use axum::{
+    http::header,
+    response::{IntoResponse, Response},
+};
+use std::{
+    collections::BTreeMap,
+    sync::{Arc, Mutex},
+};
+use tokio::task::spawn_blocking;
+
+type CaptureMap = BTreeMap<(u8, SessionId), Arc<CaptureRing>>;
+
+#[derive(Clone, Default)]
+pub(crate) struct Captures {
+    captures: Arc<Mutex<CaptureMap>>,
+}
+
+impl Captures {
+    pub(crate) fn insert(&self, kind: u8, id: SessionId, capture: Arc<CaptureRing>) {
+        self.captures
+            .lock()
+            .expect("poisoned")
+            .insert((kind, id), capture);
+    }
+
+    pub(crate) fn remove(&self, kind: u8, id: SessionId) {
+        self.captures.lock().expect("poisoned").remove(&(kind, id));
+    }
+
+    /// The capture of a sender or receiver as a pcapng file download
+    pub(crate) async fn pcapng(&self, kind: u8, id: SessionId) -> ManagementAgentResult<Response> {
+        let capture = self
+            .captures
+            .lock()
+            .expect("poisoned")
+            .get(&(kind, id))
+            .cloned()
+            .ok_or_else(|| {
+                let kind = if kind == RECEIVER { "rx" } else { "tx" };
+                ManagementAgentError::NoCapture(format!("{kind}/{id}"))
+            })?;
+        // copying the ring takes a while with a long history, so it is not done on a runtime thread
+        let file = spawn_blocking(move || capture.pcapng())
+            .await
+            .map_err(|_| ManagementAgentError::ChannelError)?;
+        let disposition = format!("attachment; filename=\"{id}.pcapng\"");
+        Ok((
+            [
+                (header::CONTENT_TYPE, "application/x-pcapng".to_owned()),
+                (header::CONTENT_DISPOSITION, disposition),
+            ],
+            file,
+        )
+            .into_response())
+    }
+}
@@ -16,7 +16,7 @@
  */
 
 use crate::error::{ManagementAgentError, ManagementAgentResult};
-use aes67_rs::config::TelemetryConfig;
+use aes67_rs::config::{MediaClockServoConfig, TelemetryConfig};
 use clap::Parser;
 use serde::{Deserialize, Serialize};
 use std::{
@@ -48,6 +48,8 @@ impl Args {
 pub struct AppConfig {
     pub web_ui: WebUiConfig,
     pub telemetry: Option<TelemetryConfig>,
+    #[serde(default)]
+    pub media_clock_servo: MediaClockServoConfig,
 }
 
 #[derive(Debug, Clone, Serialize, Deserialize)]
@@ -84,6 +86,7 @@ impl AppConfig {
                 let default = AppConfig {
                     web_ui: Default::default(),
                     telemetry: Default::default(),
+                    media_clock_servo: Default::default(),
                 };
                 Ok(default)
             }
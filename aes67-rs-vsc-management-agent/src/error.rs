@@ -58,6 +58,8 @@ pub enum ManagementAgentError {
     IoHandlerError(#[from] IoHandlerError),
     #[error("Discovery error: {0}")]
     DiscoveryError(#[from] DiscoveryError),
+    #[error("No packet capture for {0}")]
+    NoCapture(String),
 }
 
 impl From<oneshot::error::RecvError> for ManagementAgentError {
@@ -123,6 +125,7 @@ impl From<ManagementAgentError> for (StatusCode, String) {
             ManagementAgentError::DiscoveryError(e) => {
                 (StatusCode::INTERNAL_SERVER_ERROR, e.to_string())
             }
+            ManagementAgentError::NoCapture(_) => (StatusCode::NOT_FOUND, e.to_string()),
         }
     }
 }
@@ -15,29 +15,40 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+mod captures;
 pub mod config;
 pub mod error;
+mod meters;
 mod netinf_watcher;
 mod rest;
 
 use crate::{
+    captures::Captures,
     error::{IoHandlerResult, ManagementAgentError, ManagementAgentResult},
+    meters::{Meters, RECEIVER, SENDER},
     rest::{
-        app_name, refresh_netinfs, vsc_rx_config_create, vsc_rx_create, vsc_rx_delete,
-        vsc_rx_update, vsc_start, vsc_stop, vsc_tx_config_create, vsc_tx_create, vsc_tx_delete,
-        vsc_tx_update,
+        app_name, levels, refresh_netinfs, vsc_rx_capture, vsc_rx_config_create, vsc_rx_create,
+        vsc_rx_delete, vsc_rx_update, vsc_start, vsc_stop, vsc_tx_capture, vsc_tx_config_create,
+        vsc_tx_create, vsc_tx_delete, vsc_tx_update,
     },
 };
 use aes67_rs::{
+    capture::CaptureConfig,
     config::{Config, PtpMode, adjust_labels_for_channel_count},
     error::{ConfigError, VscApiError, VscApiResult},
     formats::{AudioFormat, FrameFormat, Seconds, Session, SessionId},
     monitoring::Monitoring,
     nic::find_nic_with_name,
+    player::PlayerConfig,
     receiver::{
         api::ReceiverApi,
-        config::{PartialReceiverConfig, ReceiverConfig, RefClk, SessionInfo},
+        config::{
+            IoBackend, PartialReceiverConfig, ReceiveMode, ReceiverConfig, RefClk, SessionInfo,
+        },
     },
+    recorder::RecorderConfig,
+    relay::RelayConfig,
+    routing::{RoutingConfig, RoutingMatrix},
     sender::{
         api::SenderApi,
         config::{PartialSenderConfig, SenderConfig},
@@ -53,6 +64,7 @@ use pnet::datalink::NetworkInterface;
 use serde::de::DeserializeOwned;
 use serde_json::json;
 use std::{
+    collections::{HashMap, HashSet},
     net::{IpAddr, Ipv4Addr, SocketAddr},
     path::Path,
     time::Duration,
@@ -102,6 +114,8 @@ pub enum SdpSource {
 #[derive(Clone)]
 pub struct ManagementAgentApi {
     api_tx: mpsc::Sender<VscApiMessage>,
+    meters: Meters,
+    captures: Captures,
 }
 
 impl ManagementAgentApi {
@@ -118,12 +132,22 @@ impl ManagementAgentApi {
         let app_idc = app_id.clone();
         let wbc = wb.clone();
         let discc = discovery.clone();
+        let meters = Meters::new(subsys);
+        let metersc = meters.clone();
+        let captures = Captures::default();
+        let capturesc = captures.clone();
         subsys.spawn("api", |s| async move {
-            let api_actor = VscApiActor::new(s, app_idc, api_rx, wbc, io_handler, discc);
+            let api_actor = VscApiActor::new(
+                s, app_idc, api_rx, wbc, io_handler, discc, metersc, capturesc,
+            );
             api_actor.run().await
         });
 
-        Self { api_tx }
+        Self {
+            api_tx,
+            meters,
+            captures,
+        }
     }
 
     pub async fn start_vsc(&self) -> ManagementAgentResult<()> {
@@ -259,9 +283,16 @@ struct VscApiActor<IOH: IoHandler> {
     vsc_api: Option<VirtualSoundCardApi>,
     io_handler: IOH,
     discovery: DiscoveryApi,
+    /// senders that are fed inside the process by a file player or relay and have no I/O handler client
+    internal_senders: HashSet<SessionId>,
+    /// subsystems that apply routing changes to running senders and receivers, by `tx/<id>` or `rx/<id>`
+    routing_watchers: HashMap<String, SubsystemHandle>,
+    meters: Meters,
+    captures: Captures,
 }
 
 impl<IOH: IoHandler> VscApiActor<IOH> {
+    #[allow(clippy::too_many_arguments)]
     fn new(
         subsys: SubsystemHandle,
         app_id: String,
@@ -269,6 +300,8 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
         wb: Worterbuch,
         io_handler: IOH,
         discovery: DiscoveryApi,
+        meters: Meters,
+        captures: Captures,
     ) -> Self {
         Self {
             subsys,
@@ -278,6 +311,10 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
             vsc_api: None,
             io_handler,
             discovery,
+            internal_senders: HashSet::new(),
+            routing_watchers: HashMap::new(),
+            meters,
+            captures,
         }
     }
 
@@ -352,6 +389,7 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
             PtpMode::Phc { nic } => ClockMode::Phc {
                 nic: ClockNic::NonRedundant(nic),
                 subsys: &self.subsys,
+                wb: wb.clone(),
             },
             PtpMode::Internal { nic } => ClockMode::Internal {
                 nic: ClockNic::NonRedundant(nic),
@@ -530,7 +568,18 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
                 let config = self.fetch_sender_config(id).await?;
                 self.increment_session_version(&config).await?;
                 let (api, monitoring, clock) = vsc_api.create_sender(config.clone()).await?;
-                if let Err(e) = self
+                if let Some(matrix) = api.routing() {
+                    self.watch_routing("tx", id, matrix);
+                }
+                self.meters.insert(SENDER, id, api.meter());
+                if let Some(capture) = api.capture() {
+                    self.captures.insert(SENDER, id, capture);
+                }
+                if config.playback.is_some() || config.relay.is_some() {
+                    // the file player or relay feeds the sender, the audio backend must not write to it as well
+                    self.internal_senders.insert(id);
+                    self.announce_session(config).await?;
+                } else if let Err(e) = self
                     .io_handler
                     .sender_created(
                         self.app_id.clone(),
@@ -543,6 +592,9 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
                     .await
                 {
                     error!("Could not create I/O handler for sender '{}': {}", id, e);
+                    self.unwatch_routing("tx", id);
+                    self.meters.remove(SENDER, id);
+                    self.captures.remove(SENDER, id);
                     vsc_api.destroy_sender(id).await?;
                     return Err(e.into());
                 } else {
@@ -554,6 +606,38 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
         Ok(())
     }
 
+    /// Applies changes to the routes in `config/<tx|rx>/<id>/routing` to the running routing matrix. Channel
+    /// labels and ramp time only take effect when the sender or receiver is re-created.
+    fn watch_routing(&mut self, kind: &'static str, id: SessionId, matrix: RoutingMatrix) {
+        let wb = self.wb.clone();
+        let key = topic!(self.app_id, "config", kind, id, "routing");
+        let name = format!("{kind}/{id}");
+        let watcher = self.subsys.spawn(
+            format!("routing/{name}"),
+            async move |s: SubsystemHandle| {
+                let (mut configs, _) = wb.subscribe::<RoutingConfig>(key, true, false).await?;
+                loop {
+                    select! {
+                        recv = configs.recv() => match recv {
+                            Some(Some(config)) => matrix.set_routes(&config.routes),
+                            Some(None) => matrix.set_routes(&[]),
+                            None => break,
+                        },
+                        _ = s.shutdown_requested() => break,
+                    }
+                }
+                Ok::<(), ManagementAgentError>(())
+            },
+        );
+        self.routing_watchers.insert(name, watcher);
+    }
+
+    fn unwatch_routing(&mut self, kind: &'static str, id: SessionId) {
+        if let Some(watcher) = self.routing_watchers.remove(&format!("{kind}/{id}")) {
+            watcher.request_local_shutdown();
+        }
+    }
+
     async fn announce_session(&mut self, config: SenderConfig) -> Result<(), ManagementAgentError> {
         match self.session_info_from_sender_config(&config).await {
             Ok(info) => {
@@ -577,6 +661,13 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
             Some(vsc_api) => {
                 let config = self.fetch_receiver_config(id).await?;
                 let (api, monitoring, clock) = vsc_api.create_receiver(config.clone()).await?;
+                if let Some(matrix) = api.routing() {
+                    self.watch_routing("rx", id, matrix);
+                }
+                self.meters.insert(RECEIVER, id, api.meter());
+                if let Some(capture) = api.capture() {
+                    self.captures.insert(RECEIVER, id, capture);
+                }
                 if let Err(e) = self
                     .io_handler
                     .receiver_created(
@@ -589,6 +680,9 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
                     )
                     .await
                 {
+                    self.unwatch_routing("rx", id);
+                    self.meters.remove(RECEIVER, id);
+                    self.captures.remove(RECEIVER, id);
                     vsc_api.destroy_receiver(id).await?;
                     return Err(e.into());
                 }
@@ -631,7 +725,12 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
                 // Stop the JACK client (buffer producer) first, then destroy the sender
                 // core (buffer consumer). This ensures the JACK callback can't access
                 // the buffer after the consumer is destroyed.
-                self.io_handler.sender_deleted(id).await?;
+                if !self.internal_senders.remove(&id) {
+                    self.io_handler.sender_deleted(id).await?;
+                }
+                self.unwatch_routing("tx", id);
+                self.meters.remove(SENDER, id);
+                self.captures.remove(SENDER, id);
                 info!("Revoking session {} …", id);
                 // TODO this needs to happen automatically whenever the sender stops, no matter what caused it (e.g. vsc shutdown)
                 self.revoke_session(id).await?;
@@ -660,6 +759,9 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
                 // core (buffer producer). This ensures the JACK callback can't access
                 // the buffer after the producer is destroyed.
                 self.io_handler.receiver_deleted(id).await?;
+                self.unwatch_routing("rx", id);
+                self.meters.remove(RECEIVER, id);
+                self.captures.remove(RECEIVER, id);
                 let res = vsc_api.destroy_receiver(id).await;
                 if let Err(e) = res {
                     self.wb
@@ -815,6 +917,22 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
                 "sender packet time not configured",
             )
             .await?;
+        let playback = self
+            .wb
+            .get::<PlayerConfig>(topic!(self.app_id, "config", "tx", id, "playback"))
+            .await?;
+        let relay = self
+            .wb
+            .get::<RelayConfig>(topic!(self.app_id, "config", "tx", id, "relay"))
+            .await?;
+        let routing = self
+            .wb
+            .get::<RoutingConfig>(topic!(self.app_id, "config", "tx", id, "routing"))
+            .await?;
+        let capture = self
+            .wb
+            .get::<CaptureConfig>(topic!(self.app_id, "config", "tx", id, "capture"))
+            .await?;
 
         Ok(SenderConfig {
             id,
@@ -824,6 +942,10 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
             payload_type,
             channel_labels,
             packet_time,
+            playback,
+            relay,
+            routing,
+            capture,
         })
     }
 
@@ -878,6 +1000,14 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
                 )
                 .await?;
         }
+        if let Some(payload_type) = &config.payload_type {
+            self.wb
+                .set_async(
+                    topic!(self.app_id, "config", "rx", id, "payloadType"),
+                    payload_type,
+                )
+                .await?;
+        }
         if let Some(link_offset) = &config.link_offset {
             self.wb
                 .set_async(
@@ -987,6 +1117,56 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
             .await?
             .parse()?;
 
+        let payload_type = self
+            .wb
+            .get::<u8>(topic!(self.app_id, "config", "rx", id, "payloadType"))
+            .await?;
+
+        let kernel_filter = self
+            .wb
+            .get::<bool>(topic!(self.app_id, "config", "rtpKernelFilter"))
+            .await?
+            .unwrap_or(true);
+
+        let receive_mode = match self
+            .wb
+            .get::<ReceiveMode>(topic!(self.app_id, "config", "rx", id, "receiveMode"))
+            .await?
+        {
+            Some(mode) => mode,
+            None => self
+                .wb
+                .get::<ReceiveMode>(topic!(self.app_id, "config", "receiveMode"))
+                .await?
+                .unwrap_or_default(),
+        };
+
+        let io_backend = match self
+            .wb
+            .get::<IoBackend>(topic!(self.app_id, "config", "rx", id, "ioBackend"))
+            .await?
+        {
+            Some(backend) => backend,
+            None => self
+                .wb
+                .get::<IoBackend>(topic!(self.app_id, "config", "ioBackend"))
+                .await?
+                .unwrap_or_default(),
+        };
+
+        let recording = self
+            .wb
+            .get::<RecorderConfig>(topic!(self.app_id, "config", "rx", id, "recording"))
+            .await?;
+        let routing = self
+            .wb
+            .get::<RoutingConfig>(topic!(self.app_id, "config", "rx", id, "routing"))
+            .await?;
+        let capture = self
+            .wb
+            .get::<CaptureConfig>(topic!(self.app_id, "config", "rx", id, "capture"))
+            .await?;
+
         let config = ReceiverConfig {
             id,
             audio_format,
@@ -997,6 +1177,13 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
             rtp_offset,
             source,
             origin_ip,
+            payload_type,
+            kernel_filter,
+            receive_mode,
+            io_backend,
+            recording,
+            routing,
+            capture,
         };
         Ok(config)
     }
@@ -1043,6 +1230,7 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
         let rtp_offset = 0;
         let payload_type = config.payload_type;
         let refclk = self.refclock().await?;
+        let source_filter = destination_ip.is_multicast().then_some(origin_ip);
 
         Ok(SessionInfo {
             id,
@@ -1058,6 +1246,7 @@ impl<IOH: IoHandler> VscApiActor<IOH> {
             rtp_offset,
             payload_type,
             refclk,
+            source_filter,
         })
     }
 
@@ -1350,7 +1539,8 @@ async fn run_rest_api(
     .route(
         "/api/v1/refresh/netinf",
         post(refresh_netinfs).with_state(netinf_watcher),
-    );
+    )
+    .route("/api/v1/levels", get(levels).with_state(api.meters.clone()));
 
     let app = app
         .route("/api/v1/vsc/start", post(vsc_start).with_state(api.clone()))
@@ -1386,6 +1576,14 @@ async fn run_rest_api(
         .route(
             "/api/v1/vsc/rx/delete",
             post(vsc_rx_delete).with_state(api.clone()),
+        )
+        .route(
+            "/api/v1/vsc/tx/capture",
+            post(vsc_tx_capture).with_state(api.captures.clone()),
+        )
+        .route(
+            "/api/v1/vsc/rx/capture",
+            post(vsc_rx_capture).with_state(api.captures.clone()),
         );
 
     info!("REST API is listening on {}", listener.local_addr()?);
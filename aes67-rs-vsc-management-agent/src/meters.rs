@@ -0,0 +1,142 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Publishes the level meters of all running senders and receivers to the web UI. The levels are taken
+//! [PUBLISH_RATE] times per second and sent to every client of the levels WebSocket as one binary frame,
+//! all integers little-endian:
+//!
+//! ```text
+//! frame = entry*
+//! entry = kind: u8 (0 = receiver, 1 = sender), id: u64, channels: u16, level[channels]
+//! level = peak: u8, rms: u8
+//! ```
+//!
+//! Levels are attenuations below full scale in steps of 0.5 dB, 255 means -127.5 dBFS or less.
+
+use crate::error::ManagementAgentError;
+use aes67_rs::{formats::SessionId, monitoring::meter::LevelMeter};
+use axum::{
+    body::Bytes,
+    extract::ws::{Message, WebSocket},
+};
+use std::{
+    collections::BTreeMap,
+    sync::{Arc, Mutex},
+    time::Duration,
+};
+use tokio::{select, sync::watch, time::interval};
+use tosub::SubsystemHandle;
+
+/// Level updates per second
+const PUBLISH_RATE: u64 = 15;
+
+pub(crate) const RECEIVER: u8 = 0;
+pub(crate) const SENDER: u8 = 1;
+
+type MeterMap = BTreeMap<(u8, SessionId), Arc<LevelMeter>>;
+
+#[derive(Clone)]
+pub(crate) struct Meters {
+    meters: Arc<Mutex<MeterMap>>,
+    frames: watch::Receiver<Bytes>,
+}
+
+impl Meters {
+    pub(crate) fn new(subsys: &SubsystemHandle) -> Self {
+        let meters = Arc::new(Mutex::new(MeterMap::new()));
+        let (tx, frames) = watch::channel(Bytes::new());
+        let m = meters.clone();
+        subsys.spawn("meters", async move |s: SubsystemHandle| {
+            publish(s, m, tx).await;
+            Ok::<(), ManagementAgentError>(())
+        });
+        Self { meters, frames }
+    }
+
+    pub(crate) fn insert(&self, kind: u8, id: SessionId, meter: Arc<LevelMeter>) {
+        self.meters
+            .lock()
+            .expect("poisoned")
+            .insert((kind, id), meter);
+    }
+
+    pub(crate) fn remove(&self, kind: u8, id: SessionId) {
+        self.meters.lock().expect("poisoned").remove(&(kind, id));
+    }
+
+    pub(crate) fn subscribe(&self) -> watch::Receiver<Bytes> {
+        self.frames.clone()
+    }
+}
+
+async fn publish(subsys: SubsystemHandle, meters: Arc<Mutex<MeterMap>>, tx: watch::Sender<Bytes>) {
+    let mut interval = interval(Duration::from_millis(1000 / PUBLISH_RATE));
+    loop {
+        select! {
+            _ = interval.tick() => {
+                // taking the levels resets them, so they are taken even if no one is listening
+                let frame = encode(&meters.lock().expect("poisoned"));
+                tx.send_replace(frame);
+            },
+            _ = subsys.shutdown_requested() => break,
+        }
+    }
+}
+
+fn encode(meters: &MeterMap) -> Bytes {
+    let mut frame = Vec::new();
+    for ((kind, id), meter) in meters {
+        frame.push(*kind);
+        frame.extend_from_slice(&id.to_le_bytes());
+        frame.extend_from_slice(&(meter.channels() as u16).to_le_bytes());
+        for channel in 0..meter.channels() {
+            let level = meter.take(channel);
+            frame.push(attenuation(level.peak));
+            frame.push(attenuation(level.rms));
+        }
+    }
+    frame.into()
+}
+
+fn attenuation(amplitude: f32) -> u8 {
+    if amplitude <= 0.0 {
+        return u8::MAX;
+    }
+    (-20.0 * amplitude.log10() * 2.0)
+        .round()
+        .clamp(0.0, u8::MAX as f32) as u8
+}
+
+pub(crate) async fn stream_levels(mut socket: WebSocket, mut frames: watch::Receiver<Bytes>) {
+    loop {
+        select! {
+            changed = frames.changed() => {
+                if changed.is_err() {
+                    break;
+                }
+                let frame = frames.borrow_and_update().clone();
+                if socket.send(Message::Binary(frame)).await.is_err() {
+                    break;
+                }
+            },
+            msg = socket.recv() => match msg {
+                Some(Ok(Message::Close(_))) | Some(Err(_)) | None => break,
+                Some(Ok(_)) => {}
+            },
+        }
+    }
+}
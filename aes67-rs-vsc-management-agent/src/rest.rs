@@ -17,11 +17,17 @@
 
 use crate::{
     ManagementAgentApi, Sdp,
+    captures::Captures,
     error::{LogError, ManagementAgentResult},
+    meters::{self, Meters, RECEIVER, SENDER},
     netinf_watcher,
 };
 use aes67_rs::formats::SessionId;
-use axum::{Json, extract::State};
+use axum::{
+    Json,
+    extract::{State, WebSocketUpgrade},
+    response::Response,
+};
 
 pub(crate) async fn app_name(State(app_id): State<String>) -> String {
     app_id.clone()
@@ -34,6 +40,10 @@ pub(crate) async fn refresh_netinfs(
     Ok("Network interfaces refresh triggered")
 }
 
+pub(crate) async fn levels(ws: WebSocketUpgrade, State(meters): State<Meters>) -> Response {
+    ws.on_upgrade(move |socket| meters::stream_levels(socket, meters.subscribe()))
+}
+
 pub(crate) async fn vsc_start(State(api): State<ManagementAgentApi>) -> ManagementAgentResult<()> {
     api.start_vsc().await?;
     Ok(())
@@ -129,3 +139,17 @@ pub(crate) async fn vsc_rx_delete(
         .log_error("Failed to delete receiver")?;
     Ok(())
 }
+
+pub(crate) async fn vsc_tx_capture(
+    State(captures): State<Captures>,
+    Json(spec): Json<TransceiverSpec>,
+) -> ManagementAgentResult<Response> {
+    captures.pcapng(SENDER, spec.id).await
+}
+
+pub(crate) async fn vsc_rx_capture(
+    State(captures): State<Captures>,
+    Json(spec): Json<TransceiverSpec>,
+) -> ManagementAgentResult<Response> {
+    captures.pcapng(RECEIVER, spec.id).await
+}
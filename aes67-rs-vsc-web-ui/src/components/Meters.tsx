@@ -0,0 +1,33 @@
+import { For } from "solid-js";
+import { useLevels } from "../levels";
+import "./Meters.css";
+
+// lowest level shown
+const FLOOR = -60;
+
+function height(dbfs: number): string {
+  return `${Math.max(0, (dbfs - FLOOR) / -FLOOR) * 100}%`;
+}
+
+export default function Meters(props: { kind: "rx" | "tx"; id: string }) {
+  const levels = useLevels(props.kind, props.id);
+  return (
+    <div class="meters">
+      <For each={levels()}>
+        {(level, channel) => (
+          <div
+            class="meter"
+            title={`${channel() + 1}: peak ${level.peak.toFixed(1)} dBFS, RMS ${level.rms.toFixed(1)} dBFS`}
+          >
+            <div class="rms" style={{ height: height(level.rms) }} />
+            <div
+              class="peak"
+              classList={{ clip: level.peak >= -0.5 }}
+              style={{ bottom: height(level.peak) }}
+            />
+          </div>
+        )}
+      </For>
+    </div>
+  );
+}
@@ -10,10 +10,11 @@ import {
 } from "../../utils";
 import { pDelete, set } from "../../worterbuch";
 import { appName } from "../../vscState";
-import { createEffect, createSignal } from "solid-js";
+import { createEffect, createSignal, Show } from "solid-js";
 import { IoPlay } from "solid-icons/io";
 import { IoStop } from "solid-icons/io";
 import { IoTrash } from "solid-icons/io";
+import Meters from "../Meters";
 import { createReceiver, deleteReceiver } from "../../api";
 
 export default function Editor(props: { receiver: [string, string] }) {
@@ -301,6 +302,11 @@ export default function Editor(props: { receiver: [string, string] }) {
         disabled={running()}
       />
 
+      <Show when={running()}>
+        <h3>Levels</h3>
+        <Meters kind="rx" id={transceiverID(props.receiver)} />
+      </Show>
+
       <div class="separator" />
       <button
         id="startStop"
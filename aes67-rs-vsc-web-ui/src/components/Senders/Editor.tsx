@@ -9,10 +9,11 @@ import {
 } from "../../utils";
 import { pDelete, set } from "../../worterbuch";
 import { appName } from "../../vscState";
-import { createEffect, createSignal } from "solid-js";
+import { createEffect, createSignal, Show } from "solid-js";
 import { IoPlay } from "solid-icons/io";
 import { IoStop } from "solid-icons/io";
 import { IoTrash } from "solid-icons/io";
+import Meters from "../Meters";
 import { createSender, deleteSender } from "../../api";
 
 export default function Editor(props: { sender: [string, string] }) {
@@ -253,6 +254,11 @@ export default function Editor(props: { sender: [string, string] }) {
         disabled={running()}
       />
 
+      <Show when={running()}>
+        <h3>Levels</h3>
+        <Meters kind="tx" id={transceiverID(props.sender)} />
+      </Show>
+
       <div class="separator" />
       <button
         id="startStop"
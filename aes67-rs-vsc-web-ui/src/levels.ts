@@ -0,0 +1,72 @@
+import { createSignal, onCleanup } from "solid-js";
+
+// levels in dBFS
+export type Level = { peak: number; rms: number };
+
+const [levels, setLevels] = createSignal<Map<string, Level[]>>(new Map());
+
+let socket: WebSocket | null = null;
+let subscribers = 0;
+
+function dbfs(attenuation: number): number {
+  return attenuation === 255 ? -Infinity : -attenuation / 2;
+}
+
+// see aes67-rs-vsc-management-agent/src/meters.rs for the frame format
+function decode(frame: ArrayBuffer): Map<string, Level[]> {
+  const view = new DataView(frame);
+  const decoded = new Map<string, Level[]>();
+  let pos = 0;
+  while (pos + 11 <= view.byteLength) {
+    const kind = view.getUint8(pos) === 0 ? "rx" : "tx";
+    const id = view.getBigUint64(pos + 1, true).toString();
+    const channels = view.getUint16(pos + 9, true);
+    pos += 11;
+    const channelLevels: Level[] = [];
+    for (let i = 0; i < channels && pos + 2 <= view.byteLength; i++) {
+      channelLevels.push({
+        peak: dbfs(view.getUint8(pos)),
+        rms: dbfs(view.getUint8(pos + 1)),
+      });
+      pos += 2;
+    }
+    decoded.set(`${kind}/${id}`, channelLevels);
+  }
+  return decoded;
+}
+
+function connect() {
+  const location = window.location;
+  const address = `${location.protocol === "https:" ? "wss" : "ws"}://${
+    location.host
+  }/api/v1/levels`;
+  const ws = new WebSocket(address);
+  ws.binaryType = "arraybuffer";
+  ws.onmessage = (msg) => setLevels(decode(msg.data));
+  ws.onclose = () => {
+    socket = null;
+    setLevels(new Map());
+    if (subscribers > 0) {
+      setTimeout(() => {
+        if (subscribers > 0 && !socket) {
+          connect();
+        }
+      }, 500);
+    }
+  };
+  socket = ws;
+}
+
+export function useLevels(kind: "rx" | "tx", id: string): () => Level[] {
+  subscribers++;
+  if (!socket) {
+    connect();
+  }
+  onCleanup(() => {
+    subscribers--;
+    if (subscribers === 0 && socket) {
+      socket.close();
+    }
+  });
+  return () => levels().get(`${kind}/${id}`) ?? [];
+}
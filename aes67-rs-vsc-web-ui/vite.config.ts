@@ -40,6 +40,7 @@ export default defineConfig({
       "/api": {
         target: "http://127.0.0.1:43567",
         changeOrigin: true,
+        ws: true,
       },
       "/ws": {
         target: "ws://127.0.0.1:43567",
@@ -72,6 +72,7 @@ async fn run(subsys: SubsystemHandle) -> miette::Result<()> {
         Some(ClockMode::Phc {
             nic: ClockNic::NonRedundant(nic.to_owned()),
             subsys: &subsys,
+            wb: wb.clone(),
         }),
         audio_format.sample_rate,
     )
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Replays an AES67 stream from a pcap or pcapng capture into a receiver and prints the report. Fails if any
+//! played out frame differs from the packet that carried it.
+//!
+//! ```sh
+//! cargo run --release --example replay -- capture.pcapng 8 L24 48000
+//! # a specific stream and the usual offset between a UTC system clock and PTP time
+//! cargo run --release --example replay -- capture.pcapng 2 L16 48000 239.69.0.1:5004 37
+//! ```
+
+use aes67_rs::{
+    formats::{AudioFormat, FrameFormat},
+    simulation::replay::{ReplayConfig, run_replay},
+};
+use miette::{IntoDiagnostic, miette};
+use std::{env, io, time::Duration};
+use supports_color::Stream;
+use tosub::{SubsystemHandle, SubsystemResult};
+use tracing_subscriber::{
+    EnvFilter, Layer, filter::filter_fn, fmt, layer::SubscriberExt, util::SubscriberInitExt,
+};
+
+#[tokio::main]
+async fn main() -> SubsystemResult {
+    tracing_subscriber::registry()
+        .with(
+            fmt::Layer::new()
+                .with_ansi(supports_color::on(Stream::Stderr).is_some())
+                .with_writer(io::stderr)
+                .with_filter(EnvFilter::from_default_env())
+                .with_filter(filter_fn(|meta| {
+                    !meta.is_span() && meta.fields().iter().any(|f| f.name() == "message")
+                })),
+        )
+        .init();
+
+    tosub::build_root("replay")
+        .catch_signals()
+        .with_timeout(Duration::from_secs(1))
+        .start(run)
+        .await
+}
+
+async fn run(subsys: SubsystemHandle) -> miette::Result<()> {
+    let mut args = env::args().skip(1);
+    let (Some(capture), Some(channels), Some(sample_format)) =
+        (args.next(), args.next(), args.next())
+    else {
+        return Err(miette!(
+            "Usage: replay <capture> <channels> <L16|L24> [sample rate] [group:port] [clock offset s]"
+        ));
+    };
+    let audio_format = AudioFormat {
+        sample_rate: args
+            .next()
+            .map_or(Ok(48_000), |r| r.parse())
+            .into_diagnostic()?,
+        frame_format: FrameFormat {
+            channels: channels.parse().into_diagnostic()?,
+            sample_format: sample_format.parse()?,
+        },
+    };
+    let mut config = ReplayConfig::new(capture, audio_format);
+    config.stream = args
+        .next()
+        .map(|s| s.parse())
+        .transpose()
+        .into_diagnostic()?;
+    config.clock_offset = args
+        .next()
+        .map(|s| s.parse().map(Duration::from_secs_f64))
+        .transpose()
+        .into_diagnostic()?;
+
+    let report = tokio::task::spawn_blocking(move || run_replay(&subsys, config))
+        .await
+        .into_diagnostic()??;
+    println!("{report:#?}");
+
+    if report.corrupt_frames > 0 {
+        return Err(miette!(
+            "{} frames were not played out as received",
+            report.corrupt_frames
+        ));
+    }
+
+    Ok(())
+}
@@ -0,0 +1,51 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use aes67_rs::resampling::AdaptiveResampler;
+use std::{f32::consts::PI, hint::black_box, time::Instant};
+
+/// Measures the per-channel CPU cost of the drift compensation resampler for typical JACK buffer sizes.
+pub fn main() -> miette::Result<()> {
+    let sr = 48_000.0;
+    let iterations = 100_000;
+
+    for buffer_len in [32, 64, 128, 256, 512, 1024] {
+        for compensation in [0i64, -1, 1] {
+            let input_len = (buffer_len as i64 + compensation) as usize;
+            let input = (0..input_len)
+                .map(|i| (2.0 * PI * 1_000.0 * i as f32 / sr).sin())
+                .collect::<Vec<f32>>();
+            let mut output = vec![0.0; buffer_len];
+            let mut resampler = AdaptiveResampler::new();
+
+            let start = Instant::now();
+            for _ in 0..iterations {
+                resampler.process(black_box(&input), black_box(&mut output));
+            }
+            let elapsed = start.elapsed();
+
+            let per_block = elapsed.as_nanos() as f64 / iterations as f64;
+            let per_frame = per_block / buffer_len as f64;
+            println!(
+                "buffer: {buffer_len:>5} frames, compensation: {compensation:>2} frames, {:>9.1} ns/block/channel, {:>6.2} ns/frame",
+                per_block, per_frame
+            );
+        }
+    }
+
+    Ok(())
+}
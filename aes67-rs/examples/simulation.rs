@@ -0,0 +1,104 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+use aes67_rs::simulation::{
+    ClockConditions, SimulationConfig, network::NetworkConditions, run_simulation,
+};
+use miette::IntoDiagnostic;
+use std::{io, time::Duration};
+use supports_color::Stream;
+use tosub::{SubsystemHandle, SubsystemResult};
+use tracing_subscriber::{
+    EnvFilter, Layer, filter::filter_fn, fmt, layer::SubscriberExt, util::SubscriberInitExt,
+};
+
+/// Simulates an hour of traffic for a couple of typical network and clock conditions and prints the results.
+#[tokio::main]
+async fn main() -> SubsystemResult {
+    tracing_subscriber::registry()
+        .with(
+            fmt::Layer::new()
+                .with_ansi(supports_color::on(Stream::Stderr).is_some())
+                .with_writer(io::stderr)
+                .with_filter(EnvFilter::from_default_env())
+                .with_filter(filter_fn(|meta| {
+                    !meta.is_span() && meta.fields().iter().any(|f| f.name() == "message")
+                })),
+        )
+        .init();
+
+    tosub::build_root("simulation")
+        .catch_signals()
+        .with_timeout(Duration::from_secs(1))
+        .start(run)
+        .await
+}
+
+async fn run(subsys: SubsystemHandle) -> miette::Result<()> {
+    let duration = Duration::from_secs(3_600);
+
+    let scenarios = [
+        ("ideal", SimulationConfig::default()),
+        (
+            "network jitter",
+            SimulationConfig {
+                network: NetworkConditions {
+                    delay: Duration::from_micros(200),
+                    jitter: Duration::from_micros(1_500),
+                    loss: 0.0,
+                },
+                ..Default::default()
+            },
+        ),
+        (
+            "packet loss",
+            SimulationConfig {
+                network: NetworkConditions {
+                    delay: Duration::from_micros(200),
+                    jitter: Duration::ZERO,
+                    loss: 0.001,
+                },
+                ..Default::default()
+            },
+        ),
+        (
+            "clock drift",
+            SimulationConfig {
+                sender_clock: ClockConditions {
+                    drift_ppm: 5.0,
+                    jitter: Duration::from_micros(1),
+                },
+                receiver_clock: ClockConditions {
+                    drift_ppm: -5.0,
+                    jitter: Duration::from_micros(1),
+                },
+                ..Default::default()
+            },
+        ),
+    ];
+
+    for (name, config) in scenarios {
+        let config = SimulationConfig { duration, ..config };
+        let s = subsys.clone();
+        let report = tokio::task::spawn_blocking(move || run_simulation(&s, config))
+            .await
+            .into_diagnostic()??;
+        println!("{name}: {report:#?}");
+    }
+
+    Ok(())
+}
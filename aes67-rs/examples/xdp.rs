@@ -0,0 +1,89 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Receives a stream through the AF_XDP ingest and prints packet statistics once per second. Needs root. To
+//! try it on a single machine, create a veth pair and send to it from the peer:
+//!
+//! ```sh
+//! ip link add xdp0 type veth peer name xdp1
+//! ip addr add 10.99.0.1/24 dev xdp0 && ip link set xdp0 up
+//! ip addr add 10.99.0.2/24 dev xdp1 && ip link set xdp1 up
+//! cargo run --example xdp -- xdp1 239.69.0.1:5004
+//! # in another shell, e.g. with an AES67 sender bound to xdp0 or
+//! socat -u /dev/urandom UDP4-DATAGRAM:239.69.0.1:5004,ip-multicast-if=10.99.0.1
+//! ```
+
+use aes67_rs::{
+    nic::find_nic_with_name,
+    socket::{PacketSource, RxBatch, XdpRxSocket, create_ipv4_rx_socket, create_ipv6_rx_socket},
+};
+use miette::{IntoDiagnostic, miette};
+use std::{
+    env,
+    io::ErrorKind,
+    net::{IpAddr, SocketAddr},
+    time::{Duration, Instant},
+};
+
+pub fn main() -> miette::Result<()> {
+    let mut args = env::args().skip(1);
+    let (Some(nic), Some(addr)) = (args.next(), args.next()) else {
+        return Err(miette!("Usage: xdp <interface> <group:port>"));
+    };
+    let addr: SocketAddr = addr.parse().into_diagnostic()?;
+    let iface = find_nic_with_name(&nic)?;
+
+    let socket = match addr.ip() {
+        IpAddr::V4(ip) => create_ipv4_rx_socket(ip, None, iface.clone(), addr.port())?,
+        IpAddr::V6(ip) => create_ipv6_rx_socket(ip, None, iface.clone(), addr.port())?,
+    };
+    let mut socket = XdpRxSocket::new(socket.into(), &iface, addr, true).into_diagnostic()?;
+
+    let mut batch = RxBatch::default();
+    let mut packets = 0;
+    let mut bytes = 0;
+    let mut latency = Duration::ZERO;
+    let mut last_report = Instant::now();
+    loop {
+        match socket.recv_batch(&mut batch) {
+            Ok(_) => {
+                for datagram in batch.drain() {
+                    packets += 1;
+                    bytes += unsafe { datagram.payload() }.len();
+                    if let Some(elapsed) = datagram.timestamp.and_then(|t| t.elapsed().ok()) {
+                        latency += elapsed;
+                    }
+                    socket.release(datagram);
+                }
+            }
+            Err(e) if matches!(e.kind(), ErrorKind::TimedOut | ErrorKind::WouldBlock) => {}
+            Err(e) => return Err(e).into_diagnostic(),
+        }
+
+        if last_report.elapsed() >= Duration::from_secs(1) {
+            println!(
+                "{packets:>7} packets, {bytes:>9} bytes, {:>6.1} µs mean ingest to receiver latency, {} dropped",
+                latency.as_secs_f64() * 1_000_000.0 / packets.max(1) as f64,
+                socket.drops().unwrap_or_default()
+            );
+            packets = 0;
+            bytes = 0;
+            latency = Duration::ZERO;
+            last_report = Instant::now();
+        }
+    }
+}
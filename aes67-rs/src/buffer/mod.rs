@@ -27,6 +27,7 @@ use std::{
 
 pub mod receiver;
 pub mod sender;
+pub mod shm;
 
 #[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct BufferConfig {
@@ -16,52 +16,66 @@
  */
 
 use crate::{
-    buffer::AudioBufferPointer,
+    buffer::shm::{
+        SharedAudioBuffer, SharedBufferDescriptor, SharedBufferLayout, SharedSampleFormat,
+    },
     error::ReceiverInternalResult,
-    formats::{Frames, SampleReader},
-    monitoring::Monitoring,
+    formats::{Frames, MilliSeconds, SampleReader},
+    monitoring::{Monitoring, meter::LevelMeter},
     receiver::config::ReceiverConfig,
 };
-use std::{fmt::Debug, time::Duration};
-use tokio::sync::watch;
+use std::{fmt::Debug, sync::Arc};
 use tracing::{debug, warn};
 
+/// Maximum duration of audio that can be read from a [ReceiverBufferConsumer] in a single block by consumers
+/// that need scratch buffers of their own, like a routing matrix.
+pub const MAX_CONSUMER_BUFFER_DURATION: MilliSeconds = 100.0;
+
 pub fn receiver_buffer_channel(
     config: ReceiverConfig,
     monitoring: Monitoring,
-) -> (ReceiverBufferProducer, ReceiverBufferConsumer) {
-    let buffer_len = config.duration_to_frames(Duration::from_secs(10)) as usize;
-    let (tx, rx) = watch::channel(0);
-    let buffer = vec![0f32; buffer_len].into_boxed_slice();
-    let buffer_pointer = AudioBufferPointer::from_slice(&buffer);
-    (
+) -> ReceiverInternalResult<(ReceiverBufferProducer, ReceiverBufferConsumer)> {
+    let capacity_frames = config.buffer_capacity_frames();
+    let layout = SharedBufferLayout {
+        sample_format: SharedSampleFormat::F32Planar,
+        channels: config.audio_format.frame_format.channels,
+        sample_rate: config.audio_format.sample_rate,
+        capacity_frames,
+        validity_map: true,
+    };
+    let buffer = Arc::new(SharedAudioBuffer::create(
+        &format!("rx-{}", config.id),
+        layout,
+    )?);
+    let meter = Arc::new(LevelMeter::new(config.audio_format.frame_format.channels));
+    Ok((
         ReceiverBufferProducer {
-            buffer,
+            buffer: buffer.clone(),
             config: config.clone(),
-            tx,
+            meter: meter.clone(),
         },
         ReceiverBufferConsumer {
-            buffer_pointer,
+            buffer,
             config,
-            rx,
             monitoring,
+            meter,
         },
-    )
+    ))
 }
 
 #[derive(Debug, Clone)]
 pub struct ReceiverBufferProducer {
-    buffer: Box<[f32]>,
+    buffer: Arc<SharedAudioBuffer>,
     config: ReceiverConfig,
-    tx: watch::Sender<Frames>,
+    meter: Arc<LevelMeter>,
 }
 
 #[derive(Debug, Clone)]
 pub struct ReceiverBufferConsumer {
-    buffer_pointer: AudioBufferPointer,
+    buffer: Arc<SharedAudioBuffer>,
     config: ReceiverConfig,
-    rx: watch::Receiver<Frames>,
     monitoring: Monitoring,
+    meter: Arc<LevelMeter>,
 }
 
 pub enum ReadResult {
@@ -74,11 +88,12 @@ impl ReceiverBufferProducer {
     /// Deinterlace and write audio data into the shared buffer. The buffer is partitioned into equally sized strips,
     /// one for each channel, so that audio data can be retrieved individually per channel.
     pub fn write(&mut self, payload: &[u8], ingress_time: Frames) {
-        let buf = &mut self.buffer[..];
+        // the producer is the only writer and frames only become visible to readers once they are published
+        let buf = unsafe { self.buffer.data_mut::<f32>() };
         let sample_format = &self.config.audio_format.frame_format.sample_format;
         let channels = self.config.audio_format.frame_format.channels;
-        let chunk_size = buf.len() / channels;
-        let channel_partitions = buf.chunks_mut(chunk_size);
+        let chunk_size = self.buffer.capacity_frames() as usize;
+        let channel_partitions = buf.chunks_mut(chunk_size).take(channels);
 
         let bytes_per_input_sample: usize = self
             .config
@@ -87,6 +102,8 @@ impl ReceiverBufferProducer {
             .sample_format
             .bytes_per_sample();
 
+        let frames = self.config.frames_in_buffer(payload.len());
+
         for (channel_index, output_buffer) in channel_partitions.enumerate() {
             for (offset, sample) in payload
                 .chunks(bytes_per_input_sample)
@@ -97,11 +114,25 @@ impl ReceiverBufferProducer {
                 let index = ((ingress_time + offset as u64) % output_buffer.len() as u64) as usize;
                 output_buffer[index] = sample_format.read_sample(sample);
             }
+
+            // meter the samples that were just written while they are still in cache
+            let start = (ingress_time % output_buffer.len() as u64) as usize;
+            let end = start + frames as usize;
+            if end <= output_buffer.len() {
+                self.meter.record(channel_index, &output_buffer[start..end]);
+            } else {
+                let wrapped = end - output_buffer.len();
+                self.meter.record(channel_index, &output_buffer[start..]);
+                self.meter.record(channel_index, &output_buffer[..wrapped]);
+            }
         }
 
-        self.tx
-            .send(ingress_time + self.config.frames_in_buffer(payload.len()) - 1)
-            .ok();
+        self.buffer.mark_valid(ingress_time, frames);
+        self.buffer.publish(ingress_time + frames);
+    }
+
+    pub fn descriptor(&self) -> SharedBufferDescriptor {
+        self.buffer.descriptor()
     }
 }
 
@@ -113,7 +144,8 @@ impl ReceiverBufferConsumer {
         ingress_time: Frames,
         buffer_size: usize,
     ) -> ReceiverInternalResult<ReadResult> {
-        let buf = self.buffer_pointer.buffer::<f32>();
+        let buf = unsafe { self.buffer.data::<f32>() };
+        let capacity = self.buffer.capacity_frames();
 
         let mut latest_received_frame = 0;
 
@@ -131,7 +163,7 @@ impl ReceiverBufferConsumer {
             );
 
             let last_requested_frame = ingress_time + output_buffer.len() as Frames - 1;
-            latest_received_frame = *self.rx.borrow();
+            latest_received_frame = self.buffer.write_cursor().saturating_sub(1);
 
             // TODO allow partial buffer read?
 
@@ -144,8 +176,7 @@ impl ReceiverBufferConsumer {
                 return Ok(ReadResult::NotReady(missing as usize));
             }
 
-            let oldest_frame_in_buffer =
-                latest_received_frame - self.config.frames_in_buffer(buf.len()) + 1;
+            let oldest_frame_in_buffer = (latest_received_frame + 1).saturating_sub(capacity);
             if oldest_frame_in_buffer > ingress_time {
                 warn!(
                     "The requested data is not in the receiver buffer anymore (requested frames: [{}; {}]; oldest frame in buffer: {}; {} frames late)!",
@@ -157,9 +188,7 @@ impl ReceiverBufferConsumer {
                 return Ok(ReadResult::TooLate);
             }
 
-            let channels = self.config.audio_format.frame_format.channels;
-            let chunk_size = buf.len() / channels;
-            let mut channel_partitions = buf.chunks(chunk_size);
+            let mut channel_partitions = buf.chunks(capacity as usize);
 
             let rtp_buffer = channel_partitions
                 .nth(channel)
@@ -183,6 +212,63 @@ impl ReceiverBufferConsumer {
 
         Ok(ReadResult::Ok(buffer_size))
     }
+
+    /// Media time of the frame following the newest received frame, 0 if nothing has been received yet.
+    pub fn write_cursor(&self) -> Frames {
+        self.buffer.write_cursor()
+    }
+
+    pub fn capacity_frames(&self) -> Frames {
+        self.buffer.capacity_frames()
+    }
+
+    /// Maximum number of frames per channel that can be read in a single block.
+    pub fn max_frames(&self) -> usize {
+        self.config
+            .audio_format
+            .frames_in_buffer(MAX_CONSUMER_BUFFER_DURATION) as usize
+    }
+
+    pub fn config(&self) -> &ReceiverConfig {
+        &self.config
+    }
+
+    /// Levels of the received stream channels
+    pub fn meter(&self) -> Arc<LevelMeter> {
+        self.meter.clone()
+    }
+
+    /// Reads interleaved frames starting at `start` for consumers that trail the playout, like the
+    /// [recorder](crate::recorder). Frames that were never received are returned as silence and the read is
+    /// not reported as playout.
+    pub fn read_interleaved(&self, start: Frames, output_buffer: &mut [f32]) -> ReadResult {
+        let channels = self.buffer.layout().channels;
+        let frames = output_buffer.len() / channels;
+        let capacity = self.buffer.capacity_frames();
+        let write_cursor = self.buffer.write_cursor();
+
+        if start + frames as Frames > write_cursor {
+            return ReadResult::NotReady((start + frames as Frames - write_cursor) as usize);
+        }
+        if write_cursor.saturating_sub(capacity) > start {
+            return ReadResult::TooLate;
+        }
+
+        let buf = unsafe { self.buffer.data::<f32>() };
+        for (offset, frame) in output_buffer.chunks_exact_mut(channels).enumerate() {
+            let t = start + offset as Frames;
+            if !self.buffer.is_valid(t) {
+                frame.fill(0.0);
+                continue;
+            }
+            let index = (t % capacity) as usize;
+            for (channel, sample) in frame.iter_mut().enumerate() {
+                *sample = buf[channel * capacity as usize + index];
+            }
+        }
+
+        ReadResult::Ok(frames)
+    }
 }
 
 mod monitoring {
@@ -16,54 +16,76 @@
  */
 
 use crate::{
-    buffer::AudioBufferPointer,
+    buffer::shm::{SharedAudioBuffer, SharedBufferLayout, SharedSampleFormat},
     error::{SenderInternalError, SenderInternalResult},
-    formats::{Frames, MilliSeconds, SampleWriter},
+    formats::{Frames, MilliSeconds, SampleFormat, SampleWriter},
+    monitoring::meter::LevelMeter,
     sender::config::SenderConfig,
 };
-use std::{fmt::Debug, ops::Range};
+use std::{fmt::Debug, ops::Range, sync::Arc};
 use tokio::sync::mpsc;
 
+/// Maximum duration of audio that can be written to a [SenderBufferProducer] in a single block.
+pub const MAX_PRODUCER_BUFFER_DURATION: MilliSeconds = 100.0;
+
+/// Creates the buffer that holds the wire format payload of outgoing packets. It is split into `phases`
+/// equally sized parts that are filled one after the other, frames that don't fill a whole packet spill over
+/// into the next phase. A frame's position therefore depends on the block sizes written so far and not only
+/// on its media time, so unlike receiver buffers the segment is not exported to other processes.
 pub fn sender_buffer_channel(
     config: SenderConfig,
     phases: usize,
-) -> (SenderBufferProducer, SenderBufferConsumer) {
+) -> SenderInternalResult<(SenderBufferProducer, SenderBufferConsumer)> {
     let (tx, rx) = mpsc::channel(phases);
     let max_ptime = 4.0;
-    let max_producer_buffer_duration = 100.0;
-    let buffer_len = config
+    let capacity_frames = config
         .audio_format
-        .bytes_per_buffer((max_producer_buffer_duration + max_ptime) * phases as MilliSeconds);
-    let buffer = vec![0u8; buffer_len].into_boxed_slice();
-    let buffer_pointer = AudioBufferPointer::from_slice(&buffer);
+        .frames_in_buffer((MAX_PRODUCER_BUFFER_DURATION + max_ptime) * phases as MilliSeconds);
+    let sample_format = match config.audio_format.frame_format.sample_format {
+        SampleFormat::L16 => SharedSampleFormat::L16,
+        SampleFormat::L24 => SharedSampleFormat::L24,
+    };
+    let layout = SharedBufferLayout {
+        sample_format,
+        channels: config.audio_format.frame_format.channels,
+        sample_rate: config.audio_format.sample_rate,
+        capacity_frames,
+        validity_map: false,
+    };
+    let buffer = Arc::new(SharedAudioBuffer::create(
+        &format!("tx-{}", config.id),
+        layout,
+    )?);
     let target_bytes_per_sample = config
         .audio_format
         .frame_format
         .sample_format
         .bytes_per_sample();
-    (
+    Ok((
         SenderBufferProducer {
-            buffer_pointer,
+            buffer: buffer.clone(),
             config: config.clone(),
             tx,
             unsent_frames: 0,
             target_bytes_per_sample,
             phase: 0,
             phases,
+            meter: Arc::new(LevelMeter::new(config.audio_format.frame_format.channels)),
         },
         SenderBufferConsumer { buffer, rx },
-    )
+    ))
 }
 
 #[derive(Debug, Clone)]
 pub struct SenderBufferProducer {
-    buffer_pointer: AudioBufferPointer,
+    buffer: Arc<SharedAudioBuffer>,
     config: SenderConfig,
     tx: mpsc::Sender<OutgoingPacketPointer>,
     unsent_frames: usize,
     target_bytes_per_sample: usize,
     phase: usize,
     phases: usize,
+    meter: Arc<LevelMeter>,
 }
 
 pub struct OutgoingPacketPointer {
@@ -72,17 +94,35 @@ pub struct OutgoingPacketPointer {
 }
 
 pub struct SenderBufferConsumer {
-    pub buffer: Box<[u8]>,
+    buffer: Arc<SharedAudioBuffer>,
     rx: mpsc::Receiver<OutgoingPacketPointer>,
 }
 
 impl SenderBufferProducer {
+    /// Maximum number of frames per channel that can be written in a single block.
+    pub fn max_frames(&self) -> usize {
+        self.config
+            .audio_format
+            .frames_in_buffer(MAX_PRODUCER_BUFFER_DURATION) as usize
+    }
+
+    pub fn config(&self) -> &SenderConfig {
+        &self.config
+    }
+
+    /// Levels of the sent stream channels
+    pub fn meter(&self) -> Arc<LevelMeter> {
+        self.meter.clone()
+    }
+
     pub fn write_channel(&mut self, channel: usize, offset_frames: usize, channel_buffer: &[f32]) {
-        let phase_len = self.buffer_pointer.len() / self.phases;
+        // packets are only handed to the sender after the whole phase has been written
+        let audio_buffer = unsafe { self.buffer.data_mut::<u8>() };
+        let phase_len = audio_buffer.len() / self.phases;
         let phase_offset = self.phase * phase_len;
 
         debug_assert_eq!(
-            self.buffer_pointer.len(),
+            audio_buffer.len(),
             self.phases * phase_len,
             "Buffer length is not divisible by number of phases"
         );
@@ -93,23 +133,32 @@ impl SenderBufferProducer {
         let bytes_per_frame = bytes_per_sample * channels;
         let channel_offset = channel * bytes_per_sample;
 
-        unsafe {
-            let audio_buffer = self.buffer_pointer.buffer_mut::<u8>();
-
-            for (frame_index, source_sample) in channel_buffer.iter().enumerate() {
-                let frame_offset = (frame_index + unsent_frames + offset_frames) * bytes_per_frame;
-                let start_index = phase_offset + frame_offset + channel_offset;
-                let end_index = start_index + bytes_per_sample;
+        for (frame_index, source_sample) in channel_buffer.iter().enumerate() {
+            let frame_offset = (frame_index + unsent_frames + offset_frames) * bytes_per_frame;
+            let start_index = phase_offset + frame_offset + channel_offset;
+            let end_index = start_index + bytes_per_sample;
 
-                let dest_buf = &mut audio_buffer[start_index..end_index];
+            let dest_buf = &mut audio_buffer[start_index..end_index];
 
-                self.config
-                    .audio_format
-                    .frame_format
-                    .sample_format
-                    .write_sample(*source_sample, dest_buf);
-            }
+            self.config
+                .audio_format
+                .frame_format
+                .sample_format
+                .write_sample(*source_sample, dest_buf);
         }
+
+        self.meter.record(channel, channel_buffer);
+    }
+
+    /// Wire format (interleaved, big-endian) bytes of `frames` frames starting `offset_frames` into the block,
+    /// for sources that produce the wire format directly instead of writing channels as `f32`.
+    pub fn frames_mut(&mut self, offset_frames: usize, frames: usize) -> &mut [u8] {
+        let audio_buffer = unsafe { self.buffer.data_mut::<u8>() };
+        let phase_len = audio_buffer.len() / self.phases;
+        let bytes_per_frame =
+            self.target_bytes_per_sample * self.config.audio_format.frame_format.channels;
+        let start = self.phase * phase_len + (self.unsent_frames + offset_frames) * bytes_per_frame;
+        &mut audio_buffer[start..start + frames * bytes_per_frame]
     }
 
     pub fn send_packets(
@@ -117,11 +166,12 @@ impl SenderBufferProducer {
         ingress_time: Frames,
         written_frames: usize,
     ) -> SenderInternalResult<()> {
-        let phase_len = self.buffer_pointer.len() / self.phases;
+        let audio_buffer = unsafe { self.buffer.data_mut::<u8>() };
+        let phase_len = audio_buffer.len() / self.phases;
         let phase_offset = self.phase * phase_len;
 
         debug_assert_eq!(
-            self.buffer_pointer.len(),
+            audio_buffer.len(),
             self.phases * phase_len,
             "Buffer length is not divisible by number of phases"
         );
@@ -158,12 +208,8 @@ impl SenderBufferProducer {
             let end_index = start_index + spillover_bytes;
             let src_range = start_index..end_index;
 
-            let next_phase_offset = next_phase * self.buffer_pointer.len() / self.phases;
-
-            unsafe {
-                let audio_buffer = self.buffer_pointer.buffer_mut::<u8>();
-                audio_buffer.copy_within(src_range, next_phase_offset);
-            }
+            let next_phase_offset = next_phase * phase_len;
+            audio_buffer.copy_within(src_range, next_phase_offset);
         }
 
         self.phase = next_phase;
@@ -183,4 +229,14 @@ impl SenderBufferConsumer {
 
         Ok(data)
     }
+
+    /// Non-blocking variant of [SenderBufferConsumer::recv].
+    pub fn try_recv(&mut self) -> Option<OutgoingPacketPointer> {
+        self.rx.try_recv().ok()
+    }
+
+    pub fn payload(&self, payload_range: Range<usize>) -> &[u8] {
+        // the producer does not touch a phase again before the packets in it have been received
+        unsafe { &self.buffer.data::<u8>()[payload_range] }
+    }
 }
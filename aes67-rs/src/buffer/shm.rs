@@ -0,0 +1,359 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Audio buffers that live in a sealed memfd so that other processes can map them and read audio data
+//! without copying it through a socket or pipe.
+//!
+//! A segment is laid out as follows (all offsets in bytes, all integers in native byte order):
+//!
+//! ```text
+//! 0                 SharedBufferHeader, padded to SHM_HEADER_LEN
+//! validity_offset   validity map: one u32 per frame slot (only if validity_offset != 0)
+//! data_offset       sample data, data_len bytes
+//! ```
+//!
+//! Receiver buffers hold 32 bit float samples ([SharedSampleFormat::F32Planar]), one strip of
+//! `capacity_frames` samples per channel. The sample for channel `c` at media time `t` is located at
+//! index `c * capacity_frames + t % capacity_frames`. `write_cursor` holds the media time of the frame
+//! following the newest frame written so far. The validity map entry for slot `t % capacity_frames`
+//! holds `t / capacity_frames + 1` if the frame for media time `t` has been written, so a reader can
+//! tell received frames apart from stale ones left over from a lost packet or an earlier lap around
+//! the ring.
+//!
+//! Sender buffers hold the encoded, interleaved payload of outgoing packets ([SharedSampleFormat::L16]
+//! or [SharedSampleFormat::L24], big endian as on the wire). Their payload is laid out by send phase rather
+//! than by media time, so they are not exported and their `write_cursor` is not maintained.
+//!
+//! The writer stores samples and validity entries first and then advances `write_cursor` with release
+//! semantics, so readers must load `write_cursor` with acquire semantics before touching data. Readers
+//! that want to block until new data arrives increment `waiters`, re-check `write_cursor` and then
+//! poll/read the segment's eventfd. The writer only signals the eventfd while `waiters` is non-zero, so
+//! there is no syscall on the write path as long as nobody is waiting.
+//!
+//! The memfd is published as a `/proc/<pid>/fd/<fd>` path, which any process running as the same user can
+//! open and map. An eventfd can't be reopened through `/proc`, so only its descriptor number in the VSC
+//! process is published. Readers duplicate it with `pidfd_open(2)` and `pidfd_getfd(2)` (Linux 5.6 or
+//! newer), which needs ptrace access to the VSC process: the same user with `kernel.yama.ptrace_scope` 0,
+//! or `CAP_SYS_PTRACE`. The duplicate refers to the same eventfd. Readers that can't get it have to poll
+//! `write_cursor` instead.
+
+use serde::{Deserialize, Serialize};
+use std::{
+    ffi::CString,
+    io, mem,
+    os::fd::{AsRawFd, FromRawFd, OwnedFd},
+    ptr::NonNull,
+    slice,
+    sync::atomic::{AtomicU32, AtomicU64, Ordering},
+};
+
+/// "AE67" in little endian
+pub const SHM_MAGIC: u32 = 0x3736_4541;
+pub const SHM_VERSION: u32 = 1;
+pub const SHM_HEADER_LEN: usize = 4096;
+
+#[repr(u32)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
+pub enum SharedSampleFormat {
+    F32Planar = 0,
+    L16 = 1,
+    L24 = 2,
+}
+
+impl SharedSampleFormat {
+    pub fn bytes_per_sample(&self) -> usize {
+        match self {
+            SharedSampleFormat::F32Planar => 4,
+            SharedSampleFormat::L16 => 2,
+            SharedSampleFormat::L24 => 3,
+        }
+    }
+}
+
+#[repr(C)]
+#[derive(Debug)]
+pub struct SharedBufferHeader {
+    pub magic: u32,
+    pub version: u32,
+    pub sample_format: u32,
+    pub channels: u32,
+    pub sample_rate: u32,
+    /// Number of readers currently waiting on the eventfd.
+    pub waiters: AtomicU32,
+    pub capacity_frames: u64,
+    /// Offset of the validity map, 0 if the segment has none.
+    pub validity_offset: u64,
+    pub data_offset: u64,
+    pub data_len: u64,
+    pub write_cursor: AtomicU64,
+}
+
+const _: () = assert!(mem::size_of::<SharedBufferHeader>() <= SHM_HEADER_LEN);
+
+#[derive(Debug, Clone, Copy)]
+pub struct SharedBufferLayout {
+    pub sample_format: SharedSampleFormat,
+    pub channels: usize,
+    pub sample_rate: u32,
+    pub capacity_frames: u64,
+    pub validity_map: bool,
+}
+
+/// Everything another process needs to map a [SharedAudioBuffer].
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct SharedBufferDescriptor {
+    /// `/proc/<pid>/fd/<fd>` path of the memfd
+    pub path: String,
+    /// ID of the process that owns the buffer
+    pub pid: u32,
+    /// Descriptor number of the eventfd in the owning process, to be duplicated with `pidfd_getfd(2)`
+    pub eventfd: i32,
+    pub len: usize,
+    pub sample_format: SharedSampleFormat,
+    pub channels: usize,
+    pub capacity_frames: u64,
+}
+
+#[derive(Debug)]
+pub struct SharedAudioBuffer {
+    memfd: OwnedFd,
+    eventfd: OwnedFd,
+    ptr: NonNull<u8>,
+    len: usize,
+    layout: SharedBufferLayout,
+}
+
+// the mapping is owned by this struct and only unmapped on drop, concurrent access to the sample data
+// is synchronized through the write cursor as described in the module docs
+unsafe impl Send for SharedAudioBuffer {}
+unsafe impl Sync for SharedAudioBuffer {}
+
+impl SharedAudioBuffer {
+    pub fn create(name: &str, layout: SharedBufferLayout) -> io::Result<Self> {
+        let page_size = page_size();
+        let validity_len = if layout.validity_map {
+            (layout.capacity_frames as usize * mem::size_of::<u32>()).next_multiple_of(page_size)
+        } else {
+            0
+        };
+        let validity_offset = if layout.validity_map {
+            SHM_HEADER_LEN
+        } else {
+            0
+        };
+        let data_offset = SHM_HEADER_LEN + validity_len;
+        let data_len = layout.capacity_frames as usize
+            * layout.channels
+            * layout.sample_format.bytes_per_sample();
+        let len = (data_offset + data_len).next_multiple_of(page_size);
+
+        let name = CString::new(format!("aes67-vsc-{name}"))
+            .map_err(|e| io::Error::new(io::ErrorKind::InvalidInput, e))?;
+
+        let memfd = unsafe {
+            let fd = libc::memfd_create(name.as_ptr(), libc::MFD_CLOEXEC | libc::MFD_ALLOW_SEALING);
+            if fd < 0 {
+                return Err(io::Error::last_os_error());
+            }
+            OwnedFd::from_raw_fd(fd)
+        };
+
+        if unsafe { libc::ftruncate(memfd.as_raw_fd(), len as libc::off_t) } != 0 {
+            return Err(io::Error::last_os_error());
+        }
+
+        // other processes must not be able to resize the segment under our feet
+        if unsafe {
+            libc::fcntl(
+                memfd.as_raw_fd(),
+                libc::F_ADD_SEALS,
+                libc::F_SEAL_SHRINK | libc::F_SEAL_GROW | libc::F_SEAL_SEAL,
+            )
+        } != 0
+        {
+            return Err(io::Error::last_os_error());
+        }
+
+        let eventfd = unsafe {
+            let fd = libc::eventfd(0, libc::EFD_CLOEXEC | libc::EFD_NONBLOCK);
+            if fd < 0 {
+                return Err(io::Error::last_os_error());
+            }
+            OwnedFd::from_raw_fd(fd)
+        };
+
+        let ptr = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED,
+                memfd.as_raw_fd(),
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        let ptr = NonNull::new(ptr as *mut u8).expect("mmap returned null");
+
+        // the segment is zero initialized by ftruncate, so the cursor, waiters and validity map start at 0
+        unsafe {
+            let header = ptr.as_ptr() as *mut SharedBufferHeader;
+            (*header).magic = SHM_MAGIC;
+            (*header).version = SHM_VERSION;
+            (*header).sample_format = layout.sample_format as u32;
+            (*header).channels = layout.channels as u32;
+            (*header).sample_rate = layout.sample_rate;
+            (*header).capacity_frames = layout.capacity_frames;
+            (*header).validity_offset = validity_offset as u64;
+            (*header).data_offset = data_offset as u64;
+            (*header).data_len = data_len as u64;
+        }
+
+        Ok(Self {
+            memfd,
+            eventfd,
+            ptr,
+            len,
+            layout,
+        })
+    }
+
+    pub fn header(&self) -> &SharedBufferHeader {
+        unsafe { &*(self.ptr.as_ptr() as *const SharedBufferHeader) }
+    }
+
+    pub fn layout(&self) -> &SharedBufferLayout {
+        &self.layout
+    }
+
+    pub fn capacity_frames(&self) -> u64 {
+        self.layout.capacity_frames
+    }
+
+    pub fn validity(&self) -> &[AtomicU32] {
+        if !self.layout.validity_map {
+            return &[];
+        }
+        unsafe {
+            slice::from_raw_parts(
+                self.ptr.as_ptr().add(SHM_HEADER_LEN) as *const AtomicU32,
+                self.layout.capacity_frames as usize,
+            )
+        }
+    }
+
+    /// Gets the sample data as a slice.
+    /// # Safety
+    /// The data may be modified concurrently by the writer. Callers must only read frames that have been
+    /// published through the write cursor and are not yet due to be overwritten.
+    pub unsafe fn data<T>(&self) -> &[T] {
+        let header = self.header();
+        unsafe {
+            slice::from_raw_parts(
+                self.ptr.as_ptr().add(header.data_offset as usize) as *const T,
+                header.data_len as usize / mem::size_of::<T>(),
+            )
+        }
+    }
+
+    /// Gets the sample data as a mutable slice.
+    /// # Safety
+    /// Only the single producer of this buffer may write to it and it must not hand out overlapping mutable
+    /// slices. Readers in this or other processes may be reading concurrently, which is why frames must
+    /// only be published via [SharedAudioBuffer::publish] after they have been written.
+    #[allow(clippy::mut_from_ref)]
+    pub unsafe fn data_mut<T>(&self) -> &mut [T] {
+        let header = self.header();
+        unsafe {
+            slice::from_raw_parts_mut(
+                self.ptr.as_ptr().add(header.data_offset as usize) as *mut T,
+                header.data_len as usize / mem::size_of::<T>(),
+            )
+        }
+    }
+
+    /// Marks the frames in `[start, start + frames)` as valid. No-op for segments without a validity map.
+    pub fn mark_valid(&self, start: u64, frames: u64) {
+        let validity = self.validity();
+        if validity.is_empty() {
+            return;
+        }
+        let capacity = self.layout.capacity_frames;
+        for t in start..start + frames {
+            validity[(t % capacity) as usize].store((t / capacity) as u32 + 1, Ordering::Relaxed);
+        }
+    }
+
+    pub fn is_valid(&self, frame: u64) -> bool {
+        let capacity = self.layout.capacity_frames;
+        self.validity()
+            .get((frame % capacity) as usize)
+            .map(|v| v.load(Ordering::Relaxed) == (frame / capacity) as u32 + 1)
+            .unwrap_or(false)
+    }
+
+    /// Media time of the frame following the newest published frame, 0 if nothing has been published yet.
+    pub fn write_cursor(&self) -> u64 {
+        self.header().write_cursor.load(Ordering::Acquire)
+    }
+
+    /// Advances the write cursor to `end` and wakes up waiting readers. The cursor never moves backwards,
+    /// so late packets do not hide newer data.
+    pub fn publish(&self, end: u64) {
+        let header = self.header();
+        header.write_cursor.fetch_max(end, Ordering::SeqCst);
+        if header.waiters.load(Ordering::SeqCst) > 0 {
+            let val = 1u64;
+            unsafe {
+                libc::write(
+                    self.eventfd.as_raw_fd(),
+                    &val as *const u64 as *const libc::c_void,
+                    mem::size_of::<u64>(),
+                );
+            }
+        }
+    }
+
+    pub fn descriptor(&self) -> SharedBufferDescriptor {
+        let pid = std::process::id();
+        SharedBufferDescriptor {
+            path: format!("/proc/{pid}/fd/{}", self.memfd.as_raw_fd()),
+            pid,
+            eventfd: self.eventfd.as_raw_fd(),
+            len: self.len,
+            sample_format: self.layout.sample_format,
+            channels: self.layout.channels,
+            capacity_frames: self.layout.capacity_frames,
+        }
+    }
+}
+
+impl Drop for SharedAudioBuffer {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.ptr.as_ptr() as *mut libc::c_void, self.len);
+        }
+    }
+}
+
+fn page_size() -> usize {
+    let size = unsafe { libc::sysconf(libc::_SC_PAGESIZE) };
+    if size > 0 { size as usize } else { 4096 }
+}
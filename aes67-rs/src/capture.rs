@@ -0,0 +1,303 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Rolling in-memory capture of the packets a receiver or sender handled, for analysing losses after the fact.
+//! The real-time thread copies the first [CAPTURE_LEN] bytes of every packet (the RTP header) together with
+//! its source address and reception time into a fixed-size ring. Each slot is a set of atomic words behind a
+//! sequence counter, so recording never blocks or allocates and readers skip slots that are being written.
+//!
+//! The ring can be turned into a pcapng file at any time (see [pcapng]), on request through the API or
+//! automatically when a burst of packet loss is detected.
+
+mod pcapng;
+
+use crate::{
+    formats::{Frames, FramesPerSecond, Seconds},
+    utils::file_name_safe,
+};
+use chrono::Utc;
+use serde::{Deserialize, Serialize};
+use std::{
+    fs, io,
+    net::{IpAddr, Ipv6Addr, SocketAddr},
+    path::PathBuf,
+    sync::{
+        Arc,
+        atomic::{AtomicU64, AtomicUsize, Ordering, fence},
+        mpsc::{self, SyncSender, TrySendError},
+    },
+    thread,
+    time::{Duration, SystemTime, UNIX_EPOCH},
+};
+use tracing::{error, info};
+
+/// Number of bytes captured per packet, the RTP header including up to 5 CSRCs
+pub const CAPTURE_LEN: usize = 32;
+/// Highest packet rate of an AES67 stream (125 µs packet time), used to size the ring
+const MAX_PACKETS_PER_SECOND: usize = 8_000;
+
+const WORDS: usize = 4 + CAPTURE_LEN / 8;
+
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct CaptureConfig {
+    /// Seconds of packet history kept in memory
+    #[serde(default = "default_history")]
+    pub history: Seconds,
+    /// Dump the capture to a file in [CaptureConfig::directory] when this many packets are lost within one
+    /// second. Only receivers detect losses.
+    #[serde(default)]
+    pub loss_burst: Option<u64>,
+    /// Directory automatic dumps are written to
+    #[serde(default = "default_directory")]
+    pub directory: PathBuf,
+}
+
+fn default_history() -> Seconds {
+    10
+}
+
+fn default_directory() -> PathBuf {
+    std::env::temp_dir()
+}
+
+#[derive(Debug, Default)]
+struct Slot {
+    /// odd while the slot is being written
+    sequence: AtomicU64,
+    /// reception time in ns since the epoch, original length and source port, source address as IPv6,
+    /// captured bytes
+    words: [AtomicU64; WORDS],
+}
+
+/// A captured packet
+pub struct CapturedPacket {
+    pub time: SystemTime,
+    pub source: SocketAddr,
+    pub len: usize,
+    pub data: [u8; CAPTURE_LEN],
+}
+
+impl CapturedPacket {
+    /// Captured part of the packet
+    pub fn captured(&self) -> &[u8] {
+        &self.data[..self.len.min(CAPTURE_LEN)]
+    }
+}
+
+/// Ring of the packets captured last. Written by a single real-time thread, read by any number of threads.
+#[derive(Debug)]
+pub struct CaptureRing {
+    label: String,
+    /// where the packets were sent to
+    destination: SocketAddr,
+    slots: Box<[Slot]>,
+    /// number of packets recorded so far
+    head: AtomicUsize,
+    history: Duration,
+}
+
+impl CaptureRing {
+    pub fn new(label: String, destination: SocketAddr, history: Seconds) -> Self {
+        let capacity = (history as usize * MAX_PACKETS_PER_SECOND).max(1);
+        Self {
+            label,
+            destination,
+            slots: (0..capacity).map(|_| Slot::default()).collect(),
+            head: AtomicUsize::new(0),
+            history: Duration::from_secs(history as u64),
+        }
+    }
+
+    /// Copies the header of a packet into the ring. Must only be called from one thread at a time.
+    pub fn record(&self, time: SystemTime, source: SocketAddr, packet: &[u8]) {
+        let head = self.head.load(Ordering::Relaxed);
+        let slot = &self.slots[head % self.slots.len()];
+
+        let mut words = [0u64; WORDS];
+        words[0] = time
+            .duration_since(UNIX_EPOCH)
+            .map(|t| t.as_nanos() as u64)
+            .unwrap_or_default();
+        words[1] = packet.len() as u64 | (source.port() as u64) << 32;
+        let ip = match source.ip() {
+            IpAddr::V4(ip) => ip.to_ipv6_mapped(),
+            IpAddr::V6(ip) => ip,
+        }
+        .to_bits();
+        words[2] = (ip >> 64) as u64;
+        words[3] = ip as u64;
+        let mut data = [0u8; CAPTURE_LEN];
+        let len = packet.len().min(CAPTURE_LEN);
+        data[..len].copy_from_slice(&packet[..len]);
+        for (word, bytes) in words[4..].iter_mut().zip(data.chunks_exact(8)) {
+            *word = u64::from_ne_bytes(bytes.try_into().expect("chunks are 8 bytes"));
+        }
+
+        let sequence = slot.sequence.load(Ordering::Relaxed);
+        slot.sequence.store(sequence + 1, Ordering::Relaxed);
+        fence(Ordering::Release);
+        for (atomic, word) in slot.words.iter().zip(words) {
+            atomic.store(word, Ordering::Relaxed);
+        }
+        slot.sequence.store(sequence + 2, Ordering::Release);
+        self.head.store(head + 1, Ordering::Release);
+    }
+
+    /// Packets of the last [CaptureConfig::history] seconds, oldest first.
+    pub fn packets(&self) -> Vec<CapturedPacket> {
+        let head = self.head.load(Ordering::Acquire);
+        let start = head.saturating_sub(self.slots.len());
+        let mut packets: Vec<CapturedPacket> = (start..head).filter_map(|i| self.read(i)).collect();
+        if let Some(newest) = packets.last().map(|p| p.time) {
+            let oldest = newest.checked_sub(self.history).unwrap_or(UNIX_EPOCH);
+            packets.retain(|p| p.time >= oldest);
+        }
+        packets
+    }
+
+    fn read(&self, index: usize) -> Option<CapturedPacket> {
+        let slot = &self.slots[index % self.slots.len()];
+        let sequence = slot.sequence.load(Ordering::Acquire);
+        if sequence % 2 == 1 {
+            return None;
+        }
+        let mut words = [0u64; WORDS];
+        for (word, atomic) in words.iter_mut().zip(&slot.words) {
+            *word = atomic.load(Ordering::Relaxed);
+        }
+        fence(Ordering::Acquire);
+        if slot.sequence.load(Ordering::Relaxed) != sequence {
+            // overwritten while reading
+            return None;
+        }
+
+        let ip = Ipv6Addr::from_bits((words[2] as u128) << 64 | words[3] as u128);
+        let ip = match ip.to_ipv4_mapped() {
+            Some(ip) => IpAddr::V4(ip),
+            None => IpAddr::V6(ip),
+        };
+        let mut data = [0u8; CAPTURE_LEN];
+        for (bytes, word) in data.chunks_exact_mut(8).zip(&words[4..]) {
+            bytes.copy_from_slice(&word.to_ne_bytes());
+        }
+        Some(CapturedPacket {
+            time: UNIX_EPOCH + Duration::from_nanos(words[0]),
+            source: SocketAddr::new(ip, (words[1] >> 32) as u16),
+            len: words[1] as u32 as usize,
+            data,
+        })
+    }
+
+    /// The capture as a pcapng file
+    pub fn pcapng(&self) -> Vec<u8> {
+        pcapng::write(&self.label, self.destination, &self.packets())
+    }
+
+    /// Writes the capture to a pcapng file in `directory`, returns its path.
+    pub fn dump(&self, directory: &PathBuf) -> io::Result<PathBuf> {
+        fs::create_dir_all(directory)?;
+        let path = directory.join(format!(
+            "{}_{}.pcapng",
+            file_name_safe(&self.label),
+            Utc::now().format("%Y%m%d-%H%M%S")
+        ));
+        fs::write(&path, self.pcapng())?;
+        Ok(path)
+    }
+}
+
+/// Capture as used by the real-time thread: records packets and triggers a dump when packets are lost in a
+/// burst. Dumps are written by a separate thread, so the real-time thread only ever does a non-blocking send.
+pub(crate) struct PacketCapture {
+    ring: Arc<CaptureRing>,
+    loss_burst: Option<u64>,
+    /// frames in which the lost packets are counted
+    window: Frames,
+    window_start: Frames,
+    lost: u64,
+    /// no automatic dump before this media time, so consecutive dumps don't overlap
+    holdoff: Frames,
+    history_frames: Frames,
+    dump: Option<SyncSender<()>>,
+}
+
+impl PacketCapture {
+    pub(crate) fn new(
+        config: &CaptureConfig,
+        label: String,
+        destination: SocketAddr,
+        sample_rate: FramesPerSecond,
+    ) -> Self {
+        let ring = Arc::new(CaptureRing::new(label, destination, config.history));
+        let dump = config.loss_burst.map(|_| {
+            let (tx, rx) = mpsc::sync_channel(1);
+            let ring = ring.clone();
+            let directory = config.directory.clone();
+            thread::spawn(move || {
+                // ends when the capture is dropped
+                while rx.recv().is_ok() {
+                    match ring.dump(&directory) {
+                        Ok(path) => {
+                            info!("Packet loss burst, capture written to {}.", path.display())
+                        }
+                        Err(e) => error!("Could not write packet capture: {e}"),
+                    }
+                }
+            });
+            tx
+        });
+        Self {
+            ring,
+            loss_burst: config.loss_burst,
+            window: sample_rate as Frames,
+            window_start: 0,
+            lost: 0,
+            holdoff: 0,
+            history_frames: config.history as Frames * sample_rate as Frames,
+            dump,
+        }
+    }
+
+    pub(crate) fn ring(&self) -> Arc<CaptureRing> {
+        self.ring.clone()
+    }
+
+    pub(crate) fn record(&self, time: SystemTime, source: SocketAddr, packet: &[u8]) {
+        self.ring.record(time, source, packet);
+    }
+
+    /// Counts lost packets and triggers a dump if there were too many within a second.
+    pub(crate) fn packets_lost(&mut self, lost: u64, media_time: Frames) {
+        let (Some(threshold), Some(dump)) = (self.loss_burst, &self.dump) else {
+            return;
+        };
+        if media_time >= self.window_start + self.window {
+            self.window_start = media_time;
+            self.lost = 0;
+        }
+        self.lost += lost;
+        if self.lost >= threshold && media_time >= self.holdoff {
+            if let Err(TrySendError::Full(_)) = dump.try_send(()) {
+                // a dump is still being written
+                return;
+            }
+            self.holdoff = media_time + self.history_frames;
+            self.lost = 0;
+        }
+    }
+}
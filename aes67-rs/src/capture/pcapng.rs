@@ -0,0 +1,179 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Minimal pcapng writer for [CaptureRing](super::CaptureRing) contents. Only the RTP header of each packet
+//! is kept, so the IP and UDP headers are synthesized from the addresses recorded with the packet and the
+//! packets are written to an interface with link type `LINKTYPE_RAW`. The original length of each packet is
+//! preserved, so tools show the packets as truncated captures of the full stream.
+
+use super::CapturedPacket;
+use std::{
+    net::{IpAddr, SocketAddr},
+    time::UNIX_EPOCH,
+};
+
+const SECTION_HEADER_BLOCK: u32 = 0x0A0D_0D0A;
+const INTERFACE_DESCRIPTION_BLOCK: u32 = 0x0000_0001;
+const ENHANCED_PACKET_BLOCK: u32 = 0x0000_0006;
+const BYTE_ORDER_MAGIC: u32 = 0x1A2B_3C4D;
+const LINKTYPE_RAW: u16 = 101;
+
+const OPT_ENDOFOPT: u16 = 0;
+const SHB_USERAPPL: u16 = 4;
+const IF_NAME: u16 = 2;
+const IF_TSRESOL: u16 = 9;
+
+const IPV4_HEADER_LEN: usize = 20;
+const IPV6_HEADER_LEN: usize = 40;
+const UDP_HEADER_LEN: usize = 8;
+const IPPROTO_UDP: u8 = 17;
+const TTL: u8 = 64;
+
+pub(super) fn write(label: &str, destination: SocketAddr, packets: &[CapturedPacket]) -> Vec<u8> {
+    let mut out = Vec::with_capacity(256 + packets.len() * 112);
+
+    block(&mut out, SECTION_HEADER_BLOCK, |body| {
+        body.extend_from_slice(&BYTE_ORDER_MAGIC.to_le_bytes());
+        body.extend_from_slice(&1u16.to_le_bytes());
+        body.extend_from_slice(&0u16.to_le_bytes());
+        // section length not specified
+        body.extend_from_slice(&(-1i64).to_le_bytes());
+        option(
+            body,
+            SHB_USERAPPL,
+            concat!("aes67-rs ", env!("CARGO_PKG_VERSION")).as_bytes(),
+        );
+        option(body, OPT_ENDOFOPT, &[]);
+    });
+
+    block(&mut out, INTERFACE_DESCRIPTION_BLOCK, |body| {
+        body.extend_from_slice(&LINKTYPE_RAW.to_le_bytes());
+        body.extend_from_slice(&0u16.to_le_bytes());
+        body.extend_from_slice(&0u32.to_le_bytes());
+        option(body, IF_NAME, label.as_bytes());
+        // nanosecond timestamps
+        option(body, IF_TSRESOL, &[9]);
+        option(body, OPT_ENDOFOPT, &[]);
+    });
+
+    let mut data = Vec::with_capacity(IPV6_HEADER_LEN + UDP_HEADER_LEN + super::CAPTURE_LEN);
+    for packet in packets {
+        data.clear();
+        let original_len = ip_udp_headers(&mut data, packet.source, destination, packet.len);
+        data.extend_from_slice(packet.captured());
+
+        let timestamp = packet
+            .time
+            .duration_since(UNIX_EPOCH)
+            .map(|t| t.as_nanos() as u64)
+            .unwrap_or_default();
+
+        block(&mut out, ENHANCED_PACKET_BLOCK, |body| {
+            // interface ID
+            body.extend_from_slice(&0u32.to_le_bytes());
+            body.extend_from_slice(&((timestamp >> 32) as u32).to_le_bytes());
+            body.extend_from_slice(&(timestamp as u32).to_le_bytes());
+            body.extend_from_slice(&(data.len() as u32).to_le_bytes());
+            body.extend_from_slice(&(original_len as u32).to_le_bytes());
+            body.extend_from_slice(&data);
+            pad(body);
+        });
+    }
+
+    out
+}
+
+/// Writes a block with its header and trailing length, `body` writes the contents.
+fn block(out: &mut Vec<u8>, block_type: u32, body: impl FnOnce(&mut Vec<u8>)) {
+    let start = out.len();
+    out.extend_from_slice(&block_type.to_le_bytes());
+    out.extend_from_slice(&0u32.to_le_bytes());
+    body(out);
+    let len = (out.len() - start + 4) as u32;
+    out[start + 4..start + 8].copy_from_slice(&len.to_le_bytes());
+    out.extend_from_slice(&len.to_le_bytes());
+}
+
+fn option(out: &mut Vec<u8>, code: u16, value: &[u8]) {
+    out.extend_from_slice(&code.to_le_bytes());
+    out.extend_from_slice(&(value.len() as u16).to_le_bytes());
+    out.extend_from_slice(value);
+    pad(out);
+}
+
+fn pad(out: &mut Vec<u8>) {
+    out.resize(out.len().next_multiple_of(4), 0);
+}
+
+/// Writes IP and UDP headers for a datagram with a payload of `payload_len` bytes, returns the length of the
+/// whole packet. IPv4 is used if both addresses are IPv4, IPv6 otherwise.
+fn ip_udp_headers(
+    out: &mut Vec<u8>,
+    source: SocketAddr,
+    destination: SocketAddr,
+    payload_len: usize,
+) -> usize {
+    let udp_len = UDP_HEADER_LEN + payload_len;
+
+    let total_len = match (source.ip(), destination.ip()) {
+        (IpAddr::V4(src), IpAddr::V4(dst)) => {
+            let total_len = IPV4_HEADER_LEN + udp_len;
+            let start = out.len();
+            out.extend_from_slice(&[0x45, 0]);
+            out.extend_from_slice(&(total_len as u16).to_be_bytes());
+            // identification, don't fragment
+            out.extend_from_slice(&[0, 0, 0x40, 0]);
+            out.extend_from_slice(&[TTL, IPPROTO_UDP, 0, 0]);
+            out.extend_from_slice(&src.octets());
+            out.extend_from_slice(&dst.octets());
+            let checksum = ipv4_checksum(&out[start..]);
+            out[start + 10..start + 12].copy_from_slice(&checksum.to_be_bytes());
+            total_len
+        }
+        (src, dst) => {
+            let [src, dst] = [src, dst].map(|ip| match ip {
+                IpAddr::V4(ip) => ip.to_ipv6_mapped(),
+                IpAddr::V6(ip) => ip,
+            });
+            out.extend_from_slice(&[0x60, 0, 0, 0]);
+            out.extend_from_slice(&(udp_len as u16).to_be_bytes());
+            out.extend_from_slice(&[IPPROTO_UDP, TTL]);
+            out.extend_from_slice(&src.octets());
+            out.extend_from_slice(&dst.octets());
+            IPV6_HEADER_LEN + udp_len
+        }
+    };
+
+    out.extend_from_slice(&source.port().to_be_bytes());
+    out.extend_from_slice(&destination.port().to_be_bytes());
+    out.extend_from_slice(&(udp_len as u16).to_be_bytes());
+    // the payload is truncated, so no checksum can be calculated
+    out.extend_from_slice(&0u16.to_be_bytes());
+
+    total_len
+}
+
+fn ipv4_checksum(header: &[u8]) -> u16 {
+    let mut sum = header
+        .chunks_exact(2)
+        .map(|word| u16::from_be_bytes([word[0], word[1]]) as u32)
+        .sum::<u32>();
+    while sum > 0xFFFF {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    !(sum as u16)
+}
@@ -101,10 +101,50 @@ pub struct Config {
     pub audio: AudioConfig,
 }
 
+/// Parameters of the delay-locked loop that aligns an audio backend's own frame clock (e.g. JACK's frame time)
+/// with the PTP media clock.
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct MediaClockServoConfig {
+    /// Loop bandwidth in Hz while the loop is acquiring lock.
+    #[serde(default = "default_acquisition_bandwidth")]
+    pub acquisition_bandwidth: f64,
+    /// Loop bandwidth in Hz once the loop is locked. Lower values filter out more PTP jitter but take longer
+    /// to follow frequency changes of the audio clock.
+    #[serde(default = "default_tracking_bandwidth")]
+    pub tracking_bandwidth: f64,
+    /// Interval at which the PTP clock is sampled once the loop is locked. While acquiring lock it is sampled
+    /// in every audio cycle.
+    #[serde(default = "default_locked_sample_interval", with = "serde_millis")]
+    pub locked_sample_interval: Duration,
+}
+
+impl Default for MediaClockServoConfig {
+    fn default() -> Self {
+        Self {
+            acquisition_bandwidth: default_acquisition_bandwidth(),
+            tracking_bandwidth: default_tracking_bandwidth(),
+            locked_sample_interval: default_locked_sample_interval(),
+        }
+    }
+}
+
 fn default_sample_rate() -> FramesPerSecond {
     48_000
 }
 
+fn default_acquisition_bandwidth() -> f64 {
+    1.0
+}
+
+fn default_tracking_bandwidth() -> f64 {
+    0.1
+}
+
+fn default_locked_sample_interval() -> Duration {
+    Duration::from_millis(20)
+}
+
 impl Config {
     pub async fn load(app_id: &str, wb: &Worterbuch) -> ConnectionResult<Self> {
         let ptp = wb.get::<PtpMode>(topic!(app_id, "config", "ptp")).await?;
@@ -15,7 +15,10 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-use crate::{buffer::sender::OutgoingPacketPointer, formats::SessionId};
+use crate::{
+    buffer::sender::OutgoingPacketPointer,
+    formats::{FramesPerSecond, SessionId},
+};
 use axum::{http::StatusCode, response::IntoResponse};
 use miette::Diagnostic;
 use rtp_rs::{RtpPacketBuildError, RtpReaderError};
@@ -132,6 +135,10 @@ pub enum SenderInternalError {
     ChannelCountMismatch { configured: usize, provided: usize },
     #[error("RTP packet is too large: {0}. MTU is 1500.")]
     MaxMTUExceeded(usize),
+    #[error(
+        "Block of {requested} frames is too large, at most {max} frames can be written at once."
+    )]
+    BlockTooLarge { requested: usize, max: usize },
     #[error("Producer closed.")]
     ProducerClosed,
     #[error("Shutdown triggered.")]
@@ -142,6 +149,13 @@ pub enum SenderInternalError {
     NoSuchSender(SessionId),
     #[error("No buffers provided.")]
     NoBuffersProvided,
+    #[error("Receiver with ID {0} to relay does not exist.")]
+    NoSuchRelaySource(SessionId),
+    #[error("Relay sample rate mismatch: receiver runs at {receiver} Hz, sender at {sender} Hz.")]
+    RelaySampleRateMismatch {
+        receiver: FramesPerSecond,
+        sender: FramesPerSecond,
+    },
     #[error("Send error: {0}")]
     TrySendError(#[from] mpsc::error::TrySendError<OutgoingPacketPointer>),
 }
@@ -162,6 +176,24 @@ pub enum ReceiverInternalError {
     ChildAppError(#[from] ChildAppError),
     #[error("Receiver with ID {0} does not exist.")]
     NoSuchReceiver(SessionId),
+    #[error("Block of {requested} frames is too large, at most {max} frames can be read at once.")]
+    BlockTooLarge { requested: usize, max: usize },
+}
+
+#[derive(Error, Debug, Diagnostic)]
+pub enum SimulationError {
+    #[error("Clock Error: {0}.")]
+    ClockError(#[from] ClockError),
+    #[error("Internal Sender error: {0}")]
+    SenderInternalError(#[from] SenderInternalError),
+    #[error("Internal Receiver error: {0}")]
+    ReceiverInternalError(#[from] ReceiverInternalError),
+    #[error("Could not read capture: {0}")]
+    IoError(#[from] io::Error),
+    #[error("Invalid capture file: {0}")]
+    InvalidCapture(&'static str),
+    #[error("The capture contains no RTP stream to replay")]
+    NoStreamInCapture,
 }
 
 #[derive(Error, Debug, Diagnostic)]
@@ -268,6 +300,7 @@ pub type ReceiverApiResult<T> = Result<T, ReceiverApiError>;
 pub type VscInternalResult<T> = Result<T, VscInternalError>;
 pub type SenderInternalResult<T> = Result<T, SenderInternalError>;
 pub type ReceiverInternalResult<T> = Result<T, ReceiverInternalError>;
+pub type SimulationResult<T> = Result<T, SimulationError>;
 pub type JackResult<T> = Result<T, JackError>;
 pub type AlsaResult<T> = Result<T, AlsaError>;
 pub type ConfigResult<T> = Result<T, ConfigError>;
@@ -369,41 +402,115 @@ pub trait GetErrorCode {
 
 impl GetErrorCode for ConfigError {
     fn error_code(&self) -> u8 {
-        todo!()
+        error!("{:?}", self);
+        match self {
+            ConfigError::YamlError(_) => ErrorCode::YamlError as u8,
+            ConfigError::IoError(_) => ErrorCode::IoError as u8,
+            ConfigError::InvalidSdp(_) => ErrorCode::InvalidSdp as u8,
+            ConfigError::InvalidLocalIP(_) | ConfigError::InvalidIp(_) => {
+                ErrorCode::InvalidIp as u8
+            }
+            ConfigError::UnsupportedSampleFormat(_) => ErrorCode::UnknownSampleFormat as u8,
+            _ => ErrorCode::Other as u8,
+        }
     }
 }
 
 impl GetErrorCode for VscApiError {
     fn error_code(&self) -> u8 {
         match self {
-            VscApiError::Internal(e) => error!("{:?}", e),
-            VscApiError::Sender(e) => error!("{:?}", e),
-            VscApiError::Receiver(e) => error!("{:?}", e),
-            VscApiError::ChannelError(e) => error!("{:?}", e),
-            VscApiError::ClockError(e) => error!("{:?}", e),
-            VscApiError::ConfigError(e) => error!("{:?}", e),
-            VscApiError::AlreadyRunning => error!("VSC is already running"),
-            VscApiError::NotRunning => error!("VSC is not running"),
-            VscApiError::WorterbuchError(e) => error!("{:?}", e),
-            VscApiError::SenderConfigIncomplete(_) => error!("{:?}", self),
-            VscApiError::ReceiverConfigIncomplete(_) => error!("{:?}", self),
-            VscApiError::AddrParseError(e) => error!("{:?}", e),
-            VscApiError::NotImplemented => error!("{:?}", self),
+            VscApiError::Receiver(e) => e.error_code(),
+            VscApiError::ConfigError(e) => e.error_code(),
+            VscApiError::WorterbuchError(e) => {
+                error!("{:?}", e);
+                ErrorCode::WorterbuchError as u8
+            }
+            VscApiError::ChannelError(e) => {
+                error!("{:?}", e);
+                ErrorCode::ApiError as u8
+            }
+            VscApiError::AddrParseError(e) => {
+                error!("{:?}", e);
+                ErrorCode::InvalidIp as u8
+            }
+            VscApiError::Internal(e) => {
+                error!("{:?}", e);
+                ErrorCode::Other as u8
+            }
+            VscApiError::Sender(e) => e.error_code(),
+            VscApiError::ClockError(e) => {
+                error!("{:?}", e);
+                ErrorCode::Other as u8
+            }
+            VscApiError::AlreadyRunning
+            | VscApiError::NotRunning
+            | VscApiError::SenderConfigIncomplete(_)
+            | VscApiError::ReceiverConfigIncomplete(_)
+            | VscApiError::NotImplemented => {
+                error!("{:?}", self);
+                ErrorCode::ApiError as u8
+            }
+        }
+    }
+}
+
+impl GetErrorCode for SenderApiError {
+    fn error_code(&self) -> u8 {
+        match self {
+            SenderApiError::Internal(e) => e.error_code(),
+            SenderApiError::ChannelError(e) => {
+                error!("{:?}", e);
+                ErrorCode::ApiError as u8
+            }
+        }
+    }
+}
+
+impl GetErrorCode for SenderInternalError {
+    fn error_code(&self) -> u8 {
+        match self {
+            SenderInternalError::ConfigError(e) => e.error_code(),
+            SenderInternalError::IoError(e) => {
+                error!("{:?}", e);
+                ErrorCode::IoError as u8
+            }
+            SenderInternalError::RtpPacketBuildError(e) => {
+                error!("{:?}", e);
+                ErrorCode::RtpPacketBuildError as u8
+            }
+            e => {
+                error!("{:?}", e);
+                ErrorCode::Other as u8
+            }
         }
-        // TODO
-        3
     }
 }
 
 impl GetErrorCode for ReceiverApiError {
     fn error_code(&self) -> u8 {
-        todo!()
+        match self {
+            ReceiverApiError::Internal(e) => e.error_code(),
+            ReceiverApiError::ChannelError(e) => {
+                error!("{:?}", e);
+                ErrorCode::ApiError as u8
+            }
+        }
     }
 }
 
 impl GetErrorCode for ReceiverInternalError {
     fn error_code(&self) -> u8 {
-        todo!()
+        match self {
+            ReceiverInternalError::ConfigError(e) => e.error_code(),
+            ReceiverInternalError::IoError(e) => {
+                error!("{:?}", e);
+                ErrorCode::IoError as u8
+            }
+            e => {
+                error!("{:?}", e);
+                ErrorCode::Other as u8
+            }
+        }
     }
 }
 
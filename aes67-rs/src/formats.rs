@@ -202,7 +202,7 @@ impl FromStr for SampleFormat {
 
     fn from_str(s: &str) -> Result<Self, Self::Err> {
         match s {
-            "L16" => Ok(SampleFormat::L24),
+            "L16" => Ok(SampleFormat::L16),
             "L24" => Ok(SampleFormat::L24),
             other => Err(ConfigError::UnsupportedSampleFormat(other.to_owned())),
         }
@@ -277,6 +277,10 @@ impl SampleFormat {
             SampleFormat::L24 => 3,
         }
     }
+
+    pub fn bit_depth(&self) -> usize {
+        self.bytes_per_sample() * 8
+    }
 }
 
 fn bytes_to_f32_2_bytes(bytes: &[u8]) -> f32 {
@@ -382,6 +386,15 @@ pub fn bytes_per_sample(bit_depth: usize) -> usize {
     bit_depth / 8
 }
 
+/// Inverse of reading an L16/L24 sample as `f32`, gives back exactly the integer sample that was received
+/// (except for -1, which reads as 0).
+pub fn f32_to_pcm(sample: f32, bit_depth: usize) -> i32 {
+    let max = ((1i64 << (bit_depth - 1)) - 1) as f32;
+    let sample = sample.clamp(-1.0, 1.0);
+    let value = (sample * max).round() as i32;
+    if sample < 0.0 { value - 1 } else { value }
+}
+
 pub fn bytes_per_frame(channels: usize, sample_format: SampleFormat) -> usize {
     channels * sample_format.bytes_per_sample()
 }
@@ -446,4 +459,11 @@ mod test {
     fn frames_per_link_offset_buffer_works() {
         assert_eq!(192, frames_in_buffer(4.0, 48_000));
     }
+
+    #[test]
+    fn sample_format_from_str_works() {
+        assert_eq!(SampleFormat::L16, "L16".parse().unwrap());
+        assert_eq!(SampleFormat::L24, "L24".parse().unwrap());
+        assert!("L32".parse::<SampleFormat>().is_err());
+    }
 }
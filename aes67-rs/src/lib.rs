@@ -16,13 +16,20 @@
  */
 
 pub mod buffer;
+pub mod capture;
 pub mod config;
 pub mod error;
 pub mod formats;
 pub mod monitoring;
 pub mod nic;
+pub mod player;
 pub mod receiver;
+pub mod recorder;
+pub mod relay;
+pub mod resampling;
+pub mod routing;
 pub mod sender;
+pub mod simulation;
 pub mod socket;
 pub mod time;
 pub mod utils;
@@ -0,0 +1,199 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Peak and RMS level meters. The audio threads measure every block they write to a sender or receiver buffer
+//! while it is still in cache and accumulate the result in atomics. A reader takes the levels at a low rate,
+//! which resets them for the next interval.
+//!
+//! Measuring runs on 8 samples at a time with AVX or 4 with SSE on x86_64, 4 with NEON on aarch64, and falls
+//! back to a scalar loop for the tail and on other targets.
+
+use std::sync::atomic::{AtomicU32, AtomicU64, Ordering};
+
+/// Levels of one channel since they were last taken, as linear amplitudes
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct Level {
+    pub peak: f32,
+    pub rms: f32,
+}
+
+#[derive(Debug, Default)]
+struct ChannelMeter {
+    /// bits of the largest absolute sample value, non-negative floats order like their bits
+    peak: AtomicU32,
+    /// bits of the sum of squares as `f64`
+    power: AtomicU64,
+    samples: AtomicU64,
+}
+
+#[derive(Debug)]
+pub struct LevelMeter {
+    channels: Box<[ChannelMeter]>,
+}
+
+impl LevelMeter {
+    pub fn new(channels: usize) -> Self {
+        Self {
+            channels: (0..channels).map(|_| ChannelMeter::default()).collect(),
+        }
+    }
+
+    pub fn channels(&self) -> usize {
+        self.channels.len()
+    }
+
+    /// Adds a block of samples of `channel`. Lock-free, so it is safe to call from the audio thread.
+    pub fn record(&self, channel: usize, samples: &[f32]) {
+        let Some(meter) = self.channels.get(channel) else {
+            return;
+        };
+        if samples.is_empty() {
+            return;
+        }
+        let (peak, power) = measure(samples);
+        meter.peak.fetch_max(peak.to_bits(), Ordering::Relaxed);
+        meter
+            .power
+            .fetch_update(Ordering::Relaxed, Ordering::Relaxed, |bits| {
+                Some((f64::from_bits(bits) + power as f64).to_bits())
+            })
+            .ok();
+        meter
+            .samples
+            .fetch_add(samples.len() as u64, Ordering::Relaxed);
+    }
+
+    /// Returns the levels of `channel` since the last call and resets them.
+    pub fn take(&self, channel: usize) -> Level {
+        let Some(meter) = self.channels.get(channel) else {
+            return Level::default();
+        };
+        let peak = f32::from_bits(meter.peak.swap(0, Ordering::Relaxed));
+        let power = f64::from_bits(meter.power.swap(0, Ordering::Relaxed));
+        let samples = meter.samples.swap(0, Ordering::Relaxed);
+        let rms = if samples > 0 {
+            (power / samples as f64).sqrt() as f32
+        } else {
+            0.0
+        };
+        Level { peak, rms }
+    }
+}
+
+/// Largest absolute value and sum of squares of `samples`
+fn measure(samples: &[f32]) -> (f32, f32) {
+    #[cfg(target_arch = "x86_64")]
+    let (done, peak, power) = if is_x86_feature_detected!("avx") {
+        unsafe { measure_avx(samples) }
+    } else {
+        unsafe { measure_sse(samples) }
+    };
+
+    #[cfg(target_arch = "aarch64")]
+    let (done, peak, power) = unsafe { measure_neon(samples) };
+
+    #[cfg(not(any(target_arch = "x86_64", target_arch = "aarch64")))]
+    let (done, peak, power) = (0, 0.0, 0.0);
+
+    samples[done..]
+        .iter()
+        .fold((peak, power), |(peak, power), s| {
+            (peak.max(s.abs()), power + s * s)
+        })
+}
+
+/// Returns the number of samples measured, their peak and their sum of squares.
+#[cfg(target_arch = "x86_64")]
+#[target_feature(enable = "avx")]
+unsafe fn measure_avx(samples: &[f32]) -> (usize, f32, f32) {
+    use std::arch::x86_64::{
+        _mm256_add_ps, _mm256_andnot_ps, _mm256_loadu_ps, _mm256_max_ps, _mm256_mul_ps,
+        _mm256_set1_ps, _mm256_setzero_ps, _mm256_storeu_ps,
+    };
+
+    let mut done = 0;
+    let mut peak = [0.0f32; 8];
+    let mut power = [0.0f32; 8];
+    unsafe {
+        let sign = _mm256_set1_ps(-0.0);
+        let mut peaks = _mm256_setzero_ps();
+        let mut powers = _mm256_setzero_ps();
+        while done + 8 <= samples.len() {
+            let s = _mm256_loadu_ps(samples.as_ptr().add(done));
+            peaks = _mm256_max_ps(peaks, _mm256_andnot_ps(sign, s));
+            powers = _mm256_add_ps(powers, _mm256_mul_ps(s, s));
+            done += 8;
+        }
+        _mm256_storeu_ps(peak.as_mut_ptr(), peaks);
+        _mm256_storeu_ps(power.as_mut_ptr(), powers);
+    }
+    (
+        done,
+        peak.into_iter().fold(0.0, f32::max),
+        power.into_iter().sum(),
+    )
+}
+
+#[cfg(target_arch = "x86_64")]
+unsafe fn measure_sse(samples: &[f32]) -> (usize, f32, f32) {
+    use std::arch::x86_64::{
+        _mm_add_ps, _mm_andnot_ps, _mm_loadu_ps, _mm_max_ps, _mm_mul_ps, _mm_set1_ps,
+        _mm_setzero_ps, _mm_storeu_ps,
+    };
+
+    let mut done = 0;
+    let mut peak = [0.0f32; 4];
+    let mut power = [0.0f32; 4];
+    unsafe {
+        let sign = _mm_set1_ps(-0.0);
+        let mut peaks = _mm_setzero_ps();
+        let mut powers = _mm_setzero_ps();
+        while done + 4 <= samples.len() {
+            let s = _mm_loadu_ps(samples.as_ptr().add(done));
+            peaks = _mm_max_ps(peaks, _mm_andnot_ps(sign, s));
+            powers = _mm_add_ps(powers, _mm_mul_ps(s, s));
+            done += 4;
+        }
+        _mm_storeu_ps(peak.as_mut_ptr(), peaks);
+        _mm_storeu_ps(power.as_mut_ptr(), powers);
+    }
+    (
+        done,
+        peak.into_iter().fold(0.0, f32::max),
+        power.into_iter().sum(),
+    )
+}
+
+#[cfg(target_arch = "aarch64")]
+unsafe fn measure_neon(samples: &[f32]) -> (usize, f32, f32) {
+    use std::arch::aarch64::{
+        vabsq_f32, vaddvq_f32, vdupq_n_f32, vld1q_f32, vmaxq_f32, vmaxvq_f32, vmlaq_f32,
+    };
+
+    let mut done = 0;
+    unsafe {
+        let mut peaks = vdupq_n_f32(0.0);
+        let mut powers = vdupq_n_f32(0.0);
+        while done + 4 <= samples.len() {
+            let s = vld1q_f32(samples.as_ptr().add(done));
+            peaks = vmaxq_f32(peaks, vabsq_f32(s));
+            powers = vmlaq_f32(powers, s, s);
+            done += 4;
+        }
+        (done, vmaxvq_f32(peaks), vaddvq_f32(powers))
+    }
+}
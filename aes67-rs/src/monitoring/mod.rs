@@ -16,14 +16,21 @@
  */
 
 mod health;
+pub mod meter;
 mod observability;
 mod stats;
+pub mod timing;
 
 use crate::{
-    buffer::AudioBufferPointer,
+    buffer::shm::SharedBufferDescriptor,
     error::{ChildAppError, ChildAppResult},
     formats::{Frames, MilliSeconds},
-    monitoring::{health::health, observability::observability, stats::stats},
+    monitoring::{
+        health::health,
+        observability::observability,
+        stats::stats,
+        timing::{CycleTimingStats, HistogramSnapshot},
+    },
     receiver::config::ReceiverConfig,
     sender::config::SenderConfig,
     time::Time,
@@ -78,7 +85,6 @@ pub enum SenderState {
         id: String,
         config: SenderConfig,
         label: String,
-        address: AudioBufferPointer,
     },
     Renamed {
         id: String,
@@ -95,7 +101,7 @@ pub enum ReceiverState {
         id: String,
         config: ReceiverConfig,
         label: String,
-        address: AudioBufferPointer,
+        buffer: SharedBufferDescriptor,
     },
     Renamed {
         id: String,
@@ -159,6 +165,17 @@ impl Div<usize> for Delay {
     }
 }
 
+/// State of the loop that locks an audio backend's frame clock to the PTP media clock.
+#[derive(Debug, Clone, Default, Serialize, serde::Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct MediaClockServoStats {
+    /// Estimated ratio between PTP media clock rate and audio clock rate.
+    pub rate_ratio: f64,
+    /// Phase error of the last PTP clock measurement in frames.
+    pub phase_error: f64,
+    pub locked: bool,
+}
+
 #[derive(Debug, Clone)]
 pub enum VscStatsReport {}
 
@@ -169,6 +186,14 @@ pub enum SenderStatsReport {
         ptime_frames: u64,
         packet_size: usize,
     },
+    MediaClockServo {
+        sender: String,
+        servo: MediaClockServoStats,
+    },
+    CycleTiming {
+        sender: String,
+        timing: CycleTimingStats,
+    },
 }
 
 #[derive(Debug, Clone)]
@@ -205,6 +230,22 @@ pub enum ReceiverStatsReport {
         receiver: String,
         muted: bool,
     },
+    KernelDrops {
+        receiver: String,
+        drops: u32,
+    },
+    ReceiveLatency {
+        receiver: String,
+        latency: HistogramSnapshot,
+    },
+    MediaClockServo {
+        receiver: String,
+        servo: MediaClockServoStats,
+    },
+    CycleTiming {
+        receiver: String,
+        timing: CycleTimingStats,
+    },
 }
 
 #[derive(Debug, Clone)]
@@ -233,6 +274,11 @@ pub enum Stats {
 #[derive(Debug, Clone)]
 pub enum TxStats {
     BufferOverflow,
+    /// The I/O handler wrote a block that was larger than the sender can take, the block was dropped
+    BlockTooLarge {
+        requested: usize,
+        max: usize,
+    },
     PacketSent {
         ptime_frames: Frames,
         packet_size: usize,
@@ -241,11 +287,13 @@ pub enum TxStats {
         pre_send: Time,
         post_send: Time,
     },
+    MediaClockServo(MediaClockServoStats),
+    CycleTiming(CycleTimingStats),
 }
 
 #[derive(Debug, Clone)]
 pub enum RxStats {
-    Started(ReceiverConfig, AudioBufferPointer),
+    Started(ReceiverConfig, SharedBufferDescriptor),
     BufferUnderrun,
     InconsistentTimestamp,
     PacketReceived {
@@ -273,7 +321,13 @@ pub enum RxStats {
     Stopped,
     MediaClockOffsetChanged(Frames, u32),
     PacketFromWrongSender(IpAddr),
+    /// Total number of packets the kernel dropped on the receive socket, including socket filter drops
+    KernelDrops(u32),
+    /// Time from packet reception in the kernel until the packet was written to the receiver buffer
+    ReceiveLatency(HistogramSnapshot),
     Muted(bool),
+    MediaClockServo(MediaClockServoStats),
+    CycleTiming(CycleTimingStats),
 }
 
 #[derive(Debug, Clone)]
@@ -317,6 +371,15 @@ impl Monitoring {
         self.parent.child(id)
     }
 
+    /// Creates a monitoring handle that is not connected to a monitoring service. All events are delivered
+    /// to the returned receiver instead, children created from it are discarded.
+    pub fn detached(capacity: usize) -> (Monitoring, mpsc::Receiver<MonitoringEvent>) {
+        let (parent_tx, _) = mpsc::channel(1);
+        let (tx, rx) = mpsc::channel(capacity);
+        let parent = MonitoringParent(parent_tx);
+        (Monitoring { parent, tx }, rx)
+    }
+
     pub fn vsc_state(&self, state: VscState) {
         self.tx
             .try_send(MonitoringEvent::State(StateEvent::Vsc(state)))
@@ -16,12 +16,13 @@
  */
 
 use crate::{
-    buffer::AudioBufferPointer,
+    buffer::shm::SharedBufferDescriptor,
     formats::{Frames, MilliSeconds},
     monitoring::{
-        Delay, HealthReport, ReceiverHealthReport, ReceiverState, ReceiverStatsReport, Report,
-        SenderHealthReport, SenderState, SenderStatsReport, StateEvent, StatsReport,
-        VscHealthReport, VscState, VscStatsReport,
+        Delay, HealthReport, MediaClockServoStats, ReceiverHealthReport, ReceiverState,
+        ReceiverStatsReport, Report, SenderHealthReport, SenderState, SenderStatsReport,
+        StateEvent, StatsReport, VscHealthReport, VscState, VscStatsReport,
+        timing::{CycleTimingStats, HistogramSnapshot},
     },
     receiver::config::ReceiverConfig,
     sender::config::SenderConfig,
@@ -48,6 +49,10 @@ struct LostPackets {
 struct SenderStats {
     ptime_frames: Frames,
     packet_size: usize,
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    media_clock_servo: Option<MediaClockServoStats>,
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    cycle_timing: Option<CycleTimingStats>,
 }
 #[derive(Debug, Clone, Default, Serialize, Deserialize)]
 #[serde(rename_all = "camelCase")]
@@ -61,6 +66,14 @@ struct ReceiverStats {
     lost_packets: LostPackets,
     late_packets: LostPackets,
     muted: bool,
+    /// Packets dropped by the kernel on the receive socket, e.g. by the RTP socket filter
+    kernel_drops: u32,
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    receive_latency: Option<HistogramSnapshot>,
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    media_clock_servo: Option<MediaClockServoStats>,
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    cycle_timing: Option<CycleTimingStats>,
 }
 
 #[derive(Debug, Clone, Serialize, Deserialize)]
@@ -69,7 +82,6 @@ struct SenderData {
     config: SenderConfig,
     stats: SenderStats,
     label: String,
-    address: AudioBufferPointer,
     running: bool,
 }
 
@@ -79,7 +91,7 @@ struct ReceiverData {
     config: ReceiverConfig,
     stats: ReceiverStats,
     label: String,
-    address: AudioBufferPointer,
+    buffer: SharedBufferDescriptor,
     running: bool,
 }
 
@@ -180,12 +192,9 @@ impl ObservabilityActor {
 
     async fn process_sender_event(&mut self, e: SenderState) {
         match e {
-            SenderState::Created {
-                id,
-                config,
-                label,
-                address,
-            } => self.sender_created(id, label, config, address).await,
+            SenderState::Created { id, config, label } => {
+                self.sender_created(id, label, config).await
+            }
             SenderState::Renamed { id, label } => self.sender_renamed(id, label).await,
             SenderState::Destroyed { id } => self.sender_destroyed(id).await,
         }
@@ -197,8 +206,8 @@ impl ObservabilityActor {
                 id: name,
                 config,
                 label,
-                address,
-            } => self.receiver_created(name, label, config, address).await,
+                buffer,
+            } => self.receiver_created(name, label, config, buffer).await,
             ReceiverState::Renamed { id, label } => self.receiver_renamed(id, label).await,
             ReceiverState::Destroyed { id: name } => self.receiver_destroyed(name).await,
         }
@@ -226,18 +235,11 @@ impl ObservabilityActor {
         self.publish_vsc().await;
     }
 
-    async fn sender_created(
-        &mut self,
-        name: String,
-        label: String,
-        config: SenderConfig,
-        address: AudioBufferPointer,
-    ) {
+    async fn sender_created(&mut self, name: String, label: String, config: SenderConfig) {
         let data = SenderData {
             config: config.clone(),
             stats: SenderStats::default(),
             label,
-            address,
             running: true,
         };
         self.senders.insert(name.clone(), data.clone());
@@ -262,13 +264,13 @@ impl ObservabilityActor {
         qualified_id: String,
         label: String,
         config: ReceiverConfig,
-        address: AudioBufferPointer,
+        buffer: SharedBufferDescriptor,
     ) {
         let data = ReceiverData {
             config: config.clone(),
             stats: ReceiverStats::default(),
             label,
-            address,
+            buffer,
             running: true,
         };
         self.receivers.insert(qualified_id.clone(), data.clone());
@@ -302,6 +304,12 @@ impl ObservabilityActor {
                 self.sender_packet_size_changed(sender, ptime_frames, packet_size)
                     .await;
             }
+            SenderStatsReport::MediaClockServo { sender, servo } => {
+                self.sender_media_clock_servo_changed(sender, servo).await;
+            }
+            SenderStatsReport::CycleTiming { sender, timing } => {
+                self.sender_cycle_timing_changed(sender, timing).await;
+            }
         }
     }
 
@@ -352,6 +360,20 @@ impl ObservabilityActor {
             ReceiverStatsReport::Muted { receiver, muted } => {
                 self.receiver_muted_changed(receiver, muted).await
             }
+            ReceiverStatsReport::MediaClockServo { receiver, servo } => {
+                self.receiver_media_clock_servo_changed(receiver, servo)
+                    .await
+            }
+            ReceiverStatsReport::ReceiveLatency { receiver, latency } => {
+                self.receiver_receive_latency_changed(receiver, latency)
+                    .await
+            }
+            ReceiverStatsReport::KernelDrops { receiver, drops } => {
+                self.receiver_kernel_drops_changed(receiver, drops).await
+            }
+            ReceiverStatsReport::CycleTiming { receiver, timing } => {
+                self.receiver_cycle_timing_changed(receiver, timing).await
+            }
         }
     }
 
@@ -370,6 +392,32 @@ impl ObservabilityActor {
         self.publish_sender_stats(&qualified_id, stats).await;
     }
 
+    async fn sender_media_clock_servo_changed(
+        &mut self,
+        qualified_id: String,
+        servo: MediaClockServoStats,
+    ) {
+        let Some(sender) = self.senders.get_mut(&qualified_id) else {
+            return;
+        };
+        sender.stats.media_clock_servo = Some(servo);
+        let stats = sender.stats.clone();
+        self.publish_sender_stats(&qualified_id, stats).await;
+    }
+
+    async fn sender_cycle_timing_changed(
+        &mut self,
+        qualified_id: String,
+        timing: CycleTimingStats,
+    ) {
+        let Some(sender) = self.senders.get_mut(&qualified_id) else {
+            return;
+        };
+        sender.stats.cycle_timing = Some(timing);
+        let stats = sender.stats.clone();
+        self.publish_sender_stats(&qualified_id, stats).await;
+    }
+
     async fn receiver_clock_offset_changed(&mut self, qualified_id: String, offset: u64) {
         let Some(receiver) = self.receivers.get_mut(&qualified_id) else {
             return;
@@ -461,6 +509,54 @@ impl ObservabilityActor {
         self.publish_receiver_stats(&qualified_id, stats).await;
     }
 
+    async fn receiver_media_clock_servo_changed(
+        &mut self,
+        qualified_id: String,
+        servo: MediaClockServoStats,
+    ) {
+        let Some(receiver) = self.receivers.get_mut(&qualified_id) else {
+            return;
+        };
+        receiver.stats.media_clock_servo = Some(servo);
+        let stats = receiver.stats.clone();
+        self.publish_receiver_stats(&qualified_id, stats).await;
+    }
+
+    async fn receiver_receive_latency_changed(
+        &mut self,
+        qualified_id: String,
+        latency: HistogramSnapshot,
+    ) {
+        let Some(receiver) = self.receivers.get_mut(&qualified_id) else {
+            return;
+        };
+        receiver.stats.receive_latency = Some(latency);
+        let stats = receiver.stats.clone();
+        self.publish_receiver_stats(&qualified_id, stats).await;
+    }
+
+    async fn receiver_kernel_drops_changed(&mut self, qualified_id: String, drops: u32) {
+        let Some(receiver) = self.receivers.get_mut(&qualified_id) else {
+            return;
+        };
+        receiver.stats.kernel_drops = drops;
+        let stats = receiver.stats.clone();
+        self.publish_receiver_stats(&qualified_id, stats).await;
+    }
+
+    async fn receiver_cycle_timing_changed(
+        &mut self,
+        qualified_id: String,
+        timing: CycleTimingStats,
+    ) {
+        let Some(receiver) = self.receivers.get_mut(&qualified_id) else {
+            return;
+        };
+        receiver.stats.cycle_timing = Some(timing);
+        let stats = receiver.stats.clone();
+        self.publish_receiver_stats(&qualified_id, stats).await;
+    }
+
     async fn process_vsc_health_report(&mut self, report: VscHealthReport) {
         match report {}
     }
@@ -147,13 +147,10 @@ impl StatsActor {
     async fn process_receiver_state(&mut self, s: &ReceiverState) {
         match s {
             ReceiverState::Created {
-                id,
-                config,
-                address,
-                ..
+                id, config, buffer, ..
             } => {
                 self.rx_stats(id.to_owned())
-                    .process(RxStats::Started(config.to_owned(), address.to_owned()))
+                    .process(RxStats::Started(config.to_owned(), buffer.to_owned()))
                     .await;
             }
             ReceiverState::Renamed { .. } => (),
@@ -17,7 +17,10 @@
 
 use crate::{
     formats::{Frames, MilliSeconds},
-    monitoring::{Delay, ReceiverStatsReport, Report, RxStats, StatsReport},
+    monitoring::{
+        Delay, MediaClockServoStats, ReceiverStatsReport, Report, RxStats, StatsReport,
+        timing::{CycleTimingStats, HistogramSnapshot},
+    },
     receiver::config::ReceiverConfig,
     time::{MICROS_PER_MILLI_F, MICROS_PER_SEC, MILLIS_PER_SEC_F},
     utils::{AverageCalculationBuffer, U16_WRAP},
@@ -42,7 +45,7 @@ pub struct ReceiverStats {
     lost_packet_counter: usize,
     late_packet_counter: usize,
     muted: bool,
-    buffer_address: Option<crate::buffer::AudioBufferPointer>,
+    buffer: Option<crate::buffer::shm::SharedBufferDescriptor>,
     delays: VecDeque<Delay>,
     packet_counter: u64,
     pending_lossed_packets_detection: Option<Instant>,
@@ -55,7 +58,7 @@ impl ReceiverStats {
             id,
             tx,
             config: None,
-            buffer_address: None,
+            buffer: None,
             measured_link_offset: AverageCalculationBuffer::new(vec![0; 1000].into()),
             delay_buffer: AverageCalculationBuffer::new(vec![0; 1000].into()),
             timestamp_offset: None,
@@ -72,9 +75,9 @@ impl ReceiverStats {
 
     pub(crate) async fn process(&mut self, stats: RxStats) {
         match stats {
-            RxStats::Started(rx_descriptor, buffer_address) => {
+            RxStats::Started(rx_descriptor, buffer) => {
                 self.config = Some(rx_descriptor);
-                self.buffer_address = Some(buffer_address);
+                self.buffer = Some(buffer);
             }
             RxStats::BufferUnderrun => {
                 // TODO: no ReceiverStatsReport variant exists yet
@@ -144,6 +147,10 @@ impl ReceiverStats {
                 self.process_packet_from_wrong_sender(ip).await;
             }
             RxStats::Muted(muted) => self.process_muted(muted).await,
+            RxStats::KernelDrops(drops) => self.process_kernel_drops(drops).await,
+            RxStats::ReceiveLatency(latency) => self.process_receive_latency(latency).await,
+            RxStats::MediaClockServo(servo) => self.process_media_clock_servo(servo).await,
+            RxStats::CycleTiming(timing) => self.process_cycle_timing(timing).await,
         }
     }
 
@@ -422,6 +429,60 @@ impl ReceiverStats {
         }
     }
 
+    async fn process_media_clock_servo(&mut self, servo: MediaClockServoStats) {
+        self.tx
+            .send(Report::Stats(StatsReport::Receiver(
+                ReceiverStatsReport::MediaClockServo {
+                    receiver: self.id.clone(),
+                    servo,
+                },
+            )))
+            .await
+            .ok();
+    }
+
+    async fn process_receive_latency(&mut self, latency: HistogramSnapshot) {
+        self.tx
+            .send(Report::Stats(StatsReport::Receiver(
+                ReceiverStatsReport::ReceiveLatency {
+                    receiver: self.id.clone(),
+                    latency,
+                },
+            )))
+            .await
+            .ok();
+    }
+
+    async fn process_kernel_drops(&mut self, drops: u32) {
+        self.tx
+            .send(Report::Stats(StatsReport::Receiver(
+                ReceiverStatsReport::KernelDrops {
+                    receiver: self.id.clone(),
+                    drops,
+                },
+            )))
+            .await
+            .ok();
+    }
+
+    async fn process_cycle_timing(&mut self, timing: CycleTimingStats) {
+        if timing.xruns > 0 || timing.overruns > 0 {
+            debug!(
+                "{}: {} xrun(s), {} missed deadline(s), worst cycle: {:?}",
+                self.id, timing.xruns, timing.overruns, timing.worst
+            );
+        }
+        self.tx
+            .send(Report::Stats(StatsReport::Receiver(
+                ReceiverStatsReport::CycleTiming {
+                    receiver: self.id.clone(),
+                    timing,
+                },
+            )))
+            .await
+            .ok();
+    }
+
     async fn process_late_packet(&mut self, seq: Seq, timestamp: Frames, delay: Frames) {
         let Some(desc) = &self.config else {
             return;
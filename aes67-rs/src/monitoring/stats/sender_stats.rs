@@ -17,7 +17,10 @@
 
 use crate::{
     formats::Frames,
-    monitoring::{Report, SenderStatsReport, StatsReport, TxStats},
+    monitoring::{
+        MediaClockServoStats, Report, SenderStatsReport, StatsReport, TxStats,
+        timing::CycleTimingStats,
+    },
     time::Time,
 };
 use rtp_rs::Seq;
@@ -48,6 +51,12 @@ impl SenderStats {
             TxStats::BufferOverflow => {
                 // TODO
             }
+            TxStats::BlockTooLarge { requested, max } => {
+                warn!(
+                    "Sender '{}' dropped a block of {requested} frames, at most {max} frames can be written at once.",
+                    self.id
+                );
+            }
             TxStats::PacketSent {
                 ptime_frames,
                 packet_size,
@@ -66,7 +75,39 @@ impl SenderStats {
                 )
                 .await
             }
+            TxStats::MediaClockServo(servo) => self.process_media_clock_servo(servo).await,
+            TxStats::CycleTiming(timing) => self.process_cycle_timing(timing).await,
+        }
+    }
+
+    async fn process_media_clock_servo(&mut self, servo: MediaClockServoStats) {
+        self.tx
+            .send(Report::Stats(StatsReport::Sender(
+                SenderStatsReport::MediaClockServo {
+                    sender: self.id.clone(),
+                    servo,
+                },
+            )))
+            .await
+            .ok();
+    }
+
+    async fn process_cycle_timing(&mut self, timing: CycleTimingStats) {
+        if timing.xruns > 0 || timing.overruns > 0 {
+            debug!(
+                "{}: {} xrun(s), {} missed deadline(s), worst cycle: {:?}",
+                self.id, timing.xruns, timing.overruns, timing.worst
+            );
         }
+        self.tx
+            .send(Report::Stats(StatsReport::Sender(
+                SenderStatsReport::CycleTiming {
+                    sender: self.id.clone(),
+                    timing,
+                },
+            )))
+            .await
+            .ok();
     }
 
     async fn process_packet_sent(
@@ -0,0 +1,237 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Timing of audio backend process callbacks. The RT thread records every cycle into a set of lock-free
+//! histograms, a non-RT task periodically takes a snapshot and resets them. Xruns reported by the audio
+//! backend are correlated with the cycle that was recorded last before the xrun was noticed.
+
+use serde::{Deserialize, Serialize};
+use std::{
+    sync::atomic::{AtomicI64, AtomicU64, Ordering},
+    time::Duration,
+};
+
+/// Number of histogram buckets. Bucket `0` counts values below 1 µs, bucket `i` values in
+/// `[2^(i-1), 2^i)` µs, the last bucket everything from 2^(N-2) µs upwards.
+pub const HISTOGRAM_BUCKETS: usize = 18;
+
+/// Interval in which cycle timings are reported to monitoring.
+pub const CYCLE_TIMING_REPORT_INTERVAL: Duration = Duration::from_secs(5);
+
+#[derive(Debug)]
+pub struct Histogram {
+    buckets: [AtomicU64; HISTOGRAM_BUCKETS],
+    count: AtomicU64,
+    sum_micros: AtomicU64,
+    max_micros: AtomicU64,
+}
+
+impl Default for Histogram {
+    fn default() -> Self {
+        Self {
+            buckets: [const { AtomicU64::new(0) }; HISTOGRAM_BUCKETS],
+            count: AtomicU64::new(0),
+            sum_micros: AtomicU64::new(0),
+            max_micros: AtomicU64::new(0),
+        }
+    }
+}
+
+impl Histogram {
+    pub fn record(&self, micros: u64) {
+        let bucket = ((u64::BITS - micros.leading_zeros()) as usize).min(HISTOGRAM_BUCKETS - 1);
+        self.buckets[bucket].fetch_add(1, Ordering::Relaxed);
+        self.count.fetch_add(1, Ordering::Relaxed);
+        self.sum_micros.fetch_add(micros, Ordering::Relaxed);
+        self.max_micros.fetch_max(micros, Ordering::Relaxed);
+    }
+
+    /// Returns the current state of the histogram and resets it.
+    pub fn take(&self) -> HistogramSnapshot {
+        let buckets = self
+            .buckets
+            .iter()
+            .map(|b| b.swap(0, Ordering::Relaxed))
+            .collect();
+        let count = self.count.swap(0, Ordering::Relaxed);
+        let sum_micros = self.sum_micros.swap(0, Ordering::Relaxed);
+        let max_micros = self.max_micros.swap(0, Ordering::Relaxed);
+        HistogramSnapshot {
+            buckets,
+            count,
+            mean_micros: if count > 0 {
+                sum_micros as f64 / count as f64
+            } else {
+                0.0
+            },
+            max_micros,
+        }
+    }
+}
+
+#[derive(Debug, Clone, Default, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct HistogramSnapshot {
+    /// Log2 buckets in µs, see [HISTOGRAM_BUCKETS]
+    pub buckets: Vec<u64>,
+    pub count: u64,
+    pub mean_micros: f64,
+    pub max_micros: u64,
+}
+
+/// Timing of a single process callback.
+#[derive(Debug, Clone, Copy, Default, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct CycleSample {
+    /// Time spent in the whole callback
+    pub wall_micros: u64,
+    /// Time spent receiving or encoding audio
+    pub io_micros: u64,
+    /// Time spent reading the media clock
+    pub clock_micros: u64,
+    /// Time left until the period deadline when the callback returned, negative if it was missed
+    pub slack_micros: i64,
+}
+
+#[derive(Debug, Default)]
+struct AtomicCycleSample {
+    wall_micros: AtomicU64,
+    io_micros: AtomicU64,
+    clock_micros: AtomicU64,
+    slack_micros: AtomicI64,
+}
+
+impl AtomicCycleSample {
+    fn store(&self, sample: CycleSample) {
+        self.wall_micros
+            .store(sample.wall_micros, Ordering::Relaxed);
+        self.io_micros.store(sample.io_micros, Ordering::Relaxed);
+        self.clock_micros
+            .store(sample.clock_micros, Ordering::Relaxed);
+        self.slack_micros
+            .store(sample.slack_micros, Ordering::Relaxed);
+    }
+
+    fn load(&self) -> CycleSample {
+        CycleSample {
+            wall_micros: self.wall_micros.load(Ordering::Relaxed),
+            io_micros: self.io_micros.load(Ordering::Relaxed),
+            clock_micros: self.clock_micros.load(Ordering::Relaxed),
+            slack_micros: self.slack_micros.load(Ordering::Relaxed),
+        }
+    }
+}
+
+/// Per-stream cycle timing histograms. Written by the RT thread through [CycleTimings::record], read by
+/// [CycleTimings::take]. Samples of a single cycle are not updated atomically as a whole, a snapshot taken
+/// while a cycle is being recorded may mix values of two cycles.
+#[derive(Debug, Default)]
+pub struct CycleTimings {
+    wall: Histogram,
+    io: Histogram,
+    clock: Histogram,
+    slack: Histogram,
+    overruns: AtomicU64,
+    min_slack_micros: AtomicI64,
+    period_micros: AtomicU64,
+    last: AtomicCycleSample,
+    worst: AtomicCycleSample,
+    xruns: AtomicU64,
+    xrun_cycle: AtomicCycleSample,
+}
+
+impl CycleTimings {
+    pub fn new() -> Self {
+        Self {
+            min_slack_micros: AtomicI64::new(i64::MAX),
+            ..Default::default()
+        }
+    }
+
+    /// Records the timing of a process callback. Must only be called from a single thread.
+    pub fn record(&self, period_micros: u64, sample: CycleSample) {
+        self.wall.record(sample.wall_micros);
+        self.io.record(sample.io_micros);
+        self.clock.record(sample.clock_micros);
+        self.slack.record(sample.slack_micros.max(0) as u64);
+        if sample.slack_micros < 0 {
+            self.overruns.fetch_add(1, Ordering::Relaxed);
+        }
+        self.min_slack_micros
+            .fetch_min(sample.slack_micros, Ordering::Relaxed);
+        self.period_micros.store(period_micros, Ordering::Relaxed);
+        if sample.wall_micros >= self.worst.wall_micros.load(Ordering::Relaxed) {
+            self.worst.store(sample);
+        }
+        self.last.store(sample);
+    }
+
+    /// Notifies the histograms about an xrun reported by the audio backend. Called from a non-RT thread.
+    pub fn xrun(&self) {
+        self.xruns.fetch_add(1, Ordering::Relaxed);
+        let last = self.last.load();
+        if last.wall_micros >= self.xrun_cycle.wall_micros.load(Ordering::Relaxed) {
+            self.xrun_cycle.store(last);
+        }
+    }
+
+    /// Returns the timings recorded since the last call and resets them.
+    pub fn take(&self) -> CycleTimingStats {
+        let xruns = self.xruns.swap(0, Ordering::Relaxed);
+        let xrun_cycle = self.xrun_cycle.load();
+        self.xrun_cycle.store(CycleSample::default());
+        let worst = self.worst.load();
+        self.worst.store(CycleSample::default());
+        let min_slack_micros = self.min_slack_micros.swap(i64::MAX, Ordering::Relaxed);
+
+        CycleTimingStats {
+            period_micros: self.period_micros.load(Ordering::Relaxed),
+            wall: self.wall.take(),
+            io: self.io.take(),
+            clock: self.clock.take(),
+            slack: self.slack.take(),
+            overruns: self.overruns.swap(0, Ordering::Relaxed),
+            min_slack_micros: (min_slack_micros != i64::MAX).then_some(min_slack_micros),
+            worst,
+            xruns,
+            xrun_cycle: (xruns > 0).then_some(xrun_cycle),
+        }
+    }
+}
+
+/// Cycle timings of one stream over one report interval.
+#[derive(Debug, Clone, Default, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct CycleTimingStats {
+    /// Duration of the last period
+    pub period_micros: u64,
+    pub wall: HistogramSnapshot,
+    pub io: HistogramSnapshot,
+    pub clock: HistogramSnapshot,
+    /// Slack is clamped to zero in the histogram, missed deadlines are counted in `overruns`
+    pub slack: HistogramSnapshot,
+    pub overruns: u64,
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    pub min_slack_micros: Option<i64>,
+    /// Cycle with the longest wall time
+    pub worst: CycleSample,
+    /// Xruns reported by the audio backend
+    pub xruns: u64,
+    /// Longest cycle that was the last one to run before an xrun was reported
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    pub xrun_cycle: Option<CycleSample>,
+}
@@ -0,0 +1,261 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Plays memory mapped WAV/RF64 files as the input of a sender, without any audio server. The player thread
+//! writes the file straight into the sender buffer, one block at a time as the PTP media clock reaches it.
+//! The file position is derived from the media time, so players on different machines that share a start
+//! time play in sync, and looped files stay aligned to the start time forever.
+//!
+//! If the file has the sender's channel count and integer samples, its frames are shuffled into the wire
+//! format with SIMD (see [convert]), otherwise they take the regular path through `f32` per channel.
+
+mod convert;
+mod wav;
+
+use crate::{
+    buffer::sender::SenderBufferProducer,
+    error::SenderInternalResult,
+    formats::{Frames, frames_to_duration},
+    monitoring::Monitoring,
+    sender::config::SenderConfig,
+    time::{Clock, MediaClock},
+    utils::{set_realtime_priority, sleep_precise},
+};
+use serde::{Deserialize, Serialize};
+use std::{
+    io,
+    path::PathBuf,
+    sync::{
+        Arc,
+        atomic::{AtomicBool, Ordering},
+    },
+    thread,
+};
+use tracing::{error, info, warn};
+use wav::{WavFile, WavSampleFormat};
+
+/// Number of packets written per wake-up of the player thread
+const PACKETS_PER_BLOCK: Frames = 4;
+
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct PlayerConfig {
+    /// WAV, BWF or RF64 file to play, its sample rate must match the sender's
+    pub file: PathBuf,
+    /// Media time of the first frame of the file. Playback starts immediately if not set, silence is sent
+    /// until then otherwise.
+    #[serde(default)]
+    pub start_time: Option<Frames>,
+    /// Start over at the end of the file instead of sending silence
+    #[serde(default)]
+    pub repeat: bool,
+}
+
+/// What to send at a given media time
+enum Source {
+    /// this many frames from the file, starting at the given frame
+    File(usize, usize),
+    /// this many frames of silence
+    Silence(Frames),
+}
+
+pub(crate) struct FilePlayer {
+    config: PlayerConfig,
+    sender: SenderConfig,
+    file: WavFile,
+    tx: SenderBufferProducer,
+    clock: Clock,
+    monitoring: Monitoring,
+    start_time: Option<Frames>,
+    scratch: Vec<f32>,
+}
+
+impl FilePlayer {
+    pub(crate) fn new(
+        config: PlayerConfig,
+        sender: SenderConfig,
+        tx: SenderBufferProducer,
+        clock: Clock,
+        monitoring: Monitoring,
+    ) -> SenderInternalResult<Self> {
+        let file = WavFile::open(&config.file)?;
+        if file.sample_rate != sender.audio_format.sample_rate {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                format!(
+                    "sample rate of {} is {} Hz, sender runs at {} Hz",
+                    config.file.display(),
+                    file.sample_rate,
+                    sender.audio_format.sample_rate
+                ),
+            )
+            .into());
+        }
+        let block_frames = (PACKETS_PER_BLOCK * sender.ptime_frames()) as usize;
+        Ok(Self {
+            start_time: config.start_time,
+            config,
+            sender,
+            file,
+            tx,
+            clock,
+            monitoring,
+            scratch: vec![0.0; block_frames],
+        })
+    }
+
+    /// Starts the player thread. It stops once `exit` is set.
+    pub(crate) fn start(self, exit: Arc<AtomicBool>) {
+        thread::spawn(move || {
+            set_realtime_priority();
+            if let Err(e) = self.run(exit) {
+                error!("File player stopped: {e}");
+            }
+        });
+    }
+
+    fn run(mut self, exit: Arc<AtomicBool>) -> SenderInternalResult<()> {
+        info!(
+            "Playing {} ({} frames, {} channels) on sender '{}'.",
+            self.config.file.display(),
+            self.file.frames(),
+            self.file.channels,
+            self.sender.label
+        );
+
+        let sample_rate = self.sender.audio_format.sample_rate;
+        let block = PACKETS_PER_BLOCK * self.sender.ptime_frames();
+        let mut next = None;
+
+        while !exit.load(Ordering::SeqCst) {
+            let now = self.clock.current_time()?;
+            let block_start = *next.get_or_insert((now.media_time / block + 1) * block);
+
+            if block_start > now.media_time {
+                sleep_precise(
+                    frames_to_duration(block_start - now.media_time, sample_rate),
+                    now.system_time,
+                );
+                continue;
+            }
+
+            if now.media_time >= block_start + block {
+                // fell behind by a whole block or more, skip ahead instead of sending stale audio in a burst
+                let current = now.media_time / block * block;
+                warn!(
+                    "File player of sender '{}' skipped {} frames.",
+                    self.sender.label,
+                    current - block_start
+                );
+                next = Some(current);
+                continue;
+            }
+
+            self.write_block(block_start, block as usize);
+            next = Some(block_start + block);
+        }
+
+        info!("Stopped playing {}.", self.config.file.display());
+        Ok(())
+    }
+
+    fn write_block(&mut self, ingress_time: Frames, frames: usize) {
+        let start_time = *self.start_time.get_or_insert(ingress_time);
+
+        let mut written = 0;
+        while written < frames {
+            let t = ingress_time + written as Frames;
+            match self.source(t, start_time) {
+                Source::File(position, available) => {
+                    let len = available.min(frames - written);
+                    self.write_file(position, written, len);
+                    written += len;
+                }
+                Source::Silence(available) => {
+                    let len = available.min((frames - written) as Frames) as usize;
+                    self.tx.frames_mut(written, len).fill(0);
+                    written += len;
+                }
+            }
+        }
+
+        if self.tx.send_packets(ingress_time, frames).is_err() {
+            self.report_buffer_overflow();
+        }
+    }
+
+    fn source(&self, t: Frames, start_time: Frames) -> Source {
+        let len = self.file.frames() as Frames;
+        if t < start_time {
+            return Source::Silence(start_time - t);
+        }
+        let offset = t - start_time;
+        if len == 0 || (offset >= len && !self.config.repeat) {
+            return Source::Silence(Frames::MAX);
+        }
+        let position = offset % len;
+        Source::File(position as usize, (len - position) as usize)
+    }
+
+    fn write_file(&mut self, position: usize, offset: usize, frames: usize) {
+        let channels = self.sender.audio_format.frame_format.channels;
+        let out_bytes = self
+            .sender
+            .audio_format
+            .frame_format
+            .sample_format
+            .bytes_per_sample();
+        let samples = self.file.samples(position, frames);
+
+        if let (WavSampleFormat::Int(in_bytes), true) =
+            (self.file.format, self.file.channels == channels)
+        {
+            convert::le_to_be(
+                samples,
+                in_bytes,
+                self.tx.frames_mut(offset, frames),
+                out_bytes,
+            );
+            return;
+        }
+
+        // sender channels the file doesn't have stay silent
+        self.tx.frames_mut(offset, frames).fill(0);
+        let in_bytes = self.file.format.bytes_per_sample();
+        let frame_len = self.file.bytes_per_frame();
+        for channel in 0..channels.min(self.file.channels) {
+            let scratch = &mut self.scratch[..frames];
+            for (sample, frame) in scratch.iter_mut().zip(samples.chunks_exact(frame_len)) {
+                let start = channel * in_bytes;
+                *sample = self.file.format.read_f32(&frame[start..start + in_bytes]);
+            }
+            self.tx.write_channel(channel, offset, scratch);
+        }
+    }
+}
+
+mod monitoring {
+    use crate::monitoring::TxStats;
+
+    use super::*;
+
+    impl FilePlayer {
+        pub(crate) fn report_buffer_overflow(&self) {
+            self.monitoring.sender_stats(TxStats::BufferOverflow);
+        }
+    }
+}
@@ -0,0 +1,194 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Conversion of little-endian PCM from audio files to the big-endian wire format of AES67. Both are integer
+//! PCM, so the conversion is a byte shuffle per sample that keeps the most significant bytes. It runs as a
+//! table lookup on 16 bytes at a time (`pshufb` on x86_64 with SSSE3, `tbl` on aarch64) and falls back to a
+//! scalar loop for the tail and on other targets.
+
+/// Shuffle index that produces a zero byte
+#[cfg(any(target_arch = "x86_64", target_arch = "aarch64"))]
+const ZERO: u8 = 0x80;
+
+/// Converts the samples in `src`, `in_bytes` wide, to samples `out_bytes` wide in `dst`. Narrower output
+/// drops the least significant bytes, wider output fills them with zeros.
+pub fn le_to_be(src: &[u8], in_bytes: usize, dst: &mut [u8], out_bytes: usize) {
+    let samples = src.len() / in_bytes;
+    debug_assert_eq!(
+        dst.len(),
+        samples * out_bytes,
+        "destination does not fit the converted samples"
+    );
+
+    #[allow(unused_mut)]
+    let mut done = 0;
+
+    #[cfg(target_arch = "x86_64")]
+    if is_x86_feature_detected!("ssse3") {
+        done = unsafe { le_to_be_ssse3(src, in_bytes, dst, out_bytes) };
+    }
+
+    #[cfg(target_arch = "aarch64")]
+    {
+        done = unsafe { le_to_be_neon(src, in_bytes, dst, out_bytes) };
+    }
+
+    le_to_be_scalar(
+        &src[done * in_bytes..samples * in_bytes],
+        in_bytes,
+        &mut dst[done * out_bytes..],
+        out_bytes,
+    );
+}
+
+fn le_to_be_scalar(src: &[u8], in_bytes: usize, dst: &mut [u8], out_bytes: usize) {
+    for (input, output) in src
+        .chunks_exact(in_bytes)
+        .zip(dst.chunks_exact_mut(out_bytes))
+    {
+        for (b, byte) in output.iter_mut().enumerate() {
+            *byte = if b < in_bytes {
+                input[in_bytes - 1 - b]
+            } else {
+                0
+            };
+        }
+    }
+}
+
+/// Number of samples converted per 16 byte vector and the shuffle mask that converts them
+#[cfg(any(target_arch = "x86_64", target_arch = "aarch64"))]
+fn shuffle_mask(in_bytes: usize, out_bytes: usize) -> (usize, [u8; 16]) {
+    let samples = (16 / in_bytes).min(16 / out_bytes);
+    let mut mask = [ZERO; 16];
+    for (j, index) in mask.iter_mut().enumerate().take(samples * out_bytes) {
+        let (sample, b) = (j / out_bytes, j % out_bytes);
+        if b < in_bytes {
+            *index = (sample * in_bytes + in_bytes - 1 - b) as u8;
+        }
+    }
+    (samples, mask)
+}
+
+/// Returns the number of samples converted. Every iteration loads and stores a full vector, so it stops
+/// while there are still 16 bytes left in both buffers and leaves the rest to the scalar loop.
+#[cfg(target_arch = "x86_64")]
+#[target_feature(enable = "ssse3")]
+unsafe fn le_to_be_ssse3(src: &[u8], in_bytes: usize, dst: &mut [u8], out_bytes: usize) -> usize {
+    use std::arch::x86_64::{__m128i, _mm_loadu_si128, _mm_shuffle_epi8, _mm_storeu_si128};
+
+    let (step, mask) = shuffle_mask(in_bytes, out_bytes);
+    let mut done = 0;
+    unsafe {
+        let mask = _mm_loadu_si128(mask.as_ptr() as *const __m128i);
+        while done * in_bytes + 16 <= src.len() && done * out_bytes + 16 <= dst.len() {
+            let input = _mm_loadu_si128(src.as_ptr().add(done * in_bytes) as *const __m128i);
+            let output = _mm_shuffle_epi8(input, mask);
+            _mm_storeu_si128(
+                dst.as_mut_ptr().add(done * out_bytes) as *mut __m128i,
+                output,
+            );
+            done += step;
+        }
+    }
+    done
+}
+
+#[cfg(target_arch = "aarch64")]
+unsafe fn le_to_be_neon(src: &[u8], in_bytes: usize, dst: &mut [u8], out_bytes: usize) -> usize {
+    use std::arch::aarch64::{vld1q_u8, vqtbl1q_u8, vst1q_u8};
+
+    let (step, mask) = shuffle_mask(in_bytes, out_bytes);
+    let mut done = 0;
+    unsafe {
+        let mask = vld1q_u8(mask.as_ptr());
+        while done * in_bytes + 16 <= src.len() && done * out_bytes + 16 <= dst.len() {
+            let input = vld1q_u8(src.as_ptr().add(done * in_bytes));
+            vst1q_u8(
+                dst.as_mut_ptr().add(done * out_bytes),
+                vqtbl1q_u8(input, mask),
+            );
+            done += step;
+        }
+    }
+    done
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn test_signal(len: usize) -> Vec<u8> {
+        (0..len).map(|i| (i * 37 + 11) as u8).collect()
+    }
+
+    #[test]
+    fn le_to_be_matches_scalar_conversion() {
+        for (in_bytes, out_bytes) in [(2, 3), (3, 2), (3, 3)] {
+            // short enough for the scalar loop only, and long enough for several vectors plus a tail
+            for samples in [1, 5, 17, 100] {
+                let src = test_signal(samples * in_bytes);
+                let mut expected = vec![0xFF; samples * out_bytes];
+                le_to_be_scalar(&src, in_bytes, &mut expected, out_bytes);
+                let mut actual = vec![0xFF; samples * out_bytes];
+                le_to_be(&src, in_bytes, &mut actual, out_bytes);
+                assert_eq!(
+                    expected, actual,
+                    "{in_bytes} -> {out_bytes} bytes, {samples} samples"
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn le_to_be_keeps_most_significant_bytes() {
+        let mut dst = [0xFF; 3];
+        le_to_be(&[0x34, 0x12], 2, &mut dst, 3);
+        assert_eq!([0x12, 0x34, 0x00], dst);
+
+        let mut dst = [0xFF; 2];
+        le_to_be(&[0x56, 0x34, 0x12], 3, &mut dst, 2);
+        assert_eq!([0x12, 0x34], dst);
+    }
+
+    #[cfg(any(target_arch = "x86_64", target_arch = "aarch64"))]
+    #[test]
+    fn shuffle_mask_works() {
+        assert_eq!(
+            (5, [2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, ZERO]),
+            shuffle_mask(3, 3)
+        );
+        assert_eq!(
+            (
+                5,
+                [
+                    1, 0, ZERO, 3, 2, ZERO, 5, 4, ZERO, 7, 6, ZERO, 9, 8, ZERO, ZERO
+                ]
+            ),
+            shuffle_mask(2, 3)
+        );
+        assert_eq!(
+            (
+                5,
+                [
+                    2, 1, 5, 4, 8, 7, 11, 10, 14, 13, ZERO, ZERO, ZERO, ZERO, ZERO, ZERO
+                ]
+            ),
+            shuffle_mask(3, 2)
+        );
+    }
+}
@@ -0,0 +1,232 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Read-only memory mapped WAV, BWF and RF64 files.
+
+use std::{
+    fs::File,
+    io,
+    os::fd::AsRawFd,
+    path::Path,
+    ptr::{self, NonNull},
+    slice,
+};
+
+const WAVE_FORMAT_PCM: u16 = 1;
+const WAVE_FORMAT_IEEE_FLOAT: u16 = 3;
+const WAVE_FORMAT_EXTENSIBLE: u16 = 0xFFFE;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum WavSampleFormat {
+    /// Little-endian integer PCM with the given number of bytes per sample
+    Int(usize),
+    Float32,
+}
+
+impl WavSampleFormat {
+    pub fn bytes_per_sample(&self) -> usize {
+        match self {
+            WavSampleFormat::Int(bytes) => *bytes,
+            WavSampleFormat::Float32 => 4,
+        }
+    }
+
+    /// Reads a single sample and scales it to `[-1.0, 1.0]`.
+    pub fn read_f32(&self, bytes: &[u8]) -> f32 {
+        match self {
+            WavSampleFormat::Int(len) => {
+                let mut value = [0u8; 4];
+                value[4 - len..].copy_from_slice(bytes);
+                i32::from_le_bytes(value) as f32 / 2_147_483_648.0
+            }
+            WavSampleFormat::Float32 => {
+                f32::from_le_bytes([bytes[0], bytes[1], bytes[2], bytes[3]])
+            }
+        }
+    }
+}
+
+#[derive(Debug)]
+pub struct WavFile {
+    map: NonNull<u8>,
+    map_len: usize,
+    data_offset: usize,
+    data_len: usize,
+    pub channels: usize,
+    pub sample_rate: u32,
+    pub format: WavSampleFormat,
+}
+
+// the mapping is read-only and owned by this struct
+unsafe impl Send for WavFile {}
+
+impl WavFile {
+    pub fn open(path: &Path) -> io::Result<Self> {
+        let file = File::open(path)?;
+        let map_len = file.metadata()?.len() as usize;
+        if map_len < 12 {
+            return Err(invalid("file is too short"));
+        }
+        let ptr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                map_len,
+                libc::PROT_READ,
+                libc::MAP_SHARED,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        unsafe {
+            // playback reads the file front to back, start reading ahead right away
+            libc::madvise(ptr, map_len, libc::MADV_SEQUENTIAL);
+            libc::madvise(ptr, map_len, libc::MADV_WILLNEED);
+        }
+
+        let mut wav = Self {
+            map: NonNull::new(ptr as *mut u8).ok_or_else(|| invalid("mmap returned null"))?,
+            map_len,
+            data_offset: 0,
+            data_len: 0,
+            channels: 0,
+            sample_rate: 0,
+            format: WavSampleFormat::Int(2),
+        };
+        wav.parse()?;
+        Ok(wav)
+    }
+
+    fn bytes(&self) -> &[u8] {
+        unsafe { slice::from_raw_parts(self.map.as_ptr(), self.map_len) }
+    }
+
+    fn parse(&mut self) -> io::Result<()> {
+        let bytes = self.bytes();
+        let rf64 = match &bytes[..4] {
+            b"RIFF" => false,
+            b"RF64" | b"BW64" => true,
+            _ => return Err(invalid("not a RIFF file")),
+        };
+        if &bytes[8..12] != b"WAVE" {
+            return Err(invalid("not a WAVE file"));
+        }
+
+        let mut ds64_data_len = None;
+        let mut fmt = None;
+        let mut data = None;
+        let mut pos = 12;
+        while pos + 8 <= bytes.len() {
+            let id = &bytes[pos..pos + 4];
+            let len = u32_at(bytes, pos + 4) as usize;
+            let body = pos + 8;
+            match id {
+                b"ds64" if body + 16 <= bytes.len() => {
+                    ds64_data_len = Some(u64_at(bytes, body + 8) as usize);
+                }
+                b"fmt " if body + 16 <= bytes.len() => {
+                    fmt = Some(body);
+                }
+                b"data" => {
+                    let len = if rf64 && len == u32::MAX as usize {
+                        ds64_data_len.unwrap_or(usize::MAX)
+                    } else {
+                        len
+                    };
+                    // files that are still being recorded may be longer than their header says, unfinished ones shorter
+                    data = Some((body, len.min(bytes.len() - body)));
+                    break;
+                }
+                _ => {}
+            }
+            pos = body + len + len % 2;
+        }
+
+        let fmt = fmt.ok_or_else(|| invalid("no fmt chunk"))?;
+        let (data_offset, data_len) = data.ok_or_else(|| invalid("no data chunk"))?;
+
+        let mut tag = u16_at(bytes, fmt);
+        let channels = u16_at(bytes, fmt + 2) as usize;
+        let sample_rate = u32_at(bytes, fmt + 4);
+        let bits = u16_at(bytes, fmt + 14);
+        if tag == WAVE_FORMAT_EXTENSIBLE && fmt + 26 <= bytes.len() {
+            // the first two bytes of the sub format GUID are the actual format tag
+            tag = u16_at(bytes, fmt + 24);
+        }
+        let format = match (tag, bits) {
+            (WAVE_FORMAT_PCM, 16 | 24 | 32) => WavSampleFormat::Int(bits as usize / 8),
+            (WAVE_FORMAT_IEEE_FLOAT, 32) => WavSampleFormat::Float32,
+            _ => {
+                return Err(invalid(&format!(
+                    "unsupported sample format {tag:#x} with {bits} bits"
+                )));
+            }
+        };
+        if channels == 0 {
+            return Err(invalid("file has no channels"));
+        }
+
+        self.data_offset = data_offset;
+        self.data_len = data_len;
+        self.channels = channels;
+        self.sample_rate = sample_rate;
+        self.format = format;
+        Ok(())
+    }
+
+    pub fn bytes_per_frame(&self) -> usize {
+        self.channels * self.format.bytes_per_sample()
+    }
+
+    /// Number of frames in the file
+    pub fn frames(&self) -> usize {
+        self.data_len / self.bytes_per_frame()
+    }
+
+    /// Interleaved sample data of `len` frames starting at frame `start`
+    pub fn samples(&self, start: usize, len: usize) -> &[u8] {
+        let frame = self.bytes_per_frame();
+        let offset = self.data_offset + start * frame;
+        &self.bytes()[offset..offset + len * frame]
+    }
+}
+
+impl Drop for WavFile {
+    fn drop(&mut self) {
+        unsafe { libc::munmap(self.map.as_ptr() as *mut libc::c_void, self.map_len) };
+    }
+}
+
+fn invalid(msg: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, msg)
+}
+
+fn u16_at(bytes: &[u8], pos: usize) -> u16 {
+    u16::from_le_bytes([bytes[pos], bytes[pos + 1]])
+}
+
+fn u32_at(bytes: &[u8], pos: usize) -> u32 {
+    u32::from_le_bytes([bytes[pos], bytes[pos + 1], bytes[pos + 2], bytes[pos + 3]])
+}
+
+fn u64_at(bytes: &[u8], pos: usize) -> u64 {
+    let mut value = [0; 8];
+    value.copy_from_slice(&bytes[pos..pos + 8]);
+    u64::from_le_bytes(value)
+}
@@ -17,9 +17,13 @@
 
 use crate::{
     buffer::receiver::{ReadResult, ReceiverBufferConsumer},
-    error::ReceiverInternalResult,
+    capture::CaptureRing,
+    error::{ReceiverInternalError, ReceiverInternalResult},
     formats::Frames,
+    monitoring::meter::LevelMeter,
+    routing::{Router, RoutingMatrix},
 };
+use std::sync::Arc;
 use tokio::sync::{mpsc, oneshot};
 use tracing::instrument;
 
@@ -42,11 +46,43 @@ pub enum ReceiverApiMessage {
 pub struct ReceiverApi {
     api_tx: mpsc::Sender<ReceiverApiMessage>,
     rx: ReceiverBufferConsumer,
+    router: Option<Router>,
+    /// stream channels in front of the router
+    inputs: Vec<Vec<f32>>,
+    capture: Option<Arc<CaptureRing>>,
 }
 
 impl ReceiverApi {
-    pub fn new(api_tx: mpsc::Sender<ReceiverApiMessage>, rx: ReceiverBufferConsumer) -> Self {
-        Self { api_tx, rx }
+    pub fn new(
+        api_tx: mpsc::Sender<ReceiverApiMessage>,
+        rx: ReceiverBufferConsumer,
+        capture: Option<Arc<CaptureRing>>,
+    ) -> Self {
+        let config = rx.config();
+        let router = config.routing.as_ref().map(|routing| {
+            let matrix = RoutingMatrix::new(
+                config.audio_format.frame_format.channels,
+                routing.channel_labels.len(),
+                &routing.routes,
+            );
+            Router::new(matrix, routing.ramp, config.audio_format.sample_rate)
+        });
+        let inputs = match router {
+            Some(_) => vec![vec![0.0; rx.max_frames()]; config.audio_format.frame_format.channels],
+            None => Vec::new(),
+        };
+        Self {
+            api_tx,
+            rx,
+            router,
+            inputs,
+            capture,
+        }
+    }
+
+    /// Maximum number of frames per channel that can be read in a single block through the routing matrix.
+    pub fn max_frames(&self) -> usize {
+        self.rx.max_frames()
     }
 
     #[instrument(skip(self))]
@@ -56,12 +92,53 @@ impl ReceiverApi {
         rx.await.ok();
     }
 
+    /// Reads one block per client channel, which are the routed channels if the receiver has a routing matrix.
     pub fn receive<'a>(
         &mut self,
         buffers: impl Iterator<Item = Option<&'a mut [f32]>>,
         ingress_time: Frames,
         buffer_size: usize,
     ) -> ReceiverInternalResult<ReadResult> {
-        self.rx.read(buffers, ingress_time, buffer_size)
+        let Some(router) = &mut self.router else {
+            return self.rx.read(buffers, ingress_time, buffer_size);
+        };
+
+        let max_frames = self.rx.max_frames();
+        if buffer_size > max_frames {
+            return Err(ReceiverInternalError::BlockTooLarge {
+                requested: buffer_size,
+                max: max_frames,
+            });
+        }
+        let inputs = self.inputs.iter_mut().map(|b| Some(&mut b[..buffer_size]));
+        let result = self.rx.read(inputs, ingress_time, buffer_size)?;
+        if let ReadResult::Ok(_) = result {
+            for (output, buffer) in buffers.enumerate() {
+                if let Some(buffer) = buffer {
+                    router.process(output, &self.inputs, buffer);
+                }
+            }
+        }
+        Ok(result)
+    }
+
+    /// Levels of the received stream channels
+    pub fn meter(&self) -> Arc<LevelMeter> {
+        self.rx.meter()
+    }
+
+    /// Gains of the routing matrix, if the receiver has one
+    pub fn routing(&self) -> Option<RoutingMatrix> {
+        self.router.as_ref().map(|router| router.matrix().clone())
+    }
+
+    /// Headers of the last received packets, if the receiver captures them
+    pub fn capture(&self) -> Option<Arc<CaptureRing>> {
+        self.capture.clone()
+    }
+
+    /// Buffer of the receiver, for consumers inside the process like a [relay](crate::relay).
+    pub fn buffer(&self) -> ReceiverBufferConsumer {
+        self.rx.clone()
     }
 }
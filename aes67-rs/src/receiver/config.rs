@@ -16,12 +16,15 @@
  */
 
 use crate::{
+    capture::CaptureConfig,
     config::adjust_labels_for_channel_count,
     error::ConfigError,
     formats::{
         self, AudioFormat, FrameFormat, Frames, FramesPerSecond, MilliSeconds, MutableDuration,
         SampleFormat, Seconds, Session, SessionId,
     },
+    recorder::RecorderConfig,
+    routing::RoutingConfig,
     time::MICROS_PER_MILLI_F,
 };
 use core::fmt;
@@ -52,6 +55,9 @@ lazy_static! {
         Regex::new(r"direct=([0-9]+)").expect("no dynammic input, can't fail");
     static ref CHANNELS_REGEX: Regex =
         Regex::new(r"([0-9]+) channels: (.+)").expect("no dynammic input, can't fail");
+    static ref SOURCE_FILTER_REGEX: Regex =
+        Regex::new(r"^\s*incl\s+IN\s+(?:IP4|IP6|\*)\s+(\S+)\s+(\S+)")
+            .expect("no dynammic input, can't fail");
 }
 
 #[derive(Debug, Clone, Serialize, Deserialize)]
@@ -97,6 +103,8 @@ pub struct PartialReceiverConfig {
     pub link_offset: Option<MilliSeconds>,
     pub rtp_offset: Option<u32>,
     pub channel_labels: Vec<String>,
+    #[serde(default)]
+    pub payload_type: Option<u8>,
 }
 
 impl PartialReceiverConfig {
@@ -136,10 +144,11 @@ impl PartialReceiverConfig {
             session_info.destination_ip,
             session_info.destination_port,
         )));
-        let origin_ip = Some(session_info.origin_ip);
+        let origin_ip = Some(session_info.sender_ip());
         let link_offset = Some(4.0);
         let rtp_offset = Some(session_info.rtp_offset);
         let channel_labels = session_info.channel_labels.clone();
+        let payload_type = Some(session_info.payload_type);
 
         Self {
             label,
@@ -149,6 +158,7 @@ impl PartialReceiverConfig {
             link_offset,
             rtp_offset,
             channel_labels,
+            payload_type,
         }
     }
 }
@@ -169,6 +179,7 @@ impl Default for PartialReceiverConfig {
             link_offset: Some(4.0),
             rtp_offset: Some(0),
             channel_labels: vec!["Left".to_owned(), "Right".to_owned()],
+            payload_type: None,
         }
     }
 }
@@ -186,6 +197,76 @@ pub struct ReceiverConfig {
     pub link_offset: MutableDuration,
     #[serde(default)]
     pub delay_calculation_interval: Option<Seconds>,
+    /// Expected RTP payload type, packets with other payload types are dropped if known
+    #[serde(default)]
+    pub payload_type: Option<u8>,
+    /// Drop packets that can't belong to the stream with a socket filter in the kernel
+    #[serde(default = "default_kernel_filter")]
+    pub kernel_filter: bool,
+    #[serde(default)]
+    pub receive_mode: ReceiveMode,
+    #[serde(default)]
+    pub io_backend: IoBackend,
+    /// Records the stream to disk while the receiver is running
+    #[serde(default)]
+    pub recording: Option<RecorderConfig>,
+    /// Routes the stream channels to a different set of client channels
+    #[serde(default)]
+    pub routing: Option<RoutingConfig>,
+    /// Keeps the headers of the last received packets in memory
+    #[serde(default)]
+    pub capture: Option<CaptureConfig>,
+}
+
+/// How the receiver thread waits for packets. The latency from packet reception in the kernel to the
+/// packet being written to the receiver buffer is reported as `receiveLatency` for every mode, so they can be
+/// compared on the target machine.
+#[derive(Debug, Clone, Default, PartialEq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase", tag = "mode")]
+pub enum ReceiveMode {
+    /// Sleep in the socket until a packet arrives
+    #[default]
+    Blocking,
+    /// Let the kernel poll the NIC queue for up to `busy_poll_micros` before going to sleep
+    /// (`SO_BUSY_POLL`). `budget` limits the packets processed per poll (`SO_BUSY_POLL_BUDGET`), `prefer`
+    /// suppresses interrupts while the socket is busy polled (`SO_PREFER_BUSY_POLL`). Values above
+    /// `net.core.busy_read` require `CAP_NET_ADMIN`.
+    #[serde(rename_all = "camelCase")]
+    BusyPoll {
+        busy_poll_micros: u32,
+        #[serde(default)]
+        budget: Option<u16>,
+        #[serde(default)]
+        prefer: bool,
+    },
+    /// Spin on a non-blocking socket. This occupies a whole core, it should be pinned to an isolated one.
+    /// Real-time priority is only used if the thread is pinned.
+    #[serde(rename_all = "camelCase")]
+    Spin {
+        #[serde(default)]
+        core: Option<usize>,
+    },
+}
+
+/// How packets are read from the receive socket.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub enum IoBackend {
+    /// `recvmmsg` on a plain socket, packets are copied into the receiver's batch buffer
+    #[default]
+    Socket,
+    /// Multishot `recvmsg` through io_uring, packets are processed in place in kernel-filled buffers. Falls
+    /// back to [IoBackend::Socket] if the kernel doesn't support it (Linux 6.0 or newer is required). Busy
+    /// polling socket options have no effect on this backend.
+    IoUring,
+    /// AF_XDP ingest shared by all XDP receivers on the interface, packets are steered to it by an XDP
+    /// program and processed in place in the UMEM. Needs `CAP_NET_ADMIN` and `CAP_BPF`, falls back to
+    /// [IoBackend::Socket] if the ingest can't be set up.
+    Xdp,
+}
+
+fn default_kernel_filter() -> bool {
+    true
 }
 
 impl ReceiverConfig {
@@ -204,6 +285,22 @@ impl<T: AsRef<(u64, u64)>> From<T> for Session {
 }
 
 impl ReceiverConfig {
+    /// Labels of the channels the I/O handler client sees, the routed channels if a routing matrix is
+    /// configured.
+    pub fn io_channel_labels(&self) -> &[String] {
+        match &self.routing {
+            Some(routing) => &routing.channel_labels,
+            None => &self.channel_labels,
+        }
+    }
+
+    pub fn io_channels(&self) -> usize {
+        match &self.routing {
+            Some(routing) => routing.channel_labels.len(),
+            None => self.audio_format.frame_format.channels,
+        }
+    }
+
     pub fn bytes_per_sample(&self) -> usize {
         self.audio_format
             .frame_format
@@ -238,6 +335,20 @@ impl ReceiverConfig {
         formats::duration_to_frames(duration, self.audio_format.sample_rate)
     }
 
+    /// Frames per channel held by the receiver buffer. The buffer keeps a budget of ten seconds of samples
+    /// across all channels, but holds at least one second and at least [Self::buffer_time] per channel, so
+    /// the link offset always fits and readers trailing the playout (e.g. the recorder) can bridge short stalls.
+    /// The size is fixed when the receiver is created, later link offset changes don't resize the buffer.
+    pub fn buffer_capacity_frames(&self) -> Frames {
+        let channels = self.audio_format.frame_format.channels.max(1) as u64;
+        let budget = self.duration_to_frames(Duration::from_secs(10)) as Frames / channels;
+        let minimum = self.duration_to_frames(Duration::from_secs(1)) as Frames;
+        let buffer_time = self.duration_to_frames(Duration::from_micros(
+            (self.buffer_time() * MICROS_PER_MILLI_F).round() as u64,
+        )) as Frames;
+        budget.max(minimum).max(buffer_time)
+    }
+
     pub fn frames_to_duration(&self, frames: Frames) -> Duration {
         formats::frames_to_duration(frames, self.audio_format.sample_rate)
     }
@@ -263,6 +374,17 @@ pub struct SessionInfo {
     pub rtp_offset: u32,
     pub payload_type: u8,
     pub refclk: RefClk,
+    /// Source address from an inclusive `a=source-filter` (RFC 4570). Only the first source is used.
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    pub source_filter: Option<IpAddr>,
+}
+
+impl SessionInfo {
+    /// Address RTP packets of this session are sent from. This is the source filter if there is one, the
+    /// origin address otherwise.
+    pub fn sender_ip(&self) -> IpAddr {
+        self.source_filter.unwrap_or(self.origin_ip)
+    }
 }
 
 impl From<&SessionInfo> for SessionDescription {
@@ -351,6 +473,17 @@ impl From<&SessionInfo> for SessionDescription {
             "mediaclk".to_owned(),
             Some(format!("direct={}", value.rtp_offset)),
         ));
+        if let Some(source) = value.source_filter {
+            media.attributes.push(Attribute::new(
+                "source-filter".to_owned(),
+                Some(format!(
+                    " incl IN {} {} {}",
+                    if source.is_ipv4() { "IP4" } else { "IP6" },
+                    value.destination_ip,
+                    source
+                )),
+            ));
+        }
         sd.media_descriptions.push(media);
 
         sd
@@ -501,6 +634,19 @@ impl TryFrom<&SessionDescription> for SessionInfo {
             })
             .ok_or_else(|| ConfigError::InvalidSdp("invalid ts-refclk".to_owned()))?;
 
+        // media level filters override session level filters
+        let source_filter = media
+            .attributes
+            .iter()
+            .chain(sd.attributes.iter())
+            .filter(|a| a.key == "source-filter")
+            .filter_map(|a| a.value.as_deref())
+            .find_map(|filter| {
+                let caps = SOURCE_FILTER_REGEX.captures(filter)?;
+                let applies = &caps[1] == "*" || caps[1].parse::<IpAddr>() == Ok(destination_ip);
+                applies.then(|| caps[2].parse::<IpAddr>().ok()).flatten()
+            });
+
         Ok(SessionInfo {
             id: session_id,
             name,
@@ -515,6 +661,7 @@ impl TryFrom<&SessionDescription> for SessionInfo {
             rtp_offset,
             payload_type,
             refclk,
+            source_filter,
         })
     }
 }
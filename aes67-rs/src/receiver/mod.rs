@@ -23,30 +23,30 @@ pub mod api;
 pub mod config;
 
 use crate::{
-    buffer::{
-        AudioBufferPointer,
-        receiver::{ReceiverBufferProducer, receiver_buffer_channel},
-    },
+    buffer::receiver::{ReceiverBufferProducer, receiver_buffer_channel},
+    capture::PacketCapture,
     error::ReceiverInternalResult,
-    monitoring::{Monitoring, ReceiverState, RxStats},
+    monitoring::{Monitoring, ReceiverState, RxStats, timing::Histogram},
     receiver::{
         api::{ReceiverApi, ReceiverApiMessage},
-        config::ReceiverConfig,
+        config::{ReceiveMode, ReceiverConfig},
     },
-    socket::create_rx_socket,
+    recorder::Recorder,
+    socket::{Datagram, PacketSource, RtpFilter, RxBatch, create_rx_socket},
     time::{Clock, MediaClock},
-    utils::{U32_WRAP, set_realtime_priority},
+    utils::{U32_WRAP, pin_to_core, set_realtime_priority},
 };
 use pnet::datalink::NetworkInterface;
 use rtp_rs::{RtpReader, Seq};
 use std::{
-    net::{SocketAddr, UdpSocket},
+    hint,
+    net::SocketAddr,
     sync::{
         Arc,
         atomic::{AtomicBool, Ordering},
     },
     thread,
-    time::Instant,
+    time::{Duration, Instant, SystemTime},
 };
 use tokio::{
     select,
@@ -72,34 +72,58 @@ pub(crate) async fn start_receiver(
 ) -> ReceiverInternalResult<ReceiverApi> {
     let receiver_id = id.clone();
     let (api_tx, api_rx) = mpsc::channel(1024);
-    let (tx, rx) = receiver_buffer_channel(config.clone(), monitoring.clone());
-    let socket = create_rx_socket(&config, iface)?;
+    let (tx, rx) = receiver_buffer_channel(config.clone(), monitoring.clone())?;
+    let filter = config.kernel_filter.then(|| RtpFilter::new(&config));
+    let socket = create_rx_socket(&config, iface, filter.as_ref())?;
+    let recorder = config
+        .recording
+        .clone()
+        .map(|recording| Recorder::new(recording, config.clone(), rx.clone()));
+    let capture = config.capture.as_ref().map(|capture| {
+        PacketCapture::new(
+            capture,
+            config.label.clone(),
+            config.source,
+            config.audio_format.sample_rate,
+        )
+    });
+    let capture_ring = capture.as_ref().map(PacketCapture::ring);
 
     let subsystem_name = id.clone();
+    let receive_mode = config.receive_mode.clone();
     let subsystem = async move |s: SubsystemHandle| {
-        let receiver = Receiver {
+        let receiver = Receiver::new(
             id,
             label,
-            subsys: s.clone(),
+            s.clone(),
             config,
             clock,
             api_rx,
-            last_sequence_number: None,
-            last_timestamp: None,
-            timestamp_offset: None,
             socket,
             monitoring,
             tx,
-            last_valid_data: Instant::now(),
-        };
+            capture,
+        );
 
         let (tx, rx) = oneshot::channel();
         let exit = Arc::new(AtomicBool::new(false));
         let exit_clone = exit.clone();
         let rid = receiver_id.clone();
 
+        if let Some(recorder) = recorder {
+            recorder.start(exit.clone());
+        }
+
         thread::spawn(move || {
-            set_realtime_priority();
+            match receive_mode {
+                ReceiveMode::Spin { core: Some(core) } => {
+                    pin_to_core(core);
+                    set_realtime_priority();
+                }
+                // a spinning real-time thread that is not pinned can starve the whole system
+                ReceiveMode::Spin { core: None } => {}
+                ReceiveMode::Blocking | ReceiveMode::BusyPoll { .. } => set_realtime_priority(),
+            }
             let res = receiver.run(exit_clone);
             tx.send(res).ok();
             info!("Receiver thread for '{}' stopped.", rid);
@@ -112,6 +136,8 @@ pub(crate) async fn start_receiver(
                 Ok(())
             }
             res = rx => {
+                // stops the recorder
+                exit.store(true, Ordering::SeqCst);
                 s.request_local_shutdown();
                 res?
             }
@@ -122,10 +148,20 @@ pub(crate) async fn start_receiver(
 
     info!("Receiver '{subsystem_name}' started successfully.");
 
-    Ok(ReceiverApi::new(api_tx, rx))
+    Ok(ReceiverApi::new(api_tx, rx, capture_ring))
 }
 
-struct Receiver {
+/// Time without packets after which the socket filter stops expecting the SSRC it was locked to, so a
+/// restarted sender with a new SSRC is picked up again.
+const SSRC_UNLOCK_IDLE_TIME: Duration = Duration::from_secs(1);
+
+pub(crate) enum ReceiveOutcome {
+    Packet,
+    Idle,
+    Closed,
+}
+
+pub(crate) struct Receiver {
     id: String,
     label: String,
     subsys: SubsystemHandle,
@@ -135,44 +171,74 @@ struct Receiver {
     last_timestamp: Option<u32>,
     last_sequence_number: Option<Seq>,
     timestamp_offset: Option<u64>,
-    socket: UdpSocket,
+    socket: Box<dyn PacketSource>,
     monitoring: Monitoring,
     tx: ReceiverBufferProducer,
-    last_valid_data: Instant,
+    /// media time at which the last valid packet was received
+    last_valid_data: Option<u64>,
+    /// socket filter, locked to the SSRC of the first valid packet
+    filter: Option<RtpFilter>,
+    idle_since: Option<Instant>,
+    spin: bool,
+    kernel_drops: Option<u32>,
+    /// time from packet reception in the kernel until the packet is written to the buffer
+    receive_latency: Histogram,
+    last_socket_stats_report: u64,
+    capture: Option<PacketCapture>,
 }
 
 impl Receiver {
+    #[allow(clippy::too_many_arguments)]
+    pub(crate) fn new(
+        id: String,
+        label: String,
+        subsys: SubsystemHandle,
+        config: ReceiverConfig,
+        clock: Clock,
+        api_rx: mpsc::Receiver<ReceiverApiMessage>,
+        socket: Box<dyn PacketSource>,
+        monitoring: Monitoring,
+        tx: ReceiverBufferProducer,
+        capture: Option<PacketCapture>,
+    ) -> Self {
+        let filter = config.kernel_filter.then(|| RtpFilter::new(&config));
+        let spin = matches!(config.receive_mode, ReceiveMode::Spin { .. });
+        Self {
+            id,
+            label,
+            subsys,
+            config,
+            clock,
+            api_rx,
+            last_sequence_number: None,
+            last_timestamp: None,
+            timestamp_offset: None,
+            socket,
+            monitoring,
+            tx,
+            last_valid_data: None,
+            filter,
+            idle_since: None,
+            spin,
+            kernel_drops: None,
+            receive_latency: Histogram::default(),
+            last_socket_stats_report: 0,
+            capture,
+        }
+    }
+
     fn run(mut self, exit: Arc<AtomicBool>) -> ReceiverInternalResult<()> {
-        let mut receive_buffer = [0; 65_535];
+        let mut receive_batch = RxBatch::default();
 
         info!("Receiver '{}' started.", self.id);
 
-        self.report_receiver_created(AudioBufferPointer::from_slice(&receive_buffer));
+        self.report_receiver_created(self.tx.descriptor());
 
         while !exit.load(Ordering::SeqCst) {
             // receive data from socket
 
-            let recv = self.socket.recv_from(&mut receive_buffer);
-
-            match recv {
-                Ok((len, addr)) => {
-                    let time = self.clock.current_time()?.media_time;
-                    self.rtp_data_received(&receive_buffer[..len], addr, time)?;
-                }
-                Err(e) => {
-                    match e.kind() {
-                        std::io::ErrorKind::WouldBlock | std::io::ErrorKind::TimedOut => {
-                            // this is expected if no one is actually sending data to this multicast group
-                        }
-                        _ => {
-                            warn!(
-                                "Socket receive error: {e:?}, shutting down receiver '{}'.",
-                                self.id
-                            );
-                            break;
-                        }
-                    }
-                }
+            if let ReceiveOutcome::Closed = self.receive(&mut receive_batch)? {
+                break;
             }
 
             // check for API messages and shutdown requests
@@ -198,6 +264,62 @@ impl Receiver {
         Ok(())
     }
 
+    /// Receives the packets that are available from the socket and writes them to the receiver buffer.
+    pub(crate) fn receive(
+        &mut self,
+        batch: &mut RxBatch,
+    ) -> ReceiverInternalResult<ReceiveOutcome> {
+        match self.socket.recv_batch(batch) {
+            Ok(_) => {
+                self.idle_since = None;
+                for datagram in batch.drain() {
+                    let res = self.datagram_received(&datagram);
+                    self.socket.release(datagram);
+                    res?;
+                }
+                Ok(ReceiveOutcome::Packet)
+            }
+            Err(e) => match e.kind() {
+                std::io::ErrorKind::WouldBlock | std::io::ErrorKind::TimedOut => {
+                    // this is expected if no one is actually sending data to this multicast group
+                    if self.spin {
+                        hint::spin_loop();
+                    }
+                    let idle_since = *self.idle_since.get_or_insert_with(Instant::now);
+                    if idle_since.elapsed() >= SSRC_UNLOCK_IDLE_TIME {
+                        self.lock_ssrc(None);
+                    }
+                    Ok(ReceiveOutcome::Idle)
+                }
+                _ => {
+                    warn!(
+                        "Socket receive error: {e:?}, shutting down receiver '{}'.",
+                        self.id
+                    );
+                    Ok(ReceiveOutcome::Closed)
+                }
+            },
+        }
+    }
+
+    fn datagram_received(&mut self, datagram: &Datagram<'_>) -> ReceiverInternalResult<()> {
+        let time = self.clock.current_time()?.media_time;
+        let data = datagram.payload();
+        if let Some(capture) = &self.capture {
+            let received = datagram.timestamp.unwrap_or_else(SystemTime::now);
+            capture.record(received, datagram.addr, data);
+        }
+        self.rtp_data_received(data, datagram.addr, time)?;
+        if let Some(latency) = datagram
+            .timestamp
+            .and_then(|t| SystemTime::now().duration_since(t).ok())
+        {
+            self.receive_latency.record(latency.as_micros() as u64);
+        }
+        self.report_socket_stats(time);
+        Ok(())
+    }
+
     fn handle_api_message(&mut self, api_msg: ReceiverApiMessage) -> ReceiverInternalResult<()> {
         match api_msg {
             ReceiverApiMessage::Stop(tx) => {
@@ -235,7 +357,10 @@ impl Receiver {
 
         let frames_in_packet = self.config.frames_in_buffer(rtp.payload().len());
 
-        if self.last_valid_data.elapsed().as_secs() >= 1 {
+        if self.last_valid_data.is_some_and(|last| {
+            media_time_at_reception.saturating_sub(last)
+                >= self.config.audio_format.sample_rate as u64
+        }) {
             warn!(
                 "No valid RTP data received for more than 1 second, resetting sequence tracking."
             );
@@ -261,6 +386,9 @@ impl Receiver {
                     if let Some(ts_offset) = self.timestamp_offset {
                         self.report_out_of_order_packet(&rtp, expected_seq, expected_ts, ts_offset);
                     }
+                    if let (Some(capture), Ok(lost)) = (&mut self.capture, u64::try_from(diff)) {
+                        capture.packets_lost(lost, media_time_at_reception);
+                    }
                 } else {
                     warn!(
                         "Timestamp of out-of-order packet {} is not consistent with sequence id, discarding it",
@@ -309,7 +437,11 @@ impl Receiver {
             // return Ok(());
         }
 
-        self.last_valid_data = Instant::now();
+        self.last_valid_data = Some(media_time_at_reception);
+
+        if self.filter.as_ref().is_some_and(|f| f.ssrc.is_none()) {
+            self.lock_ssrc(Some(rtp.ssrc()));
+        }
 
         self.tx.write(rtp.payload(), ingress_time);
 
@@ -351,6 +483,58 @@ impl Receiver {
         Ok(())
     }
 
+    fn lock_ssrc(&mut self, ssrc: Option<u32>) {
+        let Some(filter) = &self.filter else {
+            return;
+        };
+        if filter.ssrc == ssrc {
+            return;
+        }
+        let filter = filter.with_ssrc(ssrc);
+        match self.socket.set_filter(&filter) {
+            Ok(()) => {
+                match ssrc {
+                    Some(ssrc) => debug!(
+                        "Socket filter of receiver '{}' locked to SSRC {ssrc:#010x}",
+                        self.id
+                    ),
+                    None => debug!("Socket filter of receiver '{}' unlocked", self.id),
+                }
+                self.filter = Some(filter);
+            }
+            Err(e) => {
+                warn!(
+                    "Could not update socket filter of receiver '{}': {e}",
+                    self.id
+                );
+                self.filter = None;
+            }
+        }
+    }
+
+    /// Reports kernel drops and receive latency about once per second.
+    fn report_socket_stats(&mut self, media_time: u64) {
+        if media_time.saturating_sub(self.last_socket_stats_report)
+            < self.config.audio_format.sample_rate as u64
+        {
+            return;
+        }
+        self.last_socket_stats_report = media_time;
+
+        let latency = self.receive_latency.take();
+        if latency.count > 0 {
+            self.report_receive_latency(latency);
+        }
+
+        let drops = self.socket.drops();
+        if drops.is_some() && drops != self.kernel_drops {
+            self.kernel_drops = drops;
+            if let Some(drops) = drops {
+                self.report_kernel_drops(drops);
+            }
+        }
+    }
+
     fn reset_sequence_tracking(&mut self) {
         self.last_sequence_number = None;
         self.last_timestamp = None;
@@ -359,17 +543,19 @@ impl Receiver {
 }
 
 mod monitoring {
-    use crate::{buffer::AudioBufferPointer, formats::Frames};
+    use crate::{
+        buffer::shm::SharedBufferDescriptor, formats::Frames, monitoring::timing::HistogramSnapshot,
+    };
 
     use super::*;
 
     impl Receiver {
-        pub(crate) fn report_receiver_created(&mut self, buffer: AudioBufferPointer) {
+        pub(crate) fn report_receiver_created(&mut self, buffer: SharedBufferDescriptor) {
             self.monitoring.receiver_state(ReceiverState::Created {
                 id: self.id.clone(),
                 label: self.label.clone(),
                 config: self.config.clone(),
-                address: buffer,
+                buffer,
             });
         }
 
@@ -409,6 +595,15 @@ mod monitoring {
                 .receiver_stats(RxStats::MalformedRtpPacket(format!("{e:?}")));
         }
 
+        pub(crate) fn report_receive_latency(&mut self, latency: HistogramSnapshot) {
+            self.monitoring
+                .receiver_stats(RxStats::ReceiveLatency(latency));
+        }
+
+        pub(crate) fn report_kernel_drops(&mut self, drops: u32) {
+            self.monitoring.receiver_stats(RxStats::KernelDrops(drops));
+        }
+
         pub(crate) fn report_inconsistent_timestamp(&mut self) {
             self.monitoring
                 .receiver_stats(RxStats::InconsistentTimestamp);
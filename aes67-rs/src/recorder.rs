@@ -0,0 +1,315 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Records the audio of a receiver to Broadcast WAV files. The recorder runs on its own non-RT thread and reads
+//! the receiver buffer a link offset behind the newest received frame, so late packets still make it into the
+//! recording and the receive thread never waits for the disk. Frames that were lost are recorded as silence,
+//! which keeps the position in the file in sync with the media clock. The media time of the first frame of a
+//! file is stored as its BWF `TimeReference`.
+
+mod bwf;
+
+use crate::{
+    buffer::receiver::{ReadResult, ReceiverBufferConsumer},
+    formats::{Frames, Seconds, frames_to_duration},
+    receiver::config::ReceiverConfig,
+    utils::file_name_safe,
+};
+use bwf::{BwfInfo, BwfWriter};
+use chrono::{DateTime, Utc};
+use serde::{Deserialize, Serialize};
+use std::{
+    collections::VecDeque,
+    fs, io,
+    path::PathBuf,
+    sync::{
+        Arc,
+        atomic::{AtomicBool, Ordering},
+    },
+    thread,
+    time::Duration,
+};
+use tracing::{error, info, warn};
+
+/// Interval in which the recorder picks up newly received frames
+const POLL_INTERVAL: Duration = Duration::from_millis(50);
+/// Maximum number of frames converted at once
+const CHUNK_FRAMES: usize = 1024;
+/// Time the recorder waits before starting a new file after a failed one
+const RETRY_INTERVAL: Duration = Duration::from_secs(1);
+/// Number of suffixed names tried if a file of the same name already exists
+const MAX_NAME_COLLISIONS: usize = 100;
+const SECONDS_PER_DAY: u64 = 86_400;
+
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct RecorderConfig {
+    /// Directory the files are written to
+    pub directory: PathBuf,
+    /// Length of a file in seconds. Files are cut at multiples of the segment length on the media clock, so
+    /// all recorders roll over at the same time. Everything is recorded to a single file if not set.
+    #[serde(default)]
+    pub segment_length: Option<Seconds>,
+    /// Number of finished files to keep, older ones are deleted
+    #[serde(default)]
+    pub keep_segments: Option<usize>,
+}
+
+struct Segment {
+    writer: BwfWriter,
+    /// media time of the first frame of the next segment
+    end: Option<Frames>,
+}
+
+pub(crate) struct Recorder {
+    config: RecorderConfig,
+    receiver: ReceiverConfig,
+    consumer: ReceiverBufferConsumer,
+    segment: Option<Segment>,
+    finished: VecDeque<PathBuf>,
+    /// media time of the next frame to be recorded
+    cursor: Option<Frames>,
+    samples: Vec<f32>,
+}
+
+impl Recorder {
+    pub(crate) fn new(
+        config: RecorderConfig,
+        receiver: ReceiverConfig,
+        consumer: ReceiverBufferConsumer,
+    ) -> Self {
+        let channels = receiver.audio_format.frame_format.channels;
+        Self {
+            config,
+            receiver,
+            consumer,
+            segment: None,
+            finished: VecDeque::new(),
+            cursor: None,
+            samples: vec![0.0; CHUNK_FRAMES * channels],
+        }
+    }
+
+    /// Starts the recorder thread. It stops once `exit` is set, finishing the current file.
+    pub(crate) fn start(self, exit: Arc<AtomicBool>) {
+        thread::spawn(move || self.run(exit));
+    }
+
+    fn run(mut self, exit: Arc<AtomicBool>) {
+        info!(
+            "Recording receiver '{}' to {}.",
+            self.receiver.label,
+            self.config.directory.display()
+        );
+
+        while !exit.load(Ordering::SeqCst) {
+            if let Err(e) = self.record() {
+                error!(
+                    "Recording of receiver '{}' failed, starting a new file: {e}",
+                    self.receiver.label
+                );
+                self.abandon_segment();
+                thread::sleep(RETRY_INTERVAL);
+                continue;
+            }
+            thread::sleep(POLL_INTERVAL);
+        }
+
+        if let Err(e) = self.finish_segment() {
+            error!(
+                "Could not finish recording of receiver '{}': {e}",
+                self.receiver.label
+            );
+        }
+
+        info!("Recording of receiver '{}' stopped.", self.receiver.label);
+    }
+
+    /// Records everything that has been received up to a link offset ago.
+    fn record(&mut self) -> io::Result<()> {
+        let write_cursor = self.consumer.write_cursor();
+        if write_cursor == 0 {
+            return Ok(());
+        }
+        let end = write_cursor.saturating_sub(self.receiver.frames_in_link_offset());
+
+        let mut position = match self.cursor {
+            // the stream was interrupted for longer than the receiver buffer can bridge, or the recorder
+            // could not keep up, continuing would corrupt the timeline of the file
+            Some(cursor) if end.saturating_sub(cursor) > self.consumer.capacity_frames() / 2 => {
+                warn!(
+                    "Recording of receiver '{}' skips {} frames, starting a new file.",
+                    self.receiver.label,
+                    end - cursor
+                );
+                self.finish_segment()?;
+                end
+            }
+            Some(cursor) => cursor,
+            None => end,
+        };
+
+        let channels = self.receiver.audio_format.frame_format.channels;
+        while position < end {
+            let segment_end = self.segment(position, write_cursor)?;
+            let frames = (end - position)
+                .min(segment_end.unwrap_or(Frames::MAX) - position)
+                .min(CHUNK_FRAMES as Frames) as usize;
+            let samples = &mut self.samples[..frames * channels];
+
+            match self.consumer.read_interleaved(position, samples) {
+                ReadResult::Ok(_) => {}
+                ReadResult::NotReady(_) | ReadResult::TooLate => {
+                    // only possible if the stream was restarted at an earlier media time
+                    warn!(
+                        "Recording of receiver '{}' lost its position, starting a new file.",
+                        self.receiver.label
+                    );
+                    self.cursor = None;
+                    return self.finish_segment();
+                }
+            }
+
+            if let Some(segment) = &mut self.segment {
+                segment.writer.write_samples(samples)?;
+            }
+            position += frames as Frames;
+
+            if segment_end == Some(position) {
+                self.finish_segment()?;
+            }
+        }
+
+        self.cursor = Some(position);
+        Ok(())
+    }
+
+    /// Opens a new file starting at `position` if none is open, returns where the segment ends.
+    fn segment(&mut self, position: Frames, write_cursor: Frames) -> io::Result<Option<Frames>> {
+        if let Some(segment) = &self.segment {
+            return Ok(segment.end);
+        }
+
+        let sample_rate = self.receiver.audio_format.sample_rate;
+        let started_at = Utc::now() - frames_to_duration(write_cursor - position, sample_rate);
+        let writer = self.create_writer(position, started_at)?;
+        info!(
+            "Recording receiver '{}' to {}.",
+            self.receiver.label,
+            writer.path().display()
+        );
+
+        let end = self
+            .config
+            .segment_length
+            .filter(|it| *it > 0)
+            .map(|it| it as Frames * sample_rate as Frames)
+            .map(|len| (position / len + 1) * len);
+        self.segment = Some(Segment { writer, end });
+        Ok(end)
+    }
+
+    /// Creates the file for a segment starting at media time `position`. The name contains the wall clock time
+    /// and the media time of the first frame, a counter is appended if a file of that name exists anyway, e.g.
+    /// because the stream was restarted at an earlier media time.
+    fn create_writer(&self, position: Frames, started_at: DateTime<Utc>) -> io::Result<BwfWriter> {
+        let stem = format!(
+            "{}_{}_{position}",
+            file_name_safe(&self.receiver.label),
+            started_at.format("%Y%m%d-%H%M%S")
+        );
+        // the directory may have been removed while recording
+        fs::create_dir_all(&self.config.directory)?;
+        let info = self.bwf_info(position, started_at);
+        for collision in 0..MAX_NAME_COLLISIONS {
+            let name = match collision {
+                0 => format!("{stem}.wav"),
+                n => format!("{stem}-{n}.wav"),
+            };
+            match BwfWriter::create(&self.config.directory.join(name), info.clone()) {
+                Err(e) if e.kind() == io::ErrorKind::AlreadyExists => continue,
+                res => return res,
+            }
+        }
+        Err(io::Error::new(
+            io::ErrorKind::AlreadyExists,
+            format!("all file names for {stem} are taken"),
+        ))
+    }
+
+    fn bwf_info(&self, position: Frames, started_at: DateTime<Utc>) -> BwfInfo {
+        let sample_rate = self.receiver.audio_format.sample_rate;
+        BwfInfo {
+            channels: self.receiver.audio_format.frame_format.channels as u16,
+            sample_rate,
+            bits_per_sample: self
+                .receiver
+                .audio_format
+                .frame_format
+                .sample_format
+                .bit_depth() as u16,
+            description: format!(
+                "AES67 stream '{}' from {}, PTP media time {position}",
+                self.receiver.label, self.receiver.source
+            ),
+            originator: "aes67-rs".to_owned(),
+            originator_reference: self.receiver.id.to_string(),
+            origination_date: started_at.format("%Y-%m-%d").to_string(),
+            origination_time: started_at.format("%H:%M:%S").to_string(),
+            // the media clock runs on PTP time, so this counts from midnight TAI
+            time_reference: position % (SECONDS_PER_DAY * sample_rate as u64),
+        }
+    }
+
+    /// Closes the current file after a failure, keeping what has been recorded if possible. Recording resumes
+    /// at the newest frames in a new file.
+    fn abandon_segment(&mut self) {
+        if let Err(e) = self.finish_segment() {
+            warn!(
+                "Could not finish recording of receiver '{}': {e}",
+                self.receiver.label
+            );
+        }
+        self.cursor = None;
+    }
+
+    fn finish_segment(&mut self) -> io::Result<()> {
+        let Some(segment) = self.segment.take() else {
+            return Ok(());
+        };
+        let frames = segment.writer.frames();
+        let path = segment.writer.finish()?;
+        info!(
+            "Finished recording {} ({:.1} s).",
+            path.display(),
+            frames_to_duration(frames, self.receiver.audio_format.sample_rate).as_secs_f32()
+        );
+        self.finished.push_back(path);
+
+        if let Some(keep) = self.config.keep_segments {
+            while self.finished.len() > keep {
+                let Some(oldest) = self.finished.pop_front() else {
+                    break;
+                };
+                if let Err(e) = fs::remove_file(&oldest) {
+                    warn!("Could not delete old recording {}: {e}", oldest.display());
+                }
+            }
+        }
+        Ok(())
+    }
+}
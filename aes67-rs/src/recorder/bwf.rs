@@ -0,0 +1,375 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Streaming Broadcast WAV writer. The header occupies the first [ALIGNMENT] bytes of the file (padded with a
+//! `JUNK` chunk), so the sample data starts block aligned and all writes can bypass the page cache with
+//! `O_DIRECT`. The header is rewritten after every flush, a file that was not finished properly is still
+//! readable up to the last flush. Files that outgrow 4 GiB are turned into RF64 files (EBU Tech 3306) by
+//! replacing the leading `JUNK` chunk with a `ds64` chunk.
+
+use crate::formats::f32_to_pcm;
+use std::{
+    alloc::{self, Layout},
+    fs::{File, OpenOptions},
+    io,
+    ops::{Deref, DerefMut},
+    os::{
+        fd::AsRawFd,
+        unix::fs::{FileExt, OpenOptionsExt},
+    },
+    path::{Path, PathBuf},
+    ptr::NonNull,
+};
+use tracing::warn;
+
+/// Alignment of `O_DIRECT` writes, covers all common logical block sizes
+pub const ALIGNMENT: usize = 4096;
+const HEADER_LEN: usize = ALIGNMENT;
+/// Sample data is written in chunks of this size
+const WRITE_BUFFER_LEN: usize = 1 << 20;
+const BEXT_LEN: usize = 602;
+const KSDATAFORMAT_SUBTYPE_PCM: [u8; 16] = [
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71,
+];
+
+/// Format and broadcast extension metadata of a file.
+#[derive(Debug, Clone)]
+pub struct BwfInfo {
+    pub channels: u16,
+    pub sample_rate: u32,
+    pub bits_per_sample: u16,
+    pub description: String,
+    pub originator: String,
+    pub originator_reference: String,
+    /// `yyyy-mm-dd`
+    pub origination_date: String,
+    /// `hh:mm:ss`
+    pub origination_time: String,
+    /// Samples since midnight of the first sample in the file
+    pub time_reference: u64,
+}
+
+impl BwfInfo {
+    fn bytes_per_sample(&self) -> usize {
+        self.bits_per_sample as usize / 8
+    }
+
+    fn block_align(&self) -> usize {
+        self.channels as usize * self.bytes_per_sample()
+    }
+}
+
+pub struct BwfWriter {
+    file: File,
+    path: PathBuf,
+    direct: bool,
+    info: BwfInfo,
+    buffer: AlignedBuffer,
+    header: AlignedBuffer,
+    filled: usize,
+    /// sample bytes that have been written to the file
+    flushed: u64,
+}
+
+impl BwfWriter {
+    /// Creates a new file, `O_DIRECT` is used if the file system supports it.
+    pub fn create(path: &Path, info: BwfInfo) -> io::Result<Self> {
+        let (file, direct) = match OpenOptions::new()
+            .write(true)
+            .create_new(true)
+            .custom_flags(libc::O_DIRECT)
+            .open(path)
+        {
+            Ok(file) => (file, true),
+            Err(e) if e.raw_os_error() == Some(libc::EINVAL) => {
+                warn!(
+                    "File system does not support O_DIRECT, recording to {} through the page cache.",
+                    path.display()
+                );
+                let file = OpenOptions::new().write(true).create_new(true).open(path)?;
+                (file, false)
+            }
+            Err(e) => return Err(e),
+        };
+
+        let mut writer = Self {
+            file,
+            path: path.to_owned(),
+            direct,
+            info,
+            buffer: AlignedBuffer::new(WRITE_BUFFER_LEN),
+            header: AlignedBuffer::new(HEADER_LEN),
+            filled: 0,
+            flushed: 0,
+        };
+        writer.write_header()?;
+        Ok(writer)
+    }
+
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
+    /// Number of frames written so far
+    pub fn frames(&self) -> u64 {
+        self.data_len() / self.info.block_align() as u64
+    }
+
+    /// Appends interleaved samples, converted to PCM of the file's bit depth.
+    pub fn write_samples(&mut self, samples: &[f32]) -> io::Result<()> {
+        let bytes = self.info.bytes_per_sample();
+        let bits = self.info.bits_per_sample as usize;
+        for &sample in samples {
+            if self.filled + bytes > self.buffer.len() {
+                self.flush()?;
+            }
+            let value = f32_to_pcm(sample, bits);
+            self.buffer[self.filled..self.filled + bytes]
+                .copy_from_slice(&value.to_le_bytes()[..bytes]);
+            self.filled += bytes;
+        }
+        Ok(())
+    }
+
+    /// Writes the remaining samples and the final header and syncs the file to disk.
+    pub fn finish(mut self) -> io::Result<PathBuf> {
+        let data_len = self.data_len();
+        let tail = self.filled;
+        if tail > 0 {
+            // direct writes must cover whole blocks, the padding is cut off again below
+            let len = if self.direct {
+                tail.next_multiple_of(ALIGNMENT)
+            } else {
+                tail
+            };
+            self.buffer[tail..len].fill(0);
+            self.write_at(HEADER_LEN as u64 + self.flushed, len)?;
+            self.flushed += tail as u64;
+            self.filled = 0;
+        }
+        self.file
+            .set_len(HEADER_LEN as u64 + data_len + data_len % 2)?;
+        self.write_header()?;
+        self.file.sync_data()?;
+        Ok(self.path)
+    }
+
+    fn data_len(&self) -> u64 {
+        self.flushed + self.filled as u64
+    }
+
+    /// Writes all complete blocks in the buffer and keeps the rest for the next flush.
+    fn flush(&mut self) -> io::Result<()> {
+        let len = self.filled / ALIGNMENT * ALIGNMENT;
+        if len == 0 {
+            return Ok(());
+        }
+        self.write_at(HEADER_LEN as u64 + self.flushed, len)?;
+        self.flushed += len as u64;
+        self.buffer.copy_within(len..self.filled, 0);
+        self.filled -= len;
+        self.write_header()
+    }
+
+    fn write_at(&mut self, offset: u64, len: usize) -> io::Result<()> {
+        match self.file.write_all_at(&self.buffer[..len], offset) {
+            Err(e) if self.direct && e.raw_os_error() == Some(libc::EINVAL) => {
+                warn!(
+                    "O_DIRECT write to {} failed, continuing through the page cache.",
+                    self.path.display()
+                );
+                self.disable_direct_io()?;
+                self.file.write_all_at(&self.buffer[..len], offset)
+            }
+            res => res,
+        }
+    }
+
+    fn write_header(&mut self) -> io::Result<()> {
+        let data_len = self.flushed;
+        let mut header = HeaderWriter::new(&mut self.header);
+        build_header(&mut header, &self.info, data_len);
+        let res = self.file.write_all_at(&self.header, 0);
+        match res {
+            Err(e) if self.direct && e.raw_os_error() == Some(libc::EINVAL) => {
+                self.disable_direct_io()?;
+                self.file.write_all_at(&self.header, 0)
+            }
+            res => res,
+        }
+    }
+
+    fn disable_direct_io(&mut self) -> io::Result<()> {
+        let fd = self.file.as_raw_fd();
+        let flags = unsafe { libc::fcntl(fd, libc::F_GETFL) };
+        if flags < 0 || unsafe { libc::fcntl(fd, libc::F_SETFL, flags & !libc::O_DIRECT) } < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        self.direct = false;
+        Ok(())
+    }
+}
+
+fn build_header(h: &mut HeaderWriter, info: &BwfInfo, data_len: u64) {
+    let riff_len = HEADER_LEN as u64 - 8 + data_len + data_len % 2;
+    let rf64 = riff_len > u32::MAX as u64;
+    let extensible = info.channels > 2;
+
+    h.bytes(if rf64 { b"RF64" } else { b"RIFF" });
+    h.u32(if rf64 { u32::MAX } else { riff_len as u32 });
+    h.bytes(b"WAVE");
+
+    // reserves the space for the ds64 chunk in case the file grows beyond 4 GiB
+    h.bytes(if rf64 { b"ds64" } else { b"JUNK" });
+    h.u32(28);
+    if rf64 {
+        h.u64(riff_len);
+        h.u64(data_len);
+        h.u64(data_len / info.block_align() as u64);
+        h.u32(0);
+    } else {
+        h.zeros(28);
+    }
+
+    h.bytes(b"fmt ");
+    h.u32(if extensible { 40 } else { 16 });
+    h.u16(if extensible { 0xFFFE } else { 1 });
+    h.u16(info.channels);
+    h.u32(info.sample_rate);
+    h.u32(info.sample_rate * info.block_align() as u32);
+    h.u16(info.block_align() as u16);
+    h.u16(info.bits_per_sample);
+    if extensible {
+        h.u16(22);
+        h.u16(info.bits_per_sample);
+        // no speaker positions
+        h.u32(0);
+        h.bytes(&KSDATAFORMAT_SUBTYPE_PCM);
+    }
+
+    h.bytes(b"bext");
+    h.u32(BEXT_LEN as u32);
+    let bext_start = h.pos;
+    h.text(&info.description, 256);
+    h.text(&info.originator, 32);
+    h.text(&info.originator_reference, 32);
+    h.text(&info.origination_date, 10);
+    h.text(&info.origination_time, 8);
+    h.u64(info.time_reference);
+    // version 1, no loudness metadata
+    h.u16(1);
+    h.zeros(BEXT_LEN - (h.pos - bext_start));
+
+    // pads the header to a whole block, so the sample data starts aligned
+    let filler = HEADER_LEN - h.pos - 16;
+    h.bytes(b"JUNK");
+    h.u32(filler as u32);
+    h.zeros(filler);
+
+    h.bytes(b"data");
+    h.u32(if rf64 {
+        u32::MAX
+    } else {
+        data_len.min(u32::MAX as u64) as u32
+    });
+    debug_assert_eq!(h.pos, HEADER_LEN);
+}
+
+struct HeaderWriter<'a> {
+    buf: &'a mut [u8],
+    pos: usize,
+}
+
+impl<'a> HeaderWriter<'a> {
+    fn new(buf: &'a mut [u8]) -> Self {
+        Self { buf, pos: 0 }
+    }
+
+    fn bytes(&mut self, bytes: &[u8]) {
+        self.buf[self.pos..self.pos + bytes.len()].copy_from_slice(bytes);
+        self.pos += bytes.len();
+    }
+
+    fn zeros(&mut self, len: usize) {
+        self.buf[self.pos..self.pos + len].fill(0);
+        self.pos += len;
+    }
+
+    fn u16(&mut self, value: u16) {
+        self.bytes(&value.to_le_bytes());
+    }
+
+    fn u32(&mut self, value: u32) {
+        self.bytes(&value.to_le_bytes());
+    }
+
+    fn u64(&mut self, value: u64) {
+        self.bytes(&value.to_le_bytes());
+    }
+
+    /// ASCII field of fixed length, padded with zeros
+    fn text(&mut self, text: &str, len: usize) {
+        let text = text.as_bytes();
+        let n = text.len().min(len);
+        self.bytes(&text[..n]);
+        self.zeros(len - n);
+    }
+}
+
+/// Heap buffer aligned for `O_DIRECT`
+struct AlignedBuffer {
+    ptr: NonNull<u8>,
+    len: usize,
+}
+
+// the buffer is owned exclusively by its writer
+unsafe impl Send for AlignedBuffer {}
+
+impl AlignedBuffer {
+    fn new(len: usize) -> Self {
+        let layout = Self::layout(len);
+        let ptr = unsafe { alloc::alloc_zeroed(layout) };
+        let Some(ptr) = NonNull::new(ptr) else {
+            alloc::handle_alloc_error(layout);
+        };
+        Self { ptr, len }
+    }
+
+    fn layout(len: usize) -> Layout {
+        Layout::from_size_align(len, ALIGNMENT).expect("invalid buffer layout")
+    }
+}
+
+impl Deref for AlignedBuffer {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        unsafe { std::slice::from_raw_parts(self.ptr.as_ptr(), self.len) }
+    }
+}
+
+impl DerefMut for AlignedBuffer {
+    fn deref_mut(&mut self) -> &mut [u8] {
+        unsafe { std::slice::from_raw_parts_mut(self.ptr.as_ptr(), self.len) }
+    }
+}
+
+impl Drop for AlignedBuffer {
+    fn drop(&mut self) {
+        unsafe { alloc::dealloc(self.ptr.as_ptr(), Self::layout(self.len)) };
+    }
+}
@@ -0,0 +1,315 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Relays a receiver to a sender inside the process, without a round trip through an audio server. The relay
+//! thread reads the receiver buffer one link offset behind the media clock, just like the playout of an I/O
+//! handler would, and writes it to the sender buffer one sender packet time at a time. The sender cuts its own
+//! packets, so the two streams may use different packet times.
+//!
+//! The receiver buffer holds `f32` samples that were converted from L16/L24 without loss, so the relay turns
+//! them back into the integers that were received (see [f32_to_pcm]) and only shifts them to the sender's bit
+//! depth.
+
+use crate::{
+    buffer::{
+        receiver::ReadResult, receiver::ReceiverBufferConsumer, sender::SenderBufferProducer,
+    },
+    error::{SenderInternalError, SenderInternalResult},
+    formats::{Frames, SessionId, f32_to_pcm, frames_to_duration},
+    monitoring::Monitoring,
+    receiver::config::ReceiverConfig,
+    sender::config::SenderConfig,
+    time::{Clock, MediaClock},
+    utils::{set_realtime_priority, sleep_precise},
+};
+use serde::{Deserialize, Serialize};
+use std::{
+    sync::{
+        Arc,
+        atomic::{AtomicBool, Ordering},
+    },
+    thread,
+};
+use tracing::{error, info, warn};
+
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct RelayConfig {
+    /// Receiver whose stream is sent
+    pub receiver: SessionId,
+    /// Receiver channel for each sender channel, `None` sends silence. Channels are passed through one to one
+    /// if empty.
+    #[serde(default)]
+    pub channels: Vec<Option<usize>>,
+}
+
+pub(crate) struct Relay {
+    receiver: ReceiverConfig,
+    sender: SenderConfig,
+    rx: ReceiverBufferConsumer,
+    tx: SenderBufferProducer,
+    clock: Clock,
+    monitoring: Monitoring,
+    /// receiver channel of each sender channel
+    channel_map: Vec<Option<usize>>,
+    input: Vec<f32>,
+}
+
+impl Relay {
+    pub(crate) fn new(
+        config: RelayConfig,
+        sender: SenderConfig,
+        rx: ReceiverBufferConsumer,
+        tx: SenderBufferProducer,
+        clock: Clock,
+        monitoring: Monitoring,
+    ) -> SenderInternalResult<Self> {
+        let receiver = rx.config().clone();
+        if receiver.audio_format.sample_rate != sender.audio_format.sample_rate {
+            return Err(SenderInternalError::RelaySampleRateMismatch {
+                receiver: receiver.audio_format.sample_rate,
+                sender: sender.audio_format.sample_rate,
+            });
+        }
+
+        let input_channels = receiver.audio_format.frame_format.channels;
+        let output_channels = sender.audio_format.frame_format.channels;
+        let channel_map = (0..output_channels)
+            .map(|channel| {
+                let source = if config.channels.is_empty() {
+                    Some(channel)
+                } else {
+                    config.channels.get(channel).copied().flatten()
+                };
+                source.filter(|&source| {
+                    if source >= input_channels && !config.channels.is_empty() {
+                        warn!(
+                            "Receiver '{}' has no channel {source}, channel {channel} of sender '{}' will be silent.",
+                            receiver.label, sender.label
+                        );
+                    }
+                    source < input_channels
+                })
+            })
+            .collect();
+
+        let block_frames = sender.ptime_frames() as usize;
+        Ok(Self {
+            input: vec![0.0; block_frames * input_channels],
+            receiver,
+            sender,
+            rx,
+            tx,
+            clock,
+            monitoring,
+            channel_map,
+        })
+    }
+
+    /// Starts the relay thread. It stops once `exit` is set.
+    pub(crate) fn start(self, exit: Arc<AtomicBool>) {
+        thread::spawn(move || {
+            set_realtime_priority();
+            if let Err(e) = self.run(exit) {
+                error!("Relay stopped: {e}");
+            }
+        });
+    }
+
+    fn run(mut self, exit: Arc<AtomicBool>) -> SenderInternalResult<()> {
+        info!(
+            "Relaying receiver '{}' to sender '{}'.",
+            self.receiver.label, self.sender.label
+        );
+
+        let sample_rate = self.sender.audio_format.sample_rate;
+        let block = self.sender.ptime_frames();
+        let link_offset = self.receiver.frames_in_link_offset();
+        let mut next = None;
+
+        while !exit.load(Ordering::SeqCst) {
+            let now = self.clock.current_time()?;
+            let block_start = *next.get_or_insert((now.media_time / block + 1) * block);
+
+            if block_start > now.media_time {
+                sleep_precise(
+                    frames_to_duration(block_start - now.media_time, sample_rate),
+                    now.system_time,
+                );
+                continue;
+            }
+
+            if now.media_time >= block_start + block {
+                let current = now.media_time / block * block;
+                warn!(
+                    "Relay to sender '{}' skipped {} frames.",
+                    self.sender.label,
+                    current - block_start
+                );
+                next = Some(current);
+                continue;
+            }
+
+            self.write_block(
+                block_start,
+                block_start.saturating_sub(link_offset),
+                block as usize,
+            );
+            next = Some(block_start + block);
+        }
+
+        info!(
+            "Stopped relaying receiver '{}' to sender '{}'.",
+            self.receiver.label, self.sender.label
+        );
+        Ok(())
+    }
+
+    fn write_block(&mut self, ingress_time: Frames, playout_time: Frames, frames: usize) {
+        let output = self.tx.frames_mut(0, frames);
+        match self.rx.read_interleaved(playout_time, &mut self.input) {
+            ReadResult::Ok(_) => {
+                let input_format = self.receiver.audio_format.frame_format.sample_format;
+                let output_format = self.sender.audio_format.frame_format.sample_format;
+                transcode(
+                    &self.input,
+                    self.receiver.audio_format.frame_format.channels,
+                    input_format.bit_depth(),
+                    output,
+                    output_format.bytes_per_sample(),
+                    &self.channel_map,
+                );
+            }
+            ReadResult::NotReady(_) | ReadResult::TooLate => output.fill(0),
+        }
+
+        if self.tx.send_packets(ingress_time, frames).is_err() {
+            self.report_buffer_overflow();
+        }
+    }
+}
+
+/// Writes interleaved receiver frames as sender wire format, picking the sender channels from the receiver
+/// channels according to `channel_map`.
+fn transcode(
+    input: &[f32],
+    input_channels: usize,
+    input_bit_depth: usize,
+    output: &mut [u8],
+    output_bytes: usize,
+    channel_map: &[Option<usize>],
+) {
+    let input_frames = input.chunks_exact(input_channels);
+    let output_frames = output.chunks_exact_mut(output_bytes * channel_map.len());
+    let shift = output_bytes as i32 * 8 - input_bit_depth as i32;
+
+    for (input_frame, output_frame) in input_frames.zip(output_frames) {
+        for (output_sample, source) in output_frame.chunks_exact_mut(output_bytes).zip(channel_map)
+        {
+            let Some(source) = source else {
+                output_sample.fill(0);
+                continue;
+            };
+            let value = f32_to_pcm(input_frame[*source], input_bit_depth);
+            let value = if shift >= 0 {
+                value << shift
+            } else {
+                value >> -shift
+            };
+            output_sample.copy_from_slice(&value.to_be_bytes()[4 - output_bytes..]);
+        }
+    }
+}
+
+mod monitoring {
+    use crate::monitoring::TxStats;
+
+    use super::*;
+
+    impl Relay {
+        pub(crate) fn report_buffer_overflow(&self) {
+            self.monitoring.sender_stats(TxStats::BufferOverflow);
+        }
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use crate::formats::{SampleFormat, SampleReader};
+
+    /// Reads mono samples in `input_format` like the receiver buffer does and transcodes them to
+    /// `output_format`.
+    fn relay(input_format: SampleFormat, input: &[u8], output_format: SampleFormat) -> Vec<u8> {
+        let samples: Vec<f32> = input
+            .chunks_exact(input_format.bytes_per_sample())
+            .map(|sample| input_format.read_sample(sample))
+            .collect();
+        let mut output = vec![0xFF; samples.len() * output_format.bytes_per_sample()];
+        transcode(
+            &samples,
+            1,
+            input_format.bit_depth(),
+            &mut output,
+            output_format.bytes_per_sample(),
+            &[Some(0)],
+        );
+        output
+    }
+
+    /// Every sample value except -1, which is read as 0.0 and comes back as 0
+    fn l16_samples() -> Vec<u8> {
+        (i16::MIN..=i16::MAX)
+            .filter(|&v| v != -1)
+            .flat_map(i16::to_be_bytes)
+            .collect()
+    }
+
+    /// Samples from the whole range, again without -1
+    fn l24_samples() -> Vec<u8> {
+        (-0x80_0000..0x80_0000)
+            .step_by(97)
+            .chain([0x7F_FFFF])
+            .filter(|&v: &i32| v != -1)
+            .flat_map(|v| v.to_be_bytes()[1..].to_vec())
+            .collect()
+    }
+
+    #[test]
+    fn transcode_keeps_sample_format() {
+        let l16 = l16_samples();
+        assert_eq!(l16, relay(SampleFormat::L16, &l16, SampleFormat::L16));
+        let l24 = l24_samples();
+        assert_eq!(l24, relay(SampleFormat::L24, &l24, SampleFormat::L24));
+    }
+
+    #[test]
+    fn transcode_converts_l16_to_l24_and_back() {
+        let l16 = l16_samples();
+        let l24 = relay(SampleFormat::L16, &l16, SampleFormat::L24);
+        let padded: Vec<u8> = l16.chunks_exact(2).flat_map(|s| [s[0], s[1], 0]).collect();
+        assert_eq!(padded, l24);
+        assert_eq!(l16, relay(SampleFormat::L24, &l24, SampleFormat::L16));
+    }
+
+    #[test]
+    fn transcode_truncates_l24_to_l16() {
+        let l24 = l24_samples();
+        let truncated: Vec<u8> = l24.chunks_exact(3).flat_map(|s| [s[0], s[1]]).collect();
+        assert_eq!(truncated, relay(SampleFormat::L24, &l24, SampleFormat::L16));
+    }
+}
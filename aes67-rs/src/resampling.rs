@@ -0,0 +1,119 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Adaptive resampling used to absorb clock drift compensation.
+//! Instead of duplicating or dropping samples when the local audio clock is slewed towards the PTP media clock,
+//! each block is stretched or compressed to the requested number of frames using 4-point cubic (Catmull-Rom)
+//! interpolation. The phase is carried over from one block to the next, so the resulting signal is continuous.
+
+use crate::formats::Frames;
+
+/// Constant delay introduced by the resampler. Callers that need sample accurate timestamps have to shift
+/// their media time by this many frames.
+pub const RESAMPLER_LATENCY_FRAMES: Frames = 2;
+
+const HISTORY_LEN: usize = 3;
+
+#[derive(Debug, Clone, Default)]
+pub struct AdaptiveResampler {
+    history: [f32; HISTORY_LEN],
+}
+
+impl AdaptiveResampler {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    pub fn reset(&mut self) {
+        self.history = [0.0; HISTORY_LEN];
+    }
+
+    /// Resample `input` so that it exactly fills `output`. If both have the same length this is a plain
+    /// (delayed) copy, otherwise the block is stretched or compressed by `output.len() - input.len()` frames.
+    pub fn process(&mut self, input: &[f32], output: &mut [f32]) {
+        let n = input.len();
+        let m = output.len();
+
+        if n == 0 || m == 0 {
+            output.fill(self.history[HISTORY_LEN - 1]);
+        } else if n == m {
+            self.copy_delayed(input, output);
+        } else {
+            self.interpolate(input, output);
+        }
+
+        self.update_history(input);
+    }
+
+    fn copy_delayed(&self, input: &[f32], output: &mut [f32]) {
+        // output[k] = y[k + 1] where y = history ++ input
+        let head = (HISTORY_LEN - 1).min(output.len());
+        output[..head].copy_from_slice(&self.history[1..1 + head]);
+        let tail = output.len() - head;
+        output[head..].copy_from_slice(&input[..tail]);
+    }
+
+    fn interpolate(&self, input: &[f32], output: &mut [f32]) {
+        let step = input.len() as f64 / output.len() as f64;
+
+        for (k, out) in output.iter_mut().enumerate() {
+            // position within y = history ++ input; the offset of 1 keeps the first read within the history
+            let pos = k as f64 * step + 1.0;
+            let i = pos as usize;
+            let frac = (pos - i as f64) as f32;
+
+            *out = if i > HISTORY_LEN {
+                let x = &input[i - HISTORY_LEN - 1..i - HISTORY_LEN + 3];
+                cubic(x[0], x[1], x[2], x[3], frac)
+            } else {
+                cubic(
+                    self.sample(input, i - 1),
+                    self.sample(input, i),
+                    self.sample(input, i + 1),
+                    self.sample(input, i + 2),
+                    frac,
+                )
+            };
+        }
+    }
+
+    fn sample(&self, input: &[f32], index: usize) -> f32 {
+        if index < HISTORY_LEN {
+            self.history[index]
+        } else {
+            input[index - HISTORY_LEN]
+        }
+    }
+
+    fn update_history(&mut self, input: &[f32]) {
+        let n = input.len();
+        if n >= HISTORY_LEN {
+            self.history.copy_from_slice(&input[n - HISTORY_LEN..]);
+        } else {
+            self.history.rotate_left(n);
+            self.history[HISTORY_LEN - n..].copy_from_slice(input);
+        }
+    }
+}
+
+#[inline(always)]
+fn cubic(xm1: f32, x0: f32, x1: f32, x2: f32, t: f32) -> f32 {
+    let c1 = 0.5 * (x1 - xm1);
+    let c2 = xm1 - 2.5 * x0 + 2.0 * x1 - 0.5 * x2;
+    let c3 = 0.5 * (x2 - xm1) + 1.5 * (x0 - x1);
+    ((c3 * t + c2) * t + c1) * t + x0
+}
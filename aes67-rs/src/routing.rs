@@ -0,0 +1,165 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Routing and mixing matrix between the channels of a stream and the channels of its I/O handler client.
+//! Receivers route stream channels to client channels, senders route client channels to stream channels, so
+//! a client only sees the channels it needs, no matter how large the stream is.
+//!
+//! Gains are sparse: only routes with a non-zero gain, or one that is still ramping down, are mixed. Gain
+//! changes ramp linearly so they don't click, a change from 0 to 1 takes [RoutingConfig::ramp].
+
+mod mix;
+
+use crate::{
+    formats::{FramesPerSecond, MilliSeconds},
+    time::MILLIS_PER_SEC_F,
+    utils::AtomicF32,
+};
+use serde::{Deserialize, Serialize};
+use std::sync::{Arc, atomic::Ordering};
+
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct RoutingConfig {
+    /// Labels of the client channels, one per channel
+    pub channel_labels: Vec<String>,
+    #[serde(default)]
+    pub routes: Vec<Route>,
+    /// Duration of a gain change by 1.0
+    #[serde(default = "default_ramp")]
+    pub ramp: MilliSeconds,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct Route {
+    pub input: usize,
+    pub output: usize,
+    /// Linear gain
+    pub gain: f32,
+}
+
+fn default_ramp() -> MilliSeconds {
+    20.0
+}
+
+/// Target gains of a routing matrix. Clones share the gains, so they can be changed while the audio threads
+/// apply them.
+#[derive(Debug, Clone)]
+pub struct RoutingMatrix {
+    inputs: usize,
+    outputs: usize,
+    gains: Arc<[AtomicF32]>,
+}
+
+impl RoutingMatrix {
+    pub fn new(inputs: usize, outputs: usize, routes: &[Route]) -> Self {
+        let matrix = Self {
+            inputs,
+            outputs,
+            gains: (0..inputs * outputs).map(|_| AtomicF32::new(0.0)).collect(),
+        };
+        matrix.set_routes(routes);
+        matrix
+    }
+
+    pub fn inputs(&self) -> usize {
+        self.inputs
+    }
+
+    pub fn outputs(&self) -> usize {
+        self.outputs
+    }
+
+    /// Returns `false` if the matrix has no such input or output.
+    pub fn set_gain(&self, input: usize, output: usize, gain: f32) -> bool {
+        if input >= self.inputs || output >= self.outputs {
+            return false;
+        }
+        self.gains[output * self.inputs + input].store(gain, Ordering::Relaxed);
+        true
+    }
+
+    /// Replaces all gains, routes that are not listed are muted.
+    pub fn set_routes(&self, routes: &[Route]) {
+        let mut gains = vec![0.0; self.gains.len()];
+        for route in routes {
+            if route.input < self.inputs && route.output < self.outputs {
+                gains[route.output * self.inputs + route.input] = route.gain;
+            }
+        }
+        for (gain, value) in self.gains.iter().zip(gains) {
+            gain.store(value, Ordering::Relaxed);
+        }
+    }
+
+    fn gain(&self, input: usize, output: usize) -> f32 {
+        self.gains[output * self.inputs + input].load(Ordering::Relaxed)
+    }
+}
+
+/// Applies a [RoutingMatrix] to blocks of audio in an audio thread, ramping the gains it applies towards the
+/// targets in the matrix.
+#[derive(Debug, Clone)]
+pub struct Router {
+    matrix: RoutingMatrix,
+    current: Vec<f32>,
+    /// largest gain change per frame
+    max_step: f32,
+}
+
+impl Router {
+    pub fn new(matrix: RoutingMatrix, ramp: MilliSeconds, sample_rate: FramesPerSecond) -> Self {
+        let ramp_frames = ramp * sample_rate as f32 / MILLIS_PER_SEC_F;
+        Self {
+            current: vec![0.0; matrix.inputs * matrix.outputs],
+            max_step: if ramp_frames >= 1.0 {
+                1.0 / ramp_frames
+            } else {
+                f32::INFINITY
+            },
+            matrix,
+        }
+    }
+
+    pub fn matrix(&self) -> &RoutingMatrix {
+        &self.matrix
+    }
+
+    /// Mixes one block of output channel `output` into `dst` from the planar `inputs`, which must be at least
+    /// as long as `dst`.
+    pub fn process(&mut self, output: usize, inputs: &[Vec<f32>], dst: &mut [f32]) {
+        dst.fill(0.0);
+        // an empty block must not advance the ramp, with an instant ramp the change limit would be inf * 0 = NaN
+        if dst.is_empty() || output >= self.matrix.outputs {
+            return;
+        }
+
+        let max_change = self.max_step * dst.len() as f32;
+        for (input, src) in inputs.iter().enumerate().take(self.matrix.inputs) {
+            let index = output * self.matrix.inputs + input;
+            let from = self.current[index];
+            let target = self.matrix.gain(input, output);
+            if from == 0.0 && target == 0.0 {
+                continue;
+            }
+            let to = from + (target - from).clamp(-max_change, max_change);
+            mix::mix(dst, &src[..dst.len()], from, to);
+            self.current[index] = to;
+        }
+    }
+}
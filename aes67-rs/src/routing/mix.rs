@@ -0,0 +1,125 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Kernel of the [routing matrix](super): adds an input channel to an output channel with a gain that moves
+//! linearly from one value to another over the block. It runs on 8 samples at a time with AVX or 4 with SSE
+//! on x86_64, 4 with NEON on aarch64, and falls back to a scalar loop for the tail and on other targets.
+
+/// Adds `src` to `dst`, scaled by a gain that ramps from `from` (exclusive) to `to` (inclusive), so
+/// consecutive blocks continue each other's ramp without a step.
+pub fn mix(dst: &mut [f32], src: &[f32], from: f32, to: f32) {
+    let frames = dst.len().min(src.len());
+    let step = (to - from) / frames.max(1) as f32;
+
+    #[cfg(target_arch = "x86_64")]
+    let done = if is_x86_feature_detected!("avx") {
+        unsafe { mix_avx(&mut dst[..frames], &src[..frames], from, step) }
+    } else {
+        unsafe { mix_sse(&mut dst[..frames], &src[..frames], from, step) }
+    };
+
+    #[cfg(target_arch = "aarch64")]
+    let done = unsafe { mix_neon(&mut dst[..frames], &src[..frames], from, step) };
+
+    #[cfg(not(any(target_arch = "x86_64", target_arch = "aarch64")))]
+    let done = 0;
+
+    mix_scalar(&mut dst[done..frames], &src[done..frames], from, step, done);
+}
+
+fn mix_scalar(dst: &mut [f32], src: &[f32], from: f32, step: f32, offset: usize) {
+    for (i, (output, input)) in dst.iter_mut().zip(src).enumerate() {
+        *output += input * (from + step * (offset + i + 1) as f32);
+    }
+}
+
+/// Returns the number of samples mixed. The gain of every lane is computed from its index rather than
+/// accumulated, so long blocks don't drift away from the target gain.
+#[cfg(target_arch = "x86_64")]
+#[target_feature(enable = "avx")]
+unsafe fn mix_avx(dst: &mut [f32], src: &[f32], from: f32, step: f32) -> usize {
+    use std::arch::x86_64::{
+        _mm256_add_ps, _mm256_loadu_ps, _mm256_mul_ps, _mm256_set1_ps, _mm256_setr_ps,
+        _mm256_storeu_ps,
+    };
+
+    let mut done = 0;
+    unsafe {
+        let lanes = _mm256_setr_ps(1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0);
+        let from = _mm256_set1_ps(from);
+        let step = _mm256_set1_ps(step);
+        while done + 8 <= dst.len() {
+            let index = _mm256_add_ps(_mm256_set1_ps(done as f32), lanes);
+            let gain = _mm256_add_ps(from, _mm256_mul_ps(step, index));
+            let input = _mm256_loadu_ps(src.as_ptr().add(done));
+            let output = _mm256_loadu_ps(dst.as_ptr().add(done));
+            _mm256_storeu_ps(
+                dst.as_mut_ptr().add(done),
+                _mm256_add_ps(output, _mm256_mul_ps(input, gain)),
+            );
+            done += 8;
+        }
+    }
+    done
+}
+
+#[cfg(target_arch = "x86_64")]
+unsafe fn mix_sse(dst: &mut [f32], src: &[f32], from: f32, step: f32) -> usize {
+    use std::arch::x86_64::{
+        _mm_add_ps, _mm_loadu_ps, _mm_mul_ps, _mm_set1_ps, _mm_setr_ps, _mm_storeu_ps,
+    };
+
+    let mut done = 0;
+    unsafe {
+        let lanes = _mm_setr_ps(1.0, 2.0, 3.0, 4.0);
+        let from = _mm_set1_ps(from);
+        let step = _mm_set1_ps(step);
+        while done + 4 <= dst.len() {
+            let index = _mm_add_ps(_mm_set1_ps(done as f32), lanes);
+            let gain = _mm_add_ps(from, _mm_mul_ps(step, index));
+            let input = _mm_loadu_ps(src.as_ptr().add(done));
+            let output = _mm_loadu_ps(dst.as_ptr().add(done));
+            _mm_storeu_ps(
+                dst.as_mut_ptr().add(done),
+                _mm_add_ps(output, _mm_mul_ps(input, gain)),
+            );
+            done += 4;
+        }
+    }
+    done
+}
+
+#[cfg(target_arch = "aarch64")]
+unsafe fn mix_neon(dst: &mut [f32], src: &[f32], from: f32, step: f32) -> usize {
+    use std::arch::aarch64::{vaddq_f32, vdupq_n_f32, vld1q_f32, vmlaq_f32, vst1q_f32};
+
+    let mut done = 0;
+    unsafe {
+        let lanes = vld1q_f32([1.0f32, 2.0, 3.0, 4.0].as_ptr());
+        let from = vdupq_n_f32(from);
+        let step = vdupq_n_f32(step);
+        while done + 4 <= dst.len() {
+            let index = vaddq_f32(vdupq_n_f32(done as f32), lanes);
+            let gain = vmlaq_f32(from, step, index);
+            let input = vld1q_f32(src.as_ptr().add(done));
+            let output = vld1q_f32(dst.as_ptr().add(done));
+            vst1q_f32(dst.as_mut_ptr().add(done), vmlaq_f32(output, input, gain));
+            done += 4;
+        }
+    }
+    done
+}
@@ -15,7 +15,17 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-use crate::{buffer::sender::SenderBufferProducer, error::SenderInternalResult, formats::Frames};
+use crate::{
+    buffer::sender::SenderBufferProducer,
+    capture::CaptureRing,
+    error::{SenderInternalError, SenderInternalResult},
+    formats::Frames,
+    monitoring::meter::LevelMeter,
+    resampling::{AdaptiveResampler, RESAMPLER_LATENCY_FRAMES},
+    routing::{Router, RoutingMatrix},
+    time::servo::MAX_SLEW_PER_CYCLE,
+};
+use std::sync::Arc;
 use tokio::sync::mpsc;
 use tracing::{error, instrument};
 
@@ -31,21 +41,56 @@ pub struct SenderApi {
     ingress_time: Frames,
     buffer_len_frames: usize,
     new_frames: usize,
-    compensation: i64,
+    resamplers: Vec<AdaptiveResampler>,
+    scratch: Vec<f32>,
+    router: Option<Router>,
+    /// client channels in front of the router
+    inputs: Vec<Vec<f32>>,
+    capture: Option<Arc<CaptureRing>>,
 }
 
 impl SenderApi {
-    pub fn new(api_tx: mpsc::Sender<SenderApiMessage>, tx: SenderBufferProducer) -> Self {
+    pub fn new(
+        api_tx: mpsc::Sender<SenderApiMessage>,
+        tx: SenderBufferProducer,
+        channels: usize,
+        capture: Option<Arc<CaptureRing>>,
+    ) -> Self {
+        // sized for the largest possible block stretched by the servo up front so that writing never allocates
+        let block_frames = tx.max_frames() + MAX_SLEW_PER_CYCLE as usize;
+        let scratch = vec![0.0; block_frames];
+        let config = tx.config();
+        let router = config.routing.as_ref().map(|routing| {
+            let matrix = RoutingMatrix::new(
+                routing.channel_labels.len(),
+                config.audio_format.frame_format.channels,
+                &routing.routes,
+            );
+            Router::new(matrix, routing.ramp, config.audio_format.sample_rate)
+        });
+        let inputs = match router {
+            Some(_) => vec![vec![0.0; block_frames]; channels],
+            None => Vec::new(),
+        };
         Self {
             api_tx,
             tx,
             ingress_time: 0,
             buffer_len_frames: 0,
             new_frames: 0,
-            compensation: 0,
+            resamplers: vec![AdaptiveResampler::new(); channels],
+            scratch,
+            router,
+            inputs,
+            capture,
         }
     }
 
+    /// Maximum number of frames per channel that can be written in a single block.
+    pub fn max_frames(&self) -> usize {
+        self.tx.max_frames()
+    }
+
     #[instrument(skip(self))]
     pub fn stop(&self) {
         if let Err(e) = self.api_tx.try_send(SenderApiMessage::Stop) {
@@ -53,30 +98,78 @@ impl SenderApi {
         }
     }
 
-    pub fn start_write(&mut self, ingress_time: u64, buffer_len: usize, compensation: i64) {
-        self.ingress_time = (ingress_time as i64 - compensation) as Frames;
+    /// Start writing a new block of audio data. A non-zero `compensation` stretches (positive) or compresses
+    /// (negative) the block by that many frames to follow the PTP media clock. The stretching is done by
+    /// resampling the whole block, so no samples are duplicated or dropped.
+    ///
+    /// Blocks longer than [SenderApi::max_frames] or compensations beyond what the servo applies are rejected,
+    /// the following writes of the block are ignored then.
+    pub fn start_write(
+        &mut self,
+        ingress_time: u64,
+        buffer_len: usize,
+        compensation: i64,
+    ) -> SenderInternalResult<()> {
+        let new_frames = (buffer_len as i64 + compensation).max(0) as usize;
+        if buffer_len > self.max_frames() || new_frames > self.scratch.len() {
+            self.new_frames = 0;
+            return Err(SenderInternalError::BlockTooLarge {
+                requested: new_frames,
+                max: self.max_frames(),
+            });
+        }
+        self.ingress_time =
+            (ingress_time as i64 - compensation) as Frames - RESAMPLER_LATENCY_FRAMES;
         self.buffer_len_frames = buffer_len;
-        self.new_frames = (buffer_len as i64 + compensation) as usize;
-        self.compensation = compensation;
+        self.new_frames = new_frames;
+        Ok(())
     }
 
+    /// Writes one block of a client channel, which are the channels in front of the routing matrix if the
+    /// sender has one.
     pub fn write_channel(&mut self, ch: usize, channel_buffer: &[f32]) {
-        if self.compensation > 0 {
-            let offset_frames = self.compensation as usize;
-            // insert first sample as many times as is required for the compensation, then write the actual buffer
-            for i in 0..offset_frames {
-                self.tx.write_channel(ch, i, &channel_buffer[0..1]);
-            }
-            self.tx.write_channel(ch, offset_frames, channel_buffer);
-        } else if self.compensation < 0 {
-            let buf = &channel_buffer[(-self.compensation) as usize..];
-            self.tx.write_channel(ch, 0, buf);
-        } else {
-            self.tx.write_channel(ch, 0, channel_buffer);
+        if self.new_frames == 0 {
+            return;
         }
+        let Some(resampler) = self.resamplers.get_mut(ch) else {
+            return;
+        };
+        if self.router.is_some() {
+            // mixed into the stream channels once all client channels have been written
+            resampler.process(channel_buffer, &mut self.inputs[ch][..self.new_frames]);
+            return;
+        }
+        let resampled = &mut self.scratch[..self.new_frames];
+        resampler.process(channel_buffer, resampled);
+        self.tx.write_channel(ch, 0, resampled);
     }
 
     pub fn end_write(&mut self) -> SenderInternalResult<()> {
+        if self.new_frames == 0 {
+            return Ok(());
+        }
+        if let Some(router) = &mut self.router {
+            let routed = &mut self.scratch[..self.new_frames];
+            for output in 0..router.matrix().outputs() {
+                router.process(output, &self.inputs, routed);
+                self.tx.write_channel(output, 0, routed);
+            }
+        }
         self.tx.send_packets(self.ingress_time, self.new_frames)
     }
+
+    /// Levels of the sent stream channels
+    pub fn meter(&self) -> Arc<LevelMeter> {
+        self.tx.meter()
+    }
+
+    /// Gains of the routing matrix, if the sender has one
+    pub fn routing(&self) -> Option<RoutingMatrix> {
+        self.router.as_ref().map(|router| router.matrix().clone())
+    }
+
+    /// Headers of the last sent packets, if the sender captures them
+    pub fn capture(&self) -> Option<Arc<CaptureRing>> {
+        self.capture.clone()
+    }
 }
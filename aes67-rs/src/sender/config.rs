@@ -15,9 +15,15 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-use crate::formats::{
-    AudioFormat, FrameFormat, Frames, MilliSeconds, MutableDuration, PayloadType, SampleFormat,
-    SessionId, SessionVersion,
+use crate::{
+    capture::CaptureConfig,
+    formats::{
+        AudioFormat, FrameFormat, Frames, MilliSeconds, MutableDuration, PayloadType, SampleFormat,
+        SessionId, SessionVersion,
+    },
+    player::PlayerConfig,
+    relay::RelayConfig,
+    routing::RoutingConfig,
 };
 use serde::{Deserialize, Serialize};
 use std::net::SocketAddr;
@@ -64,9 +70,37 @@ pub struct SenderConfig {
     pub packet_time: MutableDuration,
     pub payload_type: PayloadType,
     pub channel_labels: Vec<String>,
+    /// Plays a file instead of taking audio from the sender API
+    #[serde(default)]
+    pub playback: Option<PlayerConfig>,
+    /// Sends the stream of a receiver instead of taking audio from the sender API
+    #[serde(default)]
+    pub relay: Option<RelayConfig>,
+    /// Routes a different set of client channels to the stream channels
+    #[serde(default)]
+    pub routing: Option<RoutingConfig>,
+    /// Keeps the headers of the last sent packets in memory
+    #[serde(default)]
+    pub capture: Option<CaptureConfig>,
 }
 
 impl SenderConfig {
+    /// Labels of the channels the I/O handler client writes, the channels in front of the routing matrix if
+    /// one is configured.
+    pub fn io_channel_labels(&self) -> &[String] {
+        match &self.routing {
+            Some(routing) => &routing.channel_labels,
+            None => &self.channel_labels,
+        }
+    }
+
+    pub fn io_channels(&self) -> usize {
+        match &self.routing {
+            Some(routing) => routing.channel_labels.len(),
+            None => self.audio_format.frame_format.channels,
+        }
+    }
+
     pub fn ptime_frames(&self) -> Frames {
         self.packet_time.frames(self.audio_format.sample_rate)
     }
@@ -19,31 +19,33 @@ pub mod api;
 pub mod config;
 
 use crate::{
-    buffer::{
-        AudioBufferPointer,
-        sender::{OutgoingPacketPointer, SenderBufferConsumer, sender_buffer_channel},
-    },
+    buffer::receiver::ReceiverBufferConsumer,
+    buffer::sender::{OutgoingPacketPointer, SenderBufferConsumer, sender_buffer_channel},
+    capture::PacketCapture,
     error::{SenderInternalError, SenderInternalResult, WrappedRtpPacketBuildError},
     formats::{Frames, frames_to_duration},
     monitoring::Monitoring,
+    player::FilePlayer,
+    relay::Relay,
     sender::{
         api::{SenderApi, SenderApiMessage},
         config::SenderConfig,
     },
-    socket::create_tx_socket,
+    socket::{PacketSink, TX_BATCH_SIZE, TxPacket, create_tx_socket},
     time::{Clock, MediaClock},
     utils::{U32_WRAP, set_realtime_priority, sleep_precise},
 };
 use pnet::datalink::NetworkInterface;
 use rtp_rs::{RtpPacketBuilder, Seq};
 use std::{
-    net::{SocketAddr, UdpSocket},
-    ops::Range,
+    array, io,
+    net::SocketAddr,
     sync::{
         Arc,
         atomic::{AtomicBool, Ordering},
     },
     thread,
+    time::SystemTime,
 };
 use tokio::{
     select,
@@ -61,6 +63,7 @@ pub(crate) async fn start_sender(
     label: String,
     iface: NetworkInterface,
     config: SenderConfig,
+    relay_source: Option<ReceiverBufferConsumer>,
     monitoring: Monitoring,
     subsys: &SubsystemHandle,
     clock: Clock,
@@ -68,33 +71,82 @@ pub(crate) async fn start_sender(
 ) -> SenderInternalResult<SenderApi> {
     let sender_id = id.clone();
     let (api_tx, api_rx) = mpsc::channel(1024);
-    let (tx, rx) = sender_buffer_channel(config.clone(), 5);
+    let (tx, rx) = sender_buffer_channel(config.clone(), 5)?;
+    let channels = config.io_channels();
     let target = config.target;
-    let socket = create_tx_socket(target, iface)?;
+    // the source port of the socket is not known, the interface address is all that identifies the sender
+    let local_address = iface
+        .ips
+        .iter()
+        .map(|ip| ip.ip())
+        .find(|ip| ip.is_ipv4() == target.is_ipv4())
+        .map(|ip| SocketAddr::new(ip, 0));
+    let socket = Box::new(create_tx_socket(target, iface)?);
+    let player = match config.playback.clone() {
+        Some(playback) => Some(FilePlayer::new(
+            playback,
+            config.clone(),
+            tx.clone(),
+            clock.clone(),
+            monitoring.clone(),
+        )?),
+        None => None,
+    };
+    let relay = match (config.relay.clone(), relay_source) {
+        (Some(relay), Some(source)) => Some(Relay::new(
+            relay,
+            config.clone(),
+            source,
+            tx.clone(),
+            clock.clone(),
+            monitoring.clone(),
+        )?),
+        _ => None,
+    };
+    let capture = config
+        .capture
+        .as_ref()
+        .zip(local_address)
+        .map(|(capture, source)| {
+            (
+                PacketCapture::new(
+                    capture,
+                    config.label.clone(),
+                    target,
+                    config.audio_format.sample_rate,
+                ),
+                source,
+            )
+        });
+    let capture_ring = capture.as_ref().map(|(capture, _)| capture.ring());
 
     let subsystem_name = id.clone();
     let subsystem = async move |s: SubsystemHandle| {
-        let sender = Sender {
+        let sender = Sender::new(
             id,
             label,
-            subsys: s.clone(),
+            s.clone(),
             config,
             api_rx,
-            sequence_number: Seq::from(rand::random::<u16>()),
             rx,
-            rtp_buffer: [0u8; 65536],
             socket,
-            target_address: target,
             monitoring,
-            ssrc: rand::random(),
             clock,
-        };
+            capture,
+        );
 
         let (tx, rx) = oneshot::channel();
         let exit = Arc::new(AtomicBool::new(false));
         let exit_clone = exit.clone();
         let sid = sender_id.clone();
 
+        if let Some(player) = player {
+            player.start(exit.clone());
+        }
+        if let Some(relay) = relay {
+            relay.start(exit.clone());
+        }
+
         thread::spawn(move || {
             set_realtime_priority();
             let res = sender.run(exit_clone);
@@ -109,6 +161,8 @@ pub(crate) async fn start_sender(
                 Ok(())
             }
             res = rx => {
+                // stops the file player or relay
+                exit.store(true, Ordering::SeqCst);
                 s.request_local_shutdown();
                 res?
             }
@@ -119,56 +173,113 @@ pub(crate) async fn start_sender(
 
     info!("Sender '{subsystem_name}' started successfully.");
 
-    Ok(SenderApi::new(api_tx, tx))
+    Ok(SenderApi::new(api_tx, tx, channels, capture_ring))
 }
 
-struct Sender {
+pub(crate) struct Sender {
     id: String,
     label: String,
     subsys: SubsystemHandle,
     config: SenderConfig,
     api_rx: mpsc::Receiver<SenderApiMessage>,
     sequence_number: Seq,
-    rx: SenderBufferConsumer,
+    pub(crate) rx: SenderBufferConsumer,
     rtp_buffer: [u8; 65536],
-    socket: UdpSocket,
+    socket: Box<dyn PacketSink>,
     target_address: SocketAddr,
     monitoring: Monitoring,
     ssrc: u32,
     clock: Clock,
+    /// capture of the sent packets and the address they are sent from
+    capture: Option<(PacketCapture, SocketAddr)>,
 }
 
 impl Sender {
+    #[allow(clippy::too_many_arguments)]
+    pub(crate) fn new(
+        id: String,
+        label: String,
+        subsys: SubsystemHandle,
+        config: SenderConfig,
+        api_rx: mpsc::Receiver<SenderApiMessage>,
+        rx: SenderBufferConsumer,
+        socket: Box<dyn PacketSink>,
+        monitoring: Monitoring,
+        clock: Clock,
+        capture: Option<(PacketCapture, SocketAddr)>,
+    ) -> Self {
+        let target_address = config.target;
+        Self {
+            id,
+            label,
+            subsys,
+            config,
+            api_rx,
+            sequence_number: Seq::from(rand::random::<u16>()),
+            rx,
+            rtp_buffer: [0u8; 65536],
+            socket,
+            target_address,
+            monitoring,
+            ssrc: rand::random(),
+            clock,
+            capture,
+        }
+    }
+
     fn run(mut self, exit: Arc<AtomicBool>) -> SenderInternalResult<()> {
         info!("Sender '{}' started.", self.id);
 
-        self.report_sender_created(AudioBufferPointer::from_slice(&self.rx.buffer));
+        self.report_sender_created();
+
+        let mut batch = Vec::with_capacity(TX_BATCH_SIZE);
+        // packet taken from the buffer that was too early to join the previous batch
+        let mut next = None;
 
         while !exit.load(Ordering::SeqCst) {
             // read packet data
-            let recv = self.rx.recv();
-            if let Ok(OutgoingPacketPointer {
-                ingress_time,
-                payload_range,
-            }) = recv
-            {
-                // packets may come in bursts if the system uses a large buffer, so we sleep to make sure we don't overrun the receiver's buffer
-                let ptime_frames = self.config.ptime_frames() as Frames;
-                let current_time = self.clock.current_time()?;
-                let frames_to_packet = ingress_time as i64 - current_time.media_time as i64;
-                if frames_to_packet > 10 * ptime_frames as i64 {
-                    let frames_to_sleep = frames_to_packet as Frames - ptime_frames;
-                    sleep_precise(
-                        frames_to_duration(frames_to_sleep, self.config.audio_format.sample_rate),
-                        current_time.system_time,
-                    );
-                }
-
-                self.send(ingress_time, payload_range)?;
+            let first = match next.take() {
+                Some(packet) => packet,
+                None => match self.rx.recv() {
+                    Ok(packet) => packet,
+                    Err(_) => break,
+                },
+            };
+
+            // packets may come in bursts if the system uses a large buffer, so we sleep to make sure we don't overrun the receiver's buffer
+            let ptime_frames = self.config.ptime_frames() as Frames;
+            let current_time = self.clock.current_time()?;
+            let frames_to_packet = first.ingress_time as i64 - current_time.media_time as i64;
+            // media time once the first packet is due, packets up to 10 ptimes ahead of it are not held back
+            let media_time = if frames_to_packet > 10 * ptime_frames as i64 {
+                let frames_to_sleep = frames_to_packet as Frames - ptime_frames;
+                sleep_precise(
+                    frames_to_duration(frames_to_sleep, self.config.audio_format.sample_rate),
+                    current_time.system_time,
+                );
+                first.ingress_time - ptime_frames
             } else {
-                break;
+                current_time.media_time
+            };
+
+            // the packets of a phase are handed over at once, those that don't need to be paced go out in a
+            // single call
+            batch.push(first);
+            while batch.len() < TX_BATCH_SIZE {
+                let Some(packet) = self.rx.try_recv() else {
+                    break;
+                };
+                if packet.ingress_time > media_time + 10 * ptime_frames {
+                    next = Some(packet);
+                    break;
+                }
+                batch.push(packet);
             }
 
+            let sent = self.send(&batch);
+            batch.clear();
+            sent?;
+
             match self.api_rx.try_recv() {
                 Ok(api_msg) => {
                     self.handle_api_message(api_msg)?;
@@ -199,46 +310,84 @@ impl Sender {
         Ok(())
     }
 
-    fn send(
-        &mut self,
-        ingress_time: Frames,
-        payload_range: Range<usize>,
-    ) -> SenderInternalResult<()> {
+    /// Builds the RTP packets and sends them with as few calls to the sink as possible.
+    pub(crate) fn send(&mut self, packets: &[OutgoingPacketPointer]) -> SenderInternalResult<()> {
+        for chunk in packets.chunks(TX_BATCH_SIZE) {
+            self.send_batch(chunk)?;
+        }
+        Ok(())
+    }
+
+    fn send_batch(&mut self, packets: &[OutgoingPacketPointer]) -> SenderInternalResult<()> {
         let payload_type = self.config.payload_type;
-        let seq = self.sequence_number;
-        self.sequence_number = seq.next();
-        let timestamp = (ingress_time % U32_WRAP) as u32;
-
-        let payload = &self.rx.buffer[payload_range];
-
-        let len = RtpPacketBuilder::new()
-            .payload_type(payload_type)
-            .sequence(seq)
-            .timestamp(timestamp)
-            .payload(payload)
-            .ssrc(self.ssrc)
-            .build_into(&mut self.rtp_buffer)
-            .map_err(WrappedRtpPacketBuildError)?;
-
-        if len > 1500 {
-            return Err(SenderInternalError::MaxMTUExceeded(len));
+        let first_seq = self.sequence_number;
+        // packets are built back to back into the RTP buffer
+        let mut offsets = [0; TX_BATCH_SIZE + 1];
+
+        for (i, packet) in packets.iter().enumerate() {
+            let seq = self.sequence_number;
+            self.sequence_number = seq.next();
+            let timestamp = (packet.ingress_time % U32_WRAP) as u32;
+
+            let payload = self.rx.payload(packet.payload_range.clone());
+
+            let len = RtpPacketBuilder::new()
+                .payload_type(payload_type)
+                .sequence(seq)
+                .timestamp(timestamp)
+                .payload(payload)
+                .ssrc(self.ssrc)
+                .build_into(&mut self.rtp_buffer[offsets[i]..])
+                .map_err(WrappedRtpPacketBuildError)?;
+
+            if len > 1500 {
+                return Err(SenderInternalError::MaxMTUExceeded(len));
+            }
+            offsets[i + 1] = offsets[i] + len;
         }
 
+        let count = packets.len();
+        let rtp_buffer = &self.rtp_buffer;
+        let tx_packets: [TxPacket; TX_BATCH_SIZE] = array::from_fn(|i| TxPacket {
+            data: if i < count {
+                &rtp_buffer[offsets[i]..offsets[i + 1]]
+            } else {
+                &[]
+            },
+            target: self.target_address,
+        });
+
         let pre_send = self.clock.current_time()?;
 
-        self.socket
-            .send_to(&self.rtp_buffer[..len], self.target_address)?;
+        let mut sent = 0;
+        while sent < count {
+            match self.socket.send_batch(&tx_packets[sent..count])? {
+                0 => return Err(io::Error::from(io::ErrorKind::WriteZero).into()),
+                n => sent += n,
+            }
+        }
+
+        if let Some((capture, source)) = &self.capture {
+            let now = SystemTime::now();
+            for packet in &tx_packets[..count] {
+                capture.record(now, *source, packet.data);
+            }
+        }
 
         let post_send = self.clock.current_time()?;
 
-        self.report_packet_sent(
-            self.config.ptime_frames(),
-            len,
-            ingress_time,
-            seq,
-            pre_send,
-            post_send,
-        );
+        let mut seq = first_seq;
+        for (i, packet) in packets.iter().enumerate() {
+            self.report_packet_sent(
+                self.config.ptime_frames(),
+                offsets[i + 1] - offsets[i],
+                packet.ingress_time,
+                seq,
+                pre_send.clone(),
+                post_send.clone(),
+            );
+            seq = seq.next();
+        }
 
         Ok(())
     }
@@ -246,7 +395,6 @@ impl Sender {
 
 mod monitoring {
     use crate::{
-        buffer::AudioBufferPointer,
         formats::Frames,
         monitoring::{SenderState, TxStats},
         time::Time,
@@ -255,12 +403,11 @@ mod monitoring {
     use super::*;
 
     impl Sender {
-        pub(crate) fn report_sender_created(&self, buffer: AudioBufferPointer) {
+        pub(crate) fn report_sender_created(&self) {
             self.monitoring.sender_state(SenderState::Created {
                 id: self.id.clone(),
                 label: self.label.clone(),
                 config: self.config.clone(),
-                address: buffer,
             });
         }
 
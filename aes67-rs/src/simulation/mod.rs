@@ -0,0 +1,367 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Virtual-time simulation of a sender/receiver pair. Sender, network and receiver are driven by a shared
+//! [VirtualTimeline] instead of wall time, so hours of traffic can be simulated in seconds and every run with
+//! the same seed produces exactly the same result. Clock drift and jitter as well as network delay, jitter
+//! and packet loss can be configured to reproduce timing problems without real hardware. Captured traffic of
+//! real devices can be fed to a receiver the same way, see [replay].
+
+pub mod network;
+pub mod pcap;
+pub mod replay;
+
+use crate::{
+    buffer::{
+        receiver::ReadResult, receiver::receiver_buffer_channel, sender::sender_buffer_channel,
+    },
+    error::SimulationResult,
+    formats::{AudioFormat, FrameFormat, Frames, MilliSeconds, MutableDuration, SampleFormat},
+    monitoring::{Monitoring, MonitoringEvent, RxStats, Stats, TxStats},
+    receiver::{
+        ReceiveOutcome, Receiver,
+        config::{IoBackend, ReceiveMode, ReceiverConfig},
+    },
+    sender::{Sender, config::SenderConfig},
+    simulation::network::{MemoryNetwork, NetworkConditions},
+    socket::RxBatch,
+    time::{
+        Clock, MediaClock,
+        simulated::{SimulatedClock, VirtualTimeline},
+    },
+    utils::AtomicF32,
+};
+use std::{
+    net::SocketAddr,
+    sync::Arc,
+    time::{Duration, Instant},
+};
+use tokio::sync::mpsc;
+use tosub::SubsystemHandle;
+
+const SENDER_ADDRESS: ([u8; 4], u16) = ([192, 168, 0, 1], 5004);
+const MULTICAST_ADDRESS: ([u8; 4], u16) = ([239, 69, 0, 1], 5004);
+const SIGNAL_PERIOD: Frames = 479;
+
+#[derive(Debug, Clone, Copy, Default)]
+pub struct ClockConditions {
+    pub drift_ppm: f64,
+    pub jitter: Duration,
+}
+
+#[derive(Debug, Clone)]
+pub struct SimulationConfig {
+    pub audio_format: AudioFormat,
+    pub packet_time: MilliSeconds,
+    pub link_offset: MilliSeconds,
+    /// Number of frames the sender writes and the receiver plays out per audio cycle.
+    pub block_size: usize,
+    /// Amount of virtual time to simulate.
+    pub duration: Duration,
+    pub sender_clock: ClockConditions,
+    pub receiver_clock: ClockConditions,
+    pub network: NetworkConditions,
+    pub seed: u64,
+}
+
+impl Default for SimulationConfig {
+    fn default() -> Self {
+        Self {
+            audio_format: AudioFormat {
+                sample_rate: 48_000,
+                frame_format: FrameFormat {
+                    channels: 2,
+                    sample_format: SampleFormat::L24,
+                },
+            },
+            packet_time: 1.0,
+            link_offset: 4.0,
+            block_size: 128,
+            duration: Duration::from_secs(10),
+            sender_clock: ClockConditions::default(),
+            receiver_clock: ClockConditions::default(),
+            network: NetworkConditions::default(),
+            seed: 0,
+        }
+    }
+}
+
+#[derive(Debug, Clone, Default)]
+pub struct SimulationReport {
+    pub simulated_time: Duration,
+    pub wall_time: Duration,
+    pub packets_sent: usize,
+    /// Packets dropped by the simulated network.
+    pub packets_dropped: usize,
+    pub packets_received: usize,
+    pub out_of_order_packets: usize,
+    pub time_travelling_packets: usize,
+    /// Difference between a packet's ingress time and the receiver's media time at reception, in frames.
+    pub min_latency: Option<i64>,
+    pub max_latency: Option<i64>,
+    pub mean_latency: Option<f64>,
+    pub blocks_played: usize,
+    pub blocks_not_ready: usize,
+    pub blocks_too_late: usize,
+    /// Frames that were played out successfully, but did not contain the data that was sent for them.
+    pub corrupt_frames: usize,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord)]
+enum Event {
+    Deliver,
+    Playout,
+    Send,
+}
+
+#[derive(Default)]
+struct LatencyAccumulator {
+    min: Option<i64>,
+    max: Option<i64>,
+    sum: i128,
+    count: usize,
+}
+
+impl LatencyAccumulator {
+    fn add(&mut self, latency: i64) {
+        self.min = Some(self.min.map_or(latency, |min| min.min(latency)));
+        self.max = Some(self.max.map_or(latency, |max| max.max(latency)));
+        self.sum += latency as i128;
+        self.count += 1;
+    }
+
+    fn mean(&self) -> Option<f64> {
+        (self.count > 0).then(|| self.sum as f64 / self.count as f64)
+    }
+}
+
+/// Runs a sender and a receiver connected through a [MemoryNetwork] for `config.duration` of virtual time.
+/// The sender transmits a deterministic test signal, the receiver's playout is checked against it.
+pub fn run_simulation(
+    subsys: &SubsystemHandle,
+    config: SimulationConfig,
+) -> SimulationResult<SimulationReport> {
+    let started = Instant::now();
+    let sample_rate = config.audio_format.sample_rate;
+    let channels = config.audio_format.frame_format.channels;
+    let block_size = config.block_size;
+
+    let timeline = VirtualTimeline::new(Duration::from_secs(1_000_000));
+    let start = timeline.now();
+    let end = start + config.duration;
+
+    let network = MemoryNetwork::new(timeline.clone(), config.network.clone(), config.seed);
+    let sender_address = SocketAddr::from(SENDER_ADDRESS);
+    let target = SocketAddr::from(MULTICAST_ADDRESS);
+
+    let sender_clock = SimulatedClock::new(
+        timeline.clone(),
+        sample_rate,
+        config.sender_clock.drift_ppm,
+        config.sender_clock.jitter,
+        config.seed.wrapping_add(1),
+    );
+    let receiver_clock = SimulatedClock::new(
+        timeline.clone(),
+        sample_rate,
+        config.receiver_clock.drift_ppm,
+        config.receiver_clock.jitter,
+        config.seed.wrapping_add(2),
+    );
+
+    let channel_labels = (0..channels).map(|c| format!("{}", c + 1)).collect();
+    let sender_config = SenderConfig {
+        id: 1,
+        label: "simulated-sender".to_owned(),
+        audio_format: config.audio_format,
+        target,
+        packet_time: MutableDuration(Arc::new(AtomicF32::new(config.packet_time))),
+        payload_type: 98,
+        channel_labels,
+        playback: None,
+        relay: None,
+        routing: None,
+        capture: None,
+    };
+    let receiver_config = ReceiverConfig {
+        id: 1,
+        label: "simulated-receiver".to_owned(),
+        audio_format: config.audio_format,
+        source: target,
+        origin_ip: sender_address.ip(),
+        rtp_offset: 0,
+        channel_labels: sender_config.channel_labels.clone(),
+        link_offset: MutableDuration(Arc::new(AtomicF32::new(config.link_offset))),
+        delay_calculation_interval: None,
+        payload_type: Some(sender_config.payload_type),
+        kernel_filter: false,
+        receive_mode: ReceiveMode::Blocking,
+        io_backend: IoBackend::Socket,
+        recording: None,
+        routing: None,
+        capture: None,
+    };
+    let link_offset_frames = receiver_config.frames_in_link_offset();
+
+    let (monitoring, mut events) = Monitoring::detached(4096);
+
+    let (_sender_api_tx, sender_api_rx) = mpsc::channel(1);
+    let (mut producer, consumer) = sender_buffer_channel(sender_config.clone(), 5)?;
+    let mut sender = Sender::new(
+        sender_config.id.to_string(),
+        sender_config.label.clone(),
+        subsys.clone(),
+        sender_config,
+        sender_api_rx,
+        consumer,
+        Box::new(network.tx_socket(sender_address)),
+        monitoring.clone(),
+        Clock::Simulated(sender_clock.clone()),
+        None,
+    );
+
+    let (_receiver_api_tx, receiver_api_rx) = mpsc::channel(1);
+    let (buffer_tx, mut buffer_rx) =
+        receiver_buffer_channel(receiver_config.clone(), monitoring.clone())?;
+    let mut receiver = Receiver::new(
+        receiver_config.id.to_string(),
+        receiver_config.label.clone(),
+        subsys.clone(),
+        receiver_config,
+        Clock::Simulated(receiver_clock.clone()),
+        receiver_api_rx,
+        Box::new(network.bind(target)),
+        monitoring,
+        buffer_tx,
+        None,
+    );
+
+    let mut report = SimulationReport::default();
+    let mut latency = LatencyAccumulator::default();
+    let mut receive_batch = RxBatch::default();
+    let mut send_buffers = vec![vec![0f32; block_size]; channels];
+    let mut playout_buffers = vec![vec![0f32; block_size]; channels];
+    let tolerance = 2.0 / (1 << 15) as f32;
+
+    let mut send_ingress = sender_clock.clone().current_time()?.media_time;
+    // ingress time of the next block to be played out; playout starts with the first received packet
+    let mut playout_ingress: Option<Frames> = None;
+
+    loop {
+        let send_at = sender_clock.timeline_time(send_ingress + block_size as Frames);
+        let mut next = (send_at, Event::Send);
+        if let Some(ingress) = playout_ingress {
+            let playout_at = receiver_clock.timeline_time(ingress + link_offset_frames);
+            next = next.min((playout_at, Event::Playout));
+        }
+        if let Some(delivery_at) = network.next_delivery() {
+            next = next.min((delivery_at, Event::Deliver));
+        }
+
+        let (time, event) = next;
+        if time > end {
+            break;
+        }
+        timeline.set(time);
+
+        match event {
+            Event::Send => {
+                for (channel, buffer) in send_buffers.iter_mut().enumerate() {
+                    for (i, sample) in buffer.iter_mut().enumerate() {
+                        *sample = test_signal(send_ingress + i as Frames, channel);
+                    }
+                    producer.write_channel(channel, 0, buffer);
+                }
+                producer.send_packets(send_ingress, block_size)?;
+                let mut packets = Vec::new();
+                while let Some(packet) = sender.rx.try_recv() {
+                    packets.push(packet);
+                }
+                sender.send(&packets)?;
+                send_ingress += block_size as Frames;
+            }
+            Event::Deliver => {
+                network.deliver_next(time);
+                while let ReceiveOutcome::Packet = receiver.receive(&mut receive_batch)? {}
+            }
+            Event::Playout => {
+                let Some(ingress) = playout_ingress else {
+                    continue;
+                };
+                let buffers = playout_buffers.iter_mut().map(|b| Some(&mut b[..]));
+                match buffer_rx.read(buffers, ingress, block_size)? {
+                    ReadResult::Ok(_) => {
+                        report.blocks_played += 1;
+                        for (channel, buffer) in playout_buffers.iter().enumerate() {
+                            report.corrupt_frames += buffer
+                                .iter()
+                                .enumerate()
+                                .filter(|(i, sample)| {
+                                    let expected = test_signal(ingress + *i as Frames, channel);
+                                    (**sample - expected).abs() > tolerance
+                                })
+                                .count();
+                        }
+                    }
+                    ReadResult::NotReady(_) => report.blocks_not_ready += 1,
+                    ReadResult::TooLate => report.blocks_too_late += 1,
+                }
+                playout_ingress = Some(ingress + block_size as Frames);
+            }
+        }
+
+        while let Ok(event) = events.try_recv() {
+            match event {
+                MonitoringEvent::Stats(Stats::Tx(TxStats::PacketSent { .. })) => {
+                    report.packets_sent += 1;
+                }
+                MonitoringEvent::Stats(Stats::Rx(RxStats::PacketReceived {
+                    ingress_time,
+                    media_time_at_reception,
+                    ..
+                })) => {
+                    report.packets_received += 1;
+                    latency.add(media_time_at_reception as i64 - ingress_time as i64);
+                    playout_ingress.get_or_insert(ingress_time);
+                }
+                MonitoringEvent::Stats(Stats::Rx(RxStats::OutOfOrderPacket { .. })) => {
+                    report.out_of_order_packets += 1;
+                }
+                MonitoringEvent::Stats(Stats::Rx(RxStats::TimeTravellingPacket { .. })) => {
+                    report.time_travelling_packets += 1;
+                }
+                _ => {}
+            }
+        }
+    }
+
+    report.simulated_time = timeline.now() - start;
+    report.wall_time = started.elapsed();
+    report.packets_dropped = network.dropped();
+    report.min_latency = latency.min;
+    report.max_latency = latency.max;
+    report.mean_latency = latency.mean();
+
+    Ok(report)
+}
+
+/// Sawtooth with a prime period, so stale data from a previous pass through the receiver buffer does not
+/// accidentally match.
+fn test_signal(frame: Frames, channel: usize) -> f32 {
+    let phase = (frame + channel as Frames * 37) % SIGNAL_PERIOD;
+    phase as f32 / SIGNAL_PERIOD as f32 - 0.5
+}
@@ -0,0 +1,242 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! In-memory datagram network for simulations. Packets sent through a [MemoryTxSocket] are queued with a
+//! delivery time on the virtual timeline and only show up at the [MemoryRxSocket]s bound to their target
+//! address once the harness has delivered them, optionally delayed, reordered or dropped.
+
+use crate::{
+    socket::{PacketSink, PacketSource, RxBatch},
+    time::simulated::VirtualTimeline,
+};
+use rand::{Rng, SeedableRng, rngs::StdRng};
+use std::{
+    cmp::Reverse,
+    collections::{BinaryHeap, HashMap, VecDeque},
+    io,
+    net::SocketAddr,
+    sync::{Arc, Mutex},
+    time::Duration,
+};
+
+#[derive(Debug, Clone, Default)]
+pub struct NetworkConditions {
+    /// Constant transmission delay.
+    pub delay: Duration,
+    /// Uniformly distributed additional delay of up to `jitter`. Jitter larger than the packet time reorders
+    /// packets.
+    pub jitter: Duration,
+    /// Probability of a packet being dropped, between 0 and 1.
+    pub loss: f64,
+}
+
+#[derive(Debug)]
+struct InFlightPacket {
+    deliver_at: Duration,
+    seq: u64,
+    source: SocketAddr,
+    target: SocketAddr,
+    data: Vec<u8>,
+}
+
+impl PartialEq for InFlightPacket {
+    fn eq(&self, other: &Self) -> bool {
+        (self.deliver_at, self.seq) == (other.deliver_at, other.seq)
+    }
+}
+
+impl Eq for InFlightPacket {}
+
+impl PartialOrd for InFlightPacket {
+    fn partial_cmp(&self, other: &Self) -> Option<std::cmp::Ordering> {
+        Some(self.cmp(other))
+    }
+}
+
+impl Ord for InFlightPacket {
+    fn cmp(&self, other: &Self) -> std::cmp::Ordering {
+        (self.deliver_at, self.seq).cmp(&(other.deliver_at, other.seq))
+    }
+}
+
+type Inbox = Arc<Mutex<VecDeque<(SocketAddr, Vec<u8>)>>>;
+
+#[derive(Debug)]
+struct NetworkState {
+    conditions: NetworkConditions,
+    rng: StdRng,
+    in_flight: BinaryHeap<Reverse<InFlightPacket>>,
+    inboxes: HashMap<SocketAddr, Vec<Inbox>>,
+    seq: u64,
+    dropped: usize,
+}
+
+/// A network that only exists in memory and advances with a [VirtualTimeline].
+#[derive(Debug, Clone)]
+pub struct MemoryNetwork {
+    timeline: VirtualTimeline,
+    state: Arc<Mutex<NetworkState>>,
+}
+
+impl MemoryNetwork {
+    pub fn new(timeline: VirtualTimeline, conditions: NetworkConditions, seed: u64) -> Self {
+        Self {
+            timeline,
+            state: Arc::new(Mutex::new(NetworkState {
+                conditions,
+                rng: StdRng::seed_from_u64(seed),
+                in_flight: BinaryHeap::new(),
+                inboxes: HashMap::new(),
+                seq: 0,
+                dropped: 0,
+            })),
+        }
+    }
+
+    /// Creates a socket that receives all packets sent to `addr`. Multiple sockets may be bound to the same
+    /// address, like multicast group members.
+    pub fn bind(&self, addr: SocketAddr) -> MemoryRxSocket {
+        let inbox = Inbox::default();
+        self.lock()
+            .inboxes
+            .entry(addr)
+            .or_default()
+            .push(inbox.clone());
+        MemoryRxSocket { inbox }
+    }
+
+    pub fn tx_socket(&self, source: SocketAddr) -> MemoryTxSocket {
+        MemoryTxSocket {
+            network: self.clone(),
+            source,
+        }
+    }
+
+    /// Delivery time of the next packet in flight, if any.
+    pub fn next_delivery(&self) -> Option<Duration> {
+        self.lock().in_flight.peek().map(|p| p.0.deliver_at)
+    }
+
+    /// Delivers the next packet if it is due at or before `time`. Returns the packet's delivery time.
+    pub fn deliver_next(&self, time: Duration) -> Option<Duration> {
+        let mut state = self.lock();
+        if state.in_flight.peek()?.0.deliver_at > time {
+            return None;
+        }
+        let Reverse(packet) = state.in_flight.pop()?;
+        if let Some(inboxes) = state.inboxes.get(&packet.target) {
+            for inbox in inboxes {
+                lock(inbox).push_back((packet.source, packet.data.clone()));
+            }
+        }
+        Some(packet.deliver_at)
+    }
+
+    /// Number of packets dropped so far to simulate packet loss.
+    pub fn dropped(&self) -> usize {
+        self.lock().dropped
+    }
+
+    fn send(&self, source: SocketAddr, target: SocketAddr, data: &[u8]) {
+        let now = self.timeline.now();
+        let mut state = self.lock();
+
+        if state.conditions.loss > 0.0 && state.rng.gen_bool(state.conditions.loss.min(1.0)) {
+            state.dropped += 1;
+            return;
+        }
+
+        let jitter = state.conditions.jitter.as_nanos() as u64;
+        let jitter = if jitter > 0 {
+            Duration::from_nanos(state.rng.gen_range(0..=jitter))
+        } else {
+            Duration::ZERO
+        };
+        let deliver_at = now + state.conditions.delay + jitter;
+        let seq = state.seq;
+        state.seq += 1;
+
+        state.in_flight.push(Reverse(InFlightPacket {
+            deliver_at,
+            seq,
+            source,
+            target,
+            data: data.to_vec(),
+        }));
+    }
+
+    fn lock(&self) -> std::sync::MutexGuard<'_, NetworkState> {
+        lock(&self.state)
+    }
+}
+
+fn lock<T>(mutex: &Mutex<T>) -> std::sync::MutexGuard<'_, T> {
+    mutex.lock().unwrap_or_else(|e| e.into_inner())
+}
+
+/// Receiving end of a [MemoryNetwork]. Never blocks, returns [io::ErrorKind::WouldBlock] if no packet has
+/// been delivered.
+#[derive(Debug, Clone)]
+pub struct MemoryRxSocket {
+    inbox: Inbox,
+}
+
+impl MemoryRxSocket {
+    pub fn recv_from(&self, buf: &mut [u8]) -> io::Result<(usize, SocketAddr)> {
+        let Some((source, data)) = lock(&self.inbox).pop_front() else {
+            return Err(io::ErrorKind::WouldBlock.into());
+        };
+        let len = data.len().min(buf.len());
+        buf[..len].copy_from_slice(&data[..len]);
+        Ok((len, source))
+    }
+}
+
+impl PacketSource for MemoryRxSocket {
+    fn recv_batch(&mut self, batch: &mut RxBatch) -> io::Result<usize> {
+        let mut received = 0;
+        while !batch.is_full() {
+            match self.recv_from(batch.next_slot()) {
+                Ok((len, source)) => batch.push_copied(len, source, None),
+                Err(e) if received == 0 => return Err(e),
+                Err(_) => break,
+            }
+            received += 1;
+        }
+        Ok(received)
+    }
+}
+
+/// Sending end of a [MemoryNetwork].
+#[derive(Debug, Clone)]
+pub struct MemoryTxSocket {
+    network: MemoryNetwork,
+    source: SocketAddr,
+}
+
+impl MemoryTxSocket {
+    pub fn send_to(&self, buf: &[u8], target: SocketAddr) -> io::Result<usize> {
+        self.network.send(self.source, target, buf);
+        Ok(buf.len())
+    }
+}
+
+impl PacketSink for MemoryTxSocket {
+    fn send_to(&mut self, buf: &[u8], target: SocketAddr) -> io::Result<usize> {
+        MemoryTxSocket::send_to(self, buf, target)
+    }
+}
@@ -0,0 +1,310 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Reads UDP datagrams from pcap and pcapng files for [replay](super::replay). Supports Ethernet (with VLAN
+//! tags), raw IP and Linux cooked captures. Anything that isn't an unfragmented UDP datagram is skipped.
+
+use crate::error::{SimulationError, SimulationResult};
+use std::{
+    net::{IpAddr, Ipv4Addr, Ipv6Addr, SocketAddr},
+    time::Duration,
+};
+
+const PCAPNG_SECTION_HEADER: u32 = 0x0A0D_0D0A;
+const PCAPNG_BYTE_ORDER_MAGIC: u32 = 0x1A2B_3C4D;
+const PCAPNG_INTERFACE_DESCRIPTION: u32 = 0x0000_0001;
+const PCAPNG_ENHANCED_PACKET: u32 = 0x0000_0006;
+const PCAPNG_IF_TSRESOL: u16 = 9;
+const PCAP_MAGIC_MICROS: u32 = 0xA1B2_C3D4;
+const PCAP_MAGIC_NANOS: u32 = 0xA1B2_3C4D;
+
+const LINKTYPE_ETHERNET: u16 = 1;
+const LINKTYPE_RAW: u16 = 101;
+const LINKTYPE_LINUX_SLL: u16 = 113;
+const LINKTYPE_IPV4: u16 = 228;
+const LINKTYPE_IPV6: u16 = 229;
+const LINKTYPE_LINUX_SLL2: u16 = 276;
+
+const ETHERTYPE_IPV4: u16 = 0x0800;
+const ETHERTYPE_IPV6: u16 = 0x86DD;
+const ETHERTYPE_VLAN: u16 = 0x8100;
+const ETHERTYPE_QINQ: u16 = 0x88A8;
+const IPPROTO_UDP: u8 = 17;
+
+#[derive(Debug, Clone)]
+pub struct CapturedDatagram {
+    /// Capture timestamp, usually time since the epoch of the capturing host's system clock
+    pub time: Duration,
+    pub source: SocketAddr,
+    pub destination: SocketAddr,
+    pub payload: Vec<u8>,
+    /// Whether the datagram was cut off by the capture's snap length
+    pub truncated: bool,
+}
+
+/// Reads all UDP datagrams from a pcap or pcapng file.
+pub fn read_datagrams(file: &[u8]) -> SimulationResult<Vec<CapturedDatagram>> {
+    let magic = read_u32(file, 0, false)?;
+    if magic == PCAPNG_SECTION_HEADER {
+        read_pcapng(file)
+    } else {
+        read_pcap(file)
+    }
+}
+
+fn read_pcapng(file: &[u8]) -> SimulationResult<Vec<CapturedDatagram>> {
+    let mut datagrams = Vec::new();
+    // link type and nanoseconds per timestamp unit of each interface in the current section
+    let mut interfaces: Vec<(u16, TimestampResolution)> = Vec::new();
+    let mut big_endian = false;
+    let mut offset = 0;
+
+    while offset + 12 <= file.len() {
+        if read_u32(file, offset, false)? == PCAPNG_SECTION_HEADER {
+            big_endian = match read_u32(file, offset + 8, false)? {
+                PCAPNG_BYTE_ORDER_MAGIC => false,
+                m if m.swap_bytes() == PCAPNG_BYTE_ORDER_MAGIC => true,
+                _ => return Err(invalid("bad pcapng byte order magic")),
+            };
+            interfaces.clear();
+        }
+        let block_type = read_u32(file, offset, big_endian)?;
+        let block_len = read_u32(file, offset + 4, big_endian)? as usize;
+        if block_len < 12 || offset + block_len > file.len() {
+            return Err(invalid("truncated pcapng block"));
+        }
+        let body = &file[offset + 8..offset + block_len - 4];
+
+        match block_type {
+            PCAPNG_INTERFACE_DESCRIPTION => {
+                let link_type = read_u16(body, 0, big_endian)?;
+                let mut resolution = TimestampResolution::Decimal(6);
+                let mut options = 8;
+                while options + 4 <= body.len() {
+                    let code = read_u16(body, options, big_endian)?;
+                    let len = read_u16(body, options + 2, big_endian)? as usize;
+                    if code == 0 {
+                        break;
+                    }
+                    if code == PCAPNG_IF_TSRESOL && len >= 1 && options + 4 < body.len() {
+                        resolution = TimestampResolution::parse(body[options + 4])?;
+                    }
+                    options += 4 + len.next_multiple_of(4);
+                }
+                interfaces.push((link_type, resolution));
+            }
+            PCAPNG_ENHANCED_PACKET => {
+                let interface = read_u32(body, 0, big_endian)? as usize;
+                let &(link_type, resolution) = interfaces
+                    .get(interface)
+                    .ok_or_else(|| invalid("packet on undeclared interface"))?;
+                let timestamp = (read_u32(body, 4, big_endian)? as u64) << 32
+                    | read_u32(body, 8, big_endian)? as u64;
+                let captured_len = read_u32(body, 12, big_endian)? as usize;
+                let original_len = read_u32(body, 16, big_endian)? as usize;
+                let data = body
+                    .get(20..20 + captured_len)
+                    .ok_or_else(|| invalid("packet data exceeds its block"))?;
+                if let Some(datagram) = decode(
+                    link_type,
+                    resolution.to_duration(timestamp),
+                    data,
+                    captured_len < original_len,
+                ) {
+                    datagrams.push(datagram);
+                }
+            }
+            _ => {}
+        }
+
+        offset += block_len;
+    }
+
+    Ok(datagrams)
+}
+
+fn read_pcap(file: &[u8]) -> SimulationResult<Vec<CapturedDatagram>> {
+    let magic = read_u32(file, 0, false)?;
+    let (big_endian, resolution) = match magic {
+        PCAP_MAGIC_MICROS => (false, TimestampResolution::Decimal(6)),
+        PCAP_MAGIC_NANOS => (false, TimestampResolution::Decimal(9)),
+        m if m.swap_bytes() == PCAP_MAGIC_MICROS => (true, TimestampResolution::Decimal(6)),
+        m if m.swap_bytes() == PCAP_MAGIC_NANOS => (true, TimestampResolution::Decimal(9)),
+        _ => return Err(invalid("neither a pcap nor a pcapng file")),
+    };
+    let link_type = read_u32(file, 20, big_endian)? as u16;
+    let fraction = match resolution {
+        TimestampResolution::Decimal(9) => 1,
+        _ => 1_000,
+    };
+
+    let mut datagrams = Vec::new();
+    let mut offset = 24;
+    while offset + 16 <= file.len() {
+        let seconds = read_u32(file, offset, big_endian)? as u64;
+        let subsec = read_u32(file, offset + 4, big_endian)? as u64;
+        let captured_len = read_u32(file, offset + 8, big_endian)? as usize;
+        let original_len = read_u32(file, offset + 12, big_endian)? as usize;
+        let data = file
+            .get(offset + 16..offset + 16 + captured_len)
+            .ok_or_else(|| invalid("truncated pcap record"))?;
+        let time = Duration::from_secs(seconds) + Duration::from_nanos(subsec * fraction);
+        if let Some(datagram) = decode(link_type, time, data, captured_len < original_len) {
+            datagrams.push(datagram);
+        }
+        offset += 16 + captured_len;
+    }
+
+    Ok(datagrams)
+}
+
+#[derive(Debug, Clone, Copy)]
+enum TimestampResolution {
+    /// 10^-n seconds
+    Decimal(u8),
+    /// 2^-n seconds
+    Binary(u8),
+}
+
+impl TimestampResolution {
+    /// Parses an `if_tsresol` option value. Resolutions finer than 10^-19 or 2^-63 seconds are rejected, no
+    /// capture tool uses them and they would overflow the conversion to a [Duration].
+    fn parse(value: u8) -> SimulationResult<Self> {
+        let resolution = if value & 0x80 != 0 {
+            TimestampResolution::Binary(value & 0x7F)
+        } else {
+            TimestampResolution::Decimal(value)
+        };
+        match resolution {
+            TimestampResolution::Decimal(n) if n > 19 => {
+                Err(invalid("implausible timestamp resolution"))
+            }
+            TimestampResolution::Binary(n) if n > 63 => {
+                Err(invalid("implausible timestamp resolution"))
+            }
+            resolution => Ok(resolution),
+        }
+    }
+
+    fn to_duration(self, timestamp: u64) -> Duration {
+        let nanos = match self {
+            TimestampResolution::Decimal(n) if n <= 9 => {
+                timestamp as u128 * 10u128.pow(9 - n as u32)
+            }
+            TimestampResolution::Decimal(n) => timestamp as u128 / 10u128.pow(n as u32 - 9),
+            TimestampResolution::Binary(n) => (timestamp as u128 * 1_000_000_000) >> n,
+        };
+        Duration::from_nanos(nanos as u64)
+    }
+}
+
+/// Extracts the UDP datagram from a link layer frame.
+fn decode(link_type: u16, time: Duration, frame: &[u8], cut: bool) -> Option<CapturedDatagram> {
+    let packet = match link_type {
+        LINKTYPE_ETHERNET => {
+            let mut offset = 12;
+            let mut ethertype = u16::from_be_bytes(frame.get(offset..offset + 2)?.try_into().ok()?);
+            while matches!(ethertype, ETHERTYPE_VLAN | ETHERTYPE_QINQ) {
+                offset += 4;
+                ethertype = u16::from_be_bytes(frame.get(offset..offset + 2)?.try_into().ok()?);
+            }
+            if !matches!(ethertype, ETHERTYPE_IPV4 | ETHERTYPE_IPV6) {
+                return None;
+            }
+            frame.get(offset + 2..)?
+        }
+        LINKTYPE_RAW | LINKTYPE_IPV4 | LINKTYPE_IPV6 => frame,
+        LINKTYPE_LINUX_SLL => frame.get(16..)?,
+        LINKTYPE_LINUX_SLL2 => frame.get(20..)?,
+        _ => return None,
+    };
+
+    let (source, destination, udp) = match packet.first()? >> 4 {
+        4 => {
+            let header_len = (packet[0] & 0x0F) as usize * 4;
+            let fragment = u16::from_be_bytes(packet.get(6..8)?.try_into().ok()?);
+            // more fragments flag or fragment offset
+            if *packet.get(9)? != IPPROTO_UDP || fragment & 0x3FFF != 0 {
+                return None;
+            }
+            let source: [u8; 4] = packet.get(12..16)?.try_into().ok()?;
+            let destination: [u8; 4] = packet.get(16..20)?.try_into().ok()?;
+            (
+                IpAddr::V4(Ipv4Addr::from(source)),
+                IpAddr::V4(Ipv4Addr::from(destination)),
+                packet.get(header_len..)?,
+            )
+        }
+        6 => {
+            // extension headers are not supported, AES67 streams don't use them
+            if *packet.get(6)? != IPPROTO_UDP {
+                return None;
+            }
+            let source: [u8; 16] = packet.get(8..24)?.try_into().ok()?;
+            let destination: [u8; 16] = packet.get(24..40)?.try_into().ok()?;
+            (
+                IpAddr::V6(Ipv6Addr::from(source)),
+                IpAddr::V6(Ipv6Addr::from(destination)),
+                packet.get(40..)?,
+            )
+        }
+        _ => return None,
+    };
+
+    let source_port = u16::from_be_bytes(udp.get(0..2)?.try_into().ok()?);
+    let destination_port = u16::from_be_bytes(udp.get(2..4)?.try_into().ok()?);
+    let udp_len = u16::from_be_bytes(udp.get(4..6)?.try_into().ok()?) as usize;
+    let payload_len = udp_len.checked_sub(8)?;
+    // the snap length may have cut the frame inside the UDP header
+    let available = udp.get(8..).unwrap_or_default();
+
+    Some(CapturedDatagram {
+        time,
+        source: SocketAddr::new(source, source_port),
+        destination: SocketAddr::new(destination, destination_port),
+        payload: available[..payload_len.min(available.len())].to_vec(),
+        truncated: cut || available.len() < payload_len,
+    })
+}
+
+fn read_u32(data: &[u8], offset: usize, big_endian: bool) -> SimulationResult<u32> {
+    let bytes: [u8; 4] = data
+        .get(offset..offset + 4)
+        .and_then(|b| b.try_into().ok())
+        .ok_or_else(|| invalid("unexpected end of file"))?;
+    Ok(if big_endian {
+        u32::from_be_bytes(bytes)
+    } else {
+        u32::from_le_bytes(bytes)
+    })
+}
+
+fn read_u16(data: &[u8], offset: usize, big_endian: bool) -> SimulationResult<u16> {
+    let bytes: [u8; 2] = data
+        .get(offset..offset + 2)
+        .and_then(|b| b.try_into().ok())
+        .ok_or_else(|| invalid("unexpected end of file"))?;
+    Ok(if big_endian {
+        u16::from_be_bytes(bytes)
+    } else {
+        u16::from_le_bytes(bytes)
+    })
+}
+
+fn invalid(reason: &'static str) -> SimulationError {
+    SimulationError::InvalidCapture(reason)
+}
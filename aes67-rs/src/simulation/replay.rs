@@ -0,0 +1,555 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Replays an RTP stream from a pcap or pcapng capture into a [Receiver]. The receiver reads the packets from
+//! a [MemoryNetwork] and its clock follows the capture timestamps on a [VirtualTimeline], so a capture of a
+//! misbehaving device produces exactly the same report on every run. This makes captures usable as regression
+//! fixtures: the report counts lost and reordered packets, checks every played out frame against the packet
+//! that carried it and measures how long the receiver took for each packet.
+//!
+//! Packets have to be captured completely, the header-only captures of [crate::capture] can't be replayed.
+
+use super::{
+    Event, LatencyAccumulator,
+    network::{MemoryNetwork, NetworkConditions},
+    pcap::{CapturedDatagram, read_datagrams},
+};
+use crate::{
+    buffer::receiver::{ReadResult, receiver_buffer_channel},
+    error::{SimulationError, SimulationResult},
+    formats::{
+        AudioFormat, Frames, MilliSeconds, MutableDuration, SampleReader, frames_to_duration,
+    },
+    monitoring::{Monitoring, MonitoringEvent, RxStats, Stats},
+    receiver::{
+        ReceiveOutcome, Receiver,
+        config::{IoBackend, ReceiveMode, ReceiverConfig},
+    },
+    socket::RxBatch,
+    time::{
+        Clock, NANOS_PER_SEC,
+        simulated::{SimulatedClock, VirtualTimeline},
+    },
+    utils::AtomicF32,
+};
+use rtp_rs::RtpReader;
+use std::{
+    collections::{BTreeMap, HashMap},
+    fs,
+    net::{IpAddr, SocketAddr},
+    path::PathBuf,
+    sync::Arc,
+    time::{Duration, Instant},
+};
+use tokio::sync::mpsc;
+use tosub::SubsystemHandle;
+
+#[derive(Debug, Clone)]
+pub struct ReplayConfig {
+    /// pcap or pcapng file to replay
+    pub capture: PathBuf,
+    /// Format of the captured stream, the capture does not contain it
+    pub audio_format: AudioFormat,
+    /// Destination address of the stream to replay. The destination of the first RTP packet in the capture is
+    /// used if not set.
+    pub stream: Option<SocketAddr>,
+    /// Address of the sender, the receiver drops packets from other addresses. The source of the first packet
+    /// of the stream is used if not set.
+    pub origin_ip: Option<IpAddr>,
+    pub link_offset: MilliSeconds,
+    /// Number of frames the receiver plays out per audio cycle.
+    pub block_size: usize,
+    /// Added to the capture timestamps to get PTP time, e.g. 37 s if the capturing host's system clock ran on
+    /// UTC. If not set, the offset is chosen so that the first packet arrives exactly at its RTP timestamp, the
+    /// reported latencies are then relative to that packet.
+    pub clock_offset: Option<Duration>,
+    /// Network conditions on top of the ones recorded in the capture.
+    pub network: NetworkConditions,
+    pub seed: u64,
+}
+
+impl ReplayConfig {
+    pub fn new(capture: impl Into<PathBuf>, audio_format: AudioFormat) -> Self {
+        Self {
+            capture: capture.into(),
+            audio_format,
+            stream: None,
+            origin_ip: None,
+            link_offset: 4.0,
+            block_size: 128,
+            clock_offset: None,
+            network: NetworkConditions::default(),
+            seed: 0,
+        }
+    }
+}
+
+#[derive(Debug, Clone, Default)]
+pub struct ReplayReport {
+    pub simulated_time: Duration,
+    pub wall_time: Duration,
+    /// Packets of the stream that were fed to the receiver.
+    pub packets_replayed: usize,
+    /// Packets of the stream that were cut off by the capture's snap length and could not be replayed.
+    pub packets_truncated: usize,
+    /// Packets dropped by the simulated network.
+    pub packets_dropped: usize,
+    pub packets_received: usize,
+    /// Sequence numbers that are missing from the received packets.
+    pub packets_lost: usize,
+    pub out_of_order_packets: usize,
+    pub time_travelling_packets: usize,
+    pub inconsistent_timestamps: usize,
+    pub malformed_packets: usize,
+    pub packets_from_wrong_sender: usize,
+    /// Difference between a packet's ingress time and the receiver's media time at reception, in frames.
+    pub min_latency: Option<i64>,
+    pub max_latency: Option<i64>,
+    pub mean_latency: Option<f64>,
+    pub blocks_played: usize,
+    pub blocks_not_ready: usize,
+    pub blocks_too_late: usize,
+    /// Frames that were played out successfully, but did not contain the samples of the packet that carried
+    /// them.
+    pub corrupt_frames: usize,
+    /// Frames that were played out successfully, but were not carried by any received packet.
+    pub missing_frames: usize,
+    /// Wall time the receiver spent on each packet.
+    pub processing_time: ProcessingTime,
+}
+
+#[derive(Debug, Clone, Default)]
+pub struct ProcessingTime {
+    pub mean: Duration,
+    pub median: Duration,
+    pub p99: Duration,
+    pub max: Duration,
+}
+
+impl ProcessingTime {
+    fn from_nanos(mut nanos: Vec<u64>) -> Self {
+        if nanos.is_empty() {
+            return Self::default();
+        }
+        nanos.sort_unstable();
+        let len = nanos.len();
+        Self {
+            mean: Duration::from_nanos(nanos.iter().sum::<u64>() / len as u64),
+            median: Duration::from_nanos(nanos[len / 2]),
+            p99: Duration::from_nanos(nanos[(len * 99 / 100).min(len - 1)]),
+            max: Duration::from_nanos(nanos[len - 1]),
+        }
+    }
+}
+
+/// Counts sequence numbers missing between the lowest and the highest received one.
+#[derive(Default)]
+struct LossCounter {
+    last: Option<(u16, i64)>,
+    lowest: i64,
+    highest: i64,
+    received: i64,
+}
+
+impl LossCounter {
+    fn add(&mut self, seq: u16) {
+        let extended = match self.last {
+            Some((last, extended)) => extended + seq.wrapping_sub(last) as i16 as i64,
+            None => {
+                self.lowest = seq as i64;
+                self.highest = seq as i64;
+                seq as i64
+            }
+        };
+        self.last = Some((seq, extended));
+        self.lowest = self.lowest.min(extended);
+        self.highest = self.highest.max(extended);
+        self.received += 1;
+    }
+
+    fn lost(&self) -> usize {
+        if self.last.is_none() {
+            return 0;
+        }
+        (self.highest - self.lowest + 1 - self.received).max(0) as usize
+    }
+}
+
+/// Replays the stream in `config.capture` into a receiver and plays it out in blocks of `config.block_size`
+/// frames, one link offset behind the media clock.
+pub fn run_replay(
+    subsys: &SubsystemHandle,
+    config: ReplayConfig,
+) -> SimulationResult<ReplayReport> {
+    let started = Instant::now();
+    let sample_rate = config.audio_format.sample_rate;
+    let channels = config.audio_format.frame_format.channels;
+    let sample_format = config.audio_format.frame_format.sample_format;
+    let block_size = config.block_size;
+    let mut report = ReplayReport::default();
+
+    let datagrams = read_datagrams(&fs::read(&config.capture)?)?;
+    let stream = match config.stream {
+        Some(stream) => stream,
+        None => datagrams
+            .iter()
+            .find(|d| RtpReader::new(&d.payload).is_ok())
+            .map(|d| d.destination)
+            .ok_or(SimulationError::NoStreamInCapture)?,
+    };
+    let mut packets: Vec<CapturedDatagram> = Vec::new();
+    for datagram in datagrams.into_iter().filter(|d| d.destination == stream) {
+        if datagram.truncated {
+            report.packets_truncated += 1;
+        } else {
+            packets.push(datagram);
+        }
+    }
+    packets.sort_by_key(|p| p.time);
+    let (first, first_timestamp) = packets
+        .iter()
+        .find_map(|p| {
+            RtpReader::new(&p.payload)
+                .ok()
+                .map(|rtp| (p, rtp.timestamp()))
+        })
+        .ok_or(SimulationError::NoStreamInCapture)?;
+
+    let offset_nanos = match config.clock_offset {
+        Some(offset) => offset.as_nanos() as i128,
+        None => {
+            // rounded up, so the media clock has reached the first packet's timestamp when it arrives
+            let media_time = first.time.as_nanos() * sample_rate as u128 / NANOS_PER_SEC;
+            let frames = first_timestamp.wrapping_sub(media_time as u32) as i32 as i128;
+            let nanos = frames * NANOS_PER_SEC as i128;
+            let rate = sample_rate as i128;
+            nanos.div_euclid(rate) + (nanos.rem_euclid(rate) != 0) as i128
+        }
+    };
+    let timeline_time = |time: Duration| {
+        Duration::from_nanos((time.as_nanos() as i128 + offset_nanos).max(0) as u64)
+    };
+
+    let timeline = VirtualTimeline::new(timeline_time(first.time));
+    let start = timeline.now();
+    let clock = SimulatedClock::new(
+        timeline.clone(),
+        sample_rate,
+        0.0,
+        Duration::ZERO,
+        config.seed,
+    );
+    let network = MemoryNetwork::new(timeline.clone(), config.network.clone(), config.seed);
+
+    let receiver_config = ReceiverConfig {
+        id: 1,
+        label: "replay".to_owned(),
+        audio_format: config.audio_format,
+        source: stream,
+        origin_ip: config.origin_ip.unwrap_or(first.source.ip()),
+        rtp_offset: 0,
+        channel_labels: (0..channels).map(|c| format!("{}", c + 1)).collect(),
+        link_offset: MutableDuration(Arc::new(AtomicF32::new(config.link_offset))),
+        delay_calculation_interval: None,
+        payload_type: None,
+        kernel_filter: false,
+        receive_mode: ReceiveMode::Blocking,
+        io_backend: IoBackend::Socket,
+        recording: None,
+        routing: None,
+        capture: None,
+    };
+    let link_offset_frames = receiver_config.frames_in_link_offset();
+
+    let last = packets.last().map_or(start, |p| timeline_time(p.time));
+    let end = last
+        + frames_to_duration(link_offset_frames + block_size as Frames, sample_rate)
+        + config.network.delay
+        + config.network.jitter;
+
+    let (monitoring, mut events) = Monitoring::detached(4096);
+    let (_receiver_api_tx, receiver_api_rx) = mpsc::channel(1);
+    let (buffer_tx, mut buffer_rx) =
+        receiver_buffer_channel(receiver_config.clone(), monitoring.clone())?;
+    let mut receiver = Receiver::new(
+        receiver_config.id.to_string(),
+        receiver_config.label.clone(),
+        subsys.clone(),
+        receiver_config,
+        Clock::Simulated(clock.clone()),
+        receiver_api_rx,
+        Box::new(network.bind(stream)),
+        monitoring,
+        buffer_tx,
+        None,
+    );
+
+    let mut latency = LatencyAccumulator::default();
+    let mut losses = LossCounter::default();
+    let mut processing_nanos = Vec::with_capacity(packets.len());
+    let mut receive_batch = RxBatch::default();
+    let mut playout_buffers = vec![vec![0f32; block_size]; channels];
+    // interleaved samples of the packets that were sent but not received yet, by sequence number
+    let mut in_flight: HashMap<u16, Vec<f32>> = HashMap::new();
+    // interleaved samples of the received packets, by ingress time
+    let mut reference: BTreeMap<Frames, Vec<f32>> = BTreeMap::new();
+    let mut next_packet = 0;
+    // ingress time of the next block to be played out; playout starts with the first received packet
+    let mut playout_ingress: Option<Frames> = None;
+
+    loop {
+        let mut next = packets
+            .get(next_packet)
+            .map(|p| (timeline_time(p.time), Event::Send));
+        if let Some(ingress) = playout_ingress {
+            let playout_at = (
+                clock.timeline_time(ingress + link_offset_frames),
+                Event::Playout,
+            );
+            next = Some(next.map_or(playout_at, |n| n.min(playout_at)));
+        }
+        if let Some(delivery_at) = network.next_delivery() {
+            let delivery = (delivery_at, Event::Deliver);
+            next = Some(next.map_or(delivery, |n| n.min(delivery)));
+        }
+
+        let Some((time, event)) = next else {
+            break;
+        };
+        if time > end {
+            break;
+        }
+        timeline.set(time);
+
+        match event {
+            Event::Send => {
+                let packet = &packets[next_packet];
+                next_packet += 1;
+                if let Ok(rtp) = RtpReader::new(&packet.payload) {
+                    let samples = rtp
+                        .payload()
+                        .chunks_exact(sample_format.bytes_per_sample())
+                        .map(|sample| sample_format.read_sample(sample))
+                        .collect();
+                    in_flight.insert(rtp.sequence_number().into(), samples);
+                }
+                network
+                    .tx_socket(packet.source)
+                    .send_to(&packet.payload, stream)?;
+                report.packets_replayed += 1;
+            }
+            Event::Deliver => {
+                network.deliver_next(time);
+                loop {
+                    let processing_started = Instant::now();
+                    let ReceiveOutcome::Packet = receiver.receive(&mut receive_batch)? else {
+                        break;
+                    };
+                    processing_nanos.push(processing_started.elapsed().as_nanos() as u64);
+                }
+            }
+            Event::Playout => {
+                let Some(ingress) = playout_ingress else {
+                    continue;
+                };
+                let buffers = playout_buffers.iter_mut().map(|b| Some(&mut b[..]));
+                match buffer_rx.read(buffers, ingress, block_size)? {
+                    ReadResult::Ok(_) => {
+                        report.blocks_played += 1;
+                        for i in 0..block_size {
+                            let frame = ingress + i as Frames;
+                            let expected = reference.range(..=frame).next_back().and_then(
+                                |(start, samples)| {
+                                    let offset = (frame - start) as usize * channels;
+                                    samples.get(offset..offset + channels)
+                                },
+                            );
+                            let Some(expected) = expected else {
+                                report.missing_frames += 1;
+                                continue;
+                            };
+                            if playout_buffers
+                                .iter()
+                                .zip(expected)
+                                .any(|(buffer, sample)| buffer[i] != *sample)
+                            {
+                                report.corrupt_frames += 1;
+                            }
+                        }
+                    }
+                    ReadResult::NotReady(_) => report.blocks_not_ready += 1,
+                    ReadResult::TooLate => report.blocks_too_late += 1,
+                }
+                let next_ingress = ingress + block_size as Frames;
+                if let Some(&oldest) = reference.range(..=next_ingress).next_back().map(|(k, _)| k)
+                {
+                    reference = reference.split_off(&oldest);
+                }
+                playout_ingress = Some(next_ingress);
+            }
+        }
+
+        while let Ok(event) = events.try_recv() {
+            let MonitoringEvent::Stats(Stats::Rx(stats)) = event else {
+                continue;
+            };
+            match stats {
+                RxStats::PacketReceived {
+                    seq,
+                    ingress_time,
+                    media_time_at_reception,
+                    ..
+                } => {
+                    report.packets_received += 1;
+                    latency.add(media_time_at_reception as i64 - ingress_time as i64);
+                    losses.add(u16::from(seq));
+                    playout_ingress.get_or_insert(ingress_time);
+                    if let Some(samples) = in_flight.remove(&u16::from(seq)) {
+                        reference.insert(ingress_time, samples);
+                    }
+                }
+                RxStats::OutOfOrderPacket { .. } => report.out_of_order_packets += 1,
+                RxStats::TimeTravellingPacket { .. } => report.time_travelling_packets += 1,
+                RxStats::InconsistentTimestamp => report.inconsistent_timestamps += 1,
+                RxStats::MalformedRtpPacket(_) => report.malformed_packets += 1,
+                RxStats::PacketFromWrongSender(_) => report.packets_from_wrong_sender += 1,
+                _ => {}
+            }
+        }
+    }
+
+    report.simulated_time = timeline.now() - start;
+    report.wall_time = started.elapsed();
+    report.packets_dropped = network.dropped();
+    report.packets_lost = losses.lost();
+    report.min_latency = latency.min;
+    report.max_latency = latency.max;
+    report.mean_latency = latency.mean();
+    report.processing_time = ProcessingTime::from_nanos(processing_nanos);
+
+    Ok(report)
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use crate::formats::{FrameFormat, SampleFormat};
+    use miette::IntoDiagnostic;
+    use std::{env, process};
+    use tokio::sync::oneshot;
+
+    const FRAMES_PER_PACKET: u32 = 48;
+    const FIRST_TIMESTAMP: u32 = 48_000;
+
+    /// Builds a classic pcap with raw IPv4 frames, one RTP packet per `(seq, capture time in µs)`.
+    fn pcap(packets: &[(u16, u32)]) -> Vec<u8> {
+        let mut file = Vec::new();
+        // little endian, microsecond timestamps
+        file.extend_from_slice(&0xA1B2_C3D4u32.to_le_bytes());
+        file.extend_from_slice(&2u16.to_le_bytes());
+        file.extend_from_slice(&4u16.to_le_bytes());
+        file.extend_from_slice(&[0; 8]);
+        file.extend_from_slice(&65_535u32.to_le_bytes());
+        // LINKTYPE_RAW
+        file.extend_from_slice(&101u32.to_le_bytes());
+
+        for &(seq, micros) in packets {
+            let mut rtp = vec![0x80, 98];
+            rtp.extend_from_slice(&seq.to_be_bytes());
+            rtp.extend_from_slice(
+                &(FIRST_TIMESTAMP + seq as u32 * FRAMES_PER_PACKET).to_be_bytes(),
+            );
+            rtp.extend_from_slice(&0x1234_5678u32.to_be_bytes());
+            // 2 channels of L24
+            rtp.extend(
+                (0..FRAMES_PER_PACKET as usize * 6).map(|i| (seq as usize * 31 + i * 7) as u8),
+            );
+
+            let mut frame = vec![0x45, 0];
+            frame.extend_from_slice(&(28 + rtp.len() as u16).to_be_bytes());
+            frame.extend_from_slice(&[0, 0, 0, 0, 64, 17, 0, 0]);
+            frame.extend_from_slice(&[192, 168, 1, 10]);
+            frame.extend_from_slice(&[239, 69, 1, 1]);
+            frame.extend_from_slice(&5004u16.to_be_bytes());
+            frame.extend_from_slice(&5004u16.to_be_bytes());
+            frame.extend_from_slice(&(8 + rtp.len() as u16).to_be_bytes());
+            frame.extend_from_slice(&[0, 0]);
+            frame.extend_from_slice(&rtp);
+
+            file.extend_from_slice(&1u32.to_le_bytes());
+            file.extend_from_slice(&micros.to_le_bytes());
+            file.extend_from_slice(&(frame.len() as u32).to_le_bytes());
+            file.extend_from_slice(&(frame.len() as u32).to_le_bytes());
+            file.extend_from_slice(&frame);
+        }
+
+        file
+    }
+
+    #[tokio::test]
+    async fn replay_reports_lost_and_reordered_packets() {
+        // one packet per millisecond, seq 5 is missing and seq 9 arrives half a packet time after seq 10
+        let packets: Vec<(u16, u32)> = (0..16u16)
+            .filter(|&seq| seq != 5)
+            .map(|seq| match seq {
+                9 => (seq, 10_500),
+                _ => (seq, seq as u32 * 1_000),
+            })
+            .collect();
+        let capture = env::temp_dir().join(format!("aes67-rs-replay-{}.pcap", process::id()));
+        fs::write(&capture, pcap(&packets)).expect("could not write capture");
+
+        let audio_format = AudioFormat {
+            sample_rate: 48_000,
+            frame_format: FrameFormat {
+                channels: 2,
+                sample_format: SampleFormat::L24,
+            },
+        };
+        let config = ReplayConfig {
+            block_size: FRAMES_PER_PACKET as usize,
+            ..ReplayConfig::new(&capture, audio_format)
+        };
+
+        let (tx, rx) = oneshot::channel();
+        tosub::build_root("replay-test")
+            .start(async move |subsys: SubsystemHandle| -> miette::Result<()> {
+                let report = tokio::task::spawn_blocking(move || run_replay(&subsys, config))
+                    .await
+                    .into_diagnostic()??;
+                tx.send(report).ok();
+                Ok(())
+            })
+            .await
+            .expect("replay failed");
+        fs::remove_file(&capture).ok();
+        let report = rx.await.expect("no report");
+
+        assert_eq!(15, report.packets_replayed);
+        assert_eq!(15, report.packets_received);
+        assert_eq!(1, report.packets_lost);
+        // reported for the packet after the gap, the one that overtook the late packet, the late packet itself
+        // and the one after it
+        assert_eq!(4, report.out_of_order_packets);
+        assert_eq!(0, report.time_travelling_packets);
+        assert_eq!(0, report.inconsistent_timestamps);
+        assert_eq!(16, report.blocks_played);
+        assert_eq!(0, report.corrupt_frames);
+        // the frames of the lost packet are played out, but no packet carried them
+        assert_eq!(FRAMES_PER_PACKET as usize, report.missing_frames);
+    }
+}
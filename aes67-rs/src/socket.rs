@@ -15,10 +15,22 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+mod batch;
+mod busy_poll;
+mod filter;
+mod mmap;
+mod timestamp;
+mod uring;
+mod xdp;
+
+pub use filter::RtpFilter;
+pub use uring::UringRxSocket;
+pub use xdp::XdpRxSocket;
+
 use crate::{
     config::SocketConfig,
     error::{ConfigResult, ReceiverInternalResult, SenderInternalResult},
-    receiver::config::ReceiverConfig,
+    receiver::config::{IoBackend, ReceiveMode, ReceiverConfig},
 };
 use miette::{IntoDiagnostic, Result};
 use pnet::datalink::NetworkInterface;
@@ -26,11 +38,16 @@ use socket2::{
     Domain, InterfaceIndexOrAddress, Protocol as SockProto, SockAddr, Socket, TcpKeepalive, Type,
 };
 use std::{
+    fmt, io,
+    marker::PhantomData,
+    mem,
     net::{IpAddr, Ipv4Addr, Ipv6Addr, SocketAddr, TcpListener, UdpSocket},
     num::NonZeroU32,
-    time::Duration,
+    os::fd::AsRawFd,
+    slice,
+    time::{Duration, SystemTime},
 };
-use tracing::{info, instrument};
+use tracing::{info, instrument, warn};
 
 #[instrument]
 pub fn init_tcp_socket(bind_addr: IpAddr, port: u16, config: SocketConfig) -> Result<TcpListener> {
@@ -68,23 +85,80 @@ pub fn init_tcp_socket(bind_addr: IpAddr, port: u16, config: SocketConfig) -> Re
 pub fn create_rx_socket(
     config: &ReceiverConfig,
     iface: NetworkInterface,
-) -> ReceiverInternalResult<UdpSocket> {
-    Ok(try_create_rx_socket(config, iface)?)
+    filter: Option<&RtpFilter>,
+) -> ReceiverInternalResult<Box<dyn PacketSource>> {
+    let socket = try_create_rx_socket(config, iface.clone(), filter)?;
+    let wait = !matches!(config.receive_mode, ReceiveMode::Spin { .. });
+    match config.io_backend {
+        IoBackend::Socket => Ok(Box::new(socket)),
+        IoBackend::IoUring => {
+            // the ring takes ownership of its handle, keep the original one for the fallback
+            match UringRxSocket::new(socket.try_clone()?, wait) {
+                Ok(socket) => {
+                    info!("Receiving through io_uring");
+                    Ok(Box::new(socket))
+                }
+                Err(e) => {
+                    warn!("Could not set up io_uring, falling back to plain socket: {e}");
+                    Ok(Box::new(socket))
+                }
+            }
+        }
+        IoBackend::Xdp => {
+            match XdpRxSocket::new(socket.try_clone()?, &iface, config.source, wait) {
+                Ok(socket) => {
+                    info!("Receiving through AF_XDP");
+                    Ok(Box::new(socket))
+                }
+                Err(e) => {
+                    warn!("Could not set up AF_XDP ingest, falling back to plain socket: {e}");
+                    Ok(Box::new(socket))
+                }
+            }
+        }
+    }
 }
 
 fn try_create_rx_socket(
     config: &ReceiverConfig,
     iface: NetworkInterface,
+    filter: Option<&RtpFilter>,
 ) -> ConfigResult<UdpSocket> {
     // TODO for unicast addresses check if the IP exists on this machine and reject otherwise
     // TODO for IPv4 check if the TTL allows packets to reach this machine and reject otherwise
 
-    let socket = match &config.source {
-        SocketAddr::V4(addr) => create_ipv4_rx_socket(*addr.ip(), iface, addr.port())?,
-        SocketAddr::V6(addr) => create_ipv6_rx_socket(*addr.ip(), iface, addr.port())?,
+    // join source-specific if the sender is known, so packets from other senders are already dropped by the
+    // kernel and IGMPv3/MLDv2 snooping switches
+    let socket = match (&config.source, config.origin_ip) {
+        (SocketAddr::V4(addr), IpAddr::V4(origin)) => {
+            let source = (!origin.is_unspecified()).then_some(origin);
+            create_ipv4_rx_socket(*addr.ip(), source, iface, addr.port())?
+        }
+        (SocketAddr::V4(addr), IpAddr::V6(_)) => {
+            create_ipv4_rx_socket(*addr.ip(), None, iface, addr.port())?
+        }
+        (SocketAddr::V6(addr), IpAddr::V6(origin)) => {
+            let source = (!origin.is_unspecified()).then_some(origin);
+            create_ipv6_rx_socket(*addr.ip(), source, iface, addr.port())?
+        }
+        (SocketAddr::V6(addr), IpAddr::V4(_)) => {
+            create_ipv6_rx_socket(*addr.ip(), None, iface, addr.port())?
+        }
     };
 
     socket.set_read_timeout(Some(Duration::from_millis(100)))?;
+    busy_poll::apply_receive_mode(&socket, &config.receive_mode)?;
+
+    if let Err(e) = timestamp::enable_rx_timestamps(&socket) {
+        warn!("Could not enable receive timestamps, receive latency will not be reported: {e}");
+    }
+
+    if let Some(filter) = filter {
+        // the receiver still checks every packet, so it keeps working without the filter
+        if let Err(e) = filter.attach(socket.as_raw_fd()) {
+            warn!("Could not attach RTP socket filter: {e}");
+        }
+    }
 
     Ok(socket.into())
 }
@@ -124,6 +198,7 @@ pub fn create_tx_socket(
 #[instrument]
 pub fn create_ipv4_rx_socket(
     ip_addr: Ipv4Addr,
+    source: Option<Ipv4Addr>,
     iface: NetworkInterface,
     port: u16,
 ) -> ConfigResult<Socket> {
@@ -144,7 +219,30 @@ pub fn create_ipv4_rx_socket(
     socket.set_reuse_address(true)?;
 
     if ip_addr.is_multicast() {
-        socket.join_multicast_v4_n(&ip_addr, &InterfaceIndexOrAddress::Index(iface.index))?;
+        let iface_addr = iface.ips.iter().find_map(|it| match it.ip() {
+            IpAddr::V4(ip) => Some(ip),
+            _ => None,
+        });
+        let ssm = match (source, iface_addr) {
+            (Some(source), Some(iface_addr)) => {
+                match socket.join_ssm_v4(&source, &ip_addr, &iface_addr) {
+                    Ok(()) => {
+                        info!("Joined {ip_addr} source-specific for sender {source}");
+                        true
+                    }
+                    Err(e) => {
+                        warn!(
+                            "Source-specific join of {ip_addr} failed, falling back to any-source: {e}"
+                        );
+                        false
+                    }
+                }
+            }
+            _ => false,
+        };
+        if !ssm {
+            socket.join_multicast_v4_n(&ip_addr, &InterfaceIndexOrAddress::Index(iface.index))?;
+        }
         socket.bind(&SockAddr::from(SocketAddr::new(IpAddr::V4(ip_addr), port)))?;
     } else {
         socket.bind_device_by_index_v4(NonZeroU32::new(iface.index))?;
@@ -155,6 +253,7 @@ pub fn create_ipv4_rx_socket(
 #[instrument]
 pub fn create_ipv6_rx_socket(
     ip_addr: Ipv6Addr,
+    source: Option<Ipv6Addr>,
     iface: NetworkInterface,
     port: u16,
 ) -> ConfigResult<Socket> {
@@ -176,10 +275,254 @@ pub fn create_ipv6_rx_socket(
     socket.set_read_timeout(Some(Duration::from_millis(250)))?;
 
     if ip_addr.is_multicast() {
-        socket.join_multicast_v6(&ip_addr, 0)?;
+        let ssm = match source {
+            Some(source) => match join_ssm_v6(&socket, &source, &ip_addr, iface.index) {
+                Ok(()) => {
+                    info!("Joined {ip_addr} source-specific for sender {source}");
+                    true
+                }
+                Err(e) => {
+                    warn!(
+                        "Source-specific join of {ip_addr} failed, falling back to any-source: {e}"
+                    );
+                    false
+                }
+            },
+            None => false,
+        };
+        if !ssm {
+            socket.join_multicast_v6(&ip_addr, 0)?;
+        }
         socket.bind(&SockAddr::from(SocketAddr::new(IpAddr::V6(ip_addr), port)))?;
     } else {
         socket.bind_device_by_index_v6(NonZeroU32::new(iface.index))?;
     }
     Ok(socket)
 }
+
+/// `struct group_source_req` from `<netinet/in.h>`, which is not exposed by libc.
+#[repr(C)]
+struct GroupSourceReq {
+    gsr_interface: u32,
+    gsr_group: libc::sockaddr_storage,
+    gsr_source: libc::sockaddr_storage,
+}
+
+fn sockaddr_in6(ip: &Ipv6Addr) -> libc::sockaddr_storage {
+    let mut storage: libc::sockaddr_storage = unsafe { mem::zeroed() };
+    let addr = libc::sockaddr_in6 {
+        sin6_family: libc::AF_INET6 as libc::sa_family_t,
+        sin6_port: 0,
+        sin6_flowinfo: 0,
+        sin6_addr: libc::in6_addr {
+            s6_addr: ip.octets(),
+        },
+        sin6_scope_id: 0,
+    };
+    unsafe {
+        (&mut storage as *mut libc::sockaddr_storage as *mut libc::sockaddr_in6).write(addr);
+    }
+    storage
+}
+
+/// MLDv2 source-specific join (`MCAST_JOIN_SOURCE_GROUP`), socket2 only supports this for IPv4.
+fn join_ssm_v6(socket: &Socket, source: &Ipv6Addr, group: &Ipv6Addr, iface: u32) -> io::Result<()> {
+    let req = GroupSourceReq {
+        gsr_interface: iface,
+        gsr_group: sockaddr_in6(group),
+        gsr_source: sockaddr_in6(source),
+    };
+    let res = unsafe {
+        libc::setsockopt(
+            socket.as_raw_fd(),
+            libc::IPPROTO_IPV6,
+            libc::MCAST_JOIN_SOURCE_GROUP,
+            &req as *const GroupSourceReq as *const libc::c_void,
+            mem::size_of::<GroupSourceReq>() as libc::socklen_t,
+        )
+    };
+    if res < 0 {
+        Err(io::Error::last_os_error())
+    } else {
+        Ok(())
+    }
+}
+
+/// Maximum number of packets received with a single call
+pub const RX_BATCH_SIZE: usize = 16;
+/// Maximum number of packets sent with a single call
+pub const TX_BATCH_SIZE: usize = 16;
+/// Size of a packet slot in an [RxBatch], longer datagrams are truncated
+const MAX_DATAGRAM_SIZE: usize = 9216;
+
+/// A received packet. Its payload is either a copy in an [RxBatch] or a buffer lent by a zero-copy
+/// [PacketSource], in both cases the datagram has to be handed back with [PacketSource::release] once it has
+/// been processed. It borrows the batch it was drained from, so the batch can't receive into its storage
+/// while the datagram is alive.
+#[derive(Debug)]
+pub struct Datagram<'a> {
+    data: *const u8,
+    len: usize,
+    pub addr: SocketAddr,
+    /// time the kernel received the packet, if known
+    pub timestamp: Option<SystemTime>,
+    /// buffer of a zero-copy source the payload was written to
+    buffer: Option<u64>,
+    _payload: PhantomData<&'a [u8]>,
+}
+
+impl Datagram<'_> {
+    pub fn payload(&self) -> &[u8] {
+        // copies are not overwritten while the batch is borrowed, lent buffers are not reused before they are
+        // released and not unmapped while they are lent out (see [RxBatch::push_lent])
+        unsafe { slice::from_raw_parts(self.data, self.len) }
+    }
+}
+
+/// Packets received by a single [PacketSource::recv_batch] call, along with the storage copying sources
+/// receive them into.
+pub struct RxBatch {
+    storage: Box<[u8]>,
+    /// the datagrams only get the lifetime of the batch borrow once they are drained
+    datagrams: Vec<Datagram<'static>>,
+}
+
+impl Default for RxBatch {
+    fn default() -> Self {
+        Self::new(RX_BATCH_SIZE)
+    }
+}
+
+impl RxBatch {
+    pub fn new(capacity: usize) -> Self {
+        Self {
+            storage: vec![0; capacity * MAX_DATAGRAM_SIZE].into_boxed_slice(),
+            datagrams: Vec::with_capacity(capacity),
+        }
+    }
+
+    pub fn capacity(&self) -> usize {
+        self.datagrams.capacity()
+    }
+
+    pub fn len(&self) -> usize {
+        self.datagrams.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.datagrams.is_empty()
+    }
+
+    pub fn is_full(&self) -> bool {
+        self.len() >= self.capacity()
+    }
+
+    /// Storage for the `index`th packet of the batch
+    fn slot(&mut self, index: usize) -> &mut [u8] {
+        &mut self.storage[index * MAX_DATAGRAM_SIZE..(index + 1) * MAX_DATAGRAM_SIZE]
+    }
+
+    /// Storage for the next packet, to be committed with [RxBatch::push_copied]
+    pub fn next_slot(&mut self) -> &mut [u8] {
+        self.slot(self.len())
+    }
+
+    /// Adds the packet that was copied into [RxBatch::next_slot].
+    pub fn push_copied(&mut self, len: usize, addr: SocketAddr, timestamp: Option<SystemTime>) {
+        let data = self.next_slot().as_ptr();
+        self.datagrams.push(Datagram {
+            data,
+            len: len.min(MAX_DATAGRAM_SIZE),
+            addr,
+            timestamp,
+            buffer: None,
+            _payload: PhantomData,
+        });
+    }
+
+    /// Adds a datagram whose payload lives in a buffer of a zero-copy source.
+    ///
+    /// # Safety
+    ///
+    /// The buffer must not be written to or unmapped before the datagram was passed to
+    /// [PacketSource::release], even if the source is dropped first.
+    unsafe fn push_lent(&mut self, datagram: Datagram<'static>) {
+        self.datagrams.push(datagram);
+    }
+
+    /// Takes the received packets out of the batch, in the order they were received.
+    pub fn drain(&mut self) -> impl Iterator<Item = Datagram<'_>> + '_ {
+        self.datagrams.drain(..).map(|datagram| datagram)
+    }
+}
+
+/// Source of the packets of a receiver. Plain UDP sockets are the default implementation, alternative
+/// transports only need to implement this trait.
+pub trait PacketSource: Send + fmt::Debug {
+    /// Receives the packets that are available, up to the capacity of the batch, waiting for the first one
+    /// if there are none. Returns the number of packets received, or [io::ErrorKind::WouldBlock] or
+    /// [io::ErrorKind::TimedOut] if nothing arrived in time. The batch must be empty.
+    fn recv_batch(&mut self, batch: &mut RxBatch) -> io::Result<usize>;
+
+    /// Hands a datagram back to the source once it has been processed. Zero-copy sources reuse its buffer.
+    fn release(&mut self, datagram: Datagram<'_>) {
+        drop(datagram);
+    }
+
+    /// Replaces the socket filter, sources that don't support filters ignore it.
+    fn set_filter(&self, filter: &RtpFilter) -> io::Result<()> {
+        let _ = filter;
+        Ok(())
+    }
+
+    /// Total number of packets dropped before they reached the receiver, if the source knows.
+    fn drops(&self) -> Option<u32> {
+        None
+    }
+}
+
+/// A packet to be sent by a [PacketSink].
+#[derive(Debug, Clone, Copy)]
+pub struct TxPacket<'a> {
+    pub data: &'a [u8],
+    pub target: SocketAddr,
+}
+
+/// Destination of the packets of a sender. Plain UDP sockets are the default implementation.
+pub trait PacketSink: Send + fmt::Debug {
+    fn send_to(&mut self, buf: &[u8], target: SocketAddr) -> io::Result<usize>;
+
+    /// Sends several packets, returns how many of them were sent.
+    fn send_batch(&mut self, packets: &[TxPacket<'_>]) -> io::Result<usize> {
+        for (i, packet) in packets.iter().enumerate() {
+            if let Err(e) = self.send_to(packet.data, packet.target) {
+                return if i == 0 { Err(e) } else { Ok(i) };
+            }
+        }
+        Ok(packets.len())
+    }
+}
+
+impl PacketSource for UdpSocket {
+    fn recv_batch(&mut self, batch: &mut RxBatch) -> io::Result<usize> {
+        batch::recv_batch_timestamped(self, batch)
+    }
+
+    fn set_filter(&self, filter: &RtpFilter) -> io::Result<()> {
+        filter.attach(self.as_raw_fd())
+    }
+
+    fn drops(&self) -> Option<u32> {
+        filter::socket_drops(self.as_raw_fd()).ok()
+    }
+}
+
+impl PacketSink for UdpSocket {
+    fn send_to(&mut self, buf: &[u8], target: SocketAddr) -> io::Result<usize> {
+        UdpSocket::send_to(self, buf, target)
+    }
+
+    fn send_batch(&mut self, packets: &[TxPacket<'_>]) -> io::Result<usize> {
+        batch::send_batch(self, packets)
+    }
+}
@@ -0,0 +1,150 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Batched receiving and sending on plain UDP sockets (`recvmmsg`, `sendmmsg`).
+
+use super::{
+    RX_BATCH_SIZE, RxBatch, TX_BATCH_SIZE, TxPacket,
+    timestamp::{rx_timestamp, to_socket_addr},
+};
+use std::{
+    io, mem,
+    net::{SocketAddr, UdpSocket},
+    os::fd::AsRawFd,
+    ptr,
+};
+
+/// Receives up to [RX_BATCH_SIZE] packets into the batch with a single syscall. Blocks according to the
+/// socket's read timeout until the first packet arrives, then takes whatever else is already queued.
+pub fn recv_batch_timestamped(socket: &UdpSocket, batch: &mut RxBatch) -> io::Result<usize> {
+    let base = batch.len();
+    let count = (batch.capacity() - base).min(RX_BATCH_SIZE);
+    let mut addrs: [libc::sockaddr_storage; RX_BATCH_SIZE] = unsafe { mem::zeroed() };
+    // u64 for alignment of the cmsg headers
+    let mut control = [[0u64; 8]; RX_BATCH_SIZE];
+    let mut iovecs: [libc::iovec; RX_BATCH_SIZE] = unsafe { mem::zeroed() };
+    let mut msgs: [libc::mmsghdr; RX_BATCH_SIZE] = unsafe { mem::zeroed() };
+
+    for i in 0..count {
+        let slot = batch.slot(base + i);
+        iovecs[i] = libc::iovec {
+            iov_base: slot.as_mut_ptr() as *mut libc::c_void,
+            iov_len: slot.len(),
+        };
+        let msg = &mut msgs[i].msg_hdr;
+        msg.msg_name = &mut addrs[i] as *mut libc::sockaddr_storage as *mut libc::c_void;
+        msg.msg_namelen = mem::size_of::<libc::sockaddr_storage>() as libc::socklen_t;
+        msg.msg_iov = &mut iovecs[i];
+        msg.msg_iovlen = 1;
+        msg.msg_control = control[i].as_mut_ptr() as *mut libc::c_void;
+        msg.msg_controllen = mem::size_of_val(&control[i]) as _;
+    }
+
+    let received = unsafe {
+        libc::recvmmsg(
+            socket.as_raw_fd(),
+            msgs.as_mut_ptr(),
+            count as libc::c_uint,
+            libc::MSG_WAITFORONE,
+            ptr::null_mut(),
+        )
+    };
+    if received < 0 {
+        return Err(io::Error::last_os_error());
+    }
+
+    for (msg, addr) in msgs.iter().zip(&addrs).take(received as usize) {
+        let addr = to_socket_addr(addr)?;
+        batch.push_copied(msg.msg_len as usize, addr, rx_timestamp(&msg.msg_hdr));
+    }
+    Ok(received as usize)
+}
+
+/// Sends the packets with as few syscalls as possible. Returns the number of packets sent.
+pub fn send_batch(socket: &UdpSocket, packets: &[TxPacket<'_>]) -> io::Result<usize> {
+    let mut sent = 0;
+    for chunk in packets.chunks(TX_BATCH_SIZE) {
+        let mut addrs: [libc::sockaddr_storage; TX_BATCH_SIZE] = unsafe { mem::zeroed() };
+        let mut iovecs: [libc::iovec; TX_BATCH_SIZE] = unsafe { mem::zeroed() };
+        let mut msgs: [libc::mmsghdr; TX_BATCH_SIZE] = unsafe { mem::zeroed() };
+
+        for (i, packet) in chunk.iter().enumerate() {
+            let addr_len = write_socket_addr(&packet.target, &mut addrs[i]);
+            iovecs[i] = libc::iovec {
+                iov_base: packet.data.as_ptr() as *mut libc::c_void,
+                iov_len: packet.data.len(),
+            };
+            let msg = &mut msgs[i].msg_hdr;
+            msg.msg_name = &mut addrs[i] as *mut libc::sockaddr_storage as *mut libc::c_void;
+            msg.msg_namelen = addr_len;
+            msg.msg_iov = &mut iovecs[i];
+            msg.msg_iovlen = 1;
+        }
+
+        let res = unsafe {
+            libc::sendmmsg(
+                socket.as_raw_fd(),
+                msgs.as_mut_ptr(),
+                chunk.len() as libc::c_uint,
+                0,
+            )
+        };
+        if res < 0 {
+            let e = io::Error::last_os_error();
+            return if sent == 0 { Err(e) } else { Ok(sent) };
+        }
+        sent += res as usize;
+        if (res as usize) < chunk.len() {
+            break;
+        }
+    }
+    Ok(sent)
+}
+
+fn write_socket_addr(addr: &SocketAddr, storage: &mut libc::sockaddr_storage) -> libc::socklen_t {
+    match addr {
+        SocketAddr::V4(addr) => {
+            let sin = libc::sockaddr_in {
+                sin_family: libc::AF_INET as libc::sa_family_t,
+                sin_port: addr.port().to_be(),
+                sin_addr: libc::in_addr {
+                    s_addr: u32::from(*addr.ip()).to_be(),
+                },
+                sin_zero: [0; 8],
+            };
+            unsafe {
+                (storage as *mut libc::sockaddr_storage as *mut libc::sockaddr_in).write(sin)
+            };
+            mem::size_of::<libc::sockaddr_in>() as libc::socklen_t
+        }
+        SocketAddr::V6(addr) => {
+            let sin6 = libc::sockaddr_in6 {
+                sin6_family: libc::AF_INET6 as libc::sa_family_t,
+                sin6_port: addr.port().to_be(),
+                sin6_flowinfo: addr.flowinfo(),
+                sin6_addr: libc::in6_addr {
+                    s6_addr: addr.ip().octets(),
+                },
+                sin6_scope_id: addr.scope_id(),
+            };
+            unsafe {
+                (storage as *mut libc::sockaddr_storage as *mut libc::sockaddr_in6).write(sin6)
+            };
+            mem::size_of::<libc::sockaddr_in6>() as libc::socklen_t
+        }
+    }
+}
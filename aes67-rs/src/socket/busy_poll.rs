@@ -0,0 +1,71 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Socket options for the low latency receive modes, see [ReceiveMode].
+
+use crate::receiver::config::ReceiveMode;
+use socket2::Socket;
+use std::{io, mem, os::fd::AsRawFd};
+use tracing::{info, warn};
+
+fn set_int_option(socket: &Socket, name: libc::c_int, value: libc::c_int) -> io::Result<()> {
+    let res = unsafe {
+        libc::setsockopt(
+            socket.as_raw_fd(),
+            libc::SOL_SOCKET,
+            name,
+            &value as *const libc::c_int as *const libc::c_void,
+            mem::size_of::<libc::c_int>() as libc::socklen_t,
+        )
+    };
+    if res < 0 {
+        Err(io::Error::last_os_error())
+    } else {
+        Ok(())
+    }
+}
+
+/// Configures a receive socket for the given mode. Busy polling degrades gracefully, options the kernel
+/// rejects (e.g. without `CAP_NET_ADMIN` or on kernels older than 5.11) are logged and skipped.
+pub fn apply_receive_mode(socket: &Socket, mode: &ReceiveMode) -> io::Result<()> {
+    match mode {
+        ReceiveMode::Blocking => {}
+        ReceiveMode::BusyPoll {
+            busy_poll_micros,
+            budget,
+            prefer,
+        } => {
+            if let Err(e) = set_int_option(socket, libc::SO_BUSY_POLL, *busy_poll_micros as i32) {
+                warn!("Could not enable busy polling: {e}");
+                return Ok(());
+            }
+            if *prefer && let Err(e) = set_int_option(socket, libc::SO_PREFER_BUSY_POLL, 1) {
+                warn!("Could not prefer busy polling: {e}");
+            }
+            if let Some(budget) = budget
+                && let Err(e) = set_int_option(socket, libc::SO_BUSY_POLL_BUDGET, *budget as i32)
+            {
+                warn!("Could not set busy poll budget: {e}");
+            }
+            info!("Busy polling receive socket for {busy_poll_micros} µs");
+        }
+        ReceiveMode::Spin { .. } => {
+            socket.set_nonblocking(true)?;
+        }
+    }
+    Ok(())
+}
@@ -0,0 +1,358 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Classic BPF programs that drop packets which can't belong to a receiver's RTP stream in the kernel, before
+//! they wake up the receiver thread.
+
+use crate::receiver::config::ReceiverConfig;
+use std::{io, mem, os::fd::RawFd};
+
+/// Offset of the RTP header in the packet data seen by a socket filter of a UDP socket
+const RTP_OFFSET: u32 = 8;
+/// UDP header plus fixed RTP header
+const MIN_HEADER_LEN: u32 = RTP_OFFSET + 12;
+
+const BPF_LD: u16 = 0x00;
+const BPF_LDX: u16 = 0x01;
+const BPF_ALU: u16 = 0x04;
+const BPF_JMP: u16 = 0x05;
+const BPF_RET: u16 = 0x06;
+const BPF_MISC: u16 = 0x07;
+const BPF_W: u16 = 0x00;
+const BPF_B: u16 = 0x10;
+const BPF_ABS: u16 = 0x20;
+const BPF_LEN: u16 = 0x80;
+const BPF_IMM: u16 = 0x00;
+const BPF_ADD: u16 = 0x00;
+const BPF_SUB: u16 = 0x10;
+const BPF_AND: u16 = 0x50;
+const BPF_LSH: u16 = 0x60;
+const BPF_MOD: u16 = 0x90;
+const BPF_JEQ: u16 = 0x10;
+const BPF_JGT: u16 = 0x20;
+const BPF_JGE: u16 = 0x30;
+const BPF_JSET: u16 = 0x40;
+const BPF_K: u16 = 0x00;
+const BPF_X: u16 = 0x08;
+const BPF_TAX: u16 = 0x00;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Jump {
+    Next,
+    Accept,
+    Drop,
+}
+
+#[derive(Debug, Clone, Copy)]
+struct Insn {
+    code: u16,
+    jt: Jump,
+    jf: Jump,
+    k: u32,
+}
+
+impl Insn {
+    fn stmt(code: u16, k: u32) -> Self {
+        Self {
+            code,
+            jt: Jump::Next,
+            jf: Jump::Next,
+            k,
+        }
+    }
+
+    fn jump(code: u16, k: u32, jt: Jump, jf: Jump) -> Self {
+        Self { code, jt, jf, k }
+    }
+}
+
+/// Describes the packets a receiver socket accepts. Only RTP version 2 packets pass, optionally restricted to
+/// a payload type and an SSRC. Packets without padding or header extension must carry a whole number of
+/// frames.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct RtpFilter {
+    pub payload_type: Option<u8>,
+    pub ssrc: Option<u32>,
+    pub bytes_per_frame: usize,
+}
+
+impl RtpFilter {
+    pub fn new(config: &ReceiverConfig) -> Self {
+        Self {
+            payload_type: config.payload_type,
+            ssrc: None,
+            bytes_per_frame: config.audio_format.frame_format.bytes_per_frame(),
+        }
+    }
+
+    pub fn with_ssrc(&self, ssrc: Option<u32>) -> Self {
+        Self {
+            ssrc,
+            ..self.clone()
+        }
+    }
+
+    fn instructions(&self) -> Vec<Insn> {
+        let mut prog = vec![
+            Insn::stmt(BPF_LD | BPF_W | BPF_LEN, 0),
+            Insn::jump(
+                BPF_JMP | BPF_JGE | BPF_K,
+                MIN_HEADER_LEN,
+                Jump::Next,
+                Jump::Drop,
+            ),
+            // version 2
+            Insn::stmt(BPF_LD | BPF_B | BPF_ABS, RTP_OFFSET),
+            Insn::stmt(BPF_ALU | BPF_AND | BPF_K, 0xc0),
+            Insn::jump(BPF_JMP | BPF_JEQ | BPF_K, 0x80, Jump::Next, Jump::Drop),
+        ];
+
+        if let Some(pt) = self.payload_type {
+            prog.extend([
+                Insn::stmt(BPF_LD | BPF_B | BPF_ABS, RTP_OFFSET + 1),
+                Insn::stmt(BPF_ALU | BPF_AND | BPF_K, 0x7f),
+                Insn::jump(BPF_JMP | BPF_JEQ | BPF_K, pt as u32, Jump::Next, Jump::Drop),
+            ]);
+        }
+
+        if let Some(ssrc) = self.ssrc {
+            prog.extend([
+                // absolute word loads are in network byte order
+                Insn::stmt(BPF_LD | BPF_W | BPF_ABS, RTP_OFFSET + 8),
+                Insn::jump(BPF_JMP | BPF_JEQ | BPF_K, ssrc, Jump::Next, Jump::Drop),
+            ]);
+        }
+
+        if self.bytes_per_frame > 1 {
+            prog.extend([
+                // the payload length of packets with padding or header extension is left to userspace
+                Insn::stmt(BPF_LD | BPF_B | BPF_ABS, RTP_OFFSET),
+                Insn::jump(BPF_JMP | BPF_JSET | BPF_K, 0x30, Jump::Accept, Jump::Next),
+                // X = header length including CSRCs
+                Insn::stmt(BPF_ALU | BPF_AND | BPF_K, 0x0f),
+                Insn::stmt(BPF_ALU | BPF_LSH | BPF_K, 2),
+                Insn::stmt(BPF_ALU | BPF_ADD | BPF_K, MIN_HEADER_LEN),
+                Insn::stmt(BPF_MISC | BPF_TAX, 0),
+                Insn::stmt(BPF_LD | BPF_W | BPF_LEN, 0),
+                Insn::jump(BPF_JMP | BPF_JGT | BPF_X, 0, Jump::Next, Jump::Drop),
+                Insn::stmt(BPF_ALU | BPF_SUB | BPF_X, 0),
+                Insn::stmt(BPF_ALU | BPF_MOD | BPF_K, self.bytes_per_frame as u32),
+                Insn::jump(BPF_JMP | BPF_JEQ | BPF_K, 0, Jump::Accept, Jump::Drop),
+            ]);
+        }
+
+        prog
+    }
+
+    /// Assembles the filter into a cBPF program that ends with an accept and a drop instruction.
+    pub fn program(&self) -> Vec<libc::sock_filter> {
+        let insns = self.instructions();
+        let accept = insns.len();
+        let drop = accept + 1;
+        let offset = |i: usize, jump: Jump| match jump {
+            Jump::Next => 0,
+            Jump::Accept => (accept - i - 1) as u8,
+            Jump::Drop => (drop - i - 1) as u8,
+        };
+
+        insns
+            .iter()
+            .enumerate()
+            .map(|(i, insn)| libc::sock_filter {
+                code: insn.code,
+                jt: offset(i, insn.jt),
+                jf: offset(i, insn.jf),
+                k: insn.k,
+            })
+            .chain([
+                libc::sock_filter {
+                    code: BPF_RET | BPF_K,
+                    jt: 0,
+                    jf: 0,
+                    k: u32::MAX,
+                },
+                libc::sock_filter {
+                    code: BPF_RET | BPF_K,
+                    jt: 0,
+                    jf: 0,
+                    k: 0,
+                },
+            ])
+            .collect()
+    }
+
+    /// Attaches the filter to a socket, replacing any filter that was attached before.
+    pub fn attach(&self, fd: RawFd) -> io::Result<()> {
+        let mut program = self.program();
+        let prog = libc::sock_fprog {
+            len: program.len() as u16,
+            filter: program.as_mut_ptr(),
+        };
+        let res = unsafe {
+            libc::setsockopt(
+                fd,
+                libc::SOL_SOCKET,
+                libc::SO_ATTACH_FILTER,
+                &prog as *const libc::sock_fprog as *const libc::c_void,
+                mem::size_of::<libc::sock_fprog>() as libc::socklen_t,
+            )
+        };
+        if res < 0 {
+            Err(io::Error::last_os_error())
+        } else {
+            Ok(())
+        }
+    }
+}
+
+/// Number of packets the kernel dropped on this socket, either because of a socket filter or because the
+/// receive buffer was full (`SK_MEMINFO_DROPS`).
+pub fn socket_drops(fd: RawFd) -> io::Result<u32> {
+    const SK_MEMINFO_DROPS: usize = 8;
+    const SK_MEMINFO_VARS: usize = 9;
+    let mut meminfo = [0u32; SK_MEMINFO_VARS];
+    let mut len = mem::size_of_val(&meminfo) as libc::socklen_t;
+    let res = unsafe {
+        libc::getsockopt(
+            fd,
+            libc::SOL_SOCKET,
+            libc::SO_MEMINFO,
+            meminfo.as_mut_ptr() as *mut libc::c_void,
+            &mut len,
+        )
+    };
+    if res < 0 {
+        return Err(io::Error::last_os_error());
+    }
+    if (len as usize) < (SK_MEMINFO_DROPS + 1) * mem::size_of::<u32>() {
+        return Err(io::Error::new(
+            io::ErrorKind::Unsupported,
+            "kernel does not report socket drops",
+        ));
+    }
+    Ok(meminfo[SK_MEMINFO_DROPS])
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    /// Runs a program on a packet the way the kernel does, returns whether it is accepted.
+    fn run(program: &[libc::sock_filter], packet: &[u8]) -> bool {
+        let (mut a, mut x) = (0u32, 0u32);
+        let mut pc = 0;
+        loop {
+            let insn = program[pc];
+            let operand = if insn.code & BPF_X != 0 { x } else { insn.k };
+            pc += 1;
+            match insn.code & 0x07 {
+                BPF_LD if insn.code & BPF_LEN != 0 => a = packet.len() as u32,
+                BPF_LD => {
+                    let size = if insn.code & BPF_B != 0 { 1 } else { 4 };
+                    let Some(bytes) = packet.get(insn.k as usize..insn.k as usize + size) else {
+                        return false;
+                    };
+                    a = bytes.iter().fold(0, |a, b| a << 8 | *b as u32);
+                }
+                BPF_ALU => {
+                    a = match insn.code & 0xf0 {
+                        BPF_ADD => a.wrapping_add(operand),
+                        BPF_SUB => a.wrapping_sub(operand),
+                        BPF_AND => a & operand,
+                        BPF_LSH => a << operand,
+                        BPF_MOD => a % operand,
+                        op => panic!("unexpected ALU operation {op:#x}"),
+                    }
+                }
+                BPF_MISC => x = a,
+                BPF_JMP => {
+                    let taken = match insn.code & 0xf0 {
+                        BPF_JEQ => a == operand,
+                        BPF_JGT => a > operand,
+                        BPF_JGE => a >= operand,
+                        BPF_JSET => a & operand != 0,
+                        op => panic!("unexpected jump {op:#x}"),
+                    };
+                    pc += if taken { insn.jt } else { insn.jf } as usize;
+                }
+                BPF_RET => return insn.k != 0,
+                class => panic!("unexpected instruction class {class:#x}"),
+            }
+        }
+    }
+
+    fn packet(first_byte: u8, payload_type: u8, ssrc: u32, payload_len: usize) -> Vec<u8> {
+        let mut packet = vec![0; RTP_OFFSET as usize];
+        packet.extend_from_slice(&[first_byte, payload_type, 0, 1, 0, 0, 0, 48]);
+        packet.extend_from_slice(&ssrc.to_be_bytes());
+        packet.resize(packet.len() + payload_len, 0);
+        packet
+    }
+
+    #[test]
+    fn jumps_stay_in_program() {
+        for payload_type in [None, Some(98)] {
+            for ssrc in [None, Some(0x1234_5678)] {
+                for bytes_per_frame in [1, 6] {
+                    let program = RtpFilter {
+                        payload_type,
+                        ssrc,
+                        bytes_per_frame,
+                    }
+                    .program();
+                    let len = program.len();
+                    assert_eq!(BPF_RET | BPF_K, program[len - 2].code);
+                    assert_eq!(u32::MAX, program[len - 2].k);
+                    assert_eq!(BPF_RET | BPF_K, program[len - 1].code);
+                    assert_eq!(0, program[len - 1].k);
+                    for (i, insn) in program.iter().enumerate() {
+                        if insn.code & 0x07 == BPF_JMP {
+                            assert!(i + 1 + (insn.jt as usize) < len);
+                            assert!(i + 1 + (insn.jf as usize) < len);
+                        } else if insn.code & 0x07 != BPF_RET {
+                            assert!(i + 1 < len);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn program_accepts_only_matching_packets() {
+        let program = RtpFilter {
+            payload_type: Some(98),
+            ssrc: Some(0x1234_5678),
+            bytes_per_frame: 6,
+        }
+        .program();
+
+        assert!(run(&program, &packet(0x80, 98, 0x1234_5678, 288)));
+        // marker bit
+        assert!(run(&program, &packet(0x80, 0x80 | 98, 0x1234_5678, 288)));
+        // padding, the payload length is checked in userspace
+        assert!(run(&program, &packet(0xa0, 98, 0x1234_5678, 289)));
+
+        assert!(!run(&program, &packet(0x80, 98, 0x1234_5678, 287)));
+        assert!(!run(&program, &packet(0x40, 98, 0x1234_5678, 288)));
+        assert!(!run(&program, &packet(0x80, 97, 0x1234_5678, 288)));
+        assert!(!run(&program, &packet(0x80, 98, 0x1234_5679, 288)));
+        // CSRCs longer than the packet
+        assert!(!run(&program, &packet(0x8f, 98, 0x1234_5678, 48)));
+        assert!(!run(&program, &[0x80; 12]));
+    }
+}
@@ -0,0 +1,558 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! io_uring receive path. A single multishot `recvmsg` request stays armed on the socket and the kernel writes
+//! every datagram straight into a buffer from a registered provided buffer ring, so receiving a packet only
+//! costs a syscall when the receiver has to wait for one. The buffer a packet was written to is handed out as
+//! a [Datagram] and returned to the ring with [PacketSource::release] once the packet has been processed.
+//!
+//! Requires Linux 6.0 (multishot `recvmsg`), [create_rx_socket](super::create_rx_socket) falls back to a
+//! plain socket if the ring can't be set up.
+
+use super::{
+    Datagram, MAX_DATAGRAM_SIZE, PacketSource, RtpFilter, RxBatch, filter,
+    mmap::Mmap,
+    timestamp::{rx_timestamp, to_socket_addr},
+};
+use std::{
+    io,
+    marker::PhantomData,
+    mem,
+    net::UdpSocket,
+    os::fd::{AsRawFd, FromRawFd, OwnedFd, RawFd},
+    ptr,
+    sync::atomic::{AtomicU16, AtomicU32, Ordering},
+    time::Duration,
+};
+
+const IORING_OFF_SQ_RING: libc::off_t = 0;
+const IORING_OFF_SQES: libc::off_t = 0x10000000;
+const IORING_FEAT_SINGLE_MMAP: u32 = 1 << 0;
+const IORING_FEAT_EXT_ARG: u32 = 1 << 8;
+const IORING_ENTER_GETEVENTS: u32 = 1 << 0;
+const IORING_ENTER_EXT_ARG: u32 = 1 << 3;
+const IORING_REGISTER_PBUF_RING: u32 = 22;
+const IORING_OP_RECVMSG: u8 = 10;
+const IORING_RECV_MULTISHOT: u16 = 1 << 1;
+const IOSQE_BUFFER_SELECT: u8 = 1 << 5;
+const IORING_CQE_F_BUFFER: u32 = 1 << 0;
+const IORING_CQE_F_MORE: u32 = 1 << 1;
+const IORING_CQE_BUFFER_SHIFT: u32 = 16;
+
+const SUBMISSION_ENTRIES: u32 = 4;
+const BUFFER_GROUP: u16 = 0;
+/// Number of provided buffers, must be a power of two
+const BUFFER_COUNT: u16 = 256;
+const CONTROL_LEN: usize = 64;
+/// Size of a provided buffer, the [RecvmsgOut] header, source address and control messages come before the
+/// payload. Datagrams that don't fit are dropped.
+const BUFFER_SIZE: usize = mem::size_of::<RecvmsgOut>()
+    + mem::size_of::<libc::sockaddr_storage>()
+    + CONTROL_LEN
+    + MAX_DATAGRAM_SIZE;
+/// Same as the read timeout of plain receive sockets, so the receiver loop checks for API messages as often
+const RECV_TIMEOUT: Duration = Duration::from_millis(100);
+
+#[repr(C)]
+#[derive(Default)]
+struct SqringOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    flags: u32,
+    dropped: u32,
+    array: u32,
+    resv1: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct CqringOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    overflow: u32,
+    cqes: u32,
+    flags: u32,
+    resv1: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct Params {
+    sq_entries: u32,
+    cq_entries: u32,
+    flags: u32,
+    sq_thread_cpu: u32,
+    sq_thread_idle: u32,
+    features: u32,
+    wq_fd: u32,
+    resv: [u32; 3],
+    sq_off: SqringOffsets,
+    cq_off: CqringOffsets,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct Sqe {
+    opcode: u8,
+    flags: u8,
+    ioprio: u16,
+    fd: i32,
+    off: u64,
+    addr: u64,
+    len: u32,
+    msg_flags: u32,
+    user_data: u64,
+    buf_group: u16,
+    personality: u16,
+    splice_fd_in: i32,
+    addr3: u64,
+    pad: u64,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct Cqe {
+    user_data: u64,
+    res: i32,
+    flags: u32,
+}
+
+#[repr(C)]
+struct BufReg {
+    ring_addr: u64,
+    ring_entries: u32,
+    bgid: u16,
+    flags: u16,
+    resv: [u64; 3],
+}
+
+#[repr(C)]
+struct Buf {
+    addr: u64,
+    len: u32,
+    bid: u16,
+    resv: u16,
+}
+
+/// Header the kernel writes at the start of every provided buffer used by a multishot `recvmsg`
+#[repr(C)]
+struct RecvmsgOut {
+    namelen: u32,
+    controllen: u32,
+    payloadlen: u32,
+    flags: u32,
+}
+
+#[repr(C)]
+struct GeteventsArg {
+    sigmask: u64,
+    sigmask_sz: u32,
+    min_wait_usec: u32,
+    ts: u64,
+}
+
+#[repr(C)]
+struct KernelTimespec {
+    tv_sec: i64,
+    tv_nsec: i64,
+}
+
+/// UDP socket that receives through io_uring. See the module documentation.
+pub struct UringRxSocket {
+    // the ring must be closed before the memory the kernel writes to is unmapped, fields are dropped in order
+    ring: OwnedFd,
+    socket: UdpSocket,
+    rings: Mmap,
+    sqes: Mmap,
+    sq_off: SqringOffsets,
+    cq_off: CqringOffsets,
+    buf_ring: Mmap,
+    buffers: Mmap,
+    /// template for the multishot request, the kernel only reads the name and control lengths from it
+    msghdr: Box<libc::msghdr>,
+    armed: bool,
+    /// buffers handed out as datagrams that have not been recycled yet
+    lent: u16,
+    /// datagrams dropped because they did not fit into a buffer
+    truncated: u32,
+    wait: bool,
+}
+
+// the raw pointers only point into memory owned by the socket
+unsafe impl Send for UringRxSocket {}
+
+impl std::fmt::Debug for UringRxSocket {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("UringRxSocket")
+            .field("socket", &self.socket)
+            .field("armed", &self.armed)
+            .finish()
+    }
+}
+
+fn check(res: libc::c_long) -> io::Result<libc::c_long> {
+    if res < 0 {
+        Err(io::Error::last_os_error())
+    } else {
+        Ok(res)
+    }
+}
+
+impl UringRxSocket {
+    /// Sets up a ring for the socket. If `wait` is false, receiving never blocks and returns
+    /// [io::ErrorKind::WouldBlock] if there is no packet, for spinning receivers.
+    pub fn new(socket: UdpSocket, wait: bool) -> io::Result<Self> {
+        let mut params = Params::default();
+        let fd = check(unsafe {
+            libc::syscall(
+                libc::SYS_io_uring_setup,
+                SUBMISSION_ENTRIES,
+                &mut params as *mut Params,
+            )
+        })?;
+        let ring = unsafe { OwnedFd::from_raw_fd(fd as RawFd) };
+
+        let required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG;
+        if params.features & required != required {
+            return Err(io::Error::new(
+                io::ErrorKind::Unsupported,
+                "kernel io_uring lacks required features",
+            ));
+        }
+
+        let sq_len = params.sq_off.array as usize + params.sq_entries as usize * 4;
+        let cq_len =
+            params.cq_off.cqes as usize + params.cq_entries as usize * mem::size_of::<Cqe>();
+        let rings = Mmap::ring(ring.as_raw_fd(), sq_len.max(cq_len), IORING_OFF_SQ_RING)?;
+        let sqes = Mmap::ring(
+            ring.as_raw_fd(),
+            params.sq_entries as usize * mem::size_of::<Sqe>(),
+            IORING_OFF_SQES,
+        )?;
+
+        let buf_ring = Mmap::anonymous(BUFFER_COUNT as usize * mem::size_of::<Buf>())?;
+        let buffers = Mmap::anonymous(BUFFER_COUNT as usize * BUFFER_SIZE)?;
+        let reg = BufReg {
+            ring_addr: buf_ring.ptr as u64,
+            ring_entries: BUFFER_COUNT as u32,
+            bgid: BUFFER_GROUP,
+            flags: 0,
+            resv: [0; 3],
+        };
+        check(unsafe {
+            libc::syscall(
+                libc::SYS_io_uring_register,
+                ring.as_raw_fd(),
+                IORING_REGISTER_PBUF_RING,
+                &reg as *const BufReg,
+                1,
+            )
+        })?;
+
+        let mut msghdr: Box<libc::msghdr> = Box::new(unsafe { mem::zeroed() });
+        msghdr.msg_namelen = mem::size_of::<libc::sockaddr_storage>() as libc::socklen_t;
+        msghdr.msg_controllen = CONTROL_LEN as _;
+
+        let mut uring = Self {
+            ring,
+            socket,
+            rings,
+            sqes,
+            sq_off: params.sq_off,
+            cq_off: params.cq_off,
+            buf_ring,
+            buffers,
+            msghdr,
+            armed: false,
+            lent: 0,
+            truncated: 0,
+            wait,
+        };
+        for bid in 0..BUFFER_COUNT {
+            uring.provide(bid);
+        }
+        Ok(uring)
+    }
+
+    /// Returns the next received packet. Its payload stays valid until it is passed to [UringRxSocket::recycle].
+    fn recv(&mut self, wait: bool) -> io::Result<Datagram<'static>> {
+        loop {
+            if !self.armed {
+                // every completion that consumed a buffer has been read once the request has ended, so the
+                // buffers that are not lent out are all back in the ring
+                if self.lent >= BUFFER_COUNT {
+                    return Err(if wait {
+                        io::ErrorKind::TimedOut
+                    } else {
+                        io::ErrorKind::WouldBlock
+                    }
+                    .into());
+                }
+                self.arm()?;
+            }
+
+            let Some(cqe) = self.next_completion() else {
+                if !wait {
+                    return Err(io::ErrorKind::WouldBlock.into());
+                }
+                self.wait_for_completion()?;
+                continue;
+            };
+
+            if cqe.flags & IORING_CQE_F_MORE == 0 {
+                self.armed = false;
+            }
+            if cqe.res < 0 {
+                if cqe.res == -libc::ENOBUFS {
+                    // all buffers were in use, the packets are still queued in the socket and picked up once
+                    // the request is re-armed
+                    continue;
+                }
+                return Err(io::Error::from_raw_os_error(-cqe.res));
+            }
+            if cqe.flags & IORING_CQE_F_BUFFER == 0 {
+                continue;
+            }
+
+            let bid = (cqe.flags >> IORING_CQE_BUFFER_SHIFT) as u16;
+            if self.header(bid).flags & libc::MSG_TRUNC as u32 != 0 {
+                // the rest of the payload is lost, playing out a partial packet would only produce noise
+                self.provide(bid);
+                self.truncated = self.truncated.wrapping_add(1);
+                continue;
+            }
+            return match self.parse(bid, cqe.res as usize) {
+                Ok(datagram) => {
+                    self.lent += 1;
+                    Ok(datagram)
+                }
+                Err(e) => {
+                    self.provide(bid);
+                    Err(e)
+                }
+            };
+        }
+    }
+
+    /// Hands the buffer of a datagram returned by [UringRxSocket::recv] back to the kernel.
+    fn recycle(&mut self, datagram: Datagram<'_>) {
+        if let Some(bid) = datagram.buffer {
+            self.provide(bid as u16);
+            self.lent -= 1;
+        }
+    }
+
+    fn buffer(&self, bid: u16) -> *mut u8 {
+        unsafe { self.buffers.ptr.add(bid as usize * BUFFER_SIZE) }
+    }
+
+    /// The kernel writes the header of every completion that consumed a buffer.
+    fn header(&self, bid: u16) -> RecvmsgOut {
+        unsafe { ptr::read_unaligned(self.buffer(bid) as *const RecvmsgOut) }
+    }
+
+    fn parse(&self, bid: u16, len: usize) -> io::Result<Datagram<'static>> {
+        let buf = self.buffer(bid);
+        let header_len = mem::size_of::<RecvmsgOut>();
+        let name_len = self.msghdr.msg_namelen as usize;
+        let payload_offset = header_len + name_len + CONTROL_LEN;
+        if len < payload_offset {
+            return Err(io::ErrorKind::InvalidData.into());
+        }
+
+        let out = self.header(bid);
+        let mut addr: libc::sockaddr_storage = unsafe { mem::zeroed() };
+        unsafe {
+            ptr::copy_nonoverlapping(
+                buf.add(header_len),
+                &mut addr as *mut libc::sockaddr_storage as *mut u8,
+                (out.namelen as usize).min(name_len),
+            )
+        };
+
+        let mut msg: libc::msghdr = unsafe { mem::zeroed() };
+        msg.msg_control = unsafe { buf.add(header_len + name_len) } as *mut libc::c_void;
+        msg.msg_controllen = out.controllen as _;
+
+        Ok(Datagram {
+            data: unsafe { buf.add(payload_offset) },
+            len: (out.payloadlen as usize).min(len - payload_offset),
+            addr: to_socket_addr(&addr)?,
+            timestamp: rx_timestamp(&msg),
+            buffer: Some(bid as u64),
+            _payload: PhantomData,
+        })
+    }
+
+    fn provide(&mut self, bid: u16) {
+        let mask = BUFFER_COUNT - 1;
+        // the tail shares its memory with the reserved field of the first entry
+        let tail = unsafe { &*self.buf_ring.at::<AtomicU16>(14) };
+        let index = tail.load(Ordering::Relaxed);
+        let entry = self
+            .buf_ring
+            .at::<Buf>(((index & mask) as usize * mem::size_of::<Buf>()) as u32);
+        unsafe {
+            (*entry).addr = self.buffer(bid) as u64;
+            (*entry).len = BUFFER_SIZE as u32;
+            (*entry).bid = bid;
+        }
+        tail.store(index.wrapping_add(1), Ordering::Release);
+    }
+
+    fn arm(&mut self) -> io::Result<()> {
+        let tail = unsafe { &*self.rings.at::<AtomicU32>(self.sq_off.tail) };
+        let mask = unsafe { *self.rings.at::<u32>(self.sq_off.ring_mask) };
+        let index = tail.load(Ordering::Relaxed);
+        let slot = index & mask;
+
+        let sqe = Sqe {
+            opcode: IORING_OP_RECVMSG,
+            flags: IOSQE_BUFFER_SELECT,
+            ioprio: IORING_RECV_MULTISHOT,
+            fd: self.socket.as_raw_fd(),
+            addr: &*self.msghdr as *const libc::msghdr as u64,
+            len: 1,
+            buf_group: BUFFER_GROUP,
+            ..Default::default()
+        };
+        unsafe {
+            self.sqes
+                .at::<Sqe>(slot * mem::size_of::<Sqe>() as u32)
+                .write(sqe);
+            self.rings
+                .at::<u32>(self.sq_off.array + slot * 4)
+                .write(slot);
+        }
+        tail.store(index.wrapping_add(1), Ordering::Release);
+
+        self.enter(1, 0, 0, ptr::null(), 0)?;
+        self.armed = true;
+        Ok(())
+    }
+
+    fn next_completion(&mut self) -> Option<Cqe> {
+        let head = unsafe { &*self.rings.at::<AtomicU32>(self.cq_off.head) };
+        let tail = unsafe { &*self.rings.at::<AtomicU32>(self.cq_off.tail) };
+        let mask = unsafe { *self.rings.at::<u32>(self.cq_off.ring_mask) };
+        let index = head.load(Ordering::Relaxed);
+        if index == tail.load(Ordering::Acquire) {
+            return None;
+        }
+        let cqe = unsafe {
+            *self
+                .rings
+                .at::<Cqe>(self.cq_off.cqes + (index & mask) * mem::size_of::<Cqe>() as u32)
+        };
+        head.store(index.wrapping_add(1), Ordering::Release);
+        Some(cqe)
+    }
+
+    fn wait_for_completion(&self) -> io::Result<()> {
+        let ts = KernelTimespec {
+            tv_sec: RECV_TIMEOUT.as_secs() as i64,
+            tv_nsec: RECV_TIMEOUT.subsec_nanos() as i64,
+        };
+        let arg = GeteventsArg {
+            sigmask: 0,
+            sigmask_sz: 0,
+            min_wait_usec: 0,
+            ts: &ts as *const KernelTimespec as u64,
+        };
+        match self.enter(
+            0,
+            1,
+            IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+            &arg as *const GeteventsArg as *const libc::c_void,
+            mem::size_of::<GeteventsArg>(),
+        ) {
+            Err(e) if e.raw_os_error() == Some(libc::ETIME) => Err(io::ErrorKind::TimedOut.into()),
+            Err(e) if e.kind() == io::ErrorKind::Interrupted => Ok(()),
+            res => res,
+        }
+    }
+
+    fn enter(
+        &self,
+        to_submit: u32,
+        min_complete: u32,
+        flags: u32,
+        arg: *const libc::c_void,
+        arg_len: usize,
+    ) -> io::Result<()> {
+        check(unsafe {
+            libc::syscall(
+                libc::SYS_io_uring_enter,
+                self.ring.as_raw_fd(),
+                to_submit,
+                min_complete,
+                flags,
+                arg,
+                arg_len,
+            )
+        })
+        .map(|_| ())
+    }
+}
+
+impl PacketSource for UringRxSocket {
+    fn recv_batch(&mut self, batch: &mut RxBatch) -> io::Result<usize> {
+        // a buffer is only provided to the kernel again after it was recycled, and stays mapped if the socket
+        // is dropped while it is lent out
+        unsafe { batch.push_lent(self.recv(self.wait)?) };
+        let mut received = 1;
+        while !batch.is_full() {
+            // errors other than running out of completions show up again on the next call
+            let Ok(datagram) = self.recv(false) else {
+                break;
+            };
+            unsafe { batch.push_lent(datagram) };
+            received += 1;
+        }
+        Ok(received)
+    }
+
+    fn release(&mut self, datagram: Datagram<'_>) {
+        self.recycle(datagram);
+    }
+
+    fn set_filter(&self, filter: &RtpFilter) -> io::Result<()> {
+        filter.attach(self.socket.as_raw_fd())
+    }
+
+    /// Packets dropped by the kernel and packets that did not fit into a buffer
+    fn drops(&self) -> Option<u32> {
+        filter::socket_drops(self.socket.as_raw_fd())
+            .ok()
+            .map(|drops| drops.wrapping_add(self.truncated))
+    }
+}
+
+impl Drop for UringRxSocket {
+    fn drop(&mut self) {
+        // datagrams that were not released yet still point into the buffers
+        if self.lent > 0 {
+            self.buffers.leak();
+        }
+    }
+}
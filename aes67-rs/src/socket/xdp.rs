@@ -0,0 +1,537 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! AF_XDP ingest for hosts that terminate many streams. An XDP program on the interface redirects the UDP
+//! packets of all registered streams into one AF_XDP socket per receive queue. A single ingest thread per
+//! interface demultiplexes the frames by destination address, port and SSRC and passes them to the receivers
+//! without copying, the receivers process them in place and hand the frames back afterwards.
+//!
+//! The receiver still creates its regular socket, so multicast groups are joined as usual and the receiver
+//! falls back to it if the ingest can't be set up. This needs `CAP_NET_ADMIN` and `CAP_BPF` and Linux 5.9 or
+//! newer. The path can be tried out on a veth pair, see `examples/xdp.rs`.
+
+mod program;
+mod xsk;
+
+use super::{Datagram, PacketSource, RtpFilter, RxBatch};
+use crossbeam::queue::ArrayQueue;
+use pnet::datalink::NetworkInterface;
+use program::XdpProgram;
+use std::{
+    collections::HashMap,
+    fs, io,
+    marker::PhantomData,
+    mem,
+    net::{IpAddr, Ipv4Addr, Ipv6Addr, SocketAddr, UdpSocket},
+    os::fd::AsRawFd,
+    sync::{
+        Arc, LazyLock, Mutex, Weak,
+        atomic::{AtomicBool, AtomicU32, AtomicU64, Ordering},
+        mpsc::{self, Receiver, RecvTimeoutError, Sender, SyncSender, TryRecvError, TrySendError},
+    },
+    thread::{self, JoinHandle},
+    time::{Duration, SystemTime},
+};
+use tracing::{info, warn};
+use xsk::Xsk;
+
+/// Maximum number of streams the XDP program redirects
+const MAX_STREAMS: u32 = 1024;
+/// Frames queued for a receiver before further packets of its stream are dropped
+const ROUTE_QUEUE: usize = 256;
+const POLL_TIMEOUT_MILLIS: libc::c_int = 10;
+/// Same as the read timeout of plain receive sockets, so the receiver loop checks for API messages as often
+const RECV_TIMEOUT: Duration = Duration::from_millis(100);
+const NO_SSRC: u64 = u64::MAX;
+
+static INGESTS: LazyLock<Mutex<HashMap<u32, Weak<XdpIngest>>>> = LazyLock::new(Mutex::default);
+
+/// A received frame on its way from the ingest thread to a receiver.
+struct Frame {
+    handle: u64,
+    data: *const u8,
+    len: usize,
+    src: SocketAddr,
+    received: SystemTime,
+}
+
+// the frame data lives in a UMEM that is kept alive by the receiver's reference to the ingest
+unsafe impl Send for Frame {}
+
+fn frame_handle(queue: usize, addr: u64) -> u64 {
+    (queue as u64) << 32 | addr
+}
+
+struct Route {
+    /// SSRC the receiver is locked to, [NO_SSRC] if it accepts any
+    ssrc: AtomicU64,
+    tx: SyncSender<Frame>,
+    drops: AtomicU32,
+}
+
+impl Route {
+    fn ssrc(&self) -> Option<u32> {
+        match self.ssrc.load(Ordering::Relaxed) {
+            NO_SSRC => None,
+            ssrc => Some(ssrc as u32),
+        }
+    }
+}
+
+enum Control {
+    Add(SocketAddr, Arc<Route>),
+    /// acknowledged once the ingest thread will no longer pass frames to the route
+    Remove(SocketAddr, Arc<Route>, SyncSender<()>),
+}
+
+/// The XDP program, AF_XDP sockets and ingest thread of one interface, shared by all its XDP receivers.
+struct XdpIngest {
+    ifname: String,
+    program: XdpProgram,
+    /// receivers per stream, the stream is removed from the XDP program when the last one is gone
+    streams: Mutex<HashMap<SocketAddr, usize>>,
+    control: Sender<Control>,
+    /// frames handed back by the receivers, it can hold every frame of the UMEM, so returning a frame never
+    /// fails or allocates
+    recycle: Arc<ArrayQueue<u64>>,
+    exit: Arc<AtomicBool>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl XdpIngest {
+    fn get_or_start(iface: &NetworkInterface) -> io::Result<Arc<Self>> {
+        let mut ingests = INGESTS.lock().expect("XDP ingest registry poisoned");
+        if let Some(ingest) = ingests.get(&iface.index).and_then(Weak::upgrade) {
+            return Ok(ingest);
+        }
+        let ingest = Arc::new(Self::start(iface)?);
+        ingests.insert(iface.index, Arc::downgrade(&ingest));
+        Ok(ingest)
+    }
+
+    fn start(iface: &NetworkInterface) -> io::Result<Self> {
+        let queues = rx_queues(&iface.name);
+        let program = XdpProgram::attach(iface.index, MAX_STREAMS, queues)?;
+        let mut xsks = Vec::with_capacity(queues as usize);
+        for queue in 0..queues {
+            let xsk = Xsk::bind(iface.index, queue)?;
+            program.set_socket(queue, xsk.as_raw_fd())?;
+            xsks.push(xsk);
+        }
+        info!(
+            "XDP ingest on {} with {} queue(s) in {} mode",
+            iface.name,
+            queues,
+            if xsks.iter().all(Xsk::zero_copy) {
+                "zero-copy"
+            } else {
+                "copy"
+            }
+        );
+
+        let (control_tx, control_rx) = mpsc::channel();
+        let recycle = Arc::new(ArrayQueue::new(xsk::FRAME_COUNT as usize * queues as usize));
+        let exit = Arc::new(AtomicBool::new(false));
+        let demux = Demux {
+            xsks,
+            routes: HashMap::new(),
+            control: control_rx,
+            recycle: recycle.clone(),
+            unrouted: Vec::new(),
+        };
+        let thread_exit = exit.clone();
+        let thread = thread::Builder::new()
+            .name(format!("xdp-{}", iface.name))
+            .spawn(move || demux.run(&thread_exit))?;
+
+        Ok(Self {
+            ifname: iface.name.clone(),
+            program,
+            streams: Mutex::default(),
+            control: control_tx,
+            recycle,
+            exit,
+            thread: Some(thread),
+        })
+    }
+
+    fn register(&self, dst: SocketAddr, route: Arc<Route>) -> io::Result<()> {
+        let mut streams = self.streams.lock().expect("XDP stream table poisoned");
+        self.control.send(Control::Add(dst, route)).ok();
+        let count = streams.entry(dst).or_default();
+        if *count == 0 {
+            self.program.add_stream(dst)?;
+        }
+        *count += 1;
+        Ok(())
+    }
+
+    /// Removes the route and waits until the ingest thread has dropped it, so no more frames are queued for it.
+    fn unregister(&self, dst: SocketAddr, route: Arc<Route>) {
+        let mut streams = self.streams.lock().expect("XDP stream table poisoned");
+        if let Some(count) = streams.get_mut(&dst) {
+            *count -= 1;
+            if *count == 0 {
+                streams.remove(&dst);
+                if let Err(e) = self.program.remove_stream(dst) {
+                    warn!("Could not remove stream {dst} from XDP program: {e}");
+                }
+            }
+        }
+        let (ack_tx, ack_rx) = mpsc::sync_channel(1);
+        self.control.send(Control::Remove(dst, route, ack_tx)).ok();
+        drop(streams);
+        // fails right away if the ingest thread is gone, which drops the message with the sender
+        ack_rx.recv().ok();
+    }
+}
+
+impl Drop for XdpIngest {
+    fn drop(&mut self) {
+        self.exit.store(true, Ordering::Release);
+        if let Some(thread) = self.thread.take() {
+            thread.join().ok();
+        }
+        info!("XDP ingest on {} stopped", self.ifname);
+    }
+}
+
+/// Number of receive queues of an interface, each gets its own AF_XDP socket.
+fn rx_queues(ifname: &str) -> u32 {
+    fs::read_dir(format!("/sys/class/net/{ifname}/queues"))
+        .map(|dir| {
+            dir.filter_map(Result::ok)
+                .filter(|it| it.file_name().to_string_lossy().starts_with("rx-"))
+                .count() as u32
+        })
+        .unwrap_or_default()
+        .max(1)
+}
+
+/// State of the ingest thread.
+struct Demux {
+    xsks: Vec<Xsk>,
+    routes: HashMap<SocketAddr, Vec<Arc<Route>>>,
+    control: Receiver<Control>,
+    recycle: Arc<ArrayQueue<u64>>,
+    /// frames that were not passed to a receiver in the current batch
+    unrouted: Vec<u64>,
+}
+
+impl Demux {
+    fn run(mut self, exit: &AtomicBool) {
+        let mut fds: Vec<libc::pollfd> = self
+            .xsks
+            .iter()
+            .map(|xsk| libc::pollfd {
+                fd: xsk.as_raw_fd(),
+                events: libc::POLLIN,
+                revents: 0,
+            })
+            .collect();
+
+        while !exit.load(Ordering::Acquire) {
+            self.handle_control();
+            self.recycle();
+
+            let res = unsafe {
+                libc::poll(
+                    fds.as_mut_ptr(),
+                    fds.len() as libc::nfds_t,
+                    POLL_TIMEOUT_MILLIS,
+                )
+            };
+            if res <= 0 {
+                continue;
+            }
+
+            let received = SystemTime::now();
+            for (queue, fd) in fds.iter().enumerate() {
+                if fd.revents & libc::POLLIN == 0 {
+                    continue;
+                }
+                let Self {
+                    xsks,
+                    routes,
+                    unrouted,
+                    ..
+                } = &mut self;
+                xsks[queue].receive(|addr, data| {
+                    let handle = frame_handle(queue, addr);
+                    if !dispatch(routes, handle, data, received) {
+                        unrouted.push(handle);
+                    }
+                });
+                self.recycle();
+                for handle in self.unrouted.drain(..) {
+                    self.xsks[queue].refill(handle as u32 as u64);
+                }
+            }
+        }
+    }
+
+    fn handle_control(&mut self) {
+        loop {
+            match self.control.try_recv() {
+                Ok(Control::Add(dst, route)) => self.routes.entry(dst).or_default().push(route),
+                Ok(Control::Remove(dst, route, ack)) => {
+                    if let Some(routes) = self.routes.get_mut(&dst) {
+                        routes.retain(|it| !Arc::ptr_eq(it, &route));
+                        if routes.is_empty() {
+                            self.routes.remove(&dst);
+                        }
+                    }
+                    ack.send(()).ok();
+                }
+                Err(TryRecvError::Empty | TryRecvError::Disconnected) => break,
+            }
+        }
+    }
+
+    /// Returns the frames the receivers are done with to the fill rings.
+    fn recycle(&mut self) {
+        while let Some(handle) = self.recycle.pop() {
+            let queue = (handle >> 32) as usize;
+            if let Some(xsk) = self.xsks.get_mut(queue) {
+                xsk.refill(handle as u32 as u64);
+            }
+        }
+    }
+}
+
+/// Passes a frame to the receiver of its stream. Returns false if the frame was not taken.
+fn dispatch(
+    routes: &HashMap<SocketAddr, Vec<Arc<Route>>>,
+    handle: u64,
+    data: &[u8],
+    received: SystemTime,
+) -> bool {
+    let Some(packet) = parse_udp(data) else {
+        return false;
+    };
+    let Some(routes) = routes.get(&packet.dst) else {
+        return false;
+    };
+    let payload = &data[packet.payload.0..packet.payload.1];
+    let ssrc = payload
+        .get(8..12)
+        .map(|it| u32::from_be_bytes([it[0], it[1], it[2], it[3]]));
+    // a receiver locked to the packet's SSRC takes precedence over one that still accepts any
+    let Some(route) = routes
+        .iter()
+        .find(|r| ssrc.is_some() && r.ssrc() == ssrc)
+        .or_else(|| routes.iter().find(|r| r.ssrc().is_none()))
+    else {
+        return false;
+    };
+
+    let frame = Frame {
+        handle,
+        data: payload.as_ptr(),
+        len: payload.len(),
+        src: packet.src,
+        received,
+    };
+    match route.tx.try_send(frame) {
+        Ok(()) => true,
+        Err(TrySendError::Full(_) | TrySendError::Disconnected(_)) => {
+            route.drops.fetch_add(1, Ordering::Relaxed);
+            false
+        }
+    }
+}
+
+struct UdpPacket {
+    src: SocketAddr,
+    dst: SocketAddr,
+    payload: (usize, usize),
+}
+
+/// Parses the Ethernet, IP and UDP headers of a frame redirected by the XDP program.
+fn parse_udp(data: &[u8]) -> Option<UdpPacket> {
+    let be16 = |offset: usize| -> Option<u16> {
+        data.get(offset..offset + 2)
+            .map(|it| u16::from_be_bytes([it[0], it[1]]))
+    };
+    let (src, dst, udp) = match be16(12)? {
+        0x0800 => {
+            let header = data.get(14..34)?;
+            let ihl = (header[0] & 0x0f) as usize * 4;
+            let src: [u8; 4] = header[12..16].try_into().ok()?;
+            let dst: [u8; 4] = header[16..20].try_into().ok()?;
+            (
+                IpAddr::V4(Ipv4Addr::from(src)),
+                IpAddr::V4(Ipv4Addr::from(dst)),
+                14 + ihl,
+            )
+        }
+        0x86dd => {
+            let header = data.get(14..54)?;
+            let src: [u8; 16] = header[8..24].try_into().ok()?;
+            let dst: [u8; 16] = header[24..40].try_into().ok()?;
+            (
+                IpAddr::V6(Ipv6Addr::from(src)),
+                IpAddr::V6(Ipv6Addr::from(dst)),
+                54,
+            )
+        }
+        _ => return None,
+    };
+    let len = be16(udp + 4)? as usize;
+    let end = (udp + len).min(data.len());
+    let start = udp + 8;
+    if end < start {
+        return None;
+    }
+    Some(UdpPacket {
+        src: SocketAddr::new(src, be16(udp)?),
+        dst: SocketAddr::new(dst, be16(udp + 2)?),
+        payload: (start, end),
+    })
+}
+
+/// Receive socket of a receiver that gets its packets from the AF_XDP ingest of its interface.
+pub struct XdpRxSocket {
+    // keeps the multicast group joined so the NIC accepts the stream's traffic
+    socket: UdpSocket,
+    dst: SocketAddr,
+    route: Arc<Route>,
+    rx: Receiver<Frame>,
+    wait: bool,
+    /// frames handed out as datagrams that have not been released yet
+    lent: usize,
+    // dropped last, the frames of the receiver live in the ingest's UMEM
+    ingest: Arc<XdpIngest>,
+}
+
+impl std::fmt::Debug for XdpRxSocket {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("XdpRxSocket")
+            .field("socket", &self.socket)
+            .field("dst", &self.dst)
+            .finish()
+    }
+}
+
+impl XdpRxSocket {
+    /// Registers the stream sent to `dst` with the ingest of the interface, starting the ingest if this is the
+    /// first XDP receiver on it. If `wait` is false, receiving never blocks, for spinning receivers.
+    pub fn new(
+        socket: UdpSocket,
+        iface: &NetworkInterface,
+        dst: SocketAddr,
+        wait: bool,
+    ) -> io::Result<Self> {
+        let ingest = XdpIngest::get_or_start(iface)?;
+        let (tx, rx) = mpsc::sync_channel(ROUTE_QUEUE);
+        let route = Arc::new(Route {
+            ssrc: AtomicU64::new(NO_SSRC),
+            tx,
+            drops: AtomicU32::new(0),
+        });
+        ingest.register(dst, route.clone())?;
+        Ok(Self {
+            socket,
+            dst,
+            route,
+            rx,
+            wait,
+            lent: 0,
+            ingest,
+        })
+    }
+
+    fn recv(&mut self, wait: bool) -> io::Result<Datagram<'static>> {
+        let frame = if wait {
+            self.rx.recv_timeout(RECV_TIMEOUT).map_err(|e| match e {
+                RecvTimeoutError::Timeout => io::Error::from(io::ErrorKind::TimedOut),
+                RecvTimeoutError::Disconnected => io::ErrorKind::BrokenPipe.into(),
+            })?
+        } else {
+            self.rx.try_recv().map_err(|e| match e {
+                TryRecvError::Empty => io::Error::from(io::ErrorKind::WouldBlock),
+                TryRecvError::Disconnected => io::ErrorKind::BrokenPipe.into(),
+            })?
+        };
+        self.lent += 1;
+        Ok(Datagram {
+            data: frame.data,
+            len: frame.len,
+            addr: frame.src,
+            timestamp: Some(frame.received),
+            buffer: Some(frame.handle),
+            _payload: PhantomData,
+        })
+    }
+}
+
+impl PacketSource for XdpRxSocket {
+    fn recv_batch(&mut self, batch: &mut RxBatch) -> io::Result<usize> {
+        // the ingest only refills a frame after it was recycled, and the UMEM outlives frames that are still
+        // lent out when the socket is dropped
+        unsafe { batch.push_lent(self.recv(self.wait)?) };
+        let mut received = 1;
+        while !batch.is_full() {
+            let Ok(datagram) = self.recv(false) else {
+                break;
+            };
+            unsafe { batch.push_lent(datagram) };
+            received += 1;
+        }
+        Ok(received)
+    }
+
+    fn release(&mut self, datagram: Datagram<'_>) {
+        if let Some(handle) = datagram.buffer {
+            self.ingest.recycle.push(handle).ok();
+            self.lent -= 1;
+        }
+    }
+
+    /// Only the SSRC of the filter is used, it decides which receiver gets a packet if several receive from
+    /// the same address.
+    fn set_filter(&self, filter: &RtpFilter) -> io::Result<()> {
+        self.route
+            .ssrc
+            .store(filter.ssrc.map_or(NO_SSRC, u64::from), Ordering::Relaxed);
+        Ok(())
+    }
+
+    /// Packets dropped because the receiver did not keep up
+    fn drops(&self) -> Option<u32> {
+        Some(self.route.drops.load(Ordering::Relaxed))
+    }
+}
+
+impl Drop for XdpRxSocket {
+    fn drop(&mut self) {
+        self.ingest.unregister(self.dst, self.route.clone());
+        // frames that were never received go back to the kernel, the ingest doesn't queue any more after
+        // unregistering
+        while let Ok(frame) = self.rx.try_recv() {
+            self.ingest.recycle.push(frame.handle).ok();
+        }
+        if self.lent > 0 {
+            warn!(
+                "XDP receiver for {} dropped with {} unreleased frames, keeping the ingest on {} alive",
+                self.dst, self.lent, self.ingest.ifname
+            );
+            // datagrams still point into the UMEM
+            mem::forget(self.ingest.clone());
+        }
+    }
+}
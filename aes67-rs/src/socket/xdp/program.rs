@@ -0,0 +1,523 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! The XDP program that steers RTP packets into AF_XDP sockets, plus the `bpf(2)` calls needed to load and
+//! attach it. UDP packets whose destination address and port are in the stream map are redirected to the
+//! AF_XDP socket of the receive queue they arrived on, everything else continues up the network stack.
+
+use std::{
+    ffi::CStr,
+    io, mem,
+    net::{IpAddr, SocketAddr},
+    os::fd::{AsRawFd, FromRawFd, OwnedFd, RawFd},
+};
+
+const BPF_MAP_CREATE: libc::c_int = 0;
+const BPF_MAP_UPDATE_ELEM: libc::c_int = 2;
+const BPF_MAP_DELETE_ELEM: libc::c_int = 3;
+const BPF_PROG_LOAD: libc::c_int = 5;
+const BPF_LINK_CREATE: libc::c_int = 28;
+
+const BPF_MAP_TYPE_HASH: u32 = 1;
+const BPF_MAP_TYPE_XSKMAP: u32 = 17;
+const BPF_PROG_TYPE_XDP: u32 = 6;
+const BPF_XDP: u32 = 37;
+
+const XDP_FLAGS_SKB_MODE: u32 = 1 << 1;
+const XDP_FLAGS_DRV_MODE: u32 = 1 << 2;
+
+const XDP_PASS: i32 = 2;
+const BPF_FUNC_MAP_LOOKUP_ELEM: i32 = 1;
+const BPF_FUNC_REDIRECT_MAP: i32 = 51;
+const BPF_PSEUDO_MAP_FD: u8 = 1;
+
+const BPF_LDX: u8 = 0x01;
+const BPF_ST: u8 = 0x02;
+const BPF_STX: u8 = 0x03;
+const BPF_ALU64: u8 = 0x07;
+const BPF_JMP: u8 = 0x05;
+const BPF_LD_IMM64: u8 = 0x18;
+const BPF_MEM: u8 = 0x60;
+const BPF_W: u8 = 0x00;
+const BPF_H: u8 = 0x08;
+const BPF_B: u8 = 0x10;
+const BPF_DW: u8 = 0x18;
+const BPF_K: u8 = 0x00;
+const BPF_X: u8 = 0x08;
+const BPF_ADD: u8 = 0x00;
+const BPF_AND: u8 = 0x50;
+const BPF_MOV: u8 = 0xb0;
+const BPF_JA: u8 = 0x00;
+const BPF_JEQ: u8 = 0x10;
+const BPF_JGT: u8 = 0x20;
+const BPF_JNE: u8 = 0x50;
+const BPF_CALL: u8 = 0x80;
+const BPF_EXIT: u8 = 0x90;
+
+const R0: u8 = 0;
+const R1: u8 = 1;
+const R2: u8 = 2;
+const R3: u8 = 3;
+const R4: u8 = 4;
+const R5: u8 = 5;
+const R6: u8 = 6;
+const R10: u8 = 10;
+
+const ETH_HLEN: i16 = 14;
+/// Offset of the stream map key on the stack
+const KEY: i16 = -24;
+
+/// Key of the stream map. IPv4 addresses are stored IPv4-mapped.
+#[repr(C)]
+pub struct StreamKey {
+    addr: [u8; 16],
+    /// network byte order
+    port: [u8; 2],
+    pad: u16,
+}
+
+impl From<SocketAddr> for StreamKey {
+    fn from(value: SocketAddr) -> Self {
+        let addr = match value.ip() {
+            IpAddr::V4(ip) => ip.to_ipv6_mapped().octets(),
+            IpAddr::V6(ip) => ip.octets(),
+        };
+        Self {
+            addr,
+            port: value.port().to_be_bytes(),
+            pad: 0,
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Label {
+    Ipv4,
+    Ipv6,
+    Lookup,
+    Pass,
+}
+
+#[derive(Debug, Clone, Copy)]
+struct Insn {
+    code: u8,
+    dst: u8,
+    src: u8,
+    off: i16,
+    imm: i32,
+    target: Option<Label>,
+}
+
+impl Insn {
+    fn new(code: u8, dst: u8, src: u8, off: i16, imm: i32) -> Self {
+        Self {
+            code,
+            dst,
+            src,
+            off,
+            imm,
+            target: None,
+        }
+    }
+
+    fn mov_imm(dst: u8, imm: i32) -> Self {
+        Self::new(BPF_ALU64 | BPF_MOV | BPF_K, dst, 0, 0, imm)
+    }
+
+    fn mov(dst: u8, src: u8) -> Self {
+        Self::new(BPF_ALU64 | BPF_MOV | BPF_X, dst, src, 0, 0)
+    }
+
+    fn add_imm(dst: u8, imm: i32) -> Self {
+        Self::new(BPF_ALU64 | BPF_ADD | BPF_K, dst, 0, 0, imm)
+    }
+
+    fn and_imm(dst: u8, imm: i32) -> Self {
+        Self::new(BPF_ALU64 | BPF_AND | BPF_K, dst, 0, 0, imm)
+    }
+
+    fn load(size: u8, dst: u8, src: u8, off: i16) -> Self {
+        Self::new(BPF_LDX | BPF_MEM | size, dst, src, off, 0)
+    }
+
+    fn store(size: u8, dst: u8, off: i16, src: u8) -> Self {
+        Self::new(BPF_STX | BPF_MEM | size, dst, src, off, 0)
+    }
+
+    fn store_imm(size: u8, dst: u8, off: i16, imm: i32) -> Self {
+        Self::new(BPF_ST | BPF_MEM | size, dst, 0, off, imm)
+    }
+
+    fn jump_imm(op: u8, dst: u8, imm: i32, target: Label) -> Self {
+        Self {
+            target: Some(target),
+            ..Self::new(BPF_JMP | op | BPF_K, dst, 0, 0, imm)
+        }
+    }
+
+    fn jump_reg(op: u8, dst: u8, src: u8, target: Label) -> Self {
+        Self {
+            target: Some(target),
+            ..Self::new(BPF_JMP | op | BPF_X, dst, src, 0, 0)
+        }
+    }
+
+    fn goto(target: Label) -> Self {
+        Self::jump_imm(BPF_JA, 0, 0, target)
+    }
+
+    fn call(func: i32) -> Self {
+        Self::new(BPF_JMP | BPF_CALL, 0, 0, 0, func)
+    }
+
+    fn exit() -> Self {
+        Self::new(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+    }
+
+    /// Loads a map file descriptor, this takes two instruction slots
+    fn load_map(dst: u8, map: &OwnedFd) -> [Self; 2] {
+        [
+            Self::new(BPF_LD_IMM64, dst, BPF_PSEUDO_MAP_FD, 0, map.as_raw_fd()),
+            Self::new(0, 0, 0, 0, 0),
+        ]
+    }
+
+    /// Fails the program if the packet is shorter than `len` bytes. Clobbers R4.
+    fn check_len(len: i32) -> [Self; 3] {
+        [
+            Self::mov(R4, R2),
+            Self::add_imm(R4, len),
+            Self::jump_reg(BPF_JGT, R4, R3, Label::Pass),
+        ]
+    }
+}
+
+fn instructions(streams: &OwnedFd, xsks: &OwnedFd) -> Vec<(Option<Label>, Insn)> {
+    let mut prog = Vec::new();
+    let mut emit = |label: Option<Label>, insns: &[Insn]| {
+        for (i, insn) in insns.iter().enumerate() {
+            prog.push((if i == 0 { label } else { None }, *insn));
+        }
+    };
+
+    emit(
+        None,
+        &[
+            Insn::mov(R6, R1),
+            // struct xdp_md: data, data_end
+            Insn::load(BPF_W, R2, R1, 0),
+            Insn::load(BPF_W, R3, R1, 4),
+            Insn::store_imm(BPF_DW, R10, KEY, 0),
+            Insn::store_imm(BPF_DW, R10, KEY + 8, 0),
+            Insn::store_imm(BPF_DW, R10, KEY + 16, 0),
+        ],
+    );
+    emit(None, &Insn::check_len(ETH_HLEN as i32));
+    emit(
+        None,
+        &[
+            // ethertype, loaded in host (little endian) byte order
+            Insn::load(BPF_H, R5, R2, 12),
+            Insn::jump_imm(BPF_JEQ, R5, 0x0008, Label::Ipv4),
+            Insn::jump_imm(BPF_JEQ, R5, 0xdd86, Label::Ipv6),
+            Insn::goto(Label::Pass),
+        ],
+    );
+
+    // IPv4 without options, not fragmented
+    emit(
+        Some(Label::Ipv4),
+        &Insn::check_len(ETH_HLEN as i32 + 20 + 8),
+    );
+    emit(
+        None,
+        &[
+            Insn::load(BPF_B, R5, R2, ETH_HLEN),
+            Insn::and_imm(R5, 0x0f),
+            Insn::jump_imm(BPF_JNE, R5, 5, Label::Pass),
+            Insn::load(BPF_B, R5, R2, ETH_HLEN + 9),
+            Insn::jump_imm(BPF_JNE, R5, libc::IPPROTO_UDP, Label::Pass),
+            // more fragments flag and fragment offset
+            Insn::load(BPF_H, R5, R2, ETH_HLEN + 6),
+            Insn::and_imm(R5, 0xff3f),
+            Insn::jump_imm(BPF_JNE, R5, 0, Label::Pass),
+            // ::ffff:<destination>
+            Insn::store_imm(BPF_W, R10, KEY + 8, 0xffff0000u32 as i32),
+            Insn::load(BPF_W, R5, R2, ETH_HLEN + 16),
+            Insn::store(BPF_W, R10, KEY + 12, R5),
+            Insn::load(BPF_H, R5, R2, ETH_HLEN + 20 + 2),
+            Insn::store(BPF_H, R10, KEY + 16, R5),
+            Insn::goto(Label::Lookup),
+        ],
+    );
+
+    // IPv6 without extension headers
+    emit(
+        Some(Label::Ipv6),
+        &Insn::check_len(ETH_HLEN as i32 + 40 + 8),
+    );
+    emit(
+        None,
+        &[
+            Insn::load(BPF_B, R5, R2, ETH_HLEN + 6),
+            Insn::jump_imm(BPF_JNE, R5, libc::IPPROTO_UDP, Label::Pass),
+            Insn::load(BPF_DW, R5, R2, ETH_HLEN + 24),
+            Insn::store(BPF_DW, R10, KEY, R5),
+            Insn::load(BPF_DW, R5, R2, ETH_HLEN + 32),
+            Insn::store(BPF_DW, R10, KEY + 8, R5),
+            Insn::load(BPF_H, R5, R2, ETH_HLEN + 40 + 2),
+            Insn::store(BPF_H, R10, KEY + 16, R5),
+        ],
+    );
+
+    emit(Some(Label::Lookup), &Insn::load_map(R1, streams));
+    emit(
+        None,
+        &[
+            Insn::mov(R2, R10),
+            Insn::add_imm(R2, KEY as i32),
+            Insn::call(BPF_FUNC_MAP_LOOKUP_ELEM),
+            Insn::jump_imm(BPF_JEQ, R0, 0, Label::Pass),
+        ],
+    );
+    emit(None, &Insn::load_map(R1, xsks));
+    emit(
+        None,
+        &[
+            // struct xdp_md: rx_queue_index
+            Insn::load(BPF_W, R2, R6, 16),
+            // pass the packet on if there is no socket for the queue
+            Insn::mov_imm(R3, XDP_PASS),
+            Insn::call(BPF_FUNC_REDIRECT_MAP),
+            Insn::exit(),
+        ],
+    );
+
+    emit(
+        Some(Label::Pass),
+        &[Insn::mov_imm(R0, XDP_PASS), Insn::exit()],
+    );
+
+    prog
+}
+
+fn assemble(streams: &OwnedFd, xsks: &OwnedFd) -> Vec<u64> {
+    let prog = instructions(streams, xsks);
+    let position = |label: Label| {
+        prog.iter()
+            .position(|(l, _)| *l == Some(label))
+            .expect("label is defined") as i32
+    };
+
+    prog.iter()
+        .enumerate()
+        .map(|(i, (_, insn))| {
+            let off = match insn.target {
+                Some(label) => (position(label) - i as i32 - 1) as i16,
+                None => insn.off,
+            };
+            insn.code as u64
+                | ((insn.dst as u64 | (insn.src as u64) << 4) << 8)
+                | (off as u16 as u64) << 16
+                | (insn.imm as u32 as u64) << 32
+        })
+        .collect()
+}
+
+fn bpf<T>(cmd: libc::c_int, attr: &mut T) -> io::Result<libc::c_long> {
+    let res = unsafe {
+        libc::syscall(
+            libc::SYS_bpf,
+            cmd,
+            attr as *mut T,
+            mem::size_of::<T>() as libc::c_uint,
+        )
+    };
+    if res < 0 {
+        Err(io::Error::last_os_error())
+    } else {
+        Ok(res)
+    }
+}
+
+fn bpf_fd<T>(cmd: libc::c_int, attr: &mut T) -> io::Result<OwnedFd> {
+    let fd = bpf(cmd, attr)?;
+    Ok(unsafe { OwnedFd::from_raw_fd(fd as RawFd) })
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct MapCreateAttr {
+    map_type: u32,
+    key_size: u32,
+    value_size: u32,
+    max_entries: u32,
+    map_flags: u32,
+    reserved: [u32; 27],
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct MapElemAttr {
+    map_fd: u32,
+    pad: u32,
+    key: u64,
+    value: u64,
+    flags: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct ProgLoadAttr {
+    prog_type: u32,
+    insn_cnt: u32,
+    insns: u64,
+    license: u64,
+    log_level: u32,
+    log_size: u32,
+    log_buf: u64,
+    reserved: [u64; 12],
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct LinkCreateAttr {
+    prog_fd: u32,
+    target_ifindex: u32,
+    attach_type: u32,
+    flags: u32,
+    reserved: [u64; 6],
+}
+
+fn create_map(
+    map_type: u32,
+    key_size: usize,
+    value_size: usize,
+    max_entries: u32,
+) -> io::Result<OwnedFd> {
+    let mut attr = MapCreateAttr {
+        map_type,
+        key_size: key_size as u32,
+        value_size: value_size as u32,
+        max_entries,
+        ..Default::default()
+    };
+    bpf_fd(BPF_MAP_CREATE, &mut attr)
+}
+
+/// The loaded XDP program and its maps. The program stays attached until this is dropped.
+pub struct XdpProgram {
+    // the link must be closed first so the program is detached before its maps go away
+    _link: OwnedFd,
+    _prog: OwnedFd,
+    streams: OwnedFd,
+    xsks: OwnedFd,
+}
+
+impl XdpProgram {
+    /// Loads the program and attaches it to the interface, in driver mode if the driver supports it and in
+    /// generic mode otherwise.
+    pub fn attach(ifindex: u32, max_streams: u32, queues: u32) -> io::Result<Self> {
+        let streams = create_map(
+            BPF_MAP_TYPE_HASH,
+            mem::size_of::<StreamKey>(),
+            mem::size_of::<u32>(),
+            max_streams,
+        )?;
+        let xsks = create_map(
+            BPF_MAP_TYPE_XSKMAP,
+            mem::size_of::<u32>(),
+            mem::size_of::<u32>(),
+            queues,
+        )?;
+
+        let insns = assemble(&streams, &xsks);
+        let license = c"GPL";
+        let mut log = vec![0u8; 64 * 1024];
+        let mut attr = ProgLoadAttr {
+            prog_type: BPF_PROG_TYPE_XDP,
+            insn_cnt: insns.len() as u32,
+            insns: insns.as_ptr() as u64,
+            license: license.as_ptr() as u64,
+            log_level: 1,
+            log_size: log.len() as u32,
+            log_buf: log.as_mut_ptr() as u64,
+            ..Default::default()
+        };
+        let prog = bpf_fd(BPF_PROG_LOAD, &mut attr).map_err(|e| {
+            let log = CStr::from_bytes_until_nul(&log)
+                .map(|it| it.to_string_lossy().into_owned())
+                .unwrap_or_default();
+            io::Error::new(e.kind(), format!("XDP program rejected: {e}\n{log}"))
+        })?;
+
+        let link = |flags| {
+            let mut attr = LinkCreateAttr {
+                prog_fd: prog.as_raw_fd() as u32,
+                target_ifindex: ifindex,
+                attach_type: BPF_XDP,
+                flags,
+                ..Default::default()
+            };
+            bpf_fd(BPF_LINK_CREATE, &mut attr)
+        };
+        let link = match link(XDP_FLAGS_DRV_MODE) {
+            Ok(link) => link,
+            Err(_) => link(XDP_FLAGS_SKB_MODE)?,
+        };
+
+        Ok(Self {
+            _link: link,
+            _prog: prog,
+            streams,
+            xsks,
+        })
+    }
+
+    /// Redirects packets to `addr` to the AF_XDP sockets.
+    pub fn add_stream(&self, addr: SocketAddr) -> io::Result<()> {
+        let key = StreamKey::from(addr);
+        let value = 1u32;
+        self.update(&self.streams, &key, &value)
+    }
+
+    pub fn remove_stream(&self, addr: SocketAddr) -> io::Result<()> {
+        let key = StreamKey::from(addr);
+        let mut attr = MapElemAttr {
+            map_fd: self.streams.as_raw_fd() as u32,
+            key: &key as *const StreamKey as u64,
+            ..Default::default()
+        };
+        bpf(BPF_MAP_DELETE_ELEM, &mut attr).map(|_| ())
+    }
+
+    /// Registers the AF_XDP socket for a receive queue.
+    pub fn set_socket(&self, queue: u32, socket: RawFd) -> io::Result<()> {
+        self.update(&self.xsks, &queue, &(socket as u32))
+    }
+
+    fn update<K, V>(&self, map: &OwnedFd, key: &K, value: &V) -> io::Result<()> {
+        let mut attr = MapElemAttr {
+            map_fd: map.as_raw_fd() as u32,
+            key: key as *const K as u64,
+            value: value as *const V as u64,
+            flags: 0,
+            ..Default::default()
+        };
+        bpf(BPF_MAP_UPDATE_ELEM, &mut attr).map(|_| ())
+    }
+}
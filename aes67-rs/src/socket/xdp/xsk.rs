@@ -0,0 +1,313 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! AF_XDP sockets. Each socket is bound to one receive queue of an interface and owns its UMEM, the memory
+//! area the NIC (zero-copy mode) or the kernel (copy mode) writes redirected frames to.
+
+use crate::socket::mmap::Mmap;
+use std::{
+    io, mem,
+    os::fd::{AsRawFd, FromRawFd, OwnedFd, RawFd},
+    sync::atomic::{AtomicU32, Ordering},
+};
+
+const SOL_XDP: libc::c_int = 283;
+const XDP_MMAP_OFFSETS: libc::c_int = 1;
+const XDP_RX_RING: libc::c_int = 2;
+const XDP_UMEM_REG: libc::c_int = 4;
+const XDP_UMEM_FILL_RING: libc::c_int = 5;
+const XDP_UMEM_COMPLETION_RING: libc::c_int = 6;
+const XDP_PGOFF_RX_RING: libc::off_t = 0;
+const XDP_UMEM_PGOFF_FILL_RING: libc::off_t = 0x100000000;
+const XDP_UMEM_PGOFF_COMPLETION_RING: libc::off_t = 0x180000000;
+const XDP_COPY: u16 = 1 << 1;
+const XDP_ZEROCOPY: u16 = 1 << 2;
+const XDP_USE_NEED_WAKEUP: u16 = 1 << 3;
+
+pub const FRAME_SIZE: usize = 2048;
+/// Number of frames in the UMEM. The fill ring holds all of them, so returning a frame never fails.
+pub const FRAME_COUNT: u32 = 4096;
+const RX_RING_SIZE: u32 = 2048;
+/// Completion ring for the unused TX direction, the kernel requires one
+const COMPLETION_RING_SIZE: u32 = 64;
+
+#[repr(C)]
+struct UmemReg {
+    addr: u64,
+    len: u64,
+    chunk_size: u32,
+    headroom: u32,
+    flags: u32,
+    tx_metadata_len: u32,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct RingOffset {
+    producer: u64,
+    consumer: u64,
+    desc: u64,
+    flags: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct MmapOffsets {
+    rx: RingOffset,
+    tx: RingOffset,
+    fr: RingOffset,
+    cr: RingOffset,
+}
+
+#[repr(C)]
+struct SockaddrXdp {
+    family: u16,
+    flags: u16,
+    ifindex: u32,
+    queue_id: u32,
+    shared_umem_fd: u32,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct XdpDesc {
+    addr: u64,
+    len: u32,
+    options: u32,
+}
+
+struct Ring {
+    map: Mmap,
+    producer: u32,
+    consumer: u32,
+    desc: u32,
+    mask: u32,
+}
+
+impl Ring {
+    fn map(
+        fd: RawFd,
+        offsets: &RingOffset,
+        entries: u32,
+        entry_size: usize,
+        pgoff: libc::off_t,
+    ) -> io::Result<Self> {
+        let len = offsets.desc as usize + entries as usize * entry_size;
+        Ok(Self {
+            map: Mmap::ring(fd, len, pgoff)?,
+            producer: offsets.producer as u32,
+            consumer: offsets.consumer as u32,
+            desc: offsets.desc as u32,
+            mask: entries - 1,
+        })
+    }
+
+    fn producer(&self) -> &AtomicU32 {
+        unsafe { &*self.map.at::<AtomicU32>(self.producer) }
+    }
+
+    fn consumer(&self) -> &AtomicU32 {
+        unsafe { &*self.map.at::<AtomicU32>(self.consumer) }
+    }
+
+    fn entry<T>(&self, index: u32) -> *mut T {
+        self.map
+            .at::<T>(self.desc + (index & self.mask) * mem::size_of::<T>() as u32)
+    }
+}
+
+fn set_option<T>(fd: RawFd, name: libc::c_int, value: &T) -> io::Result<()> {
+    let res = unsafe {
+        libc::setsockopt(
+            fd,
+            SOL_XDP,
+            name,
+            value as *const T as *const libc::c_void,
+            mem::size_of::<T>() as libc::socklen_t,
+        )
+    };
+    if res < 0 {
+        Err(io::Error::last_os_error())
+    } else {
+        Ok(())
+    }
+}
+
+/// An AF_XDP socket that only receives.
+pub struct Xsk {
+    // rings and UMEM must stay mapped until the socket is closed
+    fd: OwnedFd,
+    rx: Ring,
+    fill: Ring,
+    _completion: Ring,
+    umem: Mmap,
+    zero_copy: bool,
+}
+
+// the rings and the UMEM are only accessed through the owning socket
+unsafe impl Send for Xsk {}
+
+impl Xsk {
+    /// Creates a socket for a receive queue and hands all UMEM frames to the kernel. Binds in zero-copy mode
+    /// if the driver supports it and in copy mode otherwise.
+    pub fn bind(ifindex: u32, queue: u32) -> io::Result<Self> {
+        let fd = unsafe { libc::socket(libc::AF_XDP, libc::SOCK_RAW | libc::SOCK_CLOEXEC, 0) };
+        if fd < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        let fd = unsafe { OwnedFd::from_raw_fd(fd) };
+        let raw = fd.as_raw_fd();
+
+        let umem = Mmap::anonymous(FRAME_COUNT as usize * FRAME_SIZE)?;
+        set_option(
+            raw,
+            XDP_UMEM_REG,
+            &UmemReg {
+                addr: umem.ptr as u64,
+                len: FRAME_COUNT as u64 * FRAME_SIZE as u64,
+                chunk_size: FRAME_SIZE as u32,
+                headroom: 0,
+                flags: 0,
+                tx_metadata_len: 0,
+            },
+        )?;
+        set_option(raw, XDP_UMEM_FILL_RING, &FRAME_COUNT)?;
+        set_option(raw, XDP_UMEM_COMPLETION_RING, &COMPLETION_RING_SIZE)?;
+        set_option(raw, XDP_RX_RING, &RX_RING_SIZE)?;
+
+        let mut offsets = MmapOffsets::default();
+        let mut len = mem::size_of::<MmapOffsets>() as libc::socklen_t;
+        let res = unsafe {
+            libc::getsockopt(
+                raw,
+                SOL_XDP,
+                XDP_MMAP_OFFSETS,
+                &mut offsets as *mut MmapOffsets as *mut libc::c_void,
+                &mut len,
+            )
+        };
+        if res < 0 {
+            return Err(io::Error::last_os_error());
+        }
+
+        let rx = Ring::map(
+            raw,
+            &offsets.rx,
+            RX_RING_SIZE,
+            mem::size_of::<XdpDesc>(),
+            XDP_PGOFF_RX_RING,
+        )?;
+        let fill = Ring::map(
+            raw,
+            &offsets.fr,
+            FRAME_COUNT,
+            mem::size_of::<u64>(),
+            XDP_UMEM_PGOFF_FILL_RING,
+        )?;
+        let completion = Ring::map(
+            raw,
+            &offsets.cr,
+            COMPLETION_RING_SIZE,
+            mem::size_of::<u64>(),
+            XDP_UMEM_PGOFF_COMPLETION_RING,
+        )?;
+
+        let bind = |flags: u16| {
+            let addr = SockaddrXdp {
+                family: libc::AF_XDP as u16,
+                flags: flags | XDP_USE_NEED_WAKEUP,
+                ifindex,
+                queue_id: queue,
+                shared_umem_fd: 0,
+            };
+            let res = unsafe {
+                libc::bind(
+                    raw,
+                    &addr as *const SockaddrXdp as *const libc::sockaddr,
+                    mem::size_of::<SockaddrXdp>() as libc::socklen_t,
+                )
+            };
+            if res < 0 {
+                Err(io::Error::last_os_error())
+            } else {
+                Ok(())
+            }
+        };
+        let zero_copy = match bind(XDP_ZEROCOPY) {
+            Ok(()) => true,
+            Err(_) => {
+                bind(XDP_COPY)?;
+                false
+            }
+        };
+
+        let mut xsk = Self {
+            fd,
+            rx,
+            fill,
+            _completion: completion,
+            umem,
+            zero_copy,
+        };
+        for frame in 0..FRAME_COUNT {
+            xsk.refill(frame as u64 * FRAME_SIZE as u64);
+        }
+        Ok(xsk)
+    }
+
+    pub fn zero_copy(&self) -> bool {
+        self.zero_copy
+    }
+
+    /// Calls `f` with the UMEM address and the contents of every received frame. The frames belong to the
+    /// caller until they are handed back with [Xsk::refill].
+    pub fn receive(&mut self, mut f: impl FnMut(u64, &[u8])) -> usize {
+        let producer = self.rx.producer().load(Ordering::Acquire);
+        let consumer = self.rx.consumer().load(Ordering::Relaxed);
+        let count = producer.wrapping_sub(consumer);
+        for i in 0..count {
+            let desc = unsafe { *self.rx.entry::<XdpDesc>(consumer.wrapping_add(i)) };
+            let data =
+                unsafe { std::slice::from_raw_parts(self.frame(desc.addr), desc.len as usize) };
+            f(desc.addr, data);
+        }
+        self.rx.consumer().store(producer, Ordering::Release);
+        count as usize
+    }
+
+    pub fn frame(&self, addr: u64) -> *const u8 {
+        unsafe { self.umem.ptr.add(addr as usize) }
+    }
+
+    /// Hands a frame back to the kernel.
+    pub fn refill(&mut self, addr: u64) {
+        let producer = self.fill.producer().load(Ordering::Relaxed);
+        unsafe {
+            // the kernel aligns the address down to the start of the frame
+            self.fill.entry::<u64>(producer).write(addr);
+        }
+        self.fill
+            .producer()
+            .store(producer.wrapping_add(1), Ordering::Release);
+    }
+}
+
+impl AsRawFd for Xsk {
+    fn as_raw_fd(&self) -> RawFd {
+        self.fd.as_raw_fd()
+    }
+}
@@ -20,8 +20,11 @@
 //! - passive: used when PTP is not available or required. Time is derived from RTP packet timestamps
 //! - phc: used with PTP compatible network interfaces in combination with a ptp daemon like ptp4l
 //! - statime: used when PTP is required but there is no external synchronization. Only possible if PTP port is not already used
+//! - simulated: driven by a virtual timeline, used for deterministic simulations and tests
 
 mod phc;
+pub mod servo;
+pub mod simulated;
 #[cfg(feature = "statime")]
 mod statime;
 
@@ -29,7 +32,7 @@ use crate::{
     error::{ClockCreationError, ClockCreationResult, ClockError, ClockResult},
     formats::{Frames, FramesPerSecond},
     nic::{find_clock_nic_with_name, phc_device_for_interface_ethtool},
-    time::{phc::PhcClock, statime::StatimePtpMediaClock},
+    time::{phc::PhcClock, simulated::SimulatedClock, statime::StatimePtpMediaClock},
 };
 use clock_steering::{Clock as CSClock, unix::UnixClock};
 use core::fmt;
@@ -43,7 +46,6 @@ use std::{
 };
 use tosub::SubsystemHandle;
 use tracing::{error, info, warn};
-#[cfg(feature = "statime")]
 use worterbuch_client::{Worterbuch, topic};
 
 pub const NANOS_PER_SEC: u128 = 1_000_000_000;
@@ -70,6 +72,7 @@ pub enum ClockMode<'a> {
     Phc {
         nic: ClockNic,
         subsys: &'a SubsystemHandle,
+        wb: Worterbuch,
     },
     #[cfg(feature = "statime")]
     Internal {
@@ -160,6 +163,7 @@ pub enum Clock {
     Phc(PhcClock),
     #[cfg(feature = "statime")]
     Statime(StatimePtpMediaClock),
+    Simulated(SimulatedClock),
 }
 
 impl MediaClock for Clock {
@@ -169,6 +173,7 @@ impl MediaClock for Clock {
             Clock::Phc(clock) => clock.current_time(),
             #[cfg(feature = "statime")]
             Clock::Statime(clock) => clock.current_time(),
+            Clock::Simulated(clock) => clock.current_time(),
         }
     }
 }
@@ -291,13 +296,29 @@ fn create_clocks(
         Some(ClockMode::System) => create_system_clock(sample_rate)
             .map(Clock::System)
             .map(Clocks::NonRedundant),
-        Some(ClockMode::Phc { nic, subsys }) => match nic {
-            ClockNic::NonRedundant(nic) => create_phc_clock(subsys, sample_rate, nic)
-                .map(Clock::Phc)
-                .map(Clocks::NonRedundant),
+        Some(ClockMode::Phc { nic, subsys, wb }) => match nic {
+            ClockNic::NonRedundant(nic) => {
+                create_phc_clock(subsys, topic!(app_name, "clock"), sample_rate, wb, nic)
+                    .map(Clock::Phc)
+                    .map(Clocks::NonRedundant)
+            }
             ClockNic::Redundant { primary, secondary } => {
-                let primary = create_phc_clock(subsys, sample_rate, primary).map(Clock::Phc)?;
-                let secondary = create_phc_clock(subsys, sample_rate, secondary).map(Clock::Phc)?;
+                let primary = create_phc_clock(
+                    subsys,
+                    topic!(app_name, "clock", "primary"),
+                    sample_rate,
+                    wb.clone(),
+                    primary,
+                )
+                .map(Clock::Phc)?;
+                let secondary = create_phc_clock(
+                    subsys,
+                    topic!(app_name, "clock", "secondary"),
+                    sample_rate,
+                    wb,
+                    secondary,
+                )
+                .map(Clock::Phc)?;
                 Ok(Clocks::Redundant { primary, secondary })
             }
         },
@@ -340,7 +361,9 @@ fn create_system_clock(sample_rate: FramesPerSecond) -> ClockCreationResult<Unix
 
 fn create_phc_clock(
     subsys: &SubsystemHandle,
+    root_key: String,
     sample_rate: FramesPerSecond,
+    wb: Worterbuch,
     nic: String,
 ) -> ClockCreationResult<PhcClock> {
     info!("Creating new PHC clock on NIC {nic} …");
@@ -348,7 +371,7 @@ fn create_phc_clock(
     let Some(path) = phc_device_for_interface_ethtool(&iface)? else {
         return Err(ClockCreationError::PtpNotSupported(iface.name.clone()));
     };
-    let clock = PhcClock::open(subsys, path, sample_rate)?;
+    let clock = PhcClock::open(subsys, path, sample_rate, root_key, wb)?;
     Ok(clock)
 }
 
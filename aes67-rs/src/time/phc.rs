@@ -23,17 +23,36 @@ use crate::{
         to_nanos,
     },
 };
-use libc::{CLOCK_TAI, clockid_t};
+use libc::{
+    CLOCK_REALTIME, CLOCK_TAI, PTP_MAX_SAMPLES, PTP_SYS_OFFSET_EXTENDED, PTP_SYS_OFFSET_PRECISE,
+    clockid_t, ptp_clock_time, ptp_sys_offset_extended, ptp_sys_offset_precise,
+};
+use serde::Serialize;
+use std::time::Instant;
 use std::{
+    hint, io, mem,
     os::fd::{IntoRawFd, RawFd},
     path::Path,
-    sync::{LazyLock, OnceLock, atomic::Ordering},
+    sync::{
+        OnceLock,
+        atomic::{AtomicI64, AtomicU64, Ordering, fence},
+    },
     time::Duration,
 };
-use std::{sync::atomic::AtomicI64, time::Instant};
 use tokio::{select, time::MissedTickBehavior};
 use tosub::{SubsystemError, SubsystemHandle};
 use tracing::{error, info, warn};
+use worterbuch_client::{Worterbuch, topic};
+
+/// Number of PHC/system clock readings per measurement if the offset cannot be measured precisely, the one
+/// with the narrowest system clock window is used.
+const OFFSET_SAMPLES: usize = 5;
+const NANOS_PER_SEC: i64 = 1_000_000_000;
+/// PHC offset changes larger than this between two measurements are treated as a step of the PHC
+/// (e.g. by the PTP daemon) rather than as frequency offset.
+const MAX_OFFSET_STEP_NANOS: i64 = 1_000_000;
+/// Rate ratios further away from 1 than this are considered implausible.
+const MAX_RATE_DEVIATION: f64 = 0.001;
 
 #[derive(Debug, Clone)]
 pub struct PhcClock {
@@ -42,34 +61,283 @@ pub struct PhcClock {
 
 type CLockId = (clockid_t, RawFd);
 
-static LAST_OFFSET: LazyLock<AtomicI64> = LazyLock::new(|| AtomicI64::new(0));
+static SNAPSHOT: PhcSnapshotLock = PhcSnapshotLock::new();
 static CLOCK_ID: OnceLock<ClockCreationResult<CLockId>> = OnceLock::new();
 
+/// Relation between CLOCK_TAI and the PHC at the time of the last measurement. The PHC time at any given
+/// TAI time is interpolated from it, so PHC drift between measurements is compensated.
+#[derive(Debug, Clone, Copy)]
+struct PhcSnapshot {
+    base_tai: i64,
+    base_phc: i64,
+    rate_ratio: f64,
+}
+
+impl PhcSnapshot {
+    fn phc_nanos(&self, tai: i64) -> i64 {
+        self.base_phc + ((tai - self.base_tai) as f64 * self.rate_ratio) as i64
+    }
+}
+
+/// Seqlock publishing the latest `PhcSnapshot`. There is exactly one writer (the sync task, or the clock
+/// initialization before that task is started), readers never block and never write to shared memory, so
+/// reading the snapshot on the RT threads is as cheap as reading a single atomic.
+struct PhcSnapshotLock {
+    seq: AtomicU64,
+    base_tai: AtomicI64,
+    base_phc: AtomicI64,
+    rate_ratio: AtomicU64,
+}
+
+impl PhcSnapshotLock {
+    const fn new() -> Self {
+        Self {
+            seq: AtomicU64::new(0),
+            base_tai: AtomicI64::new(0),
+            base_phc: AtomicI64::new(0),
+            rate_ratio: AtomicU64::new(0),
+        }
+    }
+
+    fn publish(&self, snapshot: PhcSnapshot) {
+        let seq = self.seq.load(Ordering::Relaxed);
+        self.seq.store(seq.wrapping_add(1), Ordering::Relaxed);
+        fence(Ordering::Release);
+        self.base_tai.store(snapshot.base_tai, Ordering::Relaxed);
+        self.base_phc.store(snapshot.base_phc, Ordering::Relaxed);
+        self.rate_ratio
+            .store(snapshot.rate_ratio.to_bits(), Ordering::Relaxed);
+        self.seq.store(seq.wrapping_add(2), Ordering::Release);
+    }
+
+    fn read(&self) -> PhcSnapshot {
+        loop {
+            let seq = self.seq.load(Ordering::Acquire);
+            if seq & 1 == 1 {
+                hint::spin_loop();
+                continue;
+            }
+
+            let snapshot = PhcSnapshot {
+                base_tai: self.base_tai.load(Ordering::Relaxed),
+                base_phc: self.base_phc.load(Ordering::Relaxed),
+                rate_ratio: f64::from_bits(self.rate_ratio.load(Ordering::Relaxed)),
+            };
+
+            fence(Ordering::Acquire);
+            if self.seq.load(Ordering::Relaxed) == seq {
+                return snapshot;
+            }
+        }
+    }
+}
+
+/// How the offset between PHC and system clock was measured, in descending order of accuracy.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize)]
+#[serde(rename_all = "camelCase")]
+enum OffsetMethod {
+    /// Hardware cross-timestamp (PTP_SYS_OFFSET_PRECISE).
+    Precise,
+    /// Sandwiched readings taken by the driver (PTP_SYS_OFFSET_EXTENDED).
+    Extended,
+    /// Sandwiched `clock_gettime` calls from user space.
+    Software,
+}
+
+#[derive(Debug, Clone, Copy)]
+struct PhcMeasurement {
+    tai: i64,
+    phc: i64,
+    quality: MeasurementQuality,
+}
+
+/// Published as a metric after each measurement. `uncertainty` is half the width of the system clock
+/// window the PHC reading was taken in, i.e. the maximum error of the measured offset.
+#[derive(Debug, Clone, Copy, Serialize)]
+#[serde(rename_all = "camelCase")]
+struct MeasurementQuality {
+    method: OffsetMethod,
+    uncertainty_nanos: i64,
+}
+
+/// Measures the PHC against CLOCK_TAI using the most accurate method the driver supports. Unsupported methods
+/// are only tried once.
+struct PhcOffsetMeter {
+    fd: RawFd,
+    clock_id: clockid_t,
+    precise: bool,
+    extended: bool,
+    extended_tai: bool,
+}
+
+impl PhcOffsetMeter {
+    fn new(fd: RawFd, clock_id: clockid_t) -> Self {
+        Self {
+            fd,
+            clock_id,
+            precise: true,
+            extended: true,
+            extended_tai: true,
+        }
+    }
+
+    fn measure(&mut self) -> ClockResult<PhcMeasurement> {
+        if self.precise {
+            match self.measure_precise() {
+                Ok(it) => return Ok(it),
+                Err(e) => {
+                    info!(
+                        "PTP_SYS_OFFSET_PRECISE not supported by PHC ({e}), trying PTP_SYS_OFFSET_EXTENDED."
+                    );
+                    self.precise = false;
+                }
+            }
+        }
+
+        if self.extended {
+            match self.measure_extended() {
+                Ok(it) => return Ok(it),
+                Err(e) => {
+                    info!(
+                        "PTP_SYS_OFFSET_EXTENDED not supported by PHC ({e}), falling back to clock_gettime."
+                    );
+                    self.extended = false;
+                }
+            }
+        }
+
+        self.measure_software()
+    }
+
+    fn measure_precise(&self) -> io::Result<PhcMeasurement> {
+        let mut req: ptp_sys_offset_precise = unsafe { mem::zeroed() };
+        // cross timestamps are only available against CLOCK_REALTIME, the TAI offset is read right before
+        let tai_offset = tai_offset()?;
+        if unsafe { libc::ioctl(self.fd, PTP_SYS_OFFSET_PRECISE, &mut req) } != 0 {
+            return Err(io::Error::last_os_error());
+        }
+
+        Ok(PhcMeasurement {
+            tai: ptp_clock_nanos(&req.sys_realtime) + tai_offset,
+            phc: ptp_clock_nanos(&req.device),
+            quality: MeasurementQuality {
+                method: OffsetMethod::Precise,
+                uncertainty_nanos: 0,
+            },
+        })
+    }
+
+    fn measure_extended(&mut self) -> io::Result<PhcMeasurement> {
+        let mut req: ptp_sys_offset_extended = unsafe { mem::zeroed() };
+        req.n_samples = (OFFSET_SAMPLES as u32).min(PTP_MAX_SAMPLES);
+
+        // older kernels only support sandwiching with CLOCK_REALTIME and reject a clock ID
+        let tai_offset = if self.extended_tai {
+            req.clockid = CLOCK_TAI;
+            if unsafe { libc::ioctl(self.fd, PTP_SYS_OFFSET_EXTENDED, &mut req) } == 0 {
+                0
+            } else {
+                self.extended_tai = false;
+                req.clockid = CLOCK_REALTIME;
+                self.extended_realtime(&mut req)?
+            }
+        } else {
+            self.extended_realtime(&mut req)?
+        };
+
+        let (window, tai, phc) = req.ts[..req.n_samples as usize]
+            .iter()
+            .map(|[before, phc, after]| {
+                let before = ptp_clock_nanos(before);
+                let after = ptp_clock_nanos(after);
+                (
+                    after - before,
+                    before + (after - before) / 2,
+                    ptp_clock_nanos(phc),
+                )
+            })
+            .min_by_key(|(window, _, _)| *window)
+            .ok_or_else(|| io::Error::other("no samples"))?;
+
+        Ok(PhcMeasurement {
+            tai: tai + tai_offset,
+            phc,
+            quality: MeasurementQuality {
+                method: OffsetMethod::Extended,
+                uncertainty_nanos: window / 2,
+            },
+        })
+    }
+
+    fn extended_realtime(&self, req: &mut ptp_sys_offset_extended) -> io::Result<i64> {
+        let tai_offset = tai_offset()?;
+        if unsafe { libc::ioctl(self.fd, PTP_SYS_OFFSET_EXTENDED, req as *mut _) } != 0 {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(tai_offset)
+    }
+
+    fn measure_software(&self) -> ClockResult<PhcMeasurement> {
+        let mut best: Option<(i64, i64, i64)> = None;
+
+        for _ in 0..OFFSET_SAMPLES {
+            let tai1 = to_nanos(get_time(CLOCK_TAI)?) as i64;
+            let phc = to_nanos(get_time(self.clock_id)?) as i64;
+            let tai2 = to_nanos(get_time(CLOCK_TAI)?) as i64;
+
+            let window = tai2 - tai1;
+            if best.is_none_or(|(w, _, _)| window < w) {
+                best = Some((window, tai1 + window / 2, phc));
+            }
+        }
+
+        let (window, tai, phc) = best.expect("OFFSET_SAMPLES is not zero");
+
+        Ok(PhcMeasurement {
+            tai,
+            phc,
+            quality: MeasurementQuality {
+                method: OffsetMethod::Software,
+                uncertainty_nanos: window / 2,
+            },
+        })
+    }
+}
+
+fn ptp_clock_nanos(t: &ptp_clock_time) -> i64 {
+    t.sec * NANOS_PER_SEC + t.nsec as i64
+}
+
+/// Offset between CLOCK_TAI and CLOCK_REALTIME. This is always a whole number of seconds, so rounding
+/// removes the error of reading the two clocks one after the other.
+fn tai_offset() -> io::Result<i64> {
+    let realtime = to_nanos(get_time(CLOCK_REALTIME)?) as i64;
+    let tai = to_nanos(get_time(CLOCK_TAI)?) as i64;
+    let offset = (tai - realtime + NANOS_PER_SEC / 2).div_euclid(NANOS_PER_SEC);
+    Ok(offset * NANOS_PER_SEC)
+}
+
 impl PhcClock {
     pub fn open(
         subsys: &SubsystemHandle,
         path: impl AsRef<Path>,
         sample_rate: FramesPerSecond,
+        root_key: String,
+        wb: Worterbuch,
     ) -> ClockCreationResult<Self> {
-        let (clock, _) = CLOCK_ID
-            .get_or_init(|| init_phc_clock(subsys, path.as_ref()))
+        CLOCK_ID
+            .get_or_init(|| init_phc_clock(subsys, path.as_ref(), root_key, wb))
             .to_owned()?;
 
-        let offset = get_current_offset(clock).map_err(|e| {
-            ClockCreationError::GetTime(e.to_string(), path.as_ref().display().to_string())
-        })?;
-
-        LAST_OFFSET.store(offset, Ordering::Release);
-
         Ok(Self { sample_rate })
     }
 
     fn now(&mut self) -> ClockResult<(SystemTimestamp, PtpTimestamp)> {
         let tp = get_time(CLOCK_TAI)?;
 
-        let offset = LAST_OFFSET.load(Ordering::Acquire);
+        let snapshot = SNAPSHOT.read();
 
-        let compensated = Duration::from_nanos((to_nanos(tp) + offset as i128) as u64);
+        let compensated = Duration::from_nanos(snapshot.phc_nanos(to_nanos(tp) as i64) as u64);
 
         let system_timestamp = Timestamp {
             seconds: tp.tv_sec as u64,
@@ -87,6 +355,8 @@ impl PhcClock {
 fn init_phc_clock(
     subsys: &SubsystemHandle,
     path: impl AsRef<Path>,
+    root_key: String,
+    wb: Worterbuch,
 ) -> ClockCreationResult<CLockId> {
     let file = std::fs::OpenOptions::new()
         .write(true)
@@ -99,6 +369,24 @@ fn init_phc_clock(
     let clock_id = ((!(fd as libc::clockid_t)) << 3) | 3;
     let clock = (clock_id, fd);
 
+    let mut meter = PhcOffsetMeter::new(fd, clock_id);
+
+    let measurement = meter.measure().map_err(|e| {
+        ClockCreationError::GetTime(e.to_string(), path.as_ref().display().to_string())
+    })?;
+
+    info!(
+        "Measuring PHC offset using {:?} method.",
+        measurement.quality.method
+    );
+
+    let mut snapshot = PhcSnapshot {
+        base_tai: measurement.tai,
+        base_phc: measurement.phc,
+        rate_ratio: 1.0,
+    };
+    SNAPSHOT.publish(snapshot);
+
     info!("Starting PHC clock sync task …");
     subsys.spawn(
         format!("phc-clock-sync-{}", path.as_ref().display()),
@@ -107,7 +395,12 @@ fn init_phc_clock(
             interval.set_missed_tick_behavior(MissedTickBehavior::Skip);
 
             loop {
-                let offset = match get_current_offset(clock_id) {
+                select! {
+                    _ = s.shutdown_requested() => break,
+                    _ = interval.tick() => (),
+                }
+
+                let measurement = match meter.measure() {
                     Ok(value) => value,
                     Err(e) => {
                         error!("Failed to get PHC offset: {e}");
@@ -115,12 +408,15 @@ fn init_phc_clock(
                     }
                 };
 
-                LAST_OFFSET.store(offset, Ordering::Release);
+                snapshot = next_snapshot(&snapshot, measurement.tai, measurement.phc);
+                SNAPSHOT.publish(snapshot);
 
-                select! {
-                    _ = s.shutdown_requested() => break,
-                    _ = interval.tick() => continue,
-                }
+                wb.publish_async(
+                    topic!(root_key, "status", "offsetMeasurement"),
+                    &measurement.quality,
+                )
+                .await
+                .ok();
             }
 
             Ok::<(), SubsystemError>(())
@@ -130,18 +426,28 @@ fn init_phc_clock(
     Ok(clock)
 }
 
-fn get_current_offset(clock: i32) -> ClockResult<i64> {
-    let tai1 = get_time(CLOCK_TAI)?;
-    let phc = get_time(clock)?;
-    let tai2 = get_time(CLOCK_TAI)?;
-
-    let tai1_nanos = to_nanos(tai1);
-    let phc_nanos = to_nanos(phc);
-    let tai2_nanos = to_nanos(tai2);
+fn next_snapshot(last: &PhcSnapshot, tai: i64, phc: i64) -> PhcSnapshot {
+    let elapsed = tai - last.base_tai;
+    let offset_change = (phc - tai) - (last.base_phc - last.base_tai);
 
-    let offset = (phc_nanos - (tai1_nanos + tai2_nanos) / 2) as i64;
+    let rate_ratio = if elapsed <= 0 || offset_change.abs() > MAX_OFFSET_STEP_NANOS {
+        warn!("PHC offset stepped by {offset_change} ns, resetting rate estimate.");
+        1.0
+    } else {
+        let rate_ratio = 1.0 + offset_change as f64 / elapsed as f64;
+        if (rate_ratio - 1.0).abs() > MAX_RATE_DEVIATION {
+            warn!("Implausible PHC rate ratio {rate_ratio}, resetting rate estimate.");
+            1.0
+        } else {
+            rate_ratio
+        }
+    };
 
-    Ok(offset)
+    PhcSnapshot {
+        base_tai: tai,
+        base_phc: phc,
+        rate_ratio,
+    }
 }
 
 impl MediaClock for PhcClock {
@@ -0,0 +1,254 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Servo that locks the frame clock of an audio backend (JACK, PipeWire, …) to the PTP media clock.
+
+use crate::{
+    config::MediaClockServoConfig,
+    error::ClockResult,
+    formats::{Frames, FramesPerSecond},
+    monitoring::MediaClockServoStats,
+    time::{Clock, MediaClock},
+};
+use std::f64::consts::{PI, SQRT_2};
+#[cfg(debug_assertions)]
+use tracing::{debug, warn};
+
+/// Maximum phase error in frames for a measurement to count towards acquiring lock.
+const LOCK_THRESHOLD: f64 = 2.0;
+/// Phase error in frames above which a locked loop falls back to acquisition mode.
+const UNLOCK_THRESHOLD: f64 = 8.0;
+/// Number of consecutive measurements within `LOCK_THRESHOLD` required to consider the loop locked.
+const LOCK_COUNT: u32 = 64;
+/// Maximum number of frames the audio clock is slewed per cycle. Slews are absorbed by the resampler, so this
+/// is kept small to keep the resampling ratio close to 1.
+pub const MAX_SLEW_PER_CYCLE: i64 = 1;
+/// Upper bound for the normalized loop bandwidth of a single update, keeps the loop stable if measurements
+/// are far apart.
+const MAX_OMEGA: f64 = 0.5;
+/// Interval in seconds at which servo telemetry is handed out.
+const TELEMETRY_INTERVAL: f64 = 1.0;
+
+/// Frame counter of an audio backend as seen from inside its process callback.
+pub trait AudioCycle {
+    /// Backend frame time of the first frame of the current cycle. Only differences between frame times are
+    /// used, so the counter may wrap.
+    fn last_frame_time(&self) -> u32;
+    /// Number of frames that have passed since the start of the current cycle.
+    fn frames_since_cycle_start(&self) -> u32;
+    /// Number of frames processed in the current cycle.
+    fn n_frames(&self) -> u32;
+}
+
+/// Keeps track of the offset between audio backend frame time and PTP media time.
+///
+/// The offset is estimated by a second order delay-locked loop that tracks both the phase and the frequency
+/// ratio of the two clocks. Between PTP clock measurements the offset is extrapolated from the estimated
+/// rate, so once the loop is locked the PTP clock only needs to be read every few cycles.
+/// The integer part of the estimated offset is applied to the backend frame time, every change to it is
+/// reported as `compensation` and absorbed by resampling the affected block.
+pub struct MediaClockServo {
+    ptp_clock: Clock,
+    config: MediaClockServoConfig,
+    sample_rate: FramesPerSecond,
+    dll: Option<Dll>,
+    base_offset: i64,
+    clock_offset: i64,
+    locked_sample_interval: u32,
+    frames_since_telemetry: u64,
+    telemetry: Option<MediaClockServoStats>,
+}
+
+/// Loop state, all values are in backend frames and relative to `MediaClockServo::base_offset`.
+struct Dll {
+    /// offset between PTP media time and backend frame time at `reference_time`
+    phase: f64,
+    /// change of the offset per backend frame, i.e. rate ratio - 1
+    rate: f64,
+    /// backend frame time of the last measurement
+    reference_time: u32,
+    phase_error: f64,
+    lock_counter: u32,
+    locked: bool,
+}
+
+impl Dll {
+    fn new(offset: f64, time: u32) -> Self {
+        Self {
+            phase: offset,
+            rate: 0.0,
+            reference_time: time,
+            phase_error: 0.0,
+            lock_counter: 0,
+            locked: false,
+        }
+    }
+
+    fn predict(&self, time: u32) -> f64 {
+        self.phase + self.rate * time.wrapping_sub(self.reference_time) as f64
+    }
+
+    fn frames_since_measurement(&self, time: u32) -> u32 {
+        time.wrapping_sub(self.reference_time)
+    }
+
+    fn update(&mut self, measured_offset: f64, time: u32, omega_per_frame: f64) {
+        let elapsed = time.wrapping_sub(self.reference_time).max(1) as f64;
+        let predicted = self.predict(time);
+        let error = measured_offset - predicted;
+
+        let omega = (omega_per_frame * elapsed).min(MAX_OMEGA);
+        let b = SQRT_2 * omega;
+        let c = omega * omega;
+
+        self.phase = predicted + b * error;
+        self.rate += c * error / elapsed;
+        self.reference_time = time;
+        self.phase_error = error;
+
+        if self.locked {
+            if error.abs() > UNLOCK_THRESHOLD {
+                self.locked = false;
+                self.lock_counter = 0;
+            }
+        } else if error.abs() <= LOCK_THRESHOLD {
+            self.lock_counter += 1;
+            self.locked = self.lock_counter >= LOCK_COUNT;
+        } else {
+            self.lock_counter = 0;
+        }
+    }
+
+    fn stats(&self) -> MediaClockServoStats {
+        MediaClockServoStats {
+            rate_ratio: 1.0 + self.rate,
+            phase_error: self.phase_error,
+            locked: self.locked,
+        }
+    }
+}
+
+pub enum ClockState {
+    Stable {
+        current_time: Frames,
+        compensation: i64,
+    },
+    Unstable,
+}
+
+impl MediaClockServo {
+    pub fn new(
+        ptp_clock: Clock,
+        config: MediaClockServoConfig,
+        sample_rate: FramesPerSecond,
+    ) -> Self {
+        let locked_sample_interval =
+            (config.locked_sample_interval.as_secs_f64() * sample_rate as f64).round() as u32;
+        MediaClockServo {
+            ptp_clock,
+            config,
+            sample_rate,
+            dll: None,
+            base_offset: 0,
+            clock_offset: 0,
+            locked_sample_interval,
+            frames_since_telemetry: 0,
+            telemetry: None,
+        }
+    }
+
+    /// Returns the latest loop state at most once every `TELEMETRY_INTERVAL`, so callers on the RT thread
+    /// can forward it to monitoring without flooding it.
+    pub fn take_telemetry(&mut self) -> Option<MediaClockServoStats> {
+        self.telemetry.take()
+    }
+
+    pub fn update_clock(&mut self, ps: &impl AudioCycle) -> ClockResult<ClockState> {
+        let cycle_start = ps.last_frame_time();
+
+        let Some(dll) = &mut self.dll else {
+            // the integer part of the initial offset is kept out of the loop so the loop can operate on small
+            // floating point values without losing precision
+            let offset = measure_offset(&mut self.ptp_clock, ps, 0)?;
+            self.base_offset = offset.round() as i64;
+            self.clock_offset = 0;
+            self.dll = Some(Dll::new(offset - self.base_offset as f64, cycle_start));
+            return Ok(ClockState::Unstable);
+        };
+
+        if !dll.locked || dll.frames_since_measurement(cycle_start) >= self.locked_sample_interval {
+            let offset = measure_offset(&mut self.ptp_clock, ps, self.base_offset)?;
+            let bandwidth = if dll.locked {
+                self.config.tracking_bandwidth
+            } else {
+                self.config.acquisition_bandwidth
+            };
+            let omega_per_frame = 2.0 * PI * bandwidth / self.sample_rate as f64;
+            dll.update(offset, cycle_start, omega_per_frame);
+        }
+
+        let diff = dll.predict(cycle_start) - self.clock_offset as f64;
+
+        // the estimate has run away further than the resampler can catch up with, start over
+        // this will cause an audible glitch
+        if diff.abs() > ps.n_frames() as f64 {
+            #[cfg(debug_assertions)]
+            warn!("Audio clock is off by {diff:.1} frames, resetting audio clock.");
+            self.dll = None;
+            return Ok(ClockState::Unstable);
+        }
+
+        let compensation = (diff.trunc() as i64).clamp(-MAX_SLEW_PER_CYCLE, MAX_SLEW_PER_CYCLE);
+
+        #[cfg(debug_assertions)]
+        if compensation != 0 {
+            debug!(
+                "Audio clock is off by {:.2} frames (rate ratio {:.8}); slewing audio clock by {}",
+                diff,
+                1.0 + dll.rate,
+                compensation
+            );
+        }
+
+        self.clock_offset += compensation;
+
+        self.frames_since_telemetry += ps.n_frames() as u64;
+        if self.frames_since_telemetry as f64 >= TELEMETRY_INTERVAL * self.sample_rate as f64 {
+            self.frames_since_telemetry = 0;
+            self.telemetry = Some(dll.stats());
+        }
+
+        Ok(ClockState::Stable {
+            // TODO this might wrap, wrap needs to be detected and handled!
+            current_time: (cycle_start as i64 + self.base_offset + self.clock_offset) as Frames,
+            compensation,
+        })
+    }
+}
+
+/// Measures the offset between PTP media time and backend frame time minus `base_offset`.
+fn measure_offset(
+    ptp_clock: &mut Clock,
+    ps: &impl AudioCycle,
+    base_offset: i64,
+) -> ClockResult<f64> {
+    let t1 = ps.frames_since_cycle_start();
+    let ptp_time = ptp_clock.current_time()?.media_time as i64;
+    let t3 = ps.frames_since_cycle_start();
+    let offset = ptp_time - ps.last_frame_time() as i64 - base_offset;
+    Ok(offset as f64 - (t1 + t3) as f64 / 2.0)
+}
@@ -0,0 +1,144 @@
+/*
+ *  Copyright (C) 2025 Michael Bachmann
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//! Media clock driven by a virtual timeline instead of wall time. Used to run senders and receivers
+//! deterministically and faster than real time, see [crate::simulation].
+
+use crate::{
+    error::ClockResult,
+    formats::{Frames, FramesPerSecond},
+    time::{MediaClock, NANOS_PER_SEC, Time, Timestamp, to_media_time},
+};
+use rand::{Rng, SeedableRng, rngs::StdRng};
+use std::{
+    sync::{
+        Arc,
+        atomic::{AtomicU64, Ordering},
+    },
+    time::Duration,
+};
+
+/// Shared virtual time. All clocks created from the same timeline advance together, but only when the
+/// timeline is explicitly advanced.
+#[derive(Debug, Clone, Default)]
+pub struct VirtualTimeline {
+    nanos: Arc<AtomicU64>,
+}
+
+impl VirtualTimeline {
+    pub fn new(start: Duration) -> Self {
+        Self {
+            nanos: Arc::new(AtomicU64::new(start.as_nanos() as u64)),
+        }
+    }
+
+    pub fn now(&self) -> Duration {
+        Duration::from_nanos(self.nanos.load(Ordering::Acquire))
+    }
+
+    /// Moves the timeline to `time`. The timeline never goes backwards, earlier times are ignored.
+    pub fn set(&self, time: Duration) {
+        self.nanos
+            .fetch_max(time.as_nanos() as u64, Ordering::AcqRel);
+    }
+
+    pub fn advance(&self, duration: Duration) {
+        self.nanos
+            .fetch_add(duration.as_nanos() as u64, Ordering::AcqRel);
+    }
+}
+
+/// Clock that derives PTP time from a [VirtualTimeline]. `drift_ppm` makes it run fast (positive) or slow
+/// (negative) relative to the timeline, starting from the timeline's time at creation. `jitter` adds a
+/// uniformly distributed error of up to +/- `jitter` to every reading. The jitter is generated from a seeded
+/// PRNG, so runs with the same seed are reproducible.
+#[derive(Debug, Clone)]
+pub struct SimulatedClock {
+    timeline: VirtualTimeline,
+    origin: Duration,
+    sample_rate: FramesPerSecond,
+    drift_ppm: f64,
+    jitter_nanos: i64,
+    rng: StdRng,
+}
+
+impl SimulatedClock {
+    pub fn new(
+        timeline: VirtualTimeline,
+        sample_rate: FramesPerSecond,
+        drift_ppm: f64,
+        jitter: Duration,
+        seed: u64,
+    ) -> Self {
+        Self {
+            origin: timeline.now(),
+            timeline,
+            sample_rate,
+            drift_ppm,
+            jitter_nanos: jitter.as_nanos() as i64,
+            rng: StdRng::seed_from_u64(seed),
+        }
+    }
+
+    pub fn timeline(&self) -> &VirtualTimeline {
+        &self.timeline
+    }
+
+    /// Point on the timeline at which this clock reaches `media_time`, disregarding jitter.
+    pub fn timeline_time(&self, media_time: Frames) -> Duration {
+        let ptp_nanos = (media_time as u128 * NANOS_PER_SEC).div_ceil(self.sample_rate as u128);
+        let drift = self.drift_ppm / 1_000_000.0;
+        let origin = self.origin.as_nanos() as f64;
+        let nanos = (ptp_nanos as f64 + origin * drift) / (1.0 + drift);
+        Duration::from_nanos(nanos.ceil() as u64)
+    }
+
+    fn ptp_nanos(&mut self, now: Duration) -> u64 {
+        let nanos = now.as_nanos() as i128;
+        let elapsed = now.saturating_sub(self.origin).as_nanos() as f64;
+        let drift = (elapsed * self.drift_ppm / 1_000_000.0) as i128;
+        let jitter = if self.jitter_nanos > 0 {
+            self.rng.gen_range(-self.jitter_nanos..=self.jitter_nanos) as i128
+        } else {
+            0
+        };
+        (nanos + drift + jitter).max(0) as u64
+    }
+}
+
+impl MediaClock for SimulatedClock {
+    fn current_time(&mut self) -> ClockResult<Time> {
+        let now = self.timeline.now();
+        let ptp_nanos = self.ptp_nanos(now);
+
+        let ptp_time = Timestamp {
+            seconds: ptp_nanos / NANOS_PER_SEC as u64,
+            nanos: (ptp_nanos % NANOS_PER_SEC as u64) as u32,
+        };
+        let system_time = Timestamp {
+            seconds: now.as_secs(),
+            nanos: now.subsec_nanos(),
+        };
+        let media_time = to_media_time(ptp_time, self.sample_rate);
+
+        Ok(Time {
+            media_time,
+            ptp_time,
+            system_time,
+        })
+    }
+}
@@ -120,6 +120,20 @@ where
     }
 }
 
+/// Replaces everything but ASCII alphanumerics, '-' and '_' so a label can be used in a file name.
+pub fn file_name_safe(label: &str) -> String {
+    label
+        .chars()
+        .map(|c| {
+            if c.is_ascii_alphanumeric() || c == '-' || c == '_' {
+                c
+            } else {
+                '_'
+            }
+        })
+        .collect()
+}
+
 pub fn set_realtime_priority() {
     let pid = thread_native_id();
     if let Err(e) = set_thread_priority_and_policy(
@@ -135,6 +149,21 @@ pub fn set_realtime_priority() {
     }
 }
 
+/// Restricts the calling thread to a single CPU core.
+pub fn pin_to_core(core: usize) {
+    let mut set: libc::cpu_set_t = unsafe { std::mem::zeroed() };
+    unsafe { libc::CPU_SET(core, &mut set) };
+    let res = unsafe { libc::sched_setaffinity(0, std::mem::size_of::<libc::cpu_set_t>(), &set) };
+    if res != 0 {
+        warn!(
+            "Could not pin thread to core {core}: {}",
+            std::io::Error::last_os_error()
+        );
+    } else {
+        info!("Pinned thread to core {core}.");
+    }
+}
+
 pub async fn publish_individual(wb: &Worterbuch, key: String, object: impl Serialize) {
     let Ok(json) = serde_json::to_value(object) else {
         return;
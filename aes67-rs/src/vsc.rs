@@ -280,6 +280,14 @@ impl VirtualSoundCard {
         let qualified_id = format!("{}/tx/{}", self.name, id);
         info!("Creating sender '{label}' ({qualified_id}) …");
 
+        let relay_source = match &config.relay {
+            Some(relay) => match self.rxs.get(&relay.receiver) {
+                Some(rx) => Some(rx.buffer()),
+                None => return Err(SenderInternalError::NoSuchRelaySource(relay.receiver)),
+            },
+            None => None,
+        };
+
         let monitoring = self.monitoring.child(qualified_id.clone());
         let sender_api = start_sender(
             self.name.clone(),
@@ -287,6 +295,7 @@ impl VirtualSoundCard {
             label,
             self.audio_nic.clone(),
             config,
+            relay_source,
             monitoring.clone(),
             &self.subsys,
             self.clock.clone(),
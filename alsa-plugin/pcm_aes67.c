@@ -0,0 +1,547 @@
+/*
+ * ALSA ioplug PCM plugin that exposes AES67 receivers as capture devices and AES67 senders as
+ * playback devices.
+ *
+ * Audio is moved directly between the receiver/sender buffers of the virtual sound card and the
+ * PCM's mmap areas, so applications using mmap access get exactly one copy between the network
+ * buffer and their own memory. Only non-interleaved float access is offered, the plug layer can
+ * convert for applications that need anything else.
+ *
+ * Example configuration (see aes67.conf):
+ *
+ *   pcm.aes67 {
+ *       @args [ SDP TARGET ]
+ *       @args.SDP { type string default "" }
+ *       @args.TARGET { type string default "" }
+ *       type aes67
+ *       sdp $SDP
+ *       target $TARGET
+ *   }
+ *
+ * `arecord -D aes67:/path/to/stream.sdp` then captures the stream described by the SDP file and
+ * `aplay -D aes67:TARGET=239.69.1.2:5004` sends a stream to the given multicast address.
+ *
+ * The plugin's hardware pointer follows the PTP media clock, which is read from CLOCK_TAI, so the
+ * system clock must be synchronized to the PTP grandmaster (e.g. with phc2sys).
+ */
+
+#include <alsa/asoundlib.h>
+#include <alsa/pcm_external.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "../aes67-rs-c/include/aes67-vsc-2.h"
+
+#define DEFAULT_LINK_OFFSET 2.0
+#define DEFAULT_BIT_DEPTH 24
+#define DEFAULT_PACKET_TIME 1.0
+#define DEFAULT_PAYLOAD_TYPE 98
+#define DEFAULT_CHANNELS 2
+#define DEFAULT_RATE 48000
+#define MAX_CHANNELS 64
+/* must not exceed the largest block the sender accepts in a single call (100 ms) */
+#define MAX_FRAMES_PER_SEND 1024
+/* PCMs without an `id` are numbered from here, above the IDs one would set in the configuration */
+#define FIRST_DEFAULT_ID (1ULL << 32)
+
+/* IDs only need to be unique within this process' virtual sound card */
+static atomic_uint_least64_t next_default_id = FIRST_DEFAULT_ID;
+
+typedef struct snd_pcm_aes67
+{
+    snd_pcm_ioplug_t io;
+    uint64_t id;
+    unsigned int channels;
+    unsigned int rate;
+    int timer_fd;
+    int started;
+    /* media time of the first frame of the stream */
+    uint64_t start_time;
+    /* frames moved between the plugin and the AES67 buffers since the last prepare */
+    uint64_t transferred;
+    float *channel_buffers[MAX_CHANNELS];
+} snd_pcm_aes67_t;
+
+static uint64_t current_time_media(unsigned int srate)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_TAI, &now);
+    return (uint64_t)now.tv_sec * (uint64_t)srate + ((uint64_t)now.tv_nsec * srate) / 1000000000;
+}
+
+static char *read_file(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *content = len >= 0 ? malloc(len + 1) : NULL;
+    if (content)
+    {
+        size_t read = fread(content, 1, len, f);
+        content[read] = 0;
+    }
+    fclose(f);
+    return content;
+}
+
+/* Only the audio format is needed to constrain the hw params, everything else is parsed by the receiver. */
+static int parse_rtpmap(const char *sdp, unsigned int *rate, unsigned int *channels)
+{
+    const char *rtpmap = strstr(sdp, "a=rtpmap:");
+    if (!rtpmap)
+    {
+        return -EINVAL;
+    }
+    unsigned int payload_type, bits;
+    int fields = sscanf(rtpmap, "a=rtpmap:%u L%u/%u/%u", &payload_type, &bits, rate, channels);
+    if (fields < 3)
+    {
+        return -EINVAL;
+    }
+    if (fields == 3)
+    {
+        *channels = 1;
+    }
+    return 0;
+}
+
+static void set_channel_pointers(snd_pcm_aes67_t *pcm, const snd_pcm_channel_area_t *areas,
+                                 snd_pcm_uframes_t offset)
+{
+    for (unsigned int c = 0; c < pcm->channels; c++)
+    {
+        pcm->channel_buffers[c] = (float *)((char *)areas[c].addr + (areas[c].first + offset * areas[c].step) / 8);
+    }
+}
+
+static snd_pcm_sframes_t aes67_capture_transfer(snd_pcm_ioplug_t *io, const snd_pcm_channel_area_t *areas,
+                                                snd_pcm_uframes_t offset, snd_pcm_uframes_t size)
+{
+    snd_pcm_aes67_t *pcm = io->private_data;
+
+    set_channel_pointers(pcm, areas, offset);
+    slice_ref_float_ptr_t buffers = {.ptr = pcm->channel_buffers, .len = pcm->channels};
+
+    size_t valid_frames = 0;
+    uint8_t res = aes67_vsc_receive(pcm->id, pcm->start_time + pcm->transferred, buffers, size, &valid_frames);
+    if (res != AES_VSC_OK)
+    {
+        valid_frames = 0;
+    }
+    if (valid_frames < size)
+    {
+        snd_pcm_areas_silence(areas, offset + valid_frames, pcm->channels, size - valid_frames, io->format);
+    }
+
+    pcm->transferred += size;
+    return size;
+}
+
+static snd_pcm_sframes_t aes67_playback_transfer(snd_pcm_ioplug_t *io, const snd_pcm_channel_area_t *areas,
+                                                 snd_pcm_uframes_t offset, snd_pcm_uframes_t size)
+{
+    snd_pcm_aes67_t *pcm = io->private_data;
+
+    if (!pcm->started)
+    {
+        /* data written before the stream is started (pre-fill) is stamped relative to the first write */
+        pcm->start_time = current_time_media(pcm->rate);
+        pcm->started = 1;
+    }
+
+    slice_ref_float_const_ptr_t buffers = {.ptr = (float const *const *)pcm->channel_buffers, .len = pcm->channels};
+
+    for (snd_pcm_uframes_t sent = 0; sent < size;)
+    {
+        snd_pcm_uframes_t frames = size - sent;
+        if (frames > MAX_FRAMES_PER_SEND)
+        {
+            frames = MAX_FRAMES_PER_SEND;
+        }
+
+        set_channel_pointers(pcm, areas, offset + sent);
+
+        /* on overflow the block is dropped, the stream timing is not affected */
+        uint8_t res = aes67_vsc_send(pcm->id, pcm->start_time + pcm->transferred, buffers, frames);
+        if (res != AES_VSC_OK && res != AES_VSC_ERROR_SENDER_BUFFER_OVERFLOW)
+        {
+            SNDERR("aes67: error sending audio: %d", res);
+            return -EIO;
+        }
+
+        pcm->transferred += frames;
+        sent += frames;
+    }
+
+    return size;
+}
+
+static snd_pcm_sframes_t aes67_pointer(snd_pcm_ioplug_t *io)
+{
+    snd_pcm_aes67_t *pcm = io->private_data;
+
+    if (!pcm->started)
+    {
+        return 0;
+    }
+
+    uint64_t now = current_time_media(pcm->rate);
+    uint64_t elapsed = now > pcm->start_time ? now - pcm->start_time : 0;
+
+    if (io->stream == SND_PCM_STREAM_PLAYBACK)
+    {
+        if (io->state == SND_PCM_STATE_RUNNING && elapsed > pcm->transferred)
+        {
+            /* the media clock has overtaken the application */
+            return -EPIPE;
+        }
+    }
+    else if (elapsed > pcm->transferred + io->buffer_size)
+    {
+        /* the application did not fetch captured data in time */
+        return -EPIPE;
+    }
+
+    return elapsed % io->buffer_size;
+}
+
+static int arm_timer(snd_pcm_aes67_t *pcm, snd_pcm_uframes_t period_size)
+{
+    uint64_t period_nanos = (uint64_t)period_size * 1000000000 / pcm->rate;
+    struct itimerspec spec = {
+        .it_interval = {.tv_sec = period_nanos / 1000000000, .tv_nsec = period_nanos % 1000000000},
+        .it_value = {.tv_sec = 0, .tv_nsec = 1},
+    };
+    if (!period_size)
+    {
+        spec.it_value.tv_nsec = 0;
+    }
+    if (timerfd_settime(pcm->timer_fd, 0, &spec, NULL) < 0)
+    {
+        return -errno;
+    }
+    return 0;
+}
+
+static int aes67_prepare(snd_pcm_ioplug_t *io)
+{
+    snd_pcm_aes67_t *pcm = io->private_data;
+    pcm->started = 0;
+    pcm->transferred = 0;
+    return arm_timer(pcm, io->period_size);
+}
+
+static int aes67_start(snd_pcm_ioplug_t *io)
+{
+    snd_pcm_aes67_t *pcm = io->private_data;
+    if (!pcm->started)
+    {
+        pcm->start_time = current_time_media(pcm->rate);
+        pcm->started = 1;
+    }
+    return 0;
+}
+
+static int aes67_stop(snd_pcm_ioplug_t *io)
+{
+    snd_pcm_aes67_t *pcm = io->private_data;
+    pcm->started = 0;
+    return arm_timer(pcm, 0);
+}
+
+static int aes67_poll_revents(snd_pcm_ioplug_t *io, struct pollfd *pfd, unsigned int nfds,
+                              unsigned short *revents)
+{
+    snd_pcm_aes67_t *pcm = io->private_data;
+    uint64_t expirations;
+
+    *revents = 0;
+    if (nfds != 1 || !(pfd[0].revents & POLLIN))
+    {
+        return 0;
+    }
+    if (read(pcm->timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+    {
+        return -errno;
+    }
+    *revents = io->stream == SND_PCM_STREAM_PLAYBACK ? POLLOUT : POLLIN;
+    return 0;
+}
+
+static int aes67_close(snd_pcm_ioplug_t *io)
+{
+    snd_pcm_aes67_t *pcm = io->private_data;
+
+    if (io->stream == SND_PCM_STREAM_PLAYBACK)
+    {
+        aes67_vsc_destroy_sender(pcm->id);
+    }
+    else
+    {
+        aes67_vsc_destroy_receiver(pcm->id);
+    }
+    close(pcm->timer_fd);
+    free(pcm);
+    return 0;
+}
+
+static const snd_pcm_ioplug_callback_t aes67_capture_callback = {
+    .start = aes67_start,
+    .stop = aes67_stop,
+    .pointer = aes67_pointer,
+    .transfer = aes67_capture_transfer,
+    .prepare = aes67_prepare,
+    .poll_revents = aes67_poll_revents,
+    .close = aes67_close,
+};
+
+static const snd_pcm_ioplug_callback_t aes67_playback_callback = {
+    .start = aes67_start,
+    .stop = aes67_stop,
+    .pointer = aes67_pointer,
+    .transfer = aes67_playback_transfer,
+    .prepare = aes67_prepare,
+    .poll_revents = aes67_poll_revents,
+    .close = aes67_close,
+};
+
+static int set_hw_constraints(snd_pcm_aes67_t *pcm)
+{
+    static const unsigned int access_list[] = {
+        SND_PCM_ACCESS_MMAP_NONINTERLEAVED,
+        SND_PCM_ACCESS_RW_NONINTERLEAVED,
+    };
+    static const unsigned int format_list[] = {SND_PCM_FORMAT_FLOAT};
+    unsigned int period_min = 16 * sizeof(float);
+    int err;
+
+    if ((err = snd_pcm_ioplug_set_param_list(&pcm->io, SND_PCM_IOPLUG_HW_ACCESS, 2, access_list)) < 0 ||
+        (err = snd_pcm_ioplug_set_param_list(&pcm->io, SND_PCM_IOPLUG_HW_FORMAT, 1, format_list)) < 0 ||
+        (err = snd_pcm_ioplug_set_param_minmax(&pcm->io, SND_PCM_IOPLUG_HW_CHANNELS, pcm->channels,
+                                               pcm->channels)) < 0 ||
+        (err = snd_pcm_ioplug_set_param_minmax(&pcm->io, SND_PCM_IOPLUG_HW_RATE, pcm->rate, pcm->rate)) < 0 ||
+        (err = snd_pcm_ioplug_set_param_minmax(&pcm->io, SND_PCM_IOPLUG_HW_PERIOD_BYTES, period_min,
+                                               period_min * 1024)) < 0 ||
+        (err = snd_pcm_ioplug_set_param_minmax(&pcm->io, SND_PCM_IOPLUG_HW_PERIODS, 2, 64)) < 0)
+    {
+        return err;
+    }
+    return 0;
+}
+
+static int open_receiver(snd_pcm_aes67_t *pcm, const char *name, const char *sdp_path, double link_offset)
+{
+    char *sdp = read_file(sdp_path);
+    if (!sdp)
+    {
+        SNDERR("aes67: could not read SDP file %s", sdp_path);
+        return -ENOENT;
+    }
+
+    int err = parse_rtpmap(sdp, &pcm->rate, &pcm->channels);
+    if (err < 0 || pcm->channels < 1 || pcm->channels > MAX_CHANNELS)
+    {
+        SNDERR("aes67: no supported rtpmap in SDP file %s", sdp_path);
+        free(sdp);
+        return -EINVAL;
+    }
+
+    Aes67VscReceiverConfig_t config = {
+        .id = pcm->id,
+        .name = name,
+        .sdp = sdp,
+        .link_offset = link_offset,
+    };
+    int32_t receiver = aes67_vsc_create_receiver(&config);
+    free(sdp);
+    if (receiver < 0)
+    {
+        SNDERR("aes67: error creating receiver: %d", -receiver);
+        return -EIO;
+    }
+    pcm->id = receiver;
+    return 0;
+}
+
+static int open_sender(snd_pcm_aes67_t *pcm, const char *name, const char *target, long bit_depth,
+                       double packet_time, long payload_type)
+{
+    Aes67VscSenderConfig_t config = {
+        .id = pcm->id,
+        .name = name,
+        .target = target,
+        .channels = pcm->channels,
+        .bit_depth = bit_depth,
+        .sample_rate = pcm->rate,
+        .packet_time = packet_time,
+        .payload_type = payload_type,
+    };
+    int32_t sender = aes67_vsc_create_sender(&config);
+    if (sender < 0)
+    {
+        SNDERR("aes67: error creating sender: %d", -sender);
+        return -EIO;
+    }
+    pcm->id = sender;
+    return 0;
+}
+
+SND_PCM_PLUGIN_DEFINE_FUNC(aes67)
+{
+    snd_config_iterator_t i, next;
+    const char *sdp = NULL, *target = NULL, *stream_name = NULL;
+    long id = -1, channels = DEFAULT_CHANNELS, rate = DEFAULT_RATE, bit_depth = DEFAULT_BIT_DEPTH,
+         payload_type = DEFAULT_PAYLOAD_TYPE;
+    double link_offset = DEFAULT_LINK_OFFSET, packet_time = DEFAULT_PACKET_TIME;
+    int err;
+
+    snd_config_for_each(i, next, conf)
+    {
+        snd_config_t *n = snd_config_iterator_entry(i);
+        const char *key;
+        if (snd_config_get_id(n, &key) < 0)
+        {
+            continue;
+        }
+        if (strcmp(key, "comment") == 0 || strcmp(key, "type") == 0 || strcmp(key, "hint") == 0)
+        {
+            continue;
+        }
+        if (strcmp(key, "sdp") == 0)
+        {
+            err = snd_config_get_string(n, &sdp);
+        }
+        else if (strcmp(key, "target") == 0)
+        {
+            err = snd_config_get_string(n, &target);
+        }
+        else if (strcmp(key, "name") == 0)
+        {
+            err = snd_config_get_string(n, &stream_name);
+        }
+        else if (strcmp(key, "id") == 0)
+        {
+            err = snd_config_get_integer(n, &id);
+        }
+        else if (strcmp(key, "channels") == 0)
+        {
+            err = snd_config_get_integer(n, &channels);
+        }
+        else if (strcmp(key, "rate") == 0)
+        {
+            err = snd_config_get_integer(n, &rate);
+        }
+        else if (strcmp(key, "bit_depth") == 0)
+        {
+            err = snd_config_get_integer(n, &bit_depth);
+        }
+        else if (strcmp(key, "payload_type") == 0)
+        {
+            err = snd_config_get_integer(n, &payload_type);
+        }
+        else if (strcmp(key, "link_offset") == 0)
+        {
+            err = snd_config_get_ireal(n, &link_offset);
+        }
+        else if (strcmp(key, "packet_time") == 0)
+        {
+            err = snd_config_get_ireal(n, &packet_time);
+        }
+        else
+        {
+            SNDERR("aes67: unknown field %s", key);
+            return -EINVAL;
+        }
+        if (err < 0)
+        {
+            SNDERR("aes67: invalid value for %s", key);
+            return err;
+        }
+    }
+
+    if (stream == SND_PCM_STREAM_CAPTURE && (!sdp || !*sdp))
+    {
+        SNDERR("aes67: capture requires an sdp file");
+        return -EINVAL;
+    }
+    if (stream == SND_PCM_STREAM_PLAYBACK && (!target || !*target))
+    {
+        SNDERR("aes67: playback requires a target address");
+        return -EINVAL;
+    }
+    if (channels < 1 || channels > MAX_CHANNELS)
+    {
+        SNDERR("aes67: unsupported channel count %ld", channels);
+        return -EINVAL;
+    }
+
+    snd_pcm_aes67_t *pcm = calloc(1, sizeof(*pcm));
+    if (!pcm)
+    {
+        return -ENOMEM;
+    }
+
+    pcm->id = id >= 0 ? (uint64_t)id : atomic_fetch_add(&next_default_id, 1);
+    pcm->channels = channels;
+    pcm->rate = rate;
+    if (!stream_name)
+    {
+        stream_name = name;
+    }
+
+    pcm->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (pcm->timer_fd < 0)
+    {
+        err = -errno;
+        free(pcm);
+        return err;
+    }
+
+    err = stream == SND_PCM_STREAM_CAPTURE
+              ? open_receiver(pcm, stream_name, sdp, link_offset)
+              : open_sender(pcm, stream_name, target, bit_depth, packet_time, payload_type);
+    if (err < 0)
+    {
+        close(pcm->timer_fd);
+        free(pcm);
+        return err;
+    }
+
+    pcm->io.version = SND_PCM_IOPLUG_VERSION;
+    pcm->io.name = "AES67 Virtual Sound Card";
+    pcm->io.poll_fd = pcm->timer_fd;
+    pcm->io.poll_events = POLLIN;
+    pcm->io.mmap_rw = 0;
+    pcm->io.callback = stream == SND_PCM_STREAM_CAPTURE ? &aes67_capture_callback : &aes67_playback_callback;
+    pcm->io.private_data = pcm;
+
+    err = snd_pcm_ioplug_create(&pcm->io, name, stream, mode);
+    if (err < 0)
+    {
+        aes67_close(&pcm->io);
+        return err;
+    }
+
+    err = set_hw_constraints(pcm);
+    if (err < 0)
+    {
+        snd_pcm_ioplug_delete(&pcm->io);
+        return err;
+    }
+
+    *pcmp = pcm->io.pcm;
+    return 0;
+}
+
+SND_PCM_PLUGIN_SYMBOL(aes67);
@@ -6,17 +6,18 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
-#include "../../aes67-rs/include/aes67-vsc-2.h"
+#include "../../aes67-rs-c/include/aes67-vsc-2.h"
 
 static const char MEDIA_REGEX[] = "m=audio ([0-9]+) RTP\\/AVP ([0-9]+)";
 static const char RTPMAP_REGEX_PREFIX[] = "a=rtpmap:";
 static const char RTPMAP_REGEX_SUFFIX[] = " (L[0-9]+)\\/([0-9]+)\\/([0-9]+)";
 
 // TODO read config from file
-static const char RECEIVER_ID[] = "alsa-1";
-static const char INTERFACE_IP[] = "10.1.255.247";
+static const uint32_t RECEIVER_ID = 1;
+static const char RECEIVER_NAME[] = "alsa-1";
 static const float LINK_OFFSET = 2.0;
 static const unsigned int ALSA_FRAMES_PER_CYCLE = 24;
 
@@ -136,10 +137,10 @@ int parse_sdp(char *sdp, media_t *media)
 }
 
 Aes67VscReceiverConfig_t receiver_config = {
-    name : RECEIVER_ID,
+    id : RECEIVER_ID,
+    name : RECEIVER_NAME,
     sdp : SDP,
-    link_offset : LINK_OFFSET,
-    interface_ip : INTERFACE_IP
+    link_offset : LINK_OFFSET
 };
 
 static volatile int keep_running = 1;
@@ -202,14 +203,18 @@ int main(int argc, char *argv[])
         fprintf(stderr, "Error creating receiver: %d\n", err);
         return err;
     }
-    uint32_t receiver = (uint32_t)maybe_receiver;
+    uint64_t receiver = (uint64_t)maybe_receiver;
 
-    // create and zero playout buffer
-    uint64_t buffer_len = ALSA_FRAMES_PER_CYCLE * channels;
-    float buffer[ALSA_FRAMES_PER_CYCLE * channels];
-    slice_mut_float_t buffer_ptr;
-    buffer_ptr.ptr = buffer;
-    buffer_ptr.len = buffer_len;
+    // create and zero playout buffers, one per channel so the receiver can write into them directly
+    float buffer[channels][ALSA_FRAMES_PER_CYCLE];
+    float *channel_buffers[channels];
+    for (unsigned int c = 0; c < channels; c++)
+    {
+        channel_buffers[c] = buffer[c];
+    }
+    slice_ref_float_ptr_t buffers;
+    buffers.ptr = channel_buffers;
+    buffers.len = channels;
 
     uint64_t link_offset_frames = LINK_OFFSET * srate / 1000;
 
@@ -217,7 +222,7 @@ int main(int argc, char *argv[])
     struct timespec now;
 
     // warmup, wait for receiver to actually receive data
-    while (keep_running && aes67_vsc_receive(receiver, current_time_media(&now, srate) - link_offset_frames, buffer_ptr) == AES_VSC_ERROR_RECEIVER_NOT_READY_YET)
+    while (keep_running && aes67_vsc_receive(receiver, current_time_media(&now, srate), buffers, ALSA_FRAMES_PER_CYCLE, NULL) != AES_VSC_OK)
     {
         usleep(100000);
     }
@@ -235,7 +240,7 @@ int main(int argc, char *argv[])
     snd_pcm_hw_params_any(pcm_handle, params);
 
     // Set parameters
-    snd_pcm_hw_params_set_access(pcm_handle, params, SND_PCM_ACCESS_RW_INTERLEAVED);
+    snd_pcm_hw_params_set_access(pcm_handle, params, SND_PCM_ACCESS_RW_NONINTERLEAVED);
     snd_pcm_hw_params_set_format(pcm_handle, params, SND_PCM_FORMAT_FLOAT_LE);
     snd_pcm_hw_params_set_channels(pcm_handle, params, media.audio_format.channels);
     unsigned int rate = srate;
@@ -256,15 +261,12 @@ int main(int argc, char *argv[])
 
     // start playout
 
-    for (int i = 0; i < buffer_len; i++)
-    {
-        buffer[i] = 0.0;
-    }
+    memset(buffer, 0, sizeof(buffer));
 
     // pre-roll for the duration of the link offset, from then on we will just play the latest packets as fast as possible
     for (int i = 0; i < link_offset_frames;)
     {
-        int written = snd_pcm_writei(pcm_handle, buffer, ALSA_FRAMES_PER_CYCLE);
+        int written = snd_pcm_writen(pcm_handle, (void **)channel_buffers, ALSA_FRAMES_PER_CYCLE);
         if (written > 0)
         {
             i += written;
@@ -279,7 +281,7 @@ int main(int argc, char *argv[])
     while (keep_running)
     {
 
-        uint8_t res = aes67_vsc_receive(receiver, playout_time, buffer_ptr);
+        uint8_t res = aes67_vsc_receive(receiver, playout_time, buffers, ALSA_FRAMES_PER_CYCLE, NULL);
 
         if (res == AES_VSC_ERROR_CLOCK_SYNC_ERROR)
         {
@@ -299,10 +301,7 @@ int main(int argc, char *argv[])
         if (muted)
         {
             muted--;
-            for (int i = 0; i < buffer_len; i++)
-            {
-                buffer[i] = 0.0;
-            }
+            memset(buffer, 0, sizeof(buffer));
             if (!muted)
             {
                 fprintf(stderr, "mute OFF\n");
@@ -310,7 +309,7 @@ int main(int argc, char *argv[])
         }
 
         // write audio data to alsa buffer
-        rc = snd_pcm_writei(pcm_handle, buffer, ALSA_FRAMES_PER_CYCLE);
+        rc = snd_pcm_writen(pcm_handle, (void **)channel_buffers, ALSA_FRAMES_PER_CYCLE);
         if (rc == -EPIPE)
         {
             // Underrun
@@ -0,0 +1,155 @@
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../../aes67-rs-c/include/aes67-vsc-2.h"
+
+// Measures the per-call overhead of aes67_vsc_send for different channel counts.
+// The VSC needs to be configured in worterbuch (see AES67_VSC_NAME) for the senders to be created.
+
+static const unsigned int SAMPLE_RATE = 48000;
+#define FRAMES_PER_CYCLE 64
+static const unsigned int CYCLES = 2000;
+#define MAX_CHANNELS 64
+static const unsigned int CHANNEL_COUNTS[] = {1, 2, 8, 16, 32, 64};
+static const char TARGET[] = "239.69.255.1:5004";
+
+static volatile int keep_running = 1;
+
+void int_handler(int dummy)
+{
+    (void)dummy;
+    keep_running = 0;
+}
+
+uint64_t now_nanos(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+uint64_t current_time_media(unsigned int srate)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_TAI, &now);
+    return (uint64_t)now.tv_sec * (uint64_t)srate + ((uint64_t)now.tv_nsec * srate) / 1000000000;
+}
+
+int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+int run_benchmark(unsigned int channels, float buffer[][FRAMES_PER_CYCLE], uint64_t *durations)
+{
+    Aes67VscSenderConfig_t config = {
+        id : channels,
+        name : "sender-benchmark",
+        target : TARGET,
+        channels : channels,
+        bit_depth : 24,
+        sample_rate : SAMPLE_RATE,
+        packet_time : 1.0,
+        payload_type : 98
+    };
+
+    int32_t maybe_sender = aes67_vsc_create_sender(&config);
+    if (maybe_sender < 0)
+    {
+        fprintf(stderr, "Error creating sender: %d\n", -maybe_sender);
+        return -maybe_sender;
+    }
+    uint64_t sender = (uint64_t)maybe_sender;
+
+    const float *channel_buffers[MAX_CHANNELS];
+    for (unsigned int c = 0; c < channels; c++)
+    {
+        channel_buffers[c] = buffer[c];
+    }
+    slice_ref_float_const_ptr_t buffers;
+    buffers.ptr = channel_buffers;
+    buffers.len = channels;
+
+    struct timespec cycle = {0, (long)FRAMES_PER_CYCLE * 1000000000 / SAMPLE_RATE};
+    uint64_t ingress_time = current_time_media(SAMPLE_RATE);
+    unsigned int overflows = 0;
+
+    for (unsigned int i = 0; i < CYCLES && keep_running; i++)
+    {
+        uint64_t start = now_nanos(CLOCK_MONOTONIC);
+        uint8_t res = aes67_vsc_send(sender, ingress_time, buffers, FRAMES_PER_CYCLE);
+        durations[i] = now_nanos(CLOCK_MONOTONIC) - start;
+
+        if (res == AES_VSC_ERROR_SENDER_BUFFER_OVERFLOW)
+        {
+            overflows++;
+        }
+        else if (res != AES_VSC_OK)
+        {
+            fprintf(stderr, "Error sending data: %d\n", res);
+            aes67_vsc_destroy_sender(sender);
+            return res;
+        }
+
+        ingress_time += FRAMES_PER_CYCLE;
+        // pace the calls like an audio callback would, otherwise the sender thread cannot keep up
+        nanosleep(&cycle, NULL);
+    }
+
+    aes67_vsc_destroy_sender(sender);
+
+    qsort(durations, CYCLES, sizeof(uint64_t), compare_u64);
+    uint64_t sum = 0;
+    for (unsigned int i = 0; i < CYCLES; i++)
+    {
+        sum += durations[i];
+    }
+
+    printf("channels: %3u, mean: %7.1f ns, median: %6lu ns, p99: %6lu ns, max: %7lu ns, %.1f ns/channel, overflows: %u\n",
+           channels,
+           (double)sum / CYCLES,
+           durations[CYCLES / 2],
+           durations[CYCLES * 99 / 100],
+           durations[CYCLES - 1],
+           (double)durations[CYCLES / 2] / channels,
+           overflows);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    signal(SIGINT, int_handler);
+    signal(SIGTERM, int_handler);
+
+    static float buffer[MAX_CHANNELS][FRAMES_PER_CYCLE];
+    for (unsigned int c = 0; c < MAX_CHANNELS; c++)
+    {
+        for (unsigned int i = 0; i < FRAMES_PER_CYCLE; i++)
+        {
+            buffer[c][i] = 0.5 * sinf(2.0 * M_PI * 1000.0 * i / SAMPLE_RATE);
+        }
+    }
+
+    uint64_t *durations = malloc(CYCLES * sizeof(uint64_t));
+
+    for (unsigned int i = 0; i < sizeof(CHANNEL_COUNTS) / sizeof(CHANNEL_COUNTS[0]) && keep_running; i++)
+    {
+        int err = run_benchmark(CHANNEL_COUNTS[i], buffer, durations);
+        if (err)
+        {
+            free(durations);
+            return err;
+        }
+    }
+
+    free(durations);
+
+    return 0;
+}